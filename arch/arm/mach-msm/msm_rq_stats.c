@@ -11,13 +11,15 @@
  *
  */
 /*
- * Qualcomm MSM Runqueue Stats Interface for Userspace
+ * Qualcomm MSM Runqueue Stats Interface for Userspace, and an in-kernel
+ * CPU hotplug policy driven by the same run queue averages
  */
 #include <linux/kernel.h>
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/hrtimer.h>
 #include <linux/cpu.h>
+#include <linux/cpufreq.h>
 #include <linux/kobject.h>
 #include <linux/sysfs.h>
 #include <linux/notifier.h>
@@ -31,6 +33,97 @@
 #define DEFAULT_RQ_POLL_JIFFIES 1
 #define DEFAULT_DEF_TIMER_JIFFIES 5
 
+/*
+ * Hotplug policy, evaluated each def_timer interval, which only runs off
+ * the tick of a CPU that is awake anyway. A CPU is brought up once the
+ * run queue average per online CPU (in tenths of a task, over the time
+ * since the previous evaluation) has stayed at or above hotplug_up_rq,
+ * with CPU0 at hotplug_up_freq kHz or more if that is set, for
+ * hotplug_up_ms; one is taken down once it has stayed below
+ * hotplug_down_rq for hotplug_down_ms. The policy keeps its own window on
+ * the run queue, so it works whether or not userspace reads run_queue_avg.
+ * Each decision is reported through hotplug_event, which can be poll()ed;
+ * with hotplug_enabled clear the decisions are only reported, and left to
+ * userspace to act on.
+ */
+static unsigned int hotplug_enabled;
+static unsigned int hotplug_up_rq = 20;
+static unsigned int hotplug_down_rq = 10;
+static unsigned int hotplug_up_freq;
+static unsigned int hotplug_up_ms = 100;
+static unsigned int hotplug_down_ms = 1000;
+
+static int hotplug_want;
+static int64_t hotplug_want_since;
+static unsigned int hotplug_target;
+static unsigned int hotplug_event_count;
+static struct rq_window hotplug_rq_window;
+
+static void hotplug_work_fn(struct work_struct *work)
+{
+	unsigned int cpu, last = 0;
+
+	if (num_online_cpus() < hotplug_target) {
+		for_each_present_cpu(cpu) {
+			if (!cpu_online(cpu)) {
+				cpu_up(cpu);
+				break;
+			}
+		}
+	} else if (num_online_cpus() > hotplug_target) {
+		for_each_online_cpu(cpu)
+			last = cpu;
+#ifdef CONFIG_HOTPLUG_CPU
+		if (last)
+			cpu_down(last);
+#endif
+	}
+	sysfs_notify(rq_info.kobj, NULL, "hotplug_event");
+}
+static DECLARE_WORK(hotplug_work, hotplug_work_fn);
+
+static void hotplug_evaluate(void)
+{
+	unsigned int online = num_online_cpus();
+	unsigned int depth, delay_ms;
+	unsigned long flags = 0;
+	int64_t now = ktime_to_ns(ktime_get());
+	int avg, want = 0;
+
+	spin_lock_irqsave(&rq_lock, flags);
+	avg = rq_window_avg(&hotplug_rq_window);
+	spin_unlock_irqrestore(&rq_lock, flags);
+	if (avg < 0)
+		avg = nr_running() * 10;
+	depth = avg / online;
+
+	if (online < num_present_cpus() && depth >= hotplug_up_rq &&
+	    (!hotplug_up_freq || cpufreq_quick_get(0) >= hotplug_up_freq))
+		want = 1;
+	else if (online > 1 && depth < hotplug_down_rq)
+		want = -1;
+
+	if (want != hotplug_want) {
+		hotplug_want = want;
+		hotplug_want_since = now;
+		return;
+	}
+	if (!want)
+		return;
+	delay_ms = want > 0 ? hotplug_up_ms : hotplug_down_ms;
+	if (now - hotplug_want_since < (int64_t)delay_ms * NSEC_PER_MSEC)
+		return;
+
+	/* time the next step from here */
+	hotplug_want_since = now;
+	hotplug_target = online + want;
+	hotplug_event_count++;
+	if (hotplug_enabled)
+		schedule_work(&hotplug_work);
+	else
+		sysfs_notify(rq_info.kobj, NULL, "hotplug_event");
+}
+
 static void def_work_fn(struct work_struct *work)
 {
 	int64_t diff;
@@ -41,6 +134,8 @@ static void def_work_fn(struct work_struct *work)
 
 	/* Notify polling threads on change of value */
 	sysfs_notify(rq_info.kobj, NULL, "def_timer_ms");
+
+	hotplug_evaluate();
 }
 
 static ssize_t show_run_queue_avg(struct kobject *kobj,
@@ -110,6 +205,38 @@ static ssize_t store_def_timer_ms(struct kobject *kobj,
 	return count;
 }
 
+static ssize_t show_hotplug_event(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u %u %u\n", hotplug_event_count,
+			hotplug_target, num_online_cpus());
+}
+
+#define HOTPLUG_TUNABLE(name)						\
+static ssize_t show_##name(struct kobject *kobj,			\
+		struct kobj_attribute *attr, char *buf)			\
+{									\
+	return snprintf(buf, MAX_LONG_SIZE, "%u\n", name);		\
+}									\
+									\
+static ssize_t store_##name(struct kobject *kobj,			\
+		struct kobj_attribute *attr, const char *buf, size_t count) \
+{									\
+	unsigned int val = 0;						\
+									\
+	if (sscanf(buf, "%u", &val) != 1)				\
+		return -EINVAL;						\
+	name = val;							\
+	return count;							\
+}
+
+HOTPLUG_TUNABLE(hotplug_enabled)
+HOTPLUG_TUNABLE(hotplug_up_rq)
+HOTPLUG_TUNABLE(hotplug_down_rq)
+HOTPLUG_TUNABLE(hotplug_up_freq)
+HOTPLUG_TUNABLE(hotplug_up_ms)
+HOTPLUG_TUNABLE(hotplug_down_ms)
+
 #define MSM_RQ_STATS_RO_ATTRIB(att) ({ \
 		struct attribute *attrib = NULL; \
 		struct kobj_attribute *ptr = NULL; \
@@ -140,7 +267,7 @@ static int init_rq_attribs(void)
 {
 	int i;
 	int err = 0;
-	const int attr_count = 4;
+	const int attr_count = 11;
 
 	struct attribute **attribs =
 		kzalloc(sizeof(struct attribute *) * attr_count, GFP_KERNEL);
@@ -153,7 +280,14 @@ static int init_rq_attribs(void)
 	attribs[0] = MSM_RQ_STATS_RW_ATTRIB(def_timer_ms);
 	attribs[1] = MSM_RQ_STATS_RO_ATTRIB(run_queue_avg);
 	attribs[2] = MSM_RQ_STATS_RW_ATTRIB(run_queue_poll_ms);
-	attribs[3] = NULL;
+	attribs[3] = MSM_RQ_STATS_RO_ATTRIB(hotplug_event);
+	attribs[4] = MSM_RQ_STATS_RW_ATTRIB(hotplug_enabled);
+	attribs[5] = MSM_RQ_STATS_RW_ATTRIB(hotplug_up_rq);
+	attribs[6] = MSM_RQ_STATS_RW_ATTRIB(hotplug_down_rq);
+	attribs[7] = MSM_RQ_STATS_RW_ATTRIB(hotplug_up_freq);
+	attribs[8] = MSM_RQ_STATS_RW_ATTRIB(hotplug_up_ms);
+	attribs[9] = MSM_RQ_STATS_RW_ATTRIB(hotplug_down_ms);
+	attribs[10] = NULL;
 
 	for (i = 0; i < attr_count - 1 ; i++) {
 		if (!attribs[i])
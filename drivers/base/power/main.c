@@ -58,6 +58,8 @@ struct dpm_drv_wd_data {
 
 static int async_error;
 
+static char *pm_verb(int event);
+
 /**
  * device_pm_init - Initialize the PM-related part of a device object.
  * @dev: Device object being initialized.
@@ -163,15 +165,11 @@ void device_pm_move_last(struct device *dev)
 
 static ktime_t initcall_debug_start(struct device *dev)
 {
-	ktime_t calltime = ktime_set(0, 0);
-
-	if (initcall_debug) {
+	if (initcall_debug)
 		pr_info("calling  %s+ @ %i\n",
 				dev_name(dev), task_pid_nr(current));
-		calltime = ktime_get();
-	}
 
-	return calltime;
+	return ktime_get();
 }
 
 static void initcall_debug_report(struct device *dev, ktime_t calltime,
@@ -275,6 +273,8 @@ static int pm_op(struct device *dev,
 	}
 
 	initcall_debug_report(dev, calltime, error);
+	suspend_time_record(pm_verb(state.event), calltime, "%s",
+			    dev_name(dev));
 
 	return error;
 }
@@ -293,14 +293,13 @@ static int pm_noirq_op(struct device *dev,
 			pm_message_t state)
 {
 	int error = 0;
-	ktime_t calltime = ktime_set(0, 0), delta, rettime;
+	ktime_t calltime, delta, rettime;
 
-	if (initcall_debug) {
+	if (initcall_debug)
 		pr_info("calling  %s+ @ %i, parent: %s\n",
 				dev_name(dev), task_pid_nr(current),
 				dev->parent ? dev_name(dev->parent) : "none");
-		calltime = ktime_get();
-	}
+	calltime = ktime_get();
 
 	switch (state.event) {
 #ifdef CONFIG_SUSPEND
@@ -356,6 +355,8 @@ static int pm_noirq_op(struct device *dev,
 			dev_name(dev), error,
 			(unsigned long long)ktime_to_ns(delta) >> 10);
 	}
+	suspend_time_record(pm_verb(state.event), calltime, "%s (noirq)",
+			    dev_name(dev));
 
 	return error;
 }
@@ -499,6 +500,7 @@ static int legacy_resume(struct device *dev, int (*cb)(struct device *dev))
 	suspend_report_result(cb, error);
 
 	initcall_debug_report(dev, calltime, error);
+	suspend_time_record("resume", calltime, "%s (legacy)", dev_name(dev));
 
 	return error;
 }
@@ -859,6 +861,8 @@ static int legacy_suspend(struct device *dev, pm_message_t state,
 	suspend_report_result(cb, error);
 
 	initcall_debug_report(dev, calltime, error);
+	suspend_time_record(pm_verb(state.event), calltime, "%s (legacy)",
+			    dev_name(dev));
 
 	return error;
 }
@@ -29,8 +29,13 @@
 #include <linux/mutex.h>
 #include <linux/slab.h>
 #include <linux/input.h>
+#ifdef CONFIG_MSM_SLEEP_STATS
+#include <linux/rq_stats.h>
+#endif
 #include <asm/cputime.h>
 
+#include "cpufreq_interactive_load.h"
+
 #define CREATE_TRACE_POINTS
 #include <trace/events/cpufreq_interactive.h>
 
@@ -51,6 +56,10 @@ struct cpufreq_interactive_cpuinfo {
 	unsigned int floor_freq;
 	u64 floor_validate_time;
 	u64 hispeed_validate_time;
+	struct interactive_predictor pred;
+#ifdef CONFIG_MSM_SLEEP_STATS
+	struct rq_window rq_window;
+#endif
 	int governor_enabled;
 };
 
@@ -93,10 +102,38 @@ static unsigned long timer_rate;
 static unsigned long above_hispeed_delay_val;
 
 /*
- * Boost pulse to hispeed on touchscreen input.
+ * Load to aim for at each speed, as "load freq:load freq:...:load", each
+ * load applying from the freq before it up to the one after it.
+ */
+#define DEFAULT_TARGET_LOAD 90
+static unsigned int target_loads[INTERACTIVE_MAX_TARGET_LOADS] = {
+	DEFAULT_TARGET_LOAD
+};
+static int ntarget_loads = 1;
+static DEFINE_SPINLOCK(target_loads_lock);
+
+/*
+ * Percentage of the newest timer window in the load average the
+ * predictor extrapolates from. Zero disables prediction, and the greater
+ * of the load in the last window and the load since the last speed change
+ * is used, as before.
+ */
+static unsigned long load_ewma_weight;
+
+/*
+ * With prediction, run queue depth (tenths of runnable tasks per online
+ * CPU) at which to treat the load as at least go_hispeed_load. Zero
+ * disables.
+ */
+static unsigned long rq_depth_boost;
+
+/*
+ * Boost pulse on touchscreen input, to input_boost_freq, or to hispeed
+ * if that is not set.
  */
 
 static int input_boost_val;
+static unsigned int input_boost_freq;
 
 struct cpufreq_interactive_inputopen {
 	struct input_handle *handle;
@@ -124,6 +161,56 @@ struct cpufreq_governor cpufreq_gov_interactive = {
 	.owner = THIS_MODULE,
 };
 
+static unsigned int cpufreq_interactive_freq_lookup(void *data,
+						    unsigned int target_freq,
+						    unsigned int relation)
+{
+	struct cpufreq_interactive_cpuinfo *pcpu = data;
+	unsigned int index;
+
+	if (cpufreq_frequency_table_target(pcpu->policy, pcpu->freq_table,
+					   target_freq, relation, &index))
+		return pcpu->policy->cur;
+	return pcpu->freq_table[index].frequency;
+}
+
+static unsigned int cpufreq_interactive_choose_freq(
+	struct cpufreq_interactive_cpuinfo *pcpu, unsigned int cpu_load)
+{
+	unsigned long flags;
+	unsigned int freq;
+
+	spin_lock_irqsave(&target_loads_lock, flags);
+	freq = interactive_choose_freq(pcpu->policy->cur,
+				       cpu_load * pcpu->policy->cur,
+				       target_loads, ntarget_loads,
+				       cpufreq_interactive_freq_lookup, pcpu);
+	spin_unlock_irqrestore(&target_loads_lock, flags);
+	return freq;
+}
+
+/*
+ * Tenths of runnable tasks per online CPU, averaged by msm_rq_stats over
+ * the ticks since this CPU's previous sample when that is running, or
+ * else the current count.
+ */
+static unsigned int cpufreq_interactive_rq_depth(
+	struct cpufreq_interactive_cpuinfo *pcpu)
+{
+	int depth = -1;
+#ifdef CONFIG_MSM_SLEEP_STATS
+	unsigned long flags;
+
+	spin_lock_irqsave(&rq_lock, flags);
+	if (rq_info.init)
+		depth = rq_window_avg(&pcpu->rq_window);
+	spin_unlock_irqrestore(&rq_lock, flags);
+#endif
+	if (depth < 0)
+		depth = nr_running() * 10;
+	return depth / num_online_cpus();
+}
+
 static void cpufreq_interactive_timer(unsigned long data)
 {
 	unsigned int delta_idle;
@@ -191,16 +278,22 @@ static void cpufreq_interactive_timer(unsigned long data)
 	/*
 	 * Choose greater of short-term load (since last idle timer
 	 * started or timer function re-armed itself) or long-term load
-	 * (since last frequency change).
+	 * (since last frequency change), unless predicting the load.
 	 */
-	if (load_since_change > cpu_load)
+	if (load_ewma_weight)
+		cpu_load = interactive_predict_load(
+			&pcpu->pred, cpu_load, load_ewma_weight,
+			cpufreq_interactive_rq_depth(pcpu),
+			rq_depth_boost, go_hispeed_load);
+	else if (load_since_change > cpu_load)
 		cpu_load = load_since_change;
 
 	if (cpu_load >= go_hispeed_load || boost_val) {
 		if (pcpu->target_freq <= pcpu->policy->min) {
 			new_freq = hispeed_freq;
 		} else {
-			new_freq = pcpu->policy->max * cpu_load / 100;
+			new_freq = cpufreq_interactive_choose_freq(pcpu,
+								   cpu_load);
 
 			if (new_freq < hispeed_freq)
 				new_freq = hispeed_freq;
@@ -217,7 +310,7 @@ static void cpufreq_interactive_timer(unsigned long data)
 			}
 		}
 	} else {
-		new_freq = pcpu->policy->max * cpu_load / 100;
+		new_freq = cpufreq_interactive_choose_freq(pcpu, cpu_load);
 	}
 
 	if (new_freq <= hispeed_freq)
@@ -494,7 +587,7 @@ static void cpufreq_interactive_freq_down(struct work_struct *work)
 	}
 }
 
-static void cpufreq_interactive_boost(void)
+static void cpufreq_interactive_boost(unsigned int freq)
 {
 	int i;
 	int anyboost = 0;
@@ -506,8 +599,8 @@ static void cpufreq_interactive_boost(void)
 	for_each_online_cpu(i) {
 		pcpu = &per_cpu(cpuinfo, i);
 
-		if (pcpu->target_freq < hispeed_freq) {
-			pcpu->target_freq = hispeed_freq;
+		if (pcpu->target_freq < freq) {
+			pcpu->target_freq = freq;
 			cpumask_set_cpu(i, &up_cpumask);
 			pcpu->target_set_time_in_idle =
 				get_cpu_idle_time_us(i, &pcpu->target_set_time);
@@ -520,7 +613,7 @@ static void cpufreq_interactive_boost(void)
 		 * validated.
 		 */
 
-		pcpu->floor_freq = hispeed_freq;
+		pcpu->floor_freq = freq;
 		pcpu->floor_validate_time = ktime_to_us(ktime_get());
 	}
 
@@ -531,9 +624,9 @@ static void cpufreq_interactive_boost(void)
 }
 
 /*
- * Pulsed boost on input event raises CPUs to hispeed_freq and lets
- * usual algorithm of min_sample_time  decide when to allow speed
- * to drop.
+ * Pulsed boost on input event raises CPUs to input_boost_freq (by default
+ * hispeed_freq) and lets usual algorithm of min_sample_time  decide when
+ * to allow speed to drop.
  */
 
 static void cpufreq_interactive_input_event(struct input_handle *handle,
@@ -542,7 +635,7 @@ static void cpufreq_interactive_input_event(struct input_handle *handle,
 {
 	if (input_boost_val && type == EV_SYN && code == SYN_REPORT) {
 		trace_cpufreq_interactive_boost("input");
-		cpufreq_interactive_boost();
+		cpufreq_interactive_boost(input_boost_freq ?: hispeed_freq);
 	}
 }
 
@@ -644,6 +737,106 @@ static struct global_attr hispeed_freq_attr = __ATTR(hispeed_freq, 0644,
 		show_hispeed_freq, store_hispeed_freq);
 
 
+static ssize_t show_target_loads(struct kobject *kobj,
+				 struct attribute *attr, char *buf)
+{
+	unsigned long flags;
+	ssize_t ret = 0;
+	int i;
+
+	spin_lock_irqsave(&target_loads_lock, flags);
+	for (i = 0; i < ntarget_loads; i++)
+		ret += sprintf(buf + ret, "%u%s", target_loads[i],
+			       i & 1 ? ":" : " ");
+	spin_unlock_irqrestore(&target_loads_lock, flags);
+	buf[ret - 1] = '\n';
+	return ret;
+}
+
+static ssize_t store_target_loads(struct kobject *kobj,
+				  struct attribute *attr, const char *buf,
+				  size_t count)
+{
+	unsigned int new_loads[INTERACTIVE_MAX_TARGET_LOADS];
+	const char *cp = buf;
+	unsigned long flags;
+	int ntokens = 0;
+	int i;
+
+	/* an odd number of tokens, loads and ascending frequencies */
+	while (ntokens < INTERACTIVE_MAX_TARGET_LOADS) {
+		if (sscanf(cp, "%u", &new_loads[ntokens]) != 1)
+			return -EINVAL;
+		if (!(ntokens & 1) && !new_loads[ntokens])
+			return -EINVAL;
+		if ((ntokens & 1) && ntokens > 1 &&
+		    new_loads[ntokens] <= new_loads[ntokens - 2])
+			return -EINVAL;
+		ntokens++;
+		cp = strpbrk(cp, " :");
+		if (!cp)
+			break;
+		cp++;
+	}
+	if (cp || !(ntokens & 1))
+		return -EINVAL;
+
+	spin_lock_irqsave(&target_loads_lock, flags);
+	for (i = 0; i < ntokens; i++)
+		target_loads[i] = new_loads[i];
+	ntarget_loads = ntokens;
+	spin_unlock_irqrestore(&target_loads_lock, flags);
+	return count;
+}
+
+define_one_global_rw(target_loads);
+
+static ssize_t show_load_ewma_weight(struct kobject *kobj,
+				     struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", load_ewma_weight);
+}
+
+static ssize_t store_load_ewma_weight(struct kobject *kobj,
+				      struct attribute *attr, const char *buf,
+				      size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	if (val > 100)
+		return -EINVAL;
+	load_ewma_weight = val;
+	return count;
+}
+
+define_one_global_rw(load_ewma_weight);
+
+static ssize_t show_rq_depth_boost(struct kobject *kobj,
+				   struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", rq_depth_boost);
+}
+
+static ssize_t store_rq_depth_boost(struct kobject *kobj,
+				    struct attribute *attr, const char *buf,
+				    size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	rq_depth_boost = val;
+	return count;
+}
+
+define_one_global_rw(rq_depth_boost);
+
 static ssize_t show_go_hispeed_load(struct kobject *kobj,
 				     struct attribute *attr, char *buf)
 {
@@ -753,6 +946,28 @@ static ssize_t store_input_boost(struct kobject *kobj, struct attribute *attr,
 
 define_one_global_rw(input_boost);
 
+static ssize_t show_input_boost_freq(struct kobject *kobj,
+				     struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", input_boost_freq);
+}
+
+static ssize_t store_input_boost_freq(struct kobject *kobj,
+				      struct attribute *attr, const char *buf,
+				      size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	input_boost_freq = val;
+	return count;
+}
+
+define_one_global_rw(input_boost_freq);
+
 static ssize_t show_boost(struct kobject *kobj, struct attribute *attr,
 			  char *buf)
 {
@@ -773,7 +988,7 @@ static ssize_t store_boost(struct kobject *kobj, struct attribute *attr,
 
 	if (boost_val) {
 		trace_cpufreq_interactive_boost("on");
-		cpufreq_interactive_boost();
+		cpufreq_interactive_boost(hispeed_freq);
 	} else {
 		trace_cpufreq_interactive_unboost("off");
 	}
@@ -794,7 +1009,7 @@ static ssize_t store_boostpulse(struct kobject *kobj, struct attribute *attr,
 		return ret;
 
 	trace_cpufreq_interactive_boost("pulse");
-	cpufreq_interactive_boost();
+	cpufreq_interactive_boost(hispeed_freq);
 	return count;
 }
 
@@ -803,11 +1018,15 @@ static struct global_attr boostpulse =
 
 static struct attribute *interactive_attributes[] = {
 	&hispeed_freq_attr.attr,
+	&target_loads.attr,
+	&load_ewma_weight.attr,
+	&rq_depth_boost.attr,
 	&go_hispeed_load_attr.attr,
 	&above_hispeed_delay.attr,
 	&min_sample_time_attr.attr,
 	&timer_rate_attr.attr,
 	&input_boost.attr,
+	&input_boost_freq.attr,
 	&boost.attr,
 	&boostpulse.attr,
 	NULL,
@@ -847,6 +1066,7 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 				pcpu->target_set_time;
 			pcpu->hispeed_validate_time =
 				pcpu->target_set_time;
+			pcpu->pred.load_avg = 0;
 			pcpu->governor_enabled = 1;
 			smp_wmb();
 		}
@@ -0,0 +1,142 @@
+/*
+ * drivers/cpufreq/cpufreq_interactive_load.h
+ *
+ * Copyright (C) 2012 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+/*
+ * Load prediction and target load frequency selection for the interactive
+ * governor. Nothing here depends on the kernel, so that
+ * tools/cpufreq/interactive_replay.c can run recorded load traces through
+ * the same code. The includer defines CPUFREQ_RELATION_L and _H.
+ */
+
+#ifndef _CPUFREQ_INTERACTIVE_LOAD_H
+#define _CPUFREQ_INTERACTIVE_LOAD_H
+
+/* Longest target_loads table, as "load freq:load freq:...:load" */
+#define INTERACTIVE_MAX_TARGET_LOADS	31
+
+/*
+ * Returns the frequency of the table the lookup is for that is closest
+ * to target_freq, rounded down for CPUFREQ_RELATION_H and up for _L.
+ */
+typedef unsigned int (*interactive_freq_lookup_t)(void *data,
+						  unsigned int target_freq,
+						  unsigned int relation);
+
+/*
+ * The load to aim for at 'freq'. target_loads holds a load, followed by
+ * pairs of the frequency it stops applying at and the next load.
+ */
+static inline unsigned int interactive_target_load(
+	const unsigned int *target_loads, int ntarget_loads, unsigned int freq)
+{
+	int i;
+
+	for (i = 0; i < ntarget_loads - 1 && freq >= target_loads[i + 1];
+	     i += 2)
+		;
+	return target_loads[i];
+}
+
+/*
+ * interactive_choose_freq - the lowest frequency at which the load seen at
+ * the current frequency, loadadjfreq (load in percent times frequency),
+ * stays at or below the target load of that frequency.
+ *
+ * As the target load itself depends on the frequency, this searches up or
+ * down from cur_freq until the chosen frequency no longer changes, keeping
+ * bounds so it cannot oscillate between two.
+ */
+static inline unsigned int interactive_choose_freq(
+	unsigned int cur_freq, unsigned int loadadjfreq,
+	const unsigned int *target_loads, int ntarget_loads,
+	interactive_freq_lookup_t lookup, void *data)
+{
+	unsigned int freq = cur_freq;
+	unsigned int prevfreq, freqmin = 0, freqmax = ~0U;
+	unsigned int tl;
+
+	do {
+		prevfreq = freq;
+		tl = interactive_target_load(target_loads, ntarget_loads, freq);
+		freq = lookup(data, loadadjfreq / tl, CPUFREQ_RELATION_L);
+
+		if (freq > prevfreq) {
+			/* prevfreq is too low */
+			freqmin = prevfreq;
+			if (freq >= freqmax) {
+				freq = lookup(data, freqmax - 1,
+					      CPUFREQ_RELATION_H);
+				if (freq == freqmin) {
+					/* nothing between is fast enough */
+					freq = freqmax;
+					break;
+				}
+			}
+		} else if (freq < prevfreq) {
+			/* prevfreq is fast enough */
+			freqmax = prevfreq;
+			if (freq <= freqmin) {
+				freq = lookup(data, freqmin + 1,
+					      CPUFREQ_RELATION_L);
+				if (freq == freqmax)
+					break;
+			}
+		}
+	} while (freq != prevfreq);
+
+	return freq;
+}
+
+struct interactive_predictor {
+	unsigned int load_avg;		/* EWMA of load, in percent */
+};
+
+/*
+ * interactive_predict_load - the load, in percent, to size the next timer
+ * window for, given the load of the one just ended.
+ * @ewma_weight: percentage of the newest window in the running average
+ * @rq_depth: tenths of runnable tasks per online CPU
+ * @rq_depth_boost: rq_depth at and above which tasks are waiting for a
+ *	CPU, so the load is predicted to be at least @rq_load; 0 disables
+ *
+ * While the load rises faster than the average, the trend is extrapolated
+ * one window ahead. When it falls, the load of the last window is used as
+ * it is, rather than the average or the load since the last speed change,
+ * so the speed drops as soon as a burst is over.
+ */
+static inline unsigned int interactive_predict_load(
+	struct interactive_predictor *pred, unsigned int load,
+	unsigned int ewma_weight, unsigned int rq_depth,
+	unsigned int rq_depth_boost, unsigned int rq_load)
+{
+	unsigned int avg = pred->load_avg;
+	unsigned int predicted = load;
+
+	if (load > avg) {
+		predicted = load + (load - avg);
+		if (predicted > 100)
+			predicted = 100;
+	}
+	pred->load_avg = (load * ewma_weight + avg * (100 - ewma_weight)) /
+		100;
+
+	if (rq_depth_boost && rq_depth >= rq_depth_boost &&
+	    predicted < rq_load)
+		predicted = rq_load;
+	return predicted;
+}
+
+#endif /* _CPUFREQ_INTERACTIVE_LOAD_H */
@@ -30,6 +30,8 @@
 #include <linux/seq_file.h>
 #include <linux/uaccess.h>
 #include <linux/debugfs.h>
+#include <linux/proc_fs.h>
+#include <linux/vmalloc.h>
 
 #include <mach/iommu_domains.h>
 #include "ion_priv.h"
@@ -65,6 +67,9 @@ struct ion_device {
  * @heap_mask:		mask of all supported heaps
  * @name:		used for debugging
  * @task:		used for debugging
+ * @nr_handles:		number of handles in the tree
+ * @total_bytes:	size of the buffers the handles refer to
+ * @heap_bytes:		the same, by heap id
  *
  * A client represents a list of buffers this client may access.
  * The mutex stored here is used to protect both handles tree
@@ -81,6 +86,9 @@ struct ion_client {
 	struct task_struct *task;
 	pid_t pid;
 	struct dentry *debug_root;
+	unsigned int nr_handles;
+	size_t total_bytes;
+	size_t heap_bytes[ION_NUM_HEAP_IDS];
 };
 
 /**
@@ -234,6 +242,11 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 	buffer->size = len;
 	mutex_init(&buffer->lock);
 	ion_buffer_add(dev, buffer);
+
+	heap->nr_buffers++;
+	heap->total_bytes += len;
+	if (heap->total_bytes > heap->peak_bytes)
+		heap->peak_bytes = heap->total_bytes;
 	return buffer;
 }
 
@@ -278,6 +291,8 @@ static void ion_buffer_destroy(struct kref *kref)
 	buffer->heap->ops->free(buffer);
 	mutex_lock(&dev->lock);
 	rb_erase(&buffer->node, &dev->buffers);
+	buffer->heap->nr_buffers--;
+	buffer->heap->total_bytes -= buffer->size;
 	mutex_unlock(&dev->lock);
 	kfree(buffer);
 }
@@ -309,6 +324,28 @@ static struct ion_handle *ion_handle_create(struct ion_client *client,
 	return handle;
 }
 
+/*
+ * Charge (or uncharge) a buffer to the client holding a handle to it and,
+ * for userspace clients, to its process, where lowmemorykiller counts it
+ * as part of the RSS. Client lock must be locked when calling.
+ */
+static void ion_client_account(struct ion_client *client,
+			       struct ion_buffer *buffer, bool charge)
+{
+	long size = buffer->size;
+	int id = buffer->heap->id;
+
+	if (!charge)
+		size = -size;
+
+	client->nr_handles += charge ? 1 : -1;
+	client->total_bytes += size;
+	if (id >= 0 && id < ION_NUM_HEAP_IDS)
+		client->heap_bytes[id] += size;
+	if (client->task)
+		atomic_long_add(size, &client->task->signal->ion_bytes);
+}
+
 /* Client lock must be locked when calling */
 static void ion_handle_destroy(struct kref *kref)
 {
@@ -317,9 +354,11 @@ static void ion_handle_destroy(struct kref *kref)
 	   if (handle->map_cnt) unmap
 	 */
 	WARN_ON(handle->kmap_cnt || handle->dmap_cnt || handle->usermap_cnt);
-	ion_buffer_put(handle->buffer);
-	if (!RB_EMPTY_NODE(&handle->node))
+	if (!RB_EMPTY_NODE(&handle->node)) {
 		rb_erase(&handle->node, &handle->client->handles);
+		ion_client_account(handle->client, handle->buffer, false);
+	}
+	ion_buffer_put(handle->buffer);
 	kfree(handle);
 }
 
@@ -389,6 +428,7 @@ static void ion_handle_add(struct ion_client *client, struct ion_handle *handle)
 
 	rb_link_node(&handle->node, parent, p);
 	rb_insert_color(&handle->node, &client->handles);
+	ion_client_account(client, handle->buffer, true);
 }
 
 struct ion_handle *ion_alloc(struct ion_client *client, size_t len,
@@ -2033,7 +2073,110 @@ static const struct file_operations debug_leak_fops = {
 	.release = single_release,
 };
 
+/*
+ * /proc/ion_stats: the counters are kept up to date as buffers are
+ * allocated, imported and freed, so a snapshot is just a copy of them,
+ * taken on open under the device lock only.
+ */
+struct ion_stats_snapshot {
+	size_t size;
+	char data[0];
+};
+
+static void ion_stats_fill_client(struct ion_client_stats *cs,
+				  struct ion_client *client)
+{
+	int i;
+
+	memset(cs, 0, sizeof(*cs));
+	cs->pid = client->pid;
+	cs->flags = client->task ? 0 : ION_CLIENT_STATS_KERNEL;
+	cs->nr_handles = ACCESS_ONCE(client->nr_handles);
+	cs->total_bytes = ACCESS_ONCE(client->total_bytes);
+	for (i = 0; i < ION_NUM_HEAP_IDS; i++)
+		cs->heap_bytes[i] = ACCESS_ONCE(client->heap_bytes[i]);
+	strlcpy(cs->name, client->name, sizeof(cs->name));
+}
+
+static int ion_stats_open(struct inode *inode, struct file *file)
+{
+	struct ion_device *dev = PDE(inode)->data;
+	struct ion_stats_snapshot *snap;
+	struct ion_stats_header *hdr;
+	struct ion_heap_stats *hs;
+	struct ion_client_stats *cs;
+	unsigned int nr_heaps = 0, nr_clients = 0;
+	struct rb_node *n;
+	size_t size;
+
+	mutex_lock(&dev->lock);
+	for (n = rb_first(&dev->heaps); n; n = rb_next(n))
+		nr_heaps++;
+	for (n = rb_first(&dev->user_clients); n; n = rb_next(n))
+		nr_clients++;
+	for (n = rb_first(&dev->kernel_clients); n; n = rb_next(n))
+		nr_clients++;
+
+	size = sizeof(*hdr) + nr_heaps * sizeof(*hs) +
+		nr_clients * sizeof(*cs);
+	snap = vmalloc(sizeof(*snap) + size);
+	if (!snap) {
+		mutex_unlock(&dev->lock);
+		return -ENOMEM;
+	}
+	snap->size = size;
+
+	hdr = (struct ion_stats_header *)snap->data;
+	hdr->version = ION_STATS_VERSION;
+	hdr->nr_heaps = nr_heaps;
+	hdr->nr_clients = nr_clients;
+	hdr->reserved = 0;
+
+	hs = (struct ion_heap_stats *)(hdr + 1);
+	for (n = rb_first(&dev->heaps); n; n = rb_next(n), hs++) {
+		struct ion_heap *heap = rb_entry(n, struct ion_heap, node);
+
+		memset(hs, 0, sizeof(*hs));
+		hs->id = heap->id;
+		hs->type = heap->type;
+		hs->total_bytes = heap->total_bytes;
+		hs->peak_bytes = heap->peak_bytes;
+		hs->nr_buffers = heap->nr_buffers;
+		strlcpy(hs->name, heap->name, sizeof(hs->name));
+	}
+
+	cs = (struct ion_client_stats *)hs;
+	for (n = rb_first(&dev->user_clients); n; n = rb_next(n), cs++)
+		ion_stats_fill_client(cs, rb_entry(n, struct ion_client, node));
+	for (n = rb_first(&dev->kernel_clients); n; n = rb_next(n), cs++)
+		ion_stats_fill_client(cs, rb_entry(n, struct ion_client, node));
+	mutex_unlock(&dev->lock);
+
+	file->private_data = snap;
+	return 0;
+}
+
+static ssize_t ion_stats_read(struct file *file, char __user *buf,
+			      size_t count, loff_t *ppos)
+{
+	struct ion_stats_snapshot *snap = file->private_data;
+
+	return simple_read_from_buffer(buf, count, ppos, snap->data,
+				       snap->size);
+}
+
+static int ion_stats_release(struct inode *inode, struct file *file)
+{
+	vfree(file->private_data);
+	return 0;
+}
 
+static const struct file_operations ion_stats_fops = {
+	.open = ion_stats_open,
+	.read = ion_stats_read,
+	.llseek = default_llseek,
+	.release = ion_stats_release,
+};
 
 struct ion_device *ion_device_create(long (*custom_ioctl)
 				     (struct ion_client *client,
@@ -2069,11 +2212,15 @@ struct ion_device *ion_device_create(long (*custom_ioctl)
 	idev->kernel_clients = RB_ROOT;
 	debugfs_create_file("check_leaked_fds", 0664, idev->debug_root, idev,
 			    &debug_leak_fops);
+	if (!proc_create_data("ion_stats", S_IRUGO, NULL, &ion_stats_fops,
+			      idev))
+		pr_err("ion: failed to create /proc/ion_stats.\n");
 	return idev;
 }
 
 void ion_device_destroy(struct ion_device *dev)
 {
+	remove_proc_entry("ion_stats", NULL);
 	misc_deregister(&dev->dev);
 	/* XXX need to free the heaps and clients ? */
 	kfree(dev);
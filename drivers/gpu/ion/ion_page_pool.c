@@ -0,0 +1,231 @@
+/*
+ * drivers/gpu/ion/ion_page_pool.c
+ *
+ * Copyright (C) 2012 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/highmem.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <asm/cacheflush.h>
+#include "ion_priv.h"
+
+struct ion_page_pool_item {
+	struct page *page;
+	struct list_head list;
+};
+
+/*
+ * Write back and invalidate the pages from the caches, so that no dirty
+ * line can later be evicted over what a device or an uncached mapping
+ * wrote to the memory.
+ */
+static void ion_page_pool_flush(struct ion_page_pool *pool, struct page *page)
+{
+	int i;
+
+	for (i = 0; i < (1 << pool->order); i++) {
+		phys_addr_t phys = page_to_phys(page + i);
+		void *vaddr = kmap_atomic(page + i, KM_USER0);
+
+		dmac_flush_range(vaddr, vaddr + PAGE_SIZE);
+		kunmap_atomic(vaddr, KM_USER0);
+		outer_flush_range(phys, phys + PAGE_SIZE);
+	}
+}
+
+static void ion_page_pool_zero(struct ion_page_pool *pool, struct page *page)
+{
+	int i;
+
+	for (i = 0; i < (1 << pool->order); i++)
+		clear_highpage(page + i);
+	if (!pool->cached)
+		ion_page_pool_flush(pool, page);
+}
+
+static struct page *ion_page_pool_alloc_pages(struct ion_page_pool *pool)
+{
+	struct page *page = alloc_pages(pool->gfp_mask | __GFP_ZERO,
+					pool->order);
+
+	if (!page)
+		return NULL;
+	if (!pool->cached)
+		ion_page_pool_flush(pool, page);
+	return page;
+}
+
+static void ion_page_pool_free_pages(struct ion_page_pool *pool,
+				     struct page *page)
+{
+	__free_pages(page, pool->order);
+}
+
+static void ion_page_pool_add(struct ion_page_pool *pool,
+			      struct ion_page_pool_item *item)
+{
+	mutex_lock(&pool->mutex);
+	list_add_tail(&item->list, &pool->items);
+	pool->count++;
+	mutex_unlock(&pool->mutex);
+}
+
+/* Takes the first item off 'list', caller must hold pool->mutex */
+static struct ion_page_pool_item *ion_page_pool_take(struct list_head *list,
+						     int *count)
+{
+	struct ion_page_pool_item *item;
+
+	if (list_empty(list))
+		return NULL;
+	item = list_first_entry(list, struct ion_page_pool_item, list);
+	list_del(&item->list);
+	(*count)--;
+	return item;
+}
+
+/*
+ * Freed pages are zeroed here rather than in the allocation path, so
+ * that allocating from the pool only has to take a page off a list.
+ */
+static void ion_page_pool_zero_work(struct work_struct *work)
+{
+	struct ion_page_pool *pool = container_of(work, struct ion_page_pool,
+						  zero_work);
+	struct ion_page_pool_item *item;
+
+	for (;;) {
+		mutex_lock(&pool->mutex);
+		item = ion_page_pool_take(&pool->dirty, &pool->dirty_count);
+		mutex_unlock(&pool->mutex);
+		if (!item)
+			break;
+
+		ion_page_pool_zero(pool, item->page);
+		ion_page_pool_add(pool, item);
+		cond_resched();
+	}
+}
+
+struct page *ion_page_pool_alloc(struct ion_page_pool *pool)
+{
+	struct ion_page_pool_item *item;
+	struct page *page;
+	bool dirty = false;
+
+	mutex_lock(&pool->mutex);
+	item = ion_page_pool_take(&pool->items, &pool->count);
+	if (!item) {
+		/* rather zero a freed page here than allocate a new one */
+		item = ion_page_pool_take(&pool->dirty, &pool->dirty_count);
+		dirty = true;
+	}
+	mutex_unlock(&pool->mutex);
+
+	if (!item)
+		return ion_page_pool_alloc_pages(pool);
+
+	page = item->page;
+	kfree(item);
+	if (dirty)
+		ion_page_pool_zero(pool, page);
+	return page;
+}
+
+void ion_page_pool_free(struct ion_page_pool *pool, struct page *page)
+{
+	struct ion_page_pool_item *item;
+
+	item = kmalloc(sizeof(struct ion_page_pool_item), GFP_KERNEL);
+	if (!item) {
+		ion_page_pool_free_pages(pool, page);
+		return;
+	}
+
+	item->page = page;
+	mutex_lock(&pool->mutex);
+	list_add_tail(&item->list, &pool->dirty);
+	pool->dirty_count++;
+	mutex_unlock(&pool->mutex);
+
+	queue_work(system_unbound_wq, &pool->zero_work);
+}
+
+/* Returns the number of pages (in PAGE_SIZE units) held by the pool */
+static int ion_page_pool_total(struct ion_page_pool *pool)
+{
+	return (pool->count + pool->dirty_count) << pool->order;
+}
+
+/*
+ * ion_page_pool_shrink - give back up to 'nr_to_scan' pages (in PAGE_SIZE
+ * units) to the system, the ones still waiting to be zeroed first, and
+ * return how many were freed. With 'nr_to_scan' of zero, returns how many
+ * pages the pool holds instead.
+ */
+int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
+			 int nr_to_scan)
+{
+	struct ion_page_pool_item *item;
+	int freed = 0;
+
+	if (!nr_to_scan)
+		return ion_page_pool_total(pool);
+
+	while (freed < nr_to_scan) {
+		mutex_lock(&pool->mutex);
+		item = ion_page_pool_take(&pool->dirty, &pool->dirty_count);
+		if (!item)
+			item = ion_page_pool_take(&pool->items, &pool->count);
+		mutex_unlock(&pool->mutex);
+		if (!item)
+			break;
+
+		ion_page_pool_free_pages(pool, item->page);
+		kfree(item);
+		freed += (1 << pool->order);
+	}
+
+	return freed;
+}
+
+struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order,
+					   bool cached)
+{
+	struct ion_page_pool *pool = kmalloc(sizeof(struct ion_page_pool),
+					     GFP_KERNEL);
+	if (!pool)
+		return NULL;
+	pool->count = 0;
+	pool->dirty_count = 0;
+	INIT_LIST_HEAD(&pool->items);
+	INIT_LIST_HEAD(&pool->dirty);
+	pool->gfp_mask = gfp_mask;
+	pool->order = order;
+	pool->cached = cached;
+	mutex_init(&pool->mutex);
+	INIT_WORK(&pool->zero_work, ion_page_pool_zero_work);
+
+	return pool;
+}
+
+void ion_page_pool_destroy(struct ion_page_pool *pool)
+{
+	cancel_work_sync(&pool->zero_work);
+	ion_page_pool_shrink(pool, GFP_KERNEL, INT_MAX);
+	kfree(pool);
+}
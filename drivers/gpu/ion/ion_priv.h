@@ -24,6 +24,7 @@
 #include <linux/rbtree.h>
 #include <linux/ion.h>
 #include <linux/iommu.h>
+#include <linux/workqueue.h>
 
 struct ion_mapping;
 
@@ -171,6 +172,9 @@ struct ion_heap_ops {
  *			allocating.  These are specified by platform data and
  *			MUST be unique
  * @name:		used for debugging
+ * @nr_buffers:		number of buffers allocated from this heap
+ * @total_bytes:	bytes allocated from this heap
+ * @peak_bytes:		high watermark of total_bytes
  *
  * Represents a pool of memory from which buffers can be made.  In some
  * systems the only heap is regular system memory allocated via vmalloc.
@@ -184,6 +188,9 @@ struct ion_heap {
 	struct ion_heap_ops *ops;
 	int id;
 	const char *name;
+	unsigned int nr_buffers;
+	size_t total_bytes;
+	size_t peak_bytes;
 };
 
 /**
@@ -319,4 +326,42 @@ void ion_cp_heap_get_base(struct ion_heap *heap, unsigned long *base,
 
 void ion_mem_map_show(struct ion_heap *heap);
 
+/**
+ * struct ion_page_pool - pool of zeroed pages of one order
+ * @count:		number of zeroed pages ready to be handed out
+ * @dirty_count:	number of freed pages still waiting to be zeroed
+ * @items:		list of zeroed pages
+ * @dirty:		list of freed pages waiting to be zeroed
+ * @mutex:		protects the lists and counts
+ * @gfp_mask:		gfp_mask to use when allocating fresh pages
+ * @order:		order of the pages in the pool
+ * @cached:		pages are handed out for cached buffers only, so
+ *			need no cache maintenance after being zeroed
+ * @zero_work:		zeroes freed pages in the background
+ *
+ * Allocating and zeroing pages, in particular high order ones, is
+ * expensive. The pool keeps pages that were freed, zeroes them off the
+ * allocation path and hands them out again. It is drained by the heap's
+ * shrinker when the system runs low on memory.
+ */
+struct ion_page_pool {
+	int count;
+	int dirty_count;
+	struct list_head items;
+	struct list_head dirty;
+	struct mutex mutex;
+	gfp_t gfp_mask;
+	unsigned int order;
+	bool cached;
+	struct work_struct zero_work;
+};
+
+struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order,
+					   bool cached);
+void ion_page_pool_destroy(struct ion_page_pool *);
+struct page *ion_page_pool_alloc(struct ion_page_pool *);
+void ion_page_pool_free(struct ion_page_pool *, struct page *);
+int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
+			 int nr_to_scan);
+
 #endif /* _ION_PRIV_H */
@@ -16,6 +16,7 @@
  */
 
 #include <linux/err.h>
+#include <linux/highmem.h>
 #include <linux/ion.h>
 #include <linux/mm.h>
 #include <linux/scatterlist.h>
@@ -33,76 +34,238 @@ static atomic_t system_contig_heap_allocated;
 static unsigned int system_heap_has_outer_cache;
 static unsigned int system_heap_contig_has_outer_cache;
 
+/*
+ * Buffers are built from the largest of these orders that fit, falling
+ * back to smaller ones when memory is fragmented. Fewer, larger chunks
+ * mean smaller scatterlists and fewer TLB misses for the devices.
+ */
+static const unsigned int orders[] = {8, 4, 0};
+static const int num_orders = ARRAY_SIZE(orders);
+
+/* Don't try too hard, or wake kswapd, for pages we can do without */
+static gfp_t high_order_gfp_flags = (GFP_HIGHUSER | __GFP_NOWARN |
+				     __GFP_NORETRY | __GFP_NO_KSWAPD) &
+				    ~__GFP_WAIT;
+static gfp_t low_order_gfp_flags  = GFP_HIGHUSER | __GFP_NOWARN;
+
+/*
+ * Separate pools for cached and uncached buffers: pages for uncached
+ * buffers have to be flushed from the caches after zeroing, which the
+ * pool does once in the background instead of on every allocation.
+ */
+static struct ion_page_pool *uncached_pools[ARRAY_SIZE(orders)];
+static struct ion_page_pool *cached_pools[ARRAY_SIZE(orders)];
+
+struct ion_system_buffer_info {
+	struct sg_table table;
+	bool cached;
+};
+
+static int order_to_index(unsigned int order)
+{
+	int i;
+
+	for (i = 0; i < num_orders; i++)
+		if (order == orders[i])
+			return i;
+	BUG();
+	return -1;
+}
+
+static struct ion_page_pool *order_to_pool(unsigned int order, bool cached)
+{
+	if (cached)
+		return cached_pools[order_to_index(order)];
+	return uncached_pools[order_to_index(order)];
+}
+
+static struct page *alloc_largest_available(unsigned long size,
+					    unsigned int max_order,
+					    bool cached, unsigned int *order)
+{
+	struct page *page;
+	int i;
+
+	for (i = 0; i < num_orders; i++) {
+		if (size < (PAGE_SIZE << orders[i]))
+			continue;
+		if (max_order < orders[i])
+			continue;
+
+		page = ion_page_pool_alloc(order_to_pool(orders[i], cached));
+		if (!page)
+			continue;
+
+		*order = orders[i];
+		return page;
+	}
+
+	return NULL;
+}
+
+static void free_buffer_pages(struct ion_system_buffer_info *info)
+{
+	struct scatterlist *sg;
+	int i;
+
+	for_each_sg(info->table.sgl, sg, info->table.nents, i)
+		ion_page_pool_free(order_to_pool(get_order(sg->length),
+						 info->cached),
+				   sg_page(sg));
+}
+
 static int ion_system_heap_allocate(struct ion_heap *heap,
 				     struct ion_buffer *buffer,
 				     unsigned long size, unsigned long align,
 				     unsigned long flags)
 {
-	buffer->priv_virt = vmalloc_user(size);
-	if (!buffer->priv_virt)
+	struct ion_system_buffer_info *info;
+	struct scatterlist *sg;
+	struct page **pages;
+	unsigned int *page_orders;
+	unsigned long size_remaining = PAGE_ALIGN(size);
+	unsigned int max_order = orders[0];
+	unsigned int order;
+	bool cached = ION_IS_CACHED(flags);
+	int nents = 0;
+	int i, ret = -ENOMEM;
+
+	info = kzalloc(sizeof(struct ion_system_buffer_info), GFP_KERNEL);
+	if (!info)
 		return -ENOMEM;
+	info->cached = cached;
+
+	/* Worst case, every chunk is an order-0 page */
+	pages = vmalloc(sizeof(struct page *) * (size_remaining >> PAGE_SHIFT));
+	page_orders = vmalloc(sizeof(unsigned int) *
+			      (size_remaining >> PAGE_SHIFT));
+	if (!pages || !page_orders)
+		goto err;
+
+	while (size_remaining > 0) {
+		pages[nents] = alloc_largest_available(size_remaining,
+						       max_order, cached,
+						       &order);
+		if (!pages[nents])
+			goto err_free_pages;
+		page_orders[nents++] = order;
+		size_remaining -= PAGE_SIZE << order;
+		max_order = order;
+	}
+
+	ret = sg_alloc_table(&info->table, nents, GFP_KERNEL);
+	if (ret)
+		goto err_free_pages;
+
+	for_each_sg(info->table.sgl, sg, info->table.nents, i)
+		sg_set_page(sg, pages[i], PAGE_SIZE << page_orders[i], 0);
 
+	vfree(page_orders);
+	vfree(pages);
+	buffer->priv_virt = info;
 	atomic_add(size, &system_heap_allocated);
 	return 0;
+
+err_free_pages:
+	ret = -ENOMEM;
+	for (i = 0; i < nents; i++)
+		ion_page_pool_free(order_to_pool(page_orders[i], cached),
+				   pages[i]);
+err:
+	vfree(page_orders);
+	vfree(pages);
+	kfree(info);
+	return ret;
 }
 
 void ion_system_heap_free(struct ion_buffer *buffer)
 {
-	vfree(buffer->priv_virt);
+	struct ion_system_buffer_info *info = buffer->priv_virt;
+
+	free_buffer_pages(info);
+	sg_free_table(&info->table);
+	kfree(info);
 	atomic_sub(buffer->size, &system_heap_allocated);
 }
 
+/*
+ * Buffers allocated for cached use come from pools that skip the cache
+ * flush after zeroing; if one is mapped uncached anyway, do it now.
+ */
+static void ion_system_heap_sync_uncached(struct ion_system_buffer_info *info,
+					  unsigned long flags)
+{
+	struct scatterlist *sg;
+	int i, j;
+
+	if (ION_IS_CACHED(flags) || !info->cached)
+		return;
+
+	for_each_sg(info->table.sgl, sg, info->table.nents, i) {
+		for (j = 0; j < sg->length >> PAGE_SHIFT; j++) {
+			struct page *page = sg_page(sg) + j;
+			phys_addr_t phys = page_to_phys(page);
+			void *vaddr = kmap_atomic(page, KM_USER0);
+
+			dmac_flush_range(vaddr, vaddr + PAGE_SIZE);
+			kunmap_atomic(vaddr, KM_USER0);
+			outer_flush_range(phys, phys + PAGE_SIZE);
+		}
+	}
+}
+
 struct scatterlist *ion_system_heap_map_dma(struct ion_heap *heap,
 					    struct ion_buffer *buffer)
 {
-	struct scatterlist *sglist;
-	struct page *page;
-	int i;
-	int npages = PAGE_ALIGN(buffer->size) / PAGE_SIZE;
-	void *vaddr = buffer->priv_virt;
+	struct ion_system_buffer_info *info = buffer->priv_virt;
 
-	sglist = vmalloc(npages * sizeof(struct scatterlist));
-	if (!sglist)
-		return ERR_PTR(-ENOMEM);
-	memset(sglist, 0, npages * sizeof(struct scatterlist));
-	sg_init_table(sglist, npages);
-	for (i = 0; i < npages; i++) {
-		page = vmalloc_to_page(vaddr);
-		if (!page)
-			goto end;
-		sg_set_page(&sglist[i], page, PAGE_SIZE, 0);
-		vaddr += PAGE_SIZE;
-	}
-	/* XXX do cache maintenance for dma? */
-	return sglist;
-end:
-	vfree(sglist);
-	return NULL;
+	ion_system_heap_sync_uncached(info, buffer->flags);
+	return info->table.sgl;
 }
 
 void ion_system_heap_unmap_dma(struct ion_heap *heap,
 			       struct ion_buffer *buffer)
 {
-	/* XXX undo cache maintenance for dma? */
-	if (buffer->sglist)
-		vfree(buffer->sglist);
 }
 
 void *ion_system_heap_map_kernel(struct ion_heap *heap,
 				 struct ion_buffer *buffer,
 				 unsigned long flags)
 {
-	if (ION_IS_CACHED(flags))
-		return buffer->priv_virt;
-	else {
-		pr_err("%s: cannot map system heap uncached\n", __func__);
-		return ERR_PTR(-EINVAL);
+	struct ion_system_buffer_info *info = buffer->priv_virt;
+	int npages = PAGE_ALIGN(buffer->size) / PAGE_SIZE;
+	struct page **pages, **tmp;
+	pgprot_t pgprot = PAGE_KERNEL;
+	struct scatterlist *sg;
+	void *vaddr;
+	int i, j;
+
+	if (!ION_IS_CACHED(flags))
+		pgprot = pgprot_noncached(pgprot);
+	ion_system_heap_sync_uncached(info, flags);
+
+	pages = vmalloc(sizeof(struct page *) * npages);
+	if (!pages)
+		return ERR_PTR(-ENOMEM);
+
+	tmp = pages;
+	for_each_sg(info->table.sgl, sg, info->table.nents, i) {
+		for (j = 0; j < sg->length >> PAGE_SHIFT; j++)
+			*(tmp++) = sg_page(sg) + j;
 	}
+
+	vaddr = vmap(pages, npages, VM_MAP, pgprot);
+	vfree(pages);
+	if (!vaddr)
+		return ERR_PTR(-ENOMEM);
+
+	return vaddr;
 }
 
 void ion_system_heap_unmap_kernel(struct ion_heap *heap,
 				  struct ion_buffer *buffer)
 {
+	vunmap(buffer->vaddr);
 }
 
 void ion_system_heap_unmap_iommu(struct ion_iommu_map *data)
@@ -134,13 +297,39 @@ void ion_system_heap_unmap_iommu(struct ion_iommu_map *data)
 int ion_system_heap_map_user(struct ion_heap *heap, struct ion_buffer *buffer,
 			     struct vm_area_struct *vma, unsigned long flags)
 {
-	if (ION_IS_CACHED(flags))
-		return remap_vmalloc_range(vma, buffer->priv_virt,
-						vma->vm_pgoff);
-	else {
-		pr_err("%s: cannot map system heap uncached\n", __func__);
-		return -EINVAL;
+	struct ion_system_buffer_info *info = buffer->priv_virt;
+	unsigned long addr = vma->vm_start;
+	unsigned long offset = vma->vm_pgoff * PAGE_SIZE;
+	struct scatterlist *sg;
+	int i, ret;
+
+	if (!ION_IS_CACHED(flags))
+		vma->vm_page_prot = pgprot_writecombine(vma->vm_page_prot);
+	ion_system_heap_sync_uncached(info, flags);
+
+	for_each_sg(info->table.sgl, sg, info->table.nents, i) {
+		struct page *page = sg_page(sg);
+		unsigned long remainder = vma->vm_end - addr;
+		unsigned long len = sg->length;
+
+		if (offset >= sg->length) {
+			offset -= sg->length;
+			continue;
+		} else if (offset) {
+			page += offset / PAGE_SIZE;
+			len = sg->length - offset;
+			offset = 0;
+		}
+		len = min(len, remainder);
+		ret = remap_pfn_range(vma, addr, page_to_pfn(page), len,
+				      vma->vm_page_prot);
+		if (ret)
+			return ret;
+		addr += len;
+		if (addr >= vma->vm_end)
+			break;
 	}
+	return 0;
 }
 
 int ion_system_heap_cache_ops(struct ion_heap *heap, struct ion_buffer *buffer,
@@ -167,17 +356,11 @@ int ion_system_heap_cache_ops(struct ion_heap *heap, struct ion_buffer *buffer,
 	}
 
 	if (system_heap_has_outer_cache) {
-		unsigned long pstart;
-		void *vend;
-		void *vtemp;
-		unsigned long ln = 0;
-		vend = buffer->priv_virt + buffer->size;
-		vtemp = buffer->priv_virt + offset;
-
-		if ((vtemp+length) > vend) {
-			pr_err("Trying to flush outside of mapped range.\n");
-			pr_err("End of mapped range: %p, trying to flush to "
-				"address %p\n", vend, vtemp+length);
+		struct ion_system_buffer_info *info = buffer->priv_virt;
+		struct scatterlist *sg;
+		int i;
+
+		if (offset + length > buffer->size) {
 			WARN(1, "%s: called with heap name %s, buffer size 0x%x, "
 				"vaddr 0x%p, offset 0x%x, length: 0x%x\n",
 				__func__, heap->name, buffer->size, vaddr,
@@ -185,26 +368,22 @@ int ion_system_heap_cache_ops(struct ion_heap *heap, struct ion_buffer *buffer,
 			return -EINVAL;
 		}
 
-		for (; ln < length && vtemp < vend;
-		      vtemp += PAGE_SIZE, ln += PAGE_SIZE) {
-			struct page *page = vmalloc_to_page(vtemp);
-			if (!page) {
-				WARN(1, "Could not find page for virt. address %p\n",
-					vtemp);
-				return -EINVAL;
-			}
-			pstart = page_to_phys(page);
-			/*
-			 * If page -> phys is returning NULL, something
-			 * has really gone wrong...
-			 */
-			if (!pstart) {
-				WARN(1, "Could not translate %p to physical address\n",
-					vtemp);
-				return -EINVAL;
-			}
+		/* the chunks are physically contiguous, so do each at once */
+		for_each_sg(info->table.sgl, sg, info->table.nents, i) {
+			unsigned long pstart;
+			unsigned int len;
 
-			outer_cache_op(pstart, pstart + PAGE_SIZE);
+			if (!length)
+				break;
+			if (offset >= sg->length) {
+				offset -= sg->length;
+				continue;
+			}
+			pstart = page_to_phys(sg_page(sg)) + offset;
+			len = min(length, sg->length - offset);
+			outer_cache_op(pstart, pstart + len);
+			length -= len;
+			offset = 0;
 		}
 	}
 	return 0;
@@ -213,9 +392,21 @@ int ion_system_heap_cache_ops(struct ion_heap *heap, struct ion_buffer *buffer,
 static int ion_system_print_debug(struct ion_heap *heap, struct seq_file *s,
 				  const struct rb_root *unused)
 {
+	int i;
+
 	seq_printf(s, "total bytes currently allocated: %lx\n",
 			(unsigned long) atomic_read(&system_heap_allocated));
 
+	for (i = 0; i < num_orders; i++) {
+		struct ion_page_pool *pool = uncached_pools[i];
+
+		seq_printf(s, "uncached pool order %u: %d zeroed, %d dirty\n",
+			   pool->order, pool->count, pool->dirty_count);
+		pool = cached_pools[i];
+		seq_printf(s, "cached pool order %u: %d zeroed, %d dirty\n",
+			   pool->order, pool->count, pool->dirty_count);
+	}
+
 	return 0;
 }
 
@@ -227,14 +418,11 @@ int ion_system_heap_map_iommu(struct ion_buffer *buffer,
 				unsigned long iova_length,
 				unsigned long flags)
 {
-	int ret = 0, i;
+	int ret = 0;
 	struct iommu_domain *domain;
 	unsigned long extra;
 	unsigned long extra_iova_addr;
-	struct page *page;
-	int npages = buffer->size >> PAGE_SHIFT;
-	void *vaddr = buffer->priv_virt;
-	struct scatterlist *sglist = 0;
+	struct ion_system_buffer_info *info = buffer->priv_virt;
 	int prot = IOMMU_WRITE | IOMMU_READ;
 	prot |= ION_IS_CACHED(flags) ? IOMMU_CACHE : 0;
 
@@ -262,23 +450,7 @@ int ion_system_heap_map_iommu(struct ion_buffer *buffer,
 		goto out1;
 	}
 
-
-	sglist = vmalloc(sizeof(*sglist) * npages);
-	if (!sglist) {
-		ret = -ENOMEM;
-		goto out1;
-	}
-
-	sg_init_table(sglist, npages);
-	for (i = 0; i < npages; i++) {
-		page = vmalloc_to_page(vaddr);
-		if (!page)
-			goto out1;
-		sg_set_page(&sglist[i], page, PAGE_SIZE, 0);
-		vaddr += PAGE_SIZE;
-	}
-
-	ret = iommu_map_range(domain, data->iova_addr, sglist,
+	ret = iommu_map_range(domain, data->iova_addr, info->table.sgl,
 			      buffer->size, prot);
 
 	if (ret) {
@@ -294,13 +466,11 @@ int ion_system_heap_map_iommu(struct ion_buffer *buffer,
 		if (ret)
 			goto out2;
 	}
-	vfree(sglist);
 	return ret;
 
 out2:
 	iommu_unmap_range(domain, data->iova_addr, buffer->size);
 out1:
-	vfree(sglist);
 	msm_free_iova_address(data->iova_addr, domain_num, partition_num,
 				data->mapped_size);
 out:
@@ -321,9 +491,59 @@ static struct ion_heap_ops vmalloc_ops = {
 	.unmap_iommu = ion_system_heap_unmap_iommu,
 };
 
+/*
+ * Hand the pooled pages back under memory pressure. 'nr_to_scan' and the
+ * return value are in pages; the pools are drained high orders first.
+ */
+static int ion_system_heap_shrink(struct shrinker *shrinker,
+				  struct shrink_control *sc)
+{
+	int nr_to_scan = sc->nr_to_scan;
+	int nr_total = 0;
+	int i;
+
+	for (i = 0; i < num_orders && nr_to_scan > 0; i++) {
+		nr_to_scan -= ion_page_pool_shrink(uncached_pools[i],
+						   sc->gfp_mask, nr_to_scan);
+		if (nr_to_scan > 0)
+			nr_to_scan -= ion_page_pool_shrink(cached_pools[i],
+							   sc->gfp_mask,
+							   nr_to_scan);
+	}
+
+	for (i = 0; i < num_orders; i++) {
+		nr_total += ion_page_pool_shrink(uncached_pools[i],
+						 sc->gfp_mask, 0);
+		nr_total += ion_page_pool_shrink(cached_pools[i],
+						 sc->gfp_mask, 0);
+	}
+
+	return nr_total;
+}
+
+static struct shrinker ion_system_heap_shrinker = {
+	.shrink = ion_system_heap_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static void ion_system_heap_destroy_pools(void)
+{
+	int i;
+
+	for (i = 0; i < num_orders; i++) {
+		if (uncached_pools[i])
+			ion_page_pool_destroy(uncached_pools[i]);
+		if (cached_pools[i])
+			ion_page_pool_destroy(cached_pools[i]);
+		uncached_pools[i] = NULL;
+		cached_pools[i] = NULL;
+	}
+}
+
 struct ion_heap *ion_system_heap_create(struct ion_platform_heap *pheap)
 {
 	struct ion_heap *heap;
+	int i;
 
 	heap = kzalloc(sizeof(struct ion_heap), GFP_KERNEL);
 	if (!heap)
@@ -331,11 +551,32 @@ struct ion_heap *ion_system_heap_create(struct ion_platform_heap *pheap)
 	heap->ops = &vmalloc_ops;
 	heap->type = ION_HEAP_TYPE_SYSTEM;
 	system_heap_has_outer_cache = pheap->has_outer_cache;
+
+	for (i = 0; i < num_orders; i++) {
+		gfp_t gfp_flags = orders[i] ? high_order_gfp_flags :
+					      low_order_gfp_flags;
+
+		uncached_pools[i] = ion_page_pool_create(gfp_flags, orders[i],
+							 false);
+		cached_pools[i] = ion_page_pool_create(gfp_flags, orders[i],
+						       true);
+		if (!uncached_pools[i] || !cached_pools[i])
+			goto err;
+	}
+
+	register_shrinker(&ion_system_heap_shrinker);
 	return heap;
+
+err:
+	ion_system_heap_destroy_pools();
+	kfree(heap);
+	return ERR_PTR(-ENOMEM);
 }
 
 void ion_system_heap_destroy(struct ion_heap *heap)
 {
+	unregister_shrinker(&ion_system_heap_shrinker);
+	ion_system_heap_destroy_pools();
 	kfree(heap);
 }
 
@@ -380,6 +621,13 @@ struct scatterlist *ion_system_contig_heap_map_dma(struct ion_heap *heap,
 	return sglist;
 }
 
+void ion_system_contig_heap_unmap_dma(struct ion_heap *heap,
+				      struct ion_buffer *buffer)
+{
+	if (buffer->sglist)
+		vfree(buffer->sglist);
+}
+
 int ion_system_contig_heap_map_user(struct ion_heap *heap,
 				    struct ion_buffer *buffer,
 				    struct vm_area_struct *vma,
@@ -525,14 +773,31 @@ out:
 	return ret;
 }
 
+void *ion_system_contig_heap_map_kernel(struct ion_heap *heap,
+					struct ion_buffer *buffer,
+					unsigned long flags)
+{
+	if (ION_IS_CACHED(flags))
+		return buffer->priv_virt;
+	else {
+		pr_err("%s: cannot map system heap uncached\n", __func__);
+		return ERR_PTR(-EINVAL);
+	}
+}
+
+void ion_system_contig_heap_unmap_kernel(struct ion_heap *heap,
+					 struct ion_buffer *buffer)
+{
+}
+
 static struct ion_heap_ops kmalloc_ops = {
 	.allocate = ion_system_contig_heap_allocate,
 	.free = ion_system_contig_heap_free,
 	.phys = ion_system_contig_heap_phys,
 	.map_dma = ion_system_contig_heap_map_dma,
-	.unmap_dma = ion_system_heap_unmap_dma,
-	.map_kernel = ion_system_heap_map_kernel,
-	.unmap_kernel = ion_system_heap_unmap_kernel,
+	.unmap_dma = ion_system_contig_heap_unmap_dma,
+	.map_kernel = ion_system_contig_heap_map_kernel,
+	.unmap_kernel = ion_system_contig_heap_unmap_kernel,
 	.map_user = ion_system_contig_heap_map_user,
 	.cache_op = ion_system_contig_heap_cache_ops,
 	.print_debug = ion_system_contig_print_debug,
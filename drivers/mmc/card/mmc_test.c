@@ -745,6 +745,46 @@ static int mmc_test_simple_transfer(struct mmc_test_card *test,
 	return mmc_test_check_result(test, &mrq);
 }
 
+/**
+ * struct mmc_test_async_req - a request for mmc_start_req().
+ * @areq: the request handed to mmc_start_req()
+ * @test: test the request is issued for
+ * @mrq: request, with its command, stop command and data below
+ */
+struct mmc_test_async_req {
+	struct mmc_async_req areq;
+	struct mmc_test_card *test;
+	struct mmc_request mrq;
+	struct mmc_command cmd;
+	struct mmc_command stop;
+	struct mmc_data data;
+};
+
+static int mmc_test_check_result_async(struct mmc_card *card,
+				       struct mmc_async_req *areq)
+{
+	struct mmc_test_async_req *test_areq =
+		container_of(areq, struct mmc_test_async_req, areq);
+
+	mmc_test_wait_busy(test_areq->test);
+
+	return mmc_test_check_result(test_areq->test, areq->mrq);
+}
+
+static void mmc_test_init_async_req(struct mmc_test_card *test,
+				    struct mmc_test_async_req *test_areq)
+{
+	memset(test_areq, 0, sizeof(struct mmc_test_async_req));
+
+	test_areq->mrq.cmd = &test_areq->cmd;
+	test_areq->mrq.data = &test_areq->data;
+	test_areq->mrq.stop = &test_areq->stop;
+
+	test_areq->areq.mrq = &test_areq->mrq;
+	test_areq->areq.err_check = mmc_test_check_result_async;
+	test_areq->test = test;
+}
+
 /*
  * Tests a transfer where the card will fail completely or partly
  */
@@ -1782,32 +1822,41 @@ static unsigned int mmc_test_rnd_num(unsigned int rnd_cnt)
 	return (r * rnd_cnt) >> 15;
 }
 
-static int mmc_test_rnd_perf(struct mmc_test_card *test, int write, int print,
-			     unsigned long sz)
+/*
+ * Random address for a transfer of ssz sectors in the second quarter of the
+ * card, in a different erase block than the previous one.
+ */
+static unsigned int mmc_test_rnd_addr(struct mmc_test_card *test,
+				      unsigned int ssz, unsigned int *last_ea)
 {
-	unsigned int dev_addr, cnt, rnd_addr, range1, range2, last_ea = 0, ea;
-	unsigned int ssz;
-	struct timespec ts1, ts2, ts;
-	int ret;
-
-	ssz = sz >> 9;
+	unsigned int rnd_addr, range1, range2, ea;
 
 	rnd_addr = mmc_test_capacity(test->card) / 4;
 	range1 = rnd_addr / test->card->pref_erase;
 	range2 = range1 / ssz;
 
+	ea = mmc_test_rnd_num(range1);
+	if (ea == *last_ea)
+		ea -= 1;
+	*last_ea = ea;
+	return rnd_addr + test->card->pref_erase * ea +
+	       ssz * mmc_test_rnd_num(range2);
+}
+
+static int mmc_test_rnd_perf(struct mmc_test_card *test, int write, int print,
+			     unsigned long sz)
+{
+	unsigned int dev_addr, cnt, last_ea = 0;
+	struct timespec ts1, ts2, ts;
+	int ret;
+
 	getnstimeofday(&ts1);
 	for (cnt = 0; cnt < UINT_MAX; cnt++) {
 		getnstimeofday(&ts2);
 		ts = timespec_sub(ts2, ts1);
 		if (ts.tv_sec >= 10)
 			break;
-		ea = mmc_test_rnd_num(range1);
-		if (ea == last_ea)
-			ea -= 1;
-		last_ea = ea;
-		dev_addr = rnd_addr + test->card->pref_erase * ea +
-			   ssz * mmc_test_rnd_num(range2);
+		dev_addr = mmc_test_rnd_addr(test, sz >> 9, &last_ea);
 		ret = mmc_test_area_io(test, sz, dev_addr, write, 0, 0);
 		if (ret)
 			return ret;
@@ -1954,6 +2003,177 @@ static int mmc_test_large_seq_write_perf(struct mmc_test_card *test)
 	return mmc_test_large_seq_perf(test, 1);
 }
 
+/**
+ * struct mmc_test_multiple_rw - a series of transfers to time.
+ * @sz: size of each transfer (in bytes)
+ * @cnt: number of transfers
+ * @write: write rather than read
+ * @random: go to random addresses rather than through the test area
+ */
+struct mmc_test_multiple_rw {
+	unsigned long sz;
+	unsigned int cnt;
+	int write;
+	int random;
+};
+
+static unsigned int mmc_test_rw_addr(struct mmc_test_card *test,
+				     struct mmc_test_multiple_rw *rw,
+				     unsigned int i, unsigned int *last_ea)
+{
+	if (rw->random)
+		return mmc_test_rnd_addr(test, rw->sz >> 9, last_ea);
+	return test->area.dev_addr + i * (rw->sz >> 9);
+}
+
+/*
+ * Issue the transfers one at a time, each waiting for the previous one to
+ * complete, the way the block driver did without request pipelining.
+ */
+static int mmc_test_block_transfer(struct mmc_test_card *test,
+				   struct mmc_test_multiple_rw *rw)
+{
+	unsigned int i, last_ea = 0;
+	int ret;
+
+	for (i = 0; i < rw->cnt; i++) {
+		ret = mmc_test_area_transfer(test,
+				mmc_test_rw_addr(test, rw, i, &last_ea),
+				rw->write);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/*
+ * Issue the transfers with mmc_start_req(), which lets the host prepare
+ * each one while the previous one is still transferring.
+ */
+static int mmc_test_nonblock_transfer(struct mmc_test_card *test,
+				      struct mmc_test_multiple_rw *rw)
+{
+	struct mmc_test_area *t = &test->area;
+	struct mmc_test_async_req test_areq[2];
+	unsigned int i, last_ea = 0;
+	int ret = 0;
+
+	for (i = 0; i < rw->cnt; i++) {
+		/* the other one is in flight, this one has completed */
+		struct mmc_test_async_req *cur = &test_areq[i & 1];
+
+		mmc_test_init_async_req(test, cur);
+		mmc_test_prepare_mrq(test, &cur->mrq, t->sg, t->sg_len,
+				     mmc_test_rw_addr(test, rw, i, &last_ea),
+				     t->blocks, 512, rw->write);
+		mmc_start_req(test->card->host, &cur->areq, &ret);
+		if (ret)
+			return ret;
+	}
+
+	/* wait for the last one */
+	mmc_start_req(test->card->host, NULL, &ret);
+	return ret;
+}
+
+static int mmc_test_rw_multiple(struct mmc_test_card *test, unsigned long sz,
+				int write, int random, int nonblock)
+{
+	struct mmc_test_area *t = &test->area;
+	struct mmc_test_multiple_rw rw = {
+		.sz = sz,
+		.cnt = t->max_sz / sz,
+		.write = write,
+		.random = random,
+	};
+	struct timespec ts1, ts2;
+	int ret;
+
+	if (write && !random) {
+		ret = mmc_test_area_erase(test);
+		if (ret)
+			return ret;
+	}
+
+	ret = mmc_test_area_map(test, sz, 0);
+	if (ret)
+		return ret;
+
+	getnstimeofday(&ts1);
+	if (nonblock)
+		ret = mmc_test_nonblock_transfer(test, &rw);
+	else
+		ret = mmc_test_block_transfer(test, &rw);
+	if (ret)
+		return ret;
+	getnstimeofday(&ts2);
+
+	mmc_test_print_avg_rate(test, sz, rw.cnt, &ts1, &ts2);
+	return 0;
+}
+
+/*
+ * Performance by transfer size with and without request pipelining. The
+ * random address sequence starts over each time, so that the blocking and
+ * the non-blocking test cases time exactly the same I/O.
+ */
+static int mmc_test_profile_pipelining(struct mmc_test_card *test, int write,
+				       int random, int nonblock)
+{
+	struct mmc_test_area *t = &test->area;
+	unsigned long sz;
+	int ret;
+
+	rnd_next = 1;
+	for (sz = 512; sz < t->max_tfr; sz <<= 1) {
+		ret = mmc_test_rw_multiple(test, sz, write, random, nonblock);
+		if (ret)
+			return ret;
+	}
+	sz = t->max_tfr;
+	return mmc_test_rw_multiple(test, sz, write, random, nonblock);
+}
+
+static int mmc_test_seq_read_blocking(struct mmc_test_card *test)
+{
+	return mmc_test_profile_pipelining(test, 0, 0, 0);
+}
+
+static int mmc_test_seq_read_nonblocking(struct mmc_test_card *test)
+{
+	return mmc_test_profile_pipelining(test, 0, 0, 1);
+}
+
+static int mmc_test_seq_write_blocking(struct mmc_test_card *test)
+{
+	return mmc_test_profile_pipelining(test, 1, 0, 0);
+}
+
+static int mmc_test_seq_write_nonblocking(struct mmc_test_card *test)
+{
+	return mmc_test_profile_pipelining(test, 1, 0, 1);
+}
+
+static int mmc_test_rnd_read_blocking(struct mmc_test_card *test)
+{
+	return mmc_test_profile_pipelining(test, 0, 1, 0);
+}
+
+static int mmc_test_rnd_read_nonblocking(struct mmc_test_card *test)
+{
+	return mmc_test_profile_pipelining(test, 0, 1, 1);
+}
+
+static int mmc_test_rnd_write_blocking(struct mmc_test_card *test)
+{
+	return mmc_test_profile_pipelining(test, 1, 1, 0);
+}
+
+static int mmc_test_rnd_write_nonblocking(struct mmc_test_card *test)
+{
+	return mmc_test_profile_pipelining(test, 1, 1, 1);
+}
+
 static const struct mmc_test_case mmc_test_cases[] = {
 	{
 		.name = "Basic write (no data verification)",
@@ -2221,6 +2441,62 @@ static const struct mmc_test_case mmc_test_cases[] = {
 		.cleanup = mmc_test_area_cleanup,
 	},
 
+	{
+		.name = "Consecutive read performance, blocking requests",
+		.prepare = mmc_test_area_prepare_fill,
+		.run = mmc_test_seq_read_blocking,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Consecutive read performance, non-blocking requests",
+		.prepare = mmc_test_area_prepare_fill,
+		.run = mmc_test_seq_read_nonblocking,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Consecutive write performance, blocking requests",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_seq_write_blocking,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Consecutive write performance, non-blocking requests",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_seq_write_nonblocking,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Random read performance, blocking requests",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_rnd_read_blocking,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Random read performance, non-blocking requests",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_rnd_read_nonblocking,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Random write performance, blocking requests",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_rnd_write_blocking,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Random write performance, non-blocking requests",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_rnd_write_nonblocking,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
 };
 
 static DEFINE_MUTEX(mmc_test_lock);
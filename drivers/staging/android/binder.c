@@ -29,6 +29,7 @@
 #include <linux/poll.h>
 #include <linux/debugfs.h>
 #include <linux/rbtree.h>
+#include <linux/rwsem.h>
 #include <linux/sched.h>
 #include <linux/seq_file.h>
 #include <linux/slab.h>
@@ -36,10 +37,48 @@
 #include <linux/vmalloc.h>
 
 #include "binder.h"
+#include "binder_trace.h"
 
-static DEFINE_MUTEX(binder_lock);
+/*
+ * Locking
+ *
+ * binder_main_lock is held for writing by everything that changes the
+ * node/reference graph across processes or tears it down: reference
+ * count commands, death notifications, transactions carrying objects,
+ * setting the context manager, thread exit and process release. Holding
+ * it for writing excludes all other binder activity.
+ *
+ * The common operations -- transactions without objects, freeing their
+ * buffers, waiting for and reading work -- only hold it for reading,
+ * together with proc->lock of each process whose state they touch:
+ * threads, todo lists, transaction stacks, nodes and the buffer
+ * allocator all belong to a process. A transaction locks at most the
+ * sender and the target, so independent pairs of processes can transact
+ * concurrently. With binder_main_lock held for reading, a process and
+ * its nodes cannot go away and the reference trees do not change.
+ *
+ * Lock order:
+ *   binder_main_lock
+ *     proc->lock (at most two, lower address first)
+ *       mm->mmap_sem
+ *         binder_lru_lock, binder_deferred_lock (leaves)
+ *
+ * The global stats, the transaction logs and binder_last_id are
+ * updated atomically without any lock.
+ */
+static DECLARE_RWSEM(binder_main_lock);
 static DEFINE_MUTEX(binder_deferred_lock);
 
+/*
+ * Pages behind freed buffers stay mapped and are parked on binder_lru
+ * so that the next allocation covering them does not have to map them
+ * again. binder_shrink() gives them back under memory pressure.
+ */
+static DEFINE_SPINLOCK(binder_lru_lock);
+static LIST_HEAD(binder_lru);
+static int binder_lru_count;
+static unsigned long binder_lru_reclaimed;
+
 static HLIST_HEAD(binder_procs);
 static HLIST_HEAD(binder_deferred_list);
 static HLIST_HEAD(binder_dead_nodes);
@@ -48,7 +87,7 @@ static struct dentry *binder_debugfs_dir_entry_root;
 static struct dentry *binder_debugfs_dir_entry_proc;
 static struct binder_node *binder_context_mgr_node;
 static uid_t binder_context_mgr_uid = -1;
-static int binder_last_id;
+static atomic_t binder_last_id;
 static struct workqueue_struct *binder_deferred_workqueue;
 
 #define BINDER_DEBUG_ENTRY(name) \
@@ -147,22 +186,22 @@ enum binder_stat_types {
 };
 
 struct binder_stats {
-	int br[_IOC_NR(BR_FAILED_REPLY) + 1];
-	int bc[_IOC_NR(BC_DEAD_BINDER_DONE) + 1];
-	int obj_created[BINDER_STAT_COUNT];
-	int obj_deleted[BINDER_STAT_COUNT];
+	atomic_t br[_IOC_NR(BR_FAILED_REPLY) + 1];
+	atomic_t bc[_IOC_NR(BC_DEAD_BINDER_DONE) + 1];
+	atomic_t obj_created[BINDER_STAT_COUNT];
+	atomic_t obj_deleted[BINDER_STAT_COUNT];
 };
 
 static struct binder_stats binder_stats;
 
 static inline void binder_stats_deleted(enum binder_stat_types type)
 {
-	binder_stats.obj_deleted[type]++;
+	atomic_inc(&binder_stats.obj_deleted[type]);
 }
 
 static inline void binder_stats_created(enum binder_stat_types type)
 {
-	binder_stats.obj_created[type]++;
+	atomic_inc(&binder_stats.obj_created[type]);
 }
 
 struct binder_transaction_log_entry {
@@ -178,7 +217,7 @@ struct binder_transaction_log_entry {
 	int offsets_size;
 };
 struct binder_transaction_log {
-	int next;
+	atomic_t cur;
 	int full;
 	struct binder_transaction_log_entry entry[32];
 };
@@ -189,13 +228,12 @@ static struct binder_transaction_log_entry *binder_transaction_log_add(
 	struct binder_transaction_log *log)
 {
 	struct binder_transaction_log_entry *e;
-	e = &log->entry[log->next];
-	memset(e, 0, sizeof(*e));
-	log->next++;
-	if (log->next == ARRAY_SIZE(log->entry)) {
-		log->next = 0;
+	unsigned int cur = atomic_inc_return(&log->cur) - 1;
+
+	if (cur >= ARRAY_SIZE(log->entry))
 		log->full = 1;
-	}
+	e = &log->entry[cur % ARRAY_SIZE(log->entry)];
+	memset(e, 0, sizeof(*e));
 	return e;
 }
 
@@ -274,14 +312,34 @@ struct binder_buffer {
 	uint8_t data[0];
 };
 
+struct binder_lru_page {
+	struct list_head lru;		/* on binder_lru while unused */
+	struct page *page_ptr;
+	struct binder_proc *proc;
+};
+
 enum binder_deferred_state {
 	BINDER_DEFERRED_PUT_FILES    = 0x01,
 	BINDER_DEFERRED_FLUSH        = 0x02,
 	BINDER_DEFERRED_RELEASE      = 0x04,
 };
 
+/*
+ * log2 histogram of latencies in microseconds: bucket 0 counts those
+ * below 1us, bucket n those in [2^(n-1), 2^n)us and the last one all
+ * longer ones.
+ */
+#define BINDER_LATENCY_BUCKETS	24
+
+struct binder_latency_hist {
+	unsigned int count;
+	unsigned int bucket[BINDER_LATENCY_BUCKETS];
+	s64 max_us;
+};
+
 struct binder_proc {
 	struct hlist_node proc_node;
+	struct mutex lock;
 	struct rb_root threads;
 	struct rb_root nodes;
 	struct rb_root refs_by_desc;
@@ -300,9 +358,14 @@ struct binder_proc {
 	struct rb_root allocated_buffers;
 	size_t free_async_space;
 
-	struct page **pages;
+	struct binder_lru_page *pages;
 	size_t buffer_size;
 	uint32_t buffer_free;
+	size_t buffer_allocated;	/* bytes handed out to transactions */
+	size_t buffer_allocated_max;	/* high-water mark of the above */
+	int pages_mapped;		/* pages backing the buffer area */
+	int pages_lru;			/* ... of which unused, on binder_lru */
+	unsigned long pages_reused;	/* allocations served from the LRU */
 	struct list_head todo;
 	wait_queue_head_t wait;
 	struct binder_stats stats;
@@ -313,6 +376,10 @@ struct binder_proc {
 	int ready_threads;
 	long default_priority;
 	struct dentry *debugfs_entry;
+	/* protected by proc->lock like the rest */
+	struct binder_latency_hist queue_latency; /* send -> dequeue here */
+	struct binder_latency_hist service_time; /* dequeue here -> reply */
+	struct binder_latency_hist round_trip;	/* call from here -> reply */
 };
 
 enum {
@@ -339,6 +406,16 @@ struct binder_thread {
 	struct binder_stats stats;
 };
 
+/*
+ * Scheduling policy and priority of a thread. prio is in the scale of
+ * task->normal_prio: 0..MAX_RT_PRIO-1 for the real-time policies,
+ * MAX_RT_PRIO..MAX_PRIO-1 for the nice levels; lower is higher.
+ */
+struct binder_priority {
+	unsigned int sched_policy;
+	int prio;
+};
+
 struct binder_transaction {
 	int debug_id;
 	struct binder_work work;
@@ -353,9 +430,12 @@ struct binder_transaction {
 	struct binder_buffer *buffer;
 	unsigned int	code;
 	unsigned int	flags;
-	long	priority;
-	long	saved_priority;
+	struct binder_priority	priority;	/* of the sender */
+	struct binder_priority	saved_priority;	/* of the target thread */
 	uid_t	sender_euid;
+	ktime_t	start_time;	/* queued for the target */
+	ktime_t	dequeue_time;	/* picked up by the target thread */
+	ktime_t	request_time;	/* replies: start_time of the request */
 };
 
 static void
@@ -516,6 +596,74 @@ static void binder_set_nice(long nice)
 	binder_user_error("binder: %d RLIMIT_NICE not set\n", current->pid);
 }
 
+static bool binder_is_rt_policy(unsigned int policy)
+{
+	return policy == SCHED_FIFO || policy == SCHED_RR;
+}
+
+static struct binder_priority binder_get_priority(void)
+{
+	struct binder_priority p;
+
+	p.sched_policy = current->policy;
+	p.prio = current->normal_prio;
+	return p;
+}
+
+/*
+ * Switch the current thread to the given policy and priority. Real-time
+ * priorities are only ever set on behalf of a caller that runs with
+ * them, so permission checks are skipped; nice values keep honouring
+ * RLIMIT_NICE through binder_set_nice().
+ */
+static void binder_set_priority(struct binder_priority p)
+{
+	struct sched_param params;
+
+	if (current->policy == p.sched_policy && current->normal_prio == p.prio)
+		return;
+
+	if (binder_is_rt_policy(p.sched_policy)) {
+		params.sched_priority = MAX_USER_RT_PRIO - 1 - p.prio;
+		sched_setscheduler_nocheck(current, p.sched_policy, &params);
+		return;
+	}
+	if (current->policy != p.sched_policy) {
+		params.sched_priority = 0;
+		sched_setscheduler_nocheck(current, p.sched_policy, &params);
+	}
+	binder_set_nice(p.prio - DEFAULT_PRIO);
+}
+
+/*
+ * Priority for the thread handling t on node: synchronous transactions
+ * run with the policy and priority of the caller, or the node's minimum
+ * priority if that is higher. One-way transactions only get raised to
+ * the node's minimum. Node minimum priorities are nice values, those
+ * outside 0..19 are ignored.
+ */
+static void binder_transaction_priority(struct binder_transaction *t,
+					struct binder_node *node)
+{
+	struct binder_priority desired = t->priority;
+	struct binder_priority node_prio;
+
+	if (node->min_priority <= 19) {
+		node_prio.sched_policy = SCHED_NORMAL;
+		node_prio.prio = DEFAULT_PRIO + node->min_priority;
+	} else
+		node_prio = t->saved_priority;
+
+	if (t->flags & TF_ONE_WAY) {
+		if (node_prio.prio >= t->saved_priority.prio)
+			return;
+		desired = node_prio;
+	} else if (node_prio.prio < desired.prio)
+		desired = node_prio;
+
+	binder_set_priority(desired);
+}
+
 static size_t binder_buffer_size(struct binder_proc *proc,
 				 struct binder_buffer *buffer)
 {
@@ -608,6 +756,56 @@ static struct binder_buffer *binder_buffer_lookup(struct binder_proc *proc,
 	return NULL;
 }
 
+static struct binder_lru_page *binder_lru_page(struct binder_proc *proc,
+						void *page_addr)
+{
+	return &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
+}
+
+static void binder_lru_add(struct binder_lru_page *page)
+{
+	spin_lock(&binder_lru_lock);
+	if (list_empty(&page->lru)) {
+		list_add_tail(&page->lru, &binder_lru);
+		binder_lru_count++;
+		page->proc->pages_lru++;
+	}
+	spin_unlock(&binder_lru_lock);
+}
+
+static bool binder_lru_del(struct binder_lru_page *page)
+{
+	bool on_lru;
+
+	spin_lock(&binder_lru_lock);
+	on_lru = !list_empty(&page->lru);
+	if (on_lru) {
+		list_del_init(&page->lru);
+		binder_lru_count--;
+		page->proc->pages_lru--;
+	}
+	spin_unlock(&binder_lru_lock);
+
+	return on_lru;
+}
+
+/* Unmap a page from the kernel (and from userspace, if vma) and free it */
+static void binder_free_page(struct binder_lru_page *page,
+			     struct vm_area_struct *vma)
+{
+	struct binder_proc *proc = page->proc;
+	void *page_addr = proc->buffer +
+		(page - proc->pages) * PAGE_SIZE;
+
+	if (vma)
+		zap_page_range(vma, (uintptr_t)page_addr +
+			proc->user_buffer_offset, PAGE_SIZE, NULL);
+	unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
+	__free_page(page->page_ptr);
+	page->page_ptr = NULL;
+	proc->pages_mapped--;
+}
+
 static int binder_update_page_range(struct binder_proc *proc, int allocate,
 				    void *start, void *end,
 				    struct vm_area_struct *vma)
@@ -615,8 +813,10 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	void *page_addr;
 	unsigned long user_page_addr;
 	struct vm_struct tmp_area;
-	struct page **page;
-	struct mm_struct *mm;
+	struct binder_lru_page *page;
+	struct mm_struct *mm = NULL;
+	bool need_map = false;
+	int ret = 0;
 
 	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "binder: %d: %s pages %p-%p\n", proc->pid,
@@ -625,18 +825,32 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	if (end <= start)
 		return 0;
 
-	if (vma)
-		mm = NULL;
-	else
-		mm = get_task_mm(proc->tsk);
+	if (allocate == 0)
+		goto free_range;
 
-	if (mm) {
-		down_write(&mm->mmap_sem);
-		vma = proc->vma;
+	/*
+	 * Pages left behind by earlier buffers are still mapped, they
+	 * only have to be taken off the LRU.
+	 */
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		page = binder_lru_page(proc, page_addr);
+		if (page->page_ptr) {
+			if (binder_lru_del(page))
+				proc->pages_reused++;
+		} else {
+			need_map = true;
+		}
 	}
+	if (!need_map)
+		return 0;
 
-	if (allocate == 0)
-		goto free_range;
+	if (vma == NULL) {
+		mm = get_task_mm(proc->tsk);
+		if (mm) {
+			down_write(&mm->mmap_sem);
+			vma = proc->vma;
+		}
+	}
 
 	if (vma == NULL) {
 		binder_debug(BINDER_DEBUG_TOP_ERRORS,
@@ -646,13 +860,14 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	}
 
 	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
-		int ret;
 		struct page **page_array_ptr;
-		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
+		page = binder_lru_page(proc, page_addr);
 
-		BUG_ON(*page);
-		*page = alloc_page(GFP_KERNEL | __GFP_ZERO);
-		if (*page == NULL) {
+		if (page->page_ptr)
+			continue;
+
+		page->page_ptr = alloc_page(GFP_KERNEL | __GFP_ZERO);
+		if (page->page_ptr == NULL) {
 			binder_debug(BINDER_DEBUG_TOP_ERRORS,
 			       "binder: %d: binder_alloc_buf failed "
 			       "for page at %p\n", proc->pid, page_addr);
@@ -660,7 +875,7 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		}
 		tmp_area.addr = page_addr;
 		tmp_area.size = PAGE_SIZE + PAGE_SIZE /* guard page? */;
-		page_array_ptr = page;
+		page_array_ptr = &page->page_ptr;
 		ret = map_vm_area(&tmp_area, PAGE_KERNEL, &page_array_ptr);
 		if (ret) {
 			binder_debug(BINDER_DEBUG_TOP_ERRORS,
@@ -671,7 +886,7 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		}
 		user_page_addr =
 			(uintptr_t)page_addr + proc->user_buffer_offset;
-		ret = vm_insert_page(vma, user_page_addr, page[0]);
+		ret = vm_insert_page(vma, user_page_addr, page->page_ptr);
 		if (ret) {
 			binder_debug(BINDER_DEBUG_TOP_ERRORS,
 			       "binder: %d: binder_alloc_buf failed "
@@ -680,6 +895,7 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 			goto err_vm_insert_page_failed;
 		}
 		/* vm_insert_page does not seem to increment the refcount */
+		proc->pages_mapped++;
 	}
 	if (mm) {
 		up_write(&mm->mmap_sem);
@@ -687,29 +903,100 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	}
 	return 0;
 
-free_range:
-	for (page_addr = end - PAGE_SIZE; page_addr >= start;
-	     page_addr -= PAGE_SIZE) {
-		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
-		if (vma)
-			zap_page_range(vma, (uintptr_t)page_addr +
-				proc->user_buffer_offset, PAGE_SIZE, NULL);
 err_vm_insert_page_failed:
-		unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
+	unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
 err_map_kernel_failed:
-		__free_page(*page);
-		*page = NULL;
+	__free_page(page->page_ptr);
+	page->page_ptr = NULL;
 err_alloc_page_failed:
-		;
-	}
 err_no_vma:
 	if (mm) {
 		up_write(&mm->mmap_sem);
 		mmput(mm);
 	}
-	return -ENOMEM;
+	/* Pages already mapped for this range go back to the LRU */
+	ret = -ENOMEM;
+
+free_range:
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		page = binder_lru_page(proc, page_addr);
+		if (page->page_ptr)
+			binder_lru_add(page);
+	}
+	return ret;
+}
+
+/*
+ * Release unused pages from the front (least recently freed end) of
+ * binder_lru. Page state is otherwise only changed under the lock of
+ * the owning process, which we must not wait for here: allocations
+ * made while holding it may be what got us into reclaim.
+ */
+static int binder_shrink(struct shrinker *s, struct shrink_control *sc)
+{
+	struct binder_lru_page *page;
+	struct binder_proc *proc;
+	struct mm_struct *mm;
+	unsigned long scanned = 0;
+
+	if (!sc->nr_to_scan)
+		return binder_lru_count;
+
+	/* Keeps the processes owning the pages alive */
+	if (!down_read_trylock(&binder_main_lock))
+		return -1;
+
+	while (scanned++ < sc->nr_to_scan) {
+		spin_lock(&binder_lru_lock);
+		if (list_empty(&binder_lru)) {
+			spin_unlock(&binder_lru_lock);
+			break;
+		}
+		page = list_first_entry(&binder_lru, struct binder_lru_page,
+					lru);
+		proc = page->proc;
+		spin_unlock(&binder_lru_lock);
+
+		if (!mutex_trylock(&proc->lock))
+			break;
+		/* Reused while we were not holding binder_lru_lock? */
+		if (!binder_lru_del(page)) {
+			mutex_unlock(&proc->lock);
+			continue;
+		}
+
+		mm = get_task_mm(proc->tsk);
+		if (mm && !down_read_trylock(&mm->mmap_sem)) {
+			/* Try again later, keep it as the oldest page */
+			mmput(mm);
+			spin_lock(&binder_lru_lock);
+			list_add(&page->lru, &binder_lru);
+			binder_lru_count++;
+			proc->pages_lru++;
+			spin_unlock(&binder_lru_lock);
+			mutex_unlock(&proc->lock);
+			break;
+		}
+
+		binder_free_page(page, mm ? proc->vma : NULL);
+		binder_lru_reclaimed++;
+
+		if (mm) {
+			up_read(&mm->mmap_sem);
+			mmput(mm);
+		}
+		mutex_unlock(&proc->lock);
+	}
+	up_read(&binder_main_lock);
+
+	return binder_lru_count;
 }
 
+static struct shrinker binder_shrinker = {
+	.shrink = binder_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
 static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 					      size_t data_size,
 					      size_t offsets_size, int is_async)
@@ -807,6 +1094,9 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 	buffer->data_size = data_size;
 	buffer->offsets_size = offsets_size;
 	buffer->async_transaction = is_async;
+	proc->buffer_allocated += size;
+	if (proc->buffer_allocated > proc->buffer_allocated_max)
+		proc->buffer_allocated_max = proc->buffer_allocated;
 	if (is_async) {
 		proc->free_async_space -= size + sizeof(struct binder_buffer);
 		binder_debug(BINDER_DEBUG_BUFFER_ALLOC_ASYNC,
@@ -895,6 +1185,8 @@ static void binder_free_buf(struct binder_proc *proc,
 	BUG_ON((void *)buffer < proc->buffer);
 	BUG_ON((void *)buffer > proc->buffer + proc->buffer_size);
 
+	proc->buffer_allocated -= size;
+
 	if (buffer->async_transaction) {
 		proc->free_async_space += size + sizeof(struct binder_buffer);
 
@@ -975,7 +1267,7 @@ static struct binder_node *binder_new_node(struct binder_proc *proc,
 	binder_stats_created(BINDER_STAT_NODE);
 	rb_link_node(&node->rb_node, parent, p);
 	rb_insert_color(&node->rb_node, &proc->nodes);
-	node->debug_id = ++binder_last_id;
+	node->debug_id = atomic_inc_return(&binder_last_id);
 	node->proc = proc;
 	node->ptr = ptr;
 	node->cookie = cookie;
@@ -1112,7 +1404,7 @@ static struct binder_ref *binder_get_ref_for_node(struct binder_proc *proc,
 	if (new_ref == NULL)
 		return NULL;
 	binder_stats_created(BINDER_STAT_REF);
-	new_ref->debug_id = ++binder_last_id;
+	new_ref->debug_id = atomic_inc_return(&binder_last_id);
 	new_ref->proc = proc;
 	new_ref->node = node;
 	rb_link_node(&new_ref->rb_node_node, parent, p);
@@ -1395,6 +1687,68 @@ static void binder_transaction_buffer_release(struct binder_proc *proc,
 	}
 }
 
+static s64 binder_latency_add(struct binder_latency_hist *hist,
+			      ktime_t start, ktime_t now)
+{
+	s64 us = ktime_us_delta(now, start);
+	int i = 0;
+
+	if (us > 0)
+		i = min_t(int, fls64(us), BINDER_LATENCY_BUCKETS - 1);
+	hist->bucket[i]++;
+	hist->count++;
+	if (us > hist->max_us)
+		hist->max_us = us;
+	return us;
+}
+
+/*
+ * Called with binder_main_lock held for reading and proc->lock held.
+ * Trade both for binder_main_lock held for writing, and back. Anything
+ * looked up under proc->lock must be looked up again afterwards.
+ */
+static void binder_lock_exclusive(struct binder_proc *proc)
+{
+	mutex_unlock(&proc->lock);
+	up_read(&binder_main_lock);
+	down_write(&binder_main_lock);
+}
+
+static void binder_unlock_exclusive(struct binder_proc *proc)
+{
+	downgrade_write(&binder_main_lock);
+	mutex_lock(&proc->lock);
+}
+
+/*
+ * Lock a second process while holding proc->lock, honouring the
+ * address order. proc->lock may be dropped and retaken meanwhile, which
+ * is safe for the sender of a transaction: its own transaction stack is
+ * only changed by itself or with binder_main_lock held for writing.
+ */
+static void binder_lock_target(struct binder_proc *proc,
+			       struct binder_proc *target)
+{
+	if (target == proc)
+		return;
+	if (target > proc) {
+		mutex_lock_nested(&target->lock, SINGLE_DEPTH_NESTING);
+		return;
+	}
+	if (mutex_trylock(&target->lock))
+		return;
+	mutex_unlock(&proc->lock);
+	mutex_lock(&target->lock);
+	mutex_lock_nested(&proc->lock, SINGLE_DEPTH_NESTING);
+}
+
+static void binder_unlock_target(struct binder_proc *proc,
+				 struct binder_proc *target)
+{
+	if (target != proc)
+		mutex_unlock(&target->lock);
+}
+
 static void binder_transaction(struct binder_proc *proc,
 			       struct binder_thread *thread,
 			       struct binder_transaction_data *tr, int reply)
@@ -1428,7 +1782,7 @@ static void binder_transaction(struct binder_proc *proc,
 			return_error = BR_FAILED_REPLY;
 			goto err_empty_call_stack;
 		}
-		binder_set_nice(in_reply_to->saved_priority);
+		binder_set_priority(in_reply_to->saved_priority);
 		if (in_reply_to->to_thread != thread) {
 			binder_user_error("binder: %d:%d got reply transaction "
 				"with bad transaction stack,"
@@ -1533,7 +1887,7 @@ static void binder_transaction(struct binder_proc *proc,
 	}
 	binder_stats_created(BINDER_STAT_TRANSACTION_COMPLETE);
 
-	t->debug_id = ++binder_last_id;
+	t->debug_id = atomic_inc_return(&binder_last_id);
 	e->debug_id = t->debug_id;
 
 	if (reply)
@@ -1562,7 +1916,7 @@ static void binder_transaction(struct binder_proc *proc,
 	t->to_thread = target_thread;
 	t->code = tr->code;
 	t->flags = tr->flags;
-	t->priority = task_nice(current);
+	t->priority = binder_get_priority();
 	t->buffer = binder_alloc_buf(target_proc, tr->data_size,
 		tr->offsets_size, !reply && (t->flags & TF_ONE_WAY));
 	if (t->buffer == NULL) {
@@ -1757,8 +2111,14 @@ static void binder_transaction(struct binder_proc *proc,
 			goto err_bad_object_type;
 		}
 	}
+	t->start_time = ktime_get();
 	if (reply) {
 		BUG_ON(t->buffer->async_transaction != 0);
+		t->request_time = in_reply_to->start_time;
+		trace_binder_reply(in_reply_to,
+			binder_latency_add(&proc->service_time,
+					   in_reply_to->dequeue_time,
+					   t->start_time));
 		binder_pop_transaction(target_thread, in_reply_to);
 	} else if (!(t->flags & TF_ONE_WAY)) {
 		BUG_ON(t->buffer->async_transaction != 0);
@@ -1774,6 +2134,7 @@ static void binder_transaction(struct binder_proc *proc,
 		} else
 			target_node->has_async_transaction = 1;
 	}
+	trace_binder_transaction(reply, t, target_node);
 	t->work.type = BINDER_WORK_TRANSACTION;
 	list_add_tail(&t->work.entry, target_list);
 	tcomplete->type = BINDER_WORK_TRANSACTION_COMPLETE;
@@ -1825,21 +2186,82 @@ err_no_context_mgr_node:
 		thread->return_error = return_error;
 }
 
+/*
+ * Find the process a transaction goes to, the same way
+ * binder_transaction() does. Returns NULL if there is none (or the
+ * reply goes to a thread that is gone), which binder_transaction()
+ * will report.
+ */
+static struct binder_proc *
+binder_transaction_target(struct binder_proc *proc,
+			  struct binder_thread *thread,
+			  struct binder_transaction_data *tr, int reply)
+{
+	struct binder_node *node;
+
+	if (reply) {
+		struct binder_transaction *t = thread->transaction_stack;
+
+		if (t == NULL || t->to_thread != thread || t->from == NULL)
+			return NULL;
+		return t->from->proc;
+	}
+	if (tr->target.handle) {
+		struct binder_ref *ref = binder_get_ref(proc, tr->target.handle);
+
+		node = ref ? ref->node : NULL;
+	} else
+		node = binder_context_mgr_node;
+	return node ? node->proc : NULL;
+}
+
+/*
+ * Transactions that carry objects change the reference graph of both
+ * processes and run with binder_main_lock held for writing, as do the
+ * failing ones. All others only need the sender and the target locked.
+ */
+static void binder_transaction_locked(struct binder_proc *proc,
+				      struct binder_thread *thread,
+				      struct binder_transaction_data *tr,
+				      int reply)
+{
+	struct binder_proc *target_proc = NULL;
+
+	if (!tr->offsets_size)
+		target_proc = binder_transaction_target(proc, thread, tr,
+							reply);
+	if (target_proc == NULL) {
+		binder_lock_exclusive(proc);
+		binder_transaction(proc, thread, tr, reply);
+		binder_unlock_exclusive(proc);
+		return;
+	}
+	binder_lock_target(proc, target_proc);
+	binder_transaction(proc, thread, tr, reply);
+	binder_unlock_target(proc, target_proc);
+}
+
+/*
+ * Called with binder_main_lock held for reading and proc->lock held.
+ * Commands that change references or death notifications switch to
+ * exclusive mode for their duration.
+ */
 int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 			void __user *buffer, int size, signed long *consumed)
 {
 	uint32_t cmd;
 	void __user *ptr = buffer + *consumed;
 	void __user *end = buffer + size;
+	bool exclusive = false;
 
 	while (ptr < end && thread->return_error == BR_OK) {
 		if (get_user(cmd, (uint32_t __user *)ptr))
 			return -EFAULT;
 		ptr += sizeof(uint32_t);
 		if (_IOC_NR(cmd) < ARRAY_SIZE(binder_stats.bc)) {
-			binder_stats.bc[_IOC_NR(cmd)]++;
-			proc->stats.bc[_IOC_NR(cmd)]++;
-			thread->stats.bc[_IOC_NR(cmd)]++;
+			atomic_inc(&binder_stats.bc[_IOC_NR(cmd)]);
+			atomic_inc(&proc->stats.bc[_IOC_NR(cmd)]);
+			atomic_inc(&thread->stats.bc[_IOC_NR(cmd)]);
 		}
 		switch (cmd) {
 		case BC_INCREFS:
@@ -1853,6 +2275,8 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 			if (get_user(target, (uint32_t __user *)ptr))
 				return -EFAULT;
 			ptr += sizeof(uint32_t);
+			binder_lock_exclusive(proc);
+			exclusive = true;
 			if (target == 0 && binder_context_mgr_node &&
 			    (cmd == BC_INCREFS || cmd == BC_ACQUIRE)) {
 				ref = binder_get_ref_for_node(proc,
@@ -1982,6 +2406,12 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 			ptr += sizeof(void *);
 
 			buffer = binder_buffer_lookup(proc, data_ptr);
+			if (buffer && buffer->offsets_size) {
+				/* Releasing objects changes other processes */
+				binder_lock_exclusive(proc);
+				exclusive = true;
+				buffer = binder_buffer_lookup(proc, data_ptr);
+			}
 			if (buffer == NULL) {
 				binder_user_error("binder: %d:%d "
 					"BC_FREE_BUFFER u%p no match\n",
@@ -2025,7 +2455,8 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 			if (copy_from_user(&tr, ptr, sizeof(tr)))
 				return -EFAULT;
 			ptr += sizeof(tr);
-			binder_transaction(proc, thread, &tr, cmd == BC_REPLY);
+			binder_transaction_locked(proc, thread, &tr,
+						  cmd == BC_REPLY);
 			break;
 		}
 
@@ -2084,6 +2515,8 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 			if (get_user(cookie, (void __user * __user *)ptr))
 				return -EFAULT;
 			ptr += sizeof(void *);
+			binder_lock_exclusive(proc);
+			exclusive = true;
 			ref = binder_get_ref(proc, target);
 			if (ref == NULL) {
 				binder_user_error("binder: %d:%d %s "
@@ -2218,6 +2651,10 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 			       proc->pid, thread->pid, cmd);
 			return -EINVAL;
 		}
+		if (exclusive) {
+			binder_unlock_exclusive(proc);
+			exclusive = false;
+		}
 		*consumed = ptr - buffer;
 	}
 	return 0;
@@ -2227,9 +2664,9 @@ void binder_stat_br(struct binder_proc *proc, struct binder_thread *thread,
 		    uint32_t cmd)
 {
 	if (_IOC_NR(cmd) < ARRAY_SIZE(binder_stats.br)) {
-		binder_stats.br[_IOC_NR(cmd)]++;
-		proc->stats.br[_IOC_NR(cmd)]++;
-		thread->stats.br[_IOC_NR(cmd)]++;
+		atomic_inc(&binder_stats.br[_IOC_NR(cmd)]);
+		atomic_inc(&proc->stats.br[_IOC_NR(cmd)]);
+		atomic_inc(&thread->stats.br[_IOC_NR(cmd)]);
 	}
 }
 
@@ -2256,6 +2693,7 @@ static int binder_thread_read(struct binder_proc *proc,
 
 	int ret = 0;
 	int wait_for_proc_work;
+	ktime_t wait_start;
 
 	if (*consumed == 0) {
 		if (put_user(BR_NOOP, (uint32_t __user *)ptr))
@@ -2284,10 +2722,15 @@ retry:
 	}
 
 
+	trace_binder_wait_for_work(wait_for_proc_work,
+				   !!thread->transaction_stack,
+				   !list_empty(&thread->todo));
+	wait_start = ktime_get();
 	thread->looper |= BINDER_LOOPER_STATE_WAITING;
 	if (wait_for_proc_work)
 		proc->ready_threads++;
-	mutex_unlock(&binder_lock);
+	mutex_unlock(&proc->lock);
+	up_read(&binder_main_lock);
 	if (wait_for_proc_work) {
 		if (!(thread->looper & (BINDER_LOOPER_STATE_REGISTERED |
 					BINDER_LOOPER_STATE_ENTERED))) {
@@ -2311,7 +2754,10 @@ retry:
 		} else
 			ret = wait_event_interruptible(thread->wait, binder_has_thread_work(thread));
 	}
-	mutex_lock(&binder_lock);
+	trace_binder_wakeup(wait_for_proc_work, ret,
+			    ktime_us_delta(ktime_get(), wait_start));
+	down_read(&binder_main_lock);
+	mutex_lock(&proc->lock);
 	if (wait_for_proc_work)
 		proc->ready_threads--;
 	thread->looper &= ~BINDER_LOOPER_STATE_WAITING;
@@ -2461,13 +2907,8 @@ retry:
 			struct binder_node *target_node = t->buffer->target_node;
 			tr.target.ptr = target_node->ptr;
 			tr.cookie =  target_node->cookie;
-			t->saved_priority = task_nice(current);
-			if (t->priority < target_node->min_priority &&
-			    !(t->flags & TF_ONE_WAY))
-				binder_set_nice(t->priority);
-			else if (!(t->flags & TF_ONE_WAY) ||
-				 t->saved_priority > target_node->min_priority)
-				binder_set_nice(target_node->min_priority);
+			t->saved_priority = binder_get_priority();
+			binder_transaction_priority(t, target_node);
 			cmd = BR_TRANSACTION;
 		} else {
 			tr.target.ptr = NULL;
@@ -2478,6 +2919,14 @@ retry:
 		tr.flags = t->flags;
 		tr.sender_euid = t->sender_euid;
 
+		t->dequeue_time = ktime_get();
+		trace_binder_transaction_received(t,
+			binder_latency_add(&proc->queue_latency,
+					   t->start_time, t->dequeue_time));
+		if (cmd == BR_REPLY)
+			binder_latency_add(&proc->round_trip, t->request_time,
+					   t->dequeue_time);
+
 		if (t->from) {
 			struct task_struct *sender = t->from->proc->tsk;
 			tr.sender_pid = task_tgid_nr_ns(sender,
@@ -2653,12 +3102,14 @@ static unsigned int binder_poll(struct file *filp,
 	struct binder_thread *thread = NULL;
 	int wait_for_proc_work;
 
-	mutex_lock(&binder_lock);
+	down_read(&binder_main_lock);
+	mutex_lock(&proc->lock);
 	thread = binder_get_thread(proc);
 
 	wait_for_proc_work = thread->transaction_stack == NULL &&
 		list_empty(&thread->todo) && thread->return_error == BR_OK;
-	mutex_unlock(&binder_lock);
+	mutex_unlock(&proc->lock);
+	up_read(&binder_main_lock);
 
 	if (wait_for_proc_work) {
 		if (binder_has_proc_work(proc, thread))
@@ -2683,6 +3134,7 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	struct binder_thread *thread;
 	unsigned int size = _IOC_SIZE(cmd);
 	void __user *ubuf = (void __user *)arg;
+	bool exclusive = false;
 
 	/*binder_debug(BINDER_DEBUG_TOP_ERRORS, "binder_ioctl: %d:%d %x %lx\n",
 					proc->pid, current->pid, cmd, arg);*/
@@ -2692,7 +3144,8 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	if (ret)
 		return ret;
 
-	mutex_lock(&binder_lock);
+	down_read(&binder_main_lock);
+	mutex_lock(&proc->lock);
 	thread = binder_get_thread(proc);
 	if (thread == NULL) {
 		ret = -ENOMEM;
@@ -2752,6 +3205,8 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		}
 		break;
 	case BINDER_SET_CONTEXT_MGR:
+		binder_lock_exclusive(proc);
+		exclusive = true;
 		if (binder_context_mgr_node != NULL) {
 			binder_debug(BINDER_DEBUG_TOP_ERRORS,
 				"binder: BINDER_SET_CONTEXT_MGR already set\n");
@@ -2783,6 +3238,8 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	case BINDER_THREAD_EXIT:
 		binder_debug(BINDER_DEBUG_THREADS, "binder: %d:%d exit\n",
 			     proc->pid, thread->pid);
+		binder_lock_exclusive(proc);
+		exclusive = true;
 		binder_free_thread(proc, thread);
 		thread = NULL;
 		break;
@@ -2804,7 +3261,12 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 err:
 	if (thread)
 		thread->looper &= ~BINDER_LOOPER_STATE_NEED_RETURN;
-	mutex_unlock(&binder_lock);
+	if (exclusive) {
+		up_write(&binder_main_lock);
+	} else {
+		mutex_unlock(&proc->lock);
+		up_read(&binder_main_lock);
+	}
 	wait_event_interruptible(binder_user_error_wait, binder_stop_on_user_error < 2);
 	if (ret && ret != -ERESTARTSYS)
 		binder_debug(BINDER_DEBUG_TOP_ERRORS,
@@ -2843,7 +3305,7 @@ static struct vm_operations_struct binder_vm_ops = {
 
 static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 {
-	int ret;
+	int ret, i;
 	struct vm_struct *area;
 	struct binder_proc *proc = filp->private_data;
 	const char *failure_string;
@@ -2897,6 +3359,10 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 		goto err_alloc_pages_failed;
 	}
 	proc->buffer_size = vma->vm_end - vma->vm_start;
+	for (i = 0; i < proc->buffer_size / PAGE_SIZE; i++) {
+		INIT_LIST_HEAD(&proc->pages[i].lru);
+		proc->pages[i].proc = proc;
+	}
 
 	vma->vm_ops = &binder_vm_ops;
 	vma->vm_private_data = proc;
@@ -2951,13 +3417,14 @@ static int binder_open(struct inode *nodp, struct file *filp)
 	INIT_LIST_HEAD(&proc->todo);
 	init_waitqueue_head(&proc->wait);
 	proc->default_priority = task_nice(current);
-	mutex_lock(&binder_lock);
+	mutex_init(&proc->lock);
+	down_write(&binder_main_lock);
 	binder_stats_created(BINDER_STAT_PROC);
 	hlist_add_head(&proc->proc_node, &binder_procs);
 	proc->pid = current->group_leader->pid;
 	INIT_LIST_HEAD(&proc->delivered_death);
 	filp->private_data = proc;
-	mutex_unlock(&binder_lock);
+	up_write(&binder_main_lock);
 
 	if (binder_debugfs_dir_entry_proc) {
 		char strbuf[11];
@@ -3102,16 +3569,15 @@ static void binder_deferred_release(struct binder_proc *proc)
 	if (proc->pages) {
 		int i;
 		for (i = 0; i < proc->buffer_size / PAGE_SIZE; i++) {
-			if (proc->pages[i]) {
-				void *page_addr = proc->buffer + i * PAGE_SIZE;
-				binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
-					     "binder_release: %d: "
-					     "page %d at %p not freed\n",
-					     proc->pid, i,
-					     page_addr);
-				unmap_kernel_range((unsigned long)page_addr,
-					PAGE_SIZE);
-				__free_page(proc->pages[i]);
+			if (proc->pages[i].page_ptr) {
+				/* Unused pages are expected to be cached */
+				if (!binder_lru_del(&proc->pages[i]))
+					binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
+						     "binder_release: %d: "
+						     "page %d at %p not freed\n",
+						     proc->pid, i, proc->buffer +
+						     i * PAGE_SIZE);
+				binder_free_page(&proc->pages[i], NULL);
 				page_count++;
 			}
 		}
@@ -3138,7 +3604,7 @@ static void binder_deferred_func(struct work_struct *work)
 
 	int defer;
 	do {
-		mutex_lock(&binder_lock);
+		down_write(&binder_main_lock);
 		mutex_lock(&binder_deferred_lock);
 		if (!hlist_empty(&binder_deferred_list)) {
 			proc = hlist_entry(binder_deferred_list.first,
@@ -3165,7 +3631,7 @@ static void binder_deferred_func(struct work_struct *work)
 		if (defer & BINDER_DEFERRED_RELEASE)
 			binder_deferred_release(proc); /* frees proc */
 
-		mutex_unlock(&binder_lock);
+		up_write(&binder_main_lock);
 		if (files)
 			put_files_struct(files);
 	} while (proc);
@@ -3189,13 +3655,14 @@ static void print_binder_transaction(struct seq_file *m, const char *prefix,
 				     struct binder_transaction *t)
 {
 	seq_printf(m,
-		   "%s %d: %p from %d:%d to %d:%d code %x flags %x pri %ld r%d",
+		   "%s %d: %p from %d:%d to %d:%d code %x flags %x pri %u:%d r%d",
 		   prefix, t->debug_id, t,
 		   t->from ? t->from->proc->pid : 0,
 		   t->from ? t->from->pid : 0,
 		   t->to_proc ? t->to_proc->pid : 0,
 		   t->to_thread ? t->to_thread->pid : 0,
-		   t->code, t->flags, t->priority, t->need_reply);
+		   t->code, t->flags, t->priority.sched_policy,
+		   t->priority.prio, t->need_reply);
 	if (t->buffer == NULL) {
 		seq_puts(m, " buffer free\n");
 		return;
@@ -3418,17 +3885,21 @@ static void print_binder_stats(struct seq_file *m, const char *prefix,
 	BUILD_BUG_ON(ARRAY_SIZE(stats->bc) !=
 		     ARRAY_SIZE(binder_command_strings));
 	for (i = 0; i < ARRAY_SIZE(stats->bc); i++) {
-		if (stats->bc[i])
+		int temp = atomic_read(&stats->bc[i]);
+
+		if (temp)
 			seq_printf(m, "%s%s: %d\n", prefix,
-				   binder_command_strings[i], stats->bc[i]);
+				   binder_command_strings[i], temp);
 	}
 
 	BUILD_BUG_ON(ARRAY_SIZE(stats->br) !=
 		     ARRAY_SIZE(binder_return_strings));
 	for (i = 0; i < ARRAY_SIZE(stats->br); i++) {
-		if (stats->br[i])
+		int temp = atomic_read(&stats->br[i]);
+
+		if (temp)
 			seq_printf(m, "%s%s: %d\n", prefix,
-				   binder_return_strings[i], stats->br[i]);
+				   binder_return_strings[i], temp);
 	}
 
 	BUILD_BUG_ON(ARRAY_SIZE(stats->obj_created) !=
@@ -3436,12 +3907,62 @@ static void print_binder_stats(struct seq_file *m, const char *prefix,
 	BUILD_BUG_ON(ARRAY_SIZE(stats->obj_created) !=
 		     ARRAY_SIZE(stats->obj_deleted));
 	for (i = 0; i < ARRAY_SIZE(stats->obj_created); i++) {
-		if (stats->obj_created[i] || stats->obj_deleted[i])
+		int created = atomic_read(&stats->obj_created[i]);
+		int deleted = atomic_read(&stats->obj_deleted[i]);
+
+		if (created || deleted)
 			seq_printf(m, "%s%s: active %d total %d\n", prefix,
 				binder_objstat_strings[i],
-				stats->obj_created[i] - stats->obj_deleted[i],
-				stats->obj_created[i]);
+				created - deleted, created);
+	}
+}
+
+static void print_binder_alloc_stats(struct seq_file *m,
+				     struct binder_proc *proc)
+{
+	struct rb_node *n;
+	size_t free_size = 0, largest = 0, size;
+
+	for (n = rb_first(&proc->free_buffers); n != NULL; n = rb_next(n)) {
+		size = binder_buffer_size(proc, rb_entry(n,
+					struct binder_buffer, rb_node));
+		free_size += size;
+		if (size > largest)
+			largest = size;
+	}
+	seq_printf(m, "  buffer space: %zd allocated %zd (max %zd) "
+		   "free %zd (largest %zd)\n", proc->buffer_size,
+		   proc->buffer_allocated, proc->buffer_allocated_max,
+		   free_size, largest);
+	seq_printf(m, "  pages: %d mapped %d lru %lu reused\n",
+		   proc->pages_mapped, proc->pages_lru, proc->pages_reused);
+}
+
+static void print_binder_latency(struct seq_file *m, const char *name,
+				 struct binder_latency_hist *hist)
+{
+	int i;
+
+	if (!hist->count)
+		return;
+	seq_printf(m, "  %s: count %u max %lldus\n", name, hist->count,
+		   hist->max_us);
+	for (i = 0; i < BINDER_LATENCY_BUCKETS - 1; i++) {
+		if (hist->bucket[i])
+			seq_printf(m, "    <%luus: %u\n", 1UL << i,
+				   hist->bucket[i]);
 	}
+	if (hist->bucket[i])
+		seq_printf(m, "    >=%luus: %u\n", 1UL << (i - 1),
+			   hist->bucket[i]);
+}
+
+static void print_binder_latency_stats(struct seq_file *m,
+				       struct binder_proc *proc)
+{
+	print_binder_latency(m, "queue latency", &proc->queue_latency);
+	print_binder_latency(m, "service time", &proc->service_time);
+	print_binder_latency(m, "round trip", &proc->round_trip);
 }
 
 static void print_binder_proc_stats(struct seq_file *m,
@@ -3481,6 +4002,8 @@ static void print_binder_proc_stats(struct seq_file *m,
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		count++;
 	seq_printf(m, "  buffers: %d\n", count);
+	print_binder_alloc_stats(m, proc);
+	print_binder_latency_stats(m, proc);
 
 	count = 0;
 	list_for_each_entry(w, &proc->todo, entry) {
@@ -3506,7 +4029,7 @@ static int binder_state_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		down_read(&binder_main_lock);
 
 	seq_puts(m, "binder state:\n");
 
@@ -3515,10 +4038,15 @@ static int binder_state_show(struct seq_file *m, void *unused)
 	hlist_for_each_entry(node, pos, &binder_dead_nodes, dead_node)
 		print_binder_node(m, node);
 
-	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
+	hlist_for_each_entry(proc, pos, &binder_procs, proc_node) {
+		if (do_lock)
+			mutex_lock(&proc->lock);
 		print_binder_proc(m, proc, 1);
+		if (do_lock)
+			mutex_unlock(&proc->lock);
+	}
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		up_read(&binder_main_lock);
 	return 0;
 }
 
@@ -3529,16 +4057,23 @@ static int binder_stats_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		down_read(&binder_main_lock);
 
 	seq_puts(m, "binder stats:\n");
 
 	print_binder_stats(m, "", &binder_stats);
+	seq_printf(m, "lru pages: %d reclaimed %lu\n", binder_lru_count,
+		   binder_lru_reclaimed);
 
-	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
+	hlist_for_each_entry(proc, pos, &binder_procs, proc_node) {
+		if (do_lock)
+			mutex_lock(&proc->lock);
 		print_binder_proc_stats(m, proc);
+		if (do_lock)
+			mutex_unlock(&proc->lock);
+	}
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		up_read(&binder_main_lock);
 	return 0;
 }
 
@@ -3549,13 +4084,18 @@ static int binder_transactions_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		down_read(&binder_main_lock);
 
 	seq_puts(m, "binder transactions:\n");
-	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
+	hlist_for_each_entry(proc, pos, &binder_procs, proc_node) {
+		if (do_lock)
+			mutex_lock(&proc->lock);
 		print_binder_proc(m, proc, 0);
+		if (do_lock)
+			mutex_unlock(&proc->lock);
+	}
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		up_read(&binder_main_lock);
 	return 0;
 }
 
@@ -3564,12 +4104,18 @@ static int binder_proc_show(struct seq_file *m, void *unused)
 	struct binder_proc *proc = m->private;
 	int do_lock = !binder_debug_no_lock;
 
-	if (do_lock)
-		mutex_lock(&binder_lock);
+	if (do_lock) {
+		down_read(&binder_main_lock);
+		mutex_lock(&proc->lock);
+	}
 	seq_puts(m, "binder proc state:\n");
 	print_binder_proc(m, proc, 1);
-	if (do_lock)
-		mutex_unlock(&binder_lock);
+	print_binder_alloc_stats(m, proc);
+	print_binder_latency_stats(m, proc);
+	if (do_lock) {
+		mutex_unlock(&proc->lock);
+		up_read(&binder_main_lock);
+	}
 	return 0;
 }
 
@@ -3587,14 +4133,16 @@ static void print_binder_transaction_log_entry(struct seq_file *m,
 static int binder_transaction_log_show(struct seq_file *m, void *unused)
 {
 	struct binder_transaction_log *log = m->private;
+	unsigned int cur = atomic_read(&log->cur);
+	unsigned int count, start;
 	int i;
 
-	if (log->full) {
-		for (i = log->next; i < ARRAY_SIZE(log->entry); i++)
-			print_binder_transaction_log_entry(m, &log->entry[i]);
-	}
-	for (i = 0; i < log->next; i++)
-		print_binder_transaction_log_entry(m, &log->entry[i]);
+	/* cur counts the entries added so far, oldest first */
+	count = log->full ? ARRAY_SIZE(log->entry) : cur;
+	start = log->full ? cur : 0;
+	for (i = 0; i < count; i++)
+		print_binder_transaction_log_entry(m,
+			&log->entry[(start + i) % ARRAY_SIZE(log->entry)]);
 	return 0;
 }
 
@@ -3632,6 +4180,7 @@ static int __init binder_init(void)
 		binder_debugfs_dir_entry_proc = debugfs_create_dir("proc",
 						 binder_debugfs_dir_entry_root);
 	ret = misc_register(&binder_miscdev);
+	register_shrinker(&binder_shrinker);
 	if (binder_debugfs_dir_entry_root) {
 		debugfs_create_file("state",
 				    S_IRUGO,
@@ -3665,3 +4214,6 @@ static int __init binder_init(void)
 device_initcall(binder_init);
 
 MODULE_LICENSE("GPL v2");
+
+#define CREATE_TRACE_POINTS
+#include "binder_trace.h"
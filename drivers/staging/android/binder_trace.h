@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2012 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM binder
+
+#if !defined(_BINDER_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _BINDER_TRACE_H
+
+#include <linux/tracepoint.h>
+
+struct binder_node;
+struct binder_proc;
+struct binder_thread;
+struct binder_transaction;
+
+/*
+ * A transaction or reply was queued for the target; to_thread is 0 if
+ * any thread of the target process may pick it up.
+ */
+TRACE_EVENT(binder_transaction,
+	TP_PROTO(bool reply, struct binder_transaction *t,
+		 struct binder_node *target_node),
+	TP_ARGS(reply, t, target_node),
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+		__field(int, target_node)
+		__field(int, to_proc)
+		__field(int, to_thread)
+		__field(int, reply)
+		__field(unsigned int, code)
+		__field(unsigned int, flags)
+	),
+	TP_fast_assign(
+		__entry->debug_id = t->debug_id;
+		__entry->target_node = target_node ? target_node->debug_id : 0;
+		__entry->to_proc = t->to_proc->pid;
+		__entry->to_thread = t->to_thread ? t->to_thread->pid : 0;
+		__entry->reply = reply;
+		__entry->code = t->code;
+		__entry->flags = t->flags;
+	),
+	TP_printk("transaction=%d dest_node=%d dest_proc=%d dest_thread=%d "
+		  "reply=%d flags=0x%x code=0x%x",
+		  __entry->debug_id, __entry->target_node,
+		  __entry->to_proc, __entry->to_thread,
+		  __entry->reply, __entry->flags, __entry->code)
+);
+
+/* A thread dequeued a transaction or reply, latency is since queueing */
+TRACE_EVENT(binder_transaction_received,
+	TP_PROTO(struct binder_transaction *t, s64 latency_us),
+	TP_ARGS(t, latency_us),
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+		__field(s64, latency_us)
+	),
+	TP_fast_assign(
+		__entry->debug_id = t->debug_id;
+		__entry->latency_us = latency_us;
+	),
+	TP_printk("transaction=%d latency=%lldus",
+		  __entry->debug_id, __entry->latency_us)
+);
+
+/* A reply was sent, service time is since the request was dequeued */
+TRACE_EVENT(binder_reply,
+	TP_PROTO(struct binder_transaction *in_reply_to, s64 service_us),
+	TP_ARGS(in_reply_to, service_us),
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+		__field(s64, service_us)
+	),
+	TP_fast_assign(
+		__entry->debug_id = in_reply_to->debug_id;
+		__entry->service_us = service_us;
+	),
+	TP_printk("transaction=%d service=%lldus",
+		  __entry->debug_id, __entry->service_us)
+);
+
+TRACE_EVENT(binder_wait_for_work,
+	TP_PROTO(bool proc_work, bool transaction_stack, bool thread_todo),
+	TP_ARGS(proc_work, transaction_stack, thread_todo),
+	TP_STRUCT__entry(
+		__field(bool, proc_work)
+		__field(bool, transaction_stack)
+		__field(bool, thread_todo)
+	),
+	TP_fast_assign(
+		__entry->proc_work = proc_work;
+		__entry->transaction_stack = transaction_stack;
+		__entry->thread_todo = thread_todo;
+	),
+	TP_printk("proc_work=%d transaction_stack=%d thread_todo=%d",
+		  __entry->proc_work, __entry->transaction_stack,
+		  __entry->thread_todo)
+);
+
+/* The waiting thread runs again, after wait_us */
+TRACE_EVENT(binder_wakeup,
+	TP_PROTO(bool proc_work, int ret, s64 wait_us),
+	TP_ARGS(proc_work, ret, wait_us),
+	TP_STRUCT__entry(
+		__field(bool, proc_work)
+		__field(int, ret)
+		__field(s64, wait_us)
+	),
+	TP_fast_assign(
+		__entry->proc_work = proc_work;
+		__entry->ret = ret;
+		__entry->wait_us = wait_us;
+	),
+	TP_printk("proc_work=%d ret=%d wait=%lldus",
+		  __entry->proc_work, __entry->ret, __entry->wait_us)
+);
+
+#endif /* _BINDER_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_PATH .
+#define TRACE_INCLUDE_FILE binder_trace
+#include <trace/define_trace.h>
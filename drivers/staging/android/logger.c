@@ -27,23 +27,57 @@
 #include <linux/time.h>
 #include "logger.h"
 
+#ifdef CONFIG_ANDROID_LOGGER_PERSIST
+#include <linux/lzo.h>
+#include <linux/math64.h>
+#include <linux/notifier.h>
+#include <linux/platform_data/ram_console.h>
+#include <linux/proc_fs.h>
+#include <linux/reboot.h>
+#include <linux/vmalloc.h>
+#endif
+
 #include <asm/ioctls.h>
 
+/*
+ * The ring buffer is written without locks. A writer reserves space for a
+ * record by advancing the free-running write position 'w_pos' with
+ * cmpxchg(), pushes 'tail' (the oldest record still in the buffer) past
+ * the space it is going to overwrite, and fills in the record with
+ * preemption disabled, so it never sleeps and others never wait long for
+ * it. Records are contiguous; one that does not fit before the end of the
+ * buffer starts over at the beginning, and the gap is skipped.
+ *
+ * Each record starts with a struct logger_frame followed by the struct
+ * logger_entry and payload that readers get. The frame carries the record's
+ * free-running position twice: 'pos' once the length is valid, 'seq' once
+ * the entry is complete. Readers copy an entry out without locks and then
+ * check that the tail has not moved past it; if it has, the entry may
+ * have been overwritten while they copied it, and they start over.
+ */
+struct logger_frame {
+	unsigned long		pos;	/* position, once 'len' is valid */
+	unsigned long		seq;	/* position, once the entry is complete */
+	__u16			len;	/* record length, including this frame */
+	__u16			flags;	/* LOGGER_FRAME_* */
+};
+
+#define LOGGER_FRAME_PAD	0x1	/* no entry, skip the record */
+
 /*
  * struct logger_log - represents a specific log, such as 'main' or 'radio'
  *
  * This structure lives from module insertion until module removal, so it does
- * not need additional reference counting. The structure is protected by the
- * mutex 'mutex'.
+ * not need additional reference counting. Positions are free-running byte
+ * counts; the offset into the buffer is logger_offset() of them.
  */
 struct logger_log {
 	unsigned char 		*buffer;/* the ring buffer itself */
 	struct miscdevice	misc;	/* misc device representing the log */
 	wait_queue_head_t	wq;	/* wait queue for readers */
-	struct list_head	readers; /* this log's readers */
-	struct mutex		mutex;	/* mutex protecting buffer */
-	size_t			w_off;	/* current write head offset */
-	size_t			head;	/* new readers start here */
+	unsigned long		w_pos;	/* end of the last reserved record */
+	unsigned long		tail;	/* oldest record in the buffer */
+	unsigned long		head;	/* new readers start here */
 	size_t			size;	/* size of the log */
 };
 
@@ -51,17 +85,19 @@ struct logger_log {
  * struct logger_reader - a logging device open for reading
  *
  * This object lives from open to release, so we don't need additional
- * reference counting. The structure is protected by log->mutex.
+ * reference counting. The structure is protected by 'mutex'.
  */
 struct logger_reader {
 	struct logger_log	*log;	/* associated log */
-	struct list_head	list;	/* entry in logger_log's list */
-	size_t			r_off;	/* current read head offset */
+	struct mutex		mutex;	/* serializes reads of this file */
+	unsigned long		r_pos;	/* current read position */
 };
 
 /* logger_offset - returns index 'n' into the log via (optimized) modulus */
 #define logger_offset(n)	((n) & (log->size - 1))
 
+#define LOGGER_RECORD_ALIGN	sizeof(unsigned long)
+
 /*
  * file_get_log - Given a file structure, return the associated log
  *
@@ -85,61 +121,139 @@ static inline struct logger_log *file_get_log(struct file *file)
 		return file->private_data;
 }
 
+static inline struct logger_frame *get_frame(struct logger_log *log,
+					     unsigned long pos)
+{
+	return (struct logger_frame *) (log->buffer + logger_offset(pos));
+}
+
 /*
- * get_entry_len - Grabs the length of the payload of the next entry starting
- * from 'off'.
+ * get_room - bytes left before the end of the buffer. A frame never wraps,
+ * if it does not fit the rest of the buffer is a gap without a frame.
+ */
+static inline size_t get_room(struct logger_log *log, unsigned long pos)
+{
+	return log->size - logger_offset(pos);
+}
+
+/*
+ * is_stale - has the record at 'pos' been dropped, i.e. is it not between
+ * 'from' and the write position? Works across wrap-around of the counters.
+ */
+static inline int is_stale(struct logger_log *log, unsigned long pos,
+			   unsigned long from)
+{
+	unsigned long w_pos = ACCESS_ONCE(log->w_pos);
+
+	return w_pos - pos > w_pos - from;
+}
+
+/*
+ * get_next_record - return the position of the record after the one at
+ * 'pos', or 'pos' itself if the tail moved away from 'pos' meanwhile.
  *
- * Caller needs to hold log->mutex.
+ * Waits for the writer of the record to publish its length, which it does
+ * with preemption disabled right after reserving it.
  */
-static __u32 get_entry_len(struct logger_log *log, size_t off)
+static unsigned long get_next_record(struct logger_log *log, unsigned long pos)
 {
-	__u16 val;
+	struct logger_frame *frame;
+	size_t room = get_room(log, pos);
 
-	switch (log->size - off) {
-	case 1:
-		memcpy(&val, log->buffer + off, 1);
-		memcpy(((char *) &val) + 1, log->buffer, 1);
-		break;
-	default:
-		memcpy(&val, log->buffer + off, 2);
+	if (room < sizeof(struct logger_frame))
+		return pos + room;
+
+	frame = get_frame(log, pos);
+	while (ACCESS_ONCE(frame->pos) != pos) {
+		if (ACCESS_ONCE(log->tail) != pos)
+			return pos;
+		cpu_relax();
 	}
+	smp_rmb();
 
-	return sizeof(struct logger_entry) + val;
+	return pos + frame->len;
 }
 
 /*
- * do_read_log_to_user - reads exactly 'count' bytes from 'log' into the
- * user-space buffer 'buf'. Returns 'count' on success.
- *
- * Caller must hold log->mutex.
+ * push_tail - drop the oldest records until the buffer has room for
+ * everything up to 'end'. New readers never start before the tail.
  */
-static ssize_t do_read_log_to_user(struct logger_log *log,
-				   struct logger_reader *reader,
-				   char __user *buf,
-				   size_t count)
+static void push_tail(struct logger_log *log, unsigned long end)
 {
-	size_t len;
-
-	/*
-	 * We read from the log in two disjoint operations. First, we read from
-	 * the current read head offset up to 'count' bytes or to the end of
-	 * the log, whichever comes first.
-	 */
-	len = min(count, log->size - reader->r_off);
-	if (copy_to_user(buf, log->buffer + reader->r_off, len))
-		return -EFAULT;
+	unsigned long tail, next, head;
 
-	/*
-	 * Second, we read any remaining bytes, starting back at the head of
-	 * the log.
-	 */
-	if (count != len)
-		if (copy_to_user(buf + len, log->buffer, count - len))
-			return -EFAULT;
+	for (;;) {
+		tail = ACCESS_ONCE(log->tail);
+		if (end - tail <= log->size)
+			break;
 
-	reader->r_off = logger_offset(reader->r_off + count);
+		next = get_next_record(log, tail);
+		if (next != tail)
+			cmpxchg(&log->tail, tail, next);
+	}
 
-	return count;
+	do {
+		head = ACCESS_ONCE(log->head);
+		if (!is_stale(log, head, tail))
+			break;
+	} while (cmpxchg(&log->head, head, tail) != head);
+}
+
+/*
+ * peek_entry - return the frame of the first complete entry at or after
+ * '*pos', updating '*pos' past dropped records and gaps. Returns NULL if
+ * there is no such entry yet.
+ */
+static struct logger_frame *peek_entry(struct logger_log *log,
+				       unsigned long *pos)
+{
+	struct logger_frame *frame;
+	unsigned long head, tail;
+	size_t room;
+
+	for (;;) {
+		head = ACCESS_ONCE(log->head);
+		tail = ACCESS_ONCE(log->tail);
+		if (is_stale(log, head, tail))
+			head = tail;
+		if (is_stale(log, *pos, head))
+			*pos = head;
+		if (*pos == ACCESS_ONCE(log->w_pos))
+			return NULL;
+
+		room = get_room(log, *pos);
+		if (room < sizeof(struct logger_frame)) {
+			*pos += room;
+			continue;
+		}
+
+		frame = get_frame(log, *pos);
+		if (ACCESS_ONCE(frame->seq) != *pos) {
+			smp_rmb();
+			if (is_stale(log, *pos, ACCESS_ONCE(log->tail)))
+				continue;
+			/* still being written */
+			return NULL;
+		}
+		smp_rmb();
+
+		if (frame->flags & LOGGER_FRAME_PAD) {
+			*pos += frame->len;
+			continue;
+		}
+		return frame;
+	}
+}
+
+/*
+ * get_entry_len - Grabs the length of the entry, header included, following
+ * 'frame'.
+ */
+static __u32 get_entry_len(struct logger_frame *frame)
+{
+	struct logger_entry *entry = (struct logger_entry *) (frame + 1);
+
+	return sizeof(struct logger_entry) + entry->len;
 }
 
 /*
@@ -159,162 +273,151 @@ static ssize_t logger_read(struct file *file, char __user *buf,
 {
 	struct logger_reader *reader = file->private_data;
 	struct logger_log *log = reader->log;
+	struct logger_frame *frame;
+	unsigned long r_pos;
+	size_t len, rec_len;
 	ssize_t ret;
-	DEFINE_WAIT(wait);
-
-start:
-	while (1) {
-		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
 
-		mutex_lock(&log->mutex);
-		ret = (log->w_off == reader->r_off);
-		mutex_unlock(&log->mutex);
-		if (!ret)
-			break;
+	mutex_lock(&reader->mutex);
 
-		if (file->f_flags & O_NONBLOCK) {
-			ret = -EAGAIN;
-			break;
-		}
-
-		if (signal_pending(current)) {
-			ret = -EINTR;
-			break;
-		}
-
-		schedule();
+start:
+	r_pos = reader->r_pos;
+	frame = peek_entry(log, &r_pos);
+	reader->r_pos = r_pos;
+	if (!frame) {
+		mutex_unlock(&reader->mutex);
+
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+
+		ret = wait_event_interruptible(log->wq,
+			({ r_pos = ACCESS_ONCE(reader->r_pos);
+			   peek_entry(log, &r_pos) != NULL; }));
+		if (ret)
+			return ret;
+
+		mutex_lock(&reader->mutex);
+		goto start;
 	}
 
-	finish_wait(&log->wq, &wait);
-	if (ret)
-		return ret;
-
-	mutex_lock(&log->mutex);
-
-	/* is there still something to read or did we race? */
-	if (unlikely(log->w_off == reader->r_off)) {
-		mutex_unlock(&log->mutex);
-		goto start;
+	/* the length fields are only trustworthy if the entry is still there */
+	rec_len = frame->len;
+	len = get_entry_len(frame);
+	if (rec_len > get_room(log, r_pos) ||
+	    len > rec_len - sizeof(struct logger_frame)) {
+		smp_rmb();
+		if (is_stale(log, r_pos, ACCESS_ONCE(log->tail)))
+			goto start;
+		WARN_ON_ONCE(1);
+		ret = -EIO;
+		goto out;
 	}
 
-	/* get the size of the next entry */
-	ret = get_entry_len(log, reader->r_off);
-	if (count < ret) {
+	if (count < len) {
 		ret = -EINVAL;
 		goto out;
 	}
 
 	/* get exactly one entry from the log */
-	ret = do_read_log_to_user(log, reader, buf, ret);
+	if (copy_to_user(buf, frame + 1, len)) {
+		ret = -EFAULT;
+		goto out;
+	}
+
+	/* and check that no writer overwrote it meanwhile */
+	smp_rmb();
+	if (is_stale(log, r_pos, ACCESS_ONCE(log->tail)))
+		goto start;
+
+	reader->r_pos = r_pos + rec_len;
+	ret = len;
 
 out:
-	mutex_unlock(&log->mutex);
+	mutex_unlock(&reader->mutex);
 
 	return ret;
 }
 
 /*
- * get_next_entry - return the offset of the first valid entry at least 'len'
- * bytes after 'off'.
+ * reserve_record - reserves 'len' bytes for a new record and makes room for
+ * it. Returns the position of the record and sets 'gap' to the position of
+ * the unused space before it, if the record had to wrap.
  *
- * Caller must hold log->mutex.
+ * The caller needs to have preemption disabled.
  */
-static size_t get_next_entry(struct logger_log *log, size_t off, size_t len)
+static unsigned long reserve_record(struct logger_log *log, size_t len,
+				    unsigned long *gap)
 {
-	size_t count = 0;
+	unsigned long old, start;
 
 	do {
-		size_t nr = get_entry_len(log, off);
-		off = logger_offset(off + nr);
-		count += nr;
-	} while (count < len);
+		old = ACCESS_ONCE(log->w_pos);
+		start = old;
+		if (get_room(log, old) < len)
+			start += get_room(log, old);
+	} while (cmpxchg(&log->w_pos, old, start + len) != old);
 
-	return off;
-}
+	push_tail(log, start + len);
+	*gap = old;
 
-/*
- * clock_interval - is a < c < b in mod-space? Put another way, does the line
- * from a to b cross c?
- */
-static inline int clock_interval(size_t a, size_t b, size_t c)
-{
-	if (b < a) {
-		if (a < c || b >= c)
-			return 1;
-	} else {
-		if (a < c && b >= c)
-			return 1;
-	}
-
-	return 0;
+	return start;
 }
 
 /*
- * fix_up_readers - walk the list of all readers and "fix up" any who were
- * lapped by the writer; also do the same for the default "start head".
- * We do this by "pulling forward" the readers and start head to the first
- * entry after the new write head.
- *
- * The caller needs to hold log->mutex.
+ * publish_frame - makes the length of the record at 'pos' known and, for
+ * padding, completes it.
  */
-static void fix_up_readers(struct logger_log *log, size_t len)
+static void publish_frame(struct logger_log *log, unsigned long pos,
+			  size_t len, __u16 flags)
 {
-	size_t old = log->w_off;
-	size_t new = logger_offset(old + len);
-	struct logger_reader *reader;
-
-	if (clock_interval(old, new, log->head))
-		log->head = get_next_entry(log, log->head, len);
-
-	list_for_each_entry(reader, &log->readers, list)
-		if (clock_interval(old, new, reader->r_off))
-			reader->r_off = get_next_entry(log, reader->r_off, len);
+	struct logger_frame *frame = get_frame(log, pos);
+
+	frame->len = len;
+	frame->flags = flags;
+	smp_wmb();
+	frame->pos = pos;
+	if (flags & LOGGER_FRAME_PAD)
+		frame->seq = pos;
 }
 
 /*
- * do_write_log - writes 'len' bytes from 'buf' to 'log'
- *
- * The caller needs to hold log->mutex.
+ * do_write_log_entry - writes the entry 'header' with its payload from the
+ * kernel buffer 'payload' into 'log'. Nothing between reserving the record
+ * and publishing it may fault, or readers would wait behind it.
  */
-static void do_write_log(struct logger_log *log, const void *buf, size_t count)
+static void do_write_log_entry(struct logger_log *log,
+			       struct logger_entry *header,
+			       const void *payload)
 {
-	size_t len;
-
-	len = min(count, log->size - log->w_off);
-	memcpy(log->buffer + log->w_off, buf, len);
-
-	if (count != len)
-		memcpy(log->buffer, buf + len, count - len);
-
-	log->w_off = logger_offset(log->w_off + count);
-
+	size_t len = ALIGN(sizeof(struct logger_frame) +
+			   sizeof(struct logger_entry) + header->len,
+			   LOGGER_RECORD_ALIGN);
+	struct logger_frame *frame;
+	unsigned char *p;
+	unsigned long pos, gap;
+
+	preempt_disable();
+
+	pos = reserve_record(log, len, &gap);
+	if (pos - gap >= sizeof(struct logger_frame))
+		publish_frame(log, gap, pos - gap, LOGGER_FRAME_PAD);
+	publish_frame(log, pos, len, 0);
+
+	frame = get_frame(log, pos);
+	p = (unsigned char *) (frame + 1);
+	memcpy(p, header, sizeof(struct logger_entry));
+	p += sizeof(struct logger_entry);
+	memcpy(p, payload, header->len);
+
+	/* publish the entry */
+	smp_wmb();
+	frame->seq = pos;
+
+	preempt_enable();
 }
 
-/*
- * do_write_log_user - writes 'len' bytes from the user-space buffer 'buf' to
- * the log 'log'
- *
- * The caller needs to hold log->mutex.
- *
- * Returns 'count' on success, negative error code on failure.
- */
-static ssize_t do_write_log_from_user(struct logger_log *log,
-				      const void __user *buf, size_t count)
-{
-	size_t len;
-
-	len = min(count, log->size - log->w_off);
-	if (len && copy_from_user(log->buffer + log->w_off, buf, len))
-		return -EFAULT;
-
-	if (count != len)
-		if (copy_from_user(log->buffer, buf + len, count - len))
-			return -EFAULT;
-
-	log->w_off = logger_offset(log->w_off + count);
-
-	return count;
-}
+/* Payloads up to this size are staged on the stack, longer ones kmalloc'ed */
+#define LOGGER_STACK_PAYLOAD	256
 
 /*
  * logger_aio_write - our write method, implementing support for write(),
@@ -325,10 +428,11 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t ppos)
 {
 	struct logger_log *log = file_get_log(iocb->ki_filp);
-	size_t orig = log->w_off;
+	unsigned char stack_payload[LOGGER_STACK_PAYLOAD];
+	unsigned char *payload = stack_payload;
 	struct logger_entry header;
 	struct timespec now;
-	ssize_t ret = 0;
+	size_t off = 0;
 
 	now = current_kernel_time();
 
@@ -337,48 +441,40 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 	header.sec = now.tv_sec;
 	header.nsec = now.tv_nsec;
 	header.len = min_t(size_t, iocb->ki_left, LOGGER_ENTRY_MAX_PAYLOAD);
+	header.__pad = 0;
 
 	/* null writes succeed, return zero */
 	if (unlikely(!header.len))
 		return 0;
 
-	mutex_lock(&log->mutex);
-
-	/*
-	 * Fix up any readers, pulling them forward to the first readable
-	 * entry after (what will be) the new write offset. We do this now
-	 * because if we partially fail, we can end up with clobbered log
-	 * entries that encroach on readable buffer.
-	 */
-	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
-
-	do_write_log(log, &header, sizeof(struct logger_entry));
-
-	while (nr_segs-- > 0) {
-		size_t len;
-		ssize_t nr;
+	/* fetch the payload first, the record must not wait for faults */
+	if (header.len > sizeof(stack_payload)) {
+		payload = kmalloc(header.len, GFP_KERNEL);
+		if (!payload)
+			return -ENOMEM;
+	}
 
+	while (nr_segs-- > 0 && off < header.len) {
 		/* figure out how much of this vector we can keep */
-		len = min_t(size_t, iov->iov_len, header.len - ret);
-
-		/* write out this segment's payload */
-		nr = do_write_log_from_user(log, iov->iov_base, len);
-		if (unlikely(nr < 0)) {
-			log->w_off = orig;
-			mutex_unlock(&log->mutex);
-			return nr;
-		}
+		size_t seg = min_t(size_t, iov->iov_len, header.len - off);
 
+		if (copy_from_user(payload + off, iov->iov_base, seg)) {
+			if (payload != stack_payload)
+				kfree(payload);
+			return -EFAULT;
+		}
 		iov++;
-		ret += nr;
+		off += seg;
 	}
 
-	mutex_unlock(&log->mutex);
+	do_write_log_entry(log, &header, payload);
+	if (payload != stack_payload)
+		kfree(payload);
 
 	/* wake up any blocked readers */
 	wake_up_interruptible(&log->wq);
 
-	return ret;
+	return header.len;
 }
 
 static struct logger_log *get_log_from_minor(int);
@@ -409,12 +505,8 @@ static int logger_open(struct inode *inode, struct file *file)
 			return -ENOMEM;
 
 		reader->log = log;
-		INIT_LIST_HEAD(&reader->list);
-
-		mutex_lock(&log->mutex);
-		reader->r_off = log->head;
-		list_add_tail(&reader->list, &log->readers);
-		mutex_unlock(&log->mutex);
+		mutex_init(&reader->mutex);
+		reader->r_pos = ACCESS_ONCE(log->head);
 
 		file->private_data = reader;
 	} else
@@ -432,7 +524,6 @@ static int logger_release(struct inode *ignored, struct file *file)
 {
 	if (file->f_mode & FMODE_READ) {
 		struct logger_reader *reader = file->private_data;
-		list_del(&reader->list);
 		kfree(reader);
 	}
 
@@ -452,6 +543,7 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 {
 	struct logger_reader *reader;
 	struct logger_log *log;
+	unsigned long r_pos;
 	unsigned int ret = POLLOUT | POLLWRNORM;
 
 	if (!(file->f_mode & FMODE_READ))
@@ -462,10 +554,9 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, &log->wq, wait);
 
-	mutex_lock(&log->mutex);
-	if (log->w_off != reader->r_off)
+	r_pos = ACCESS_ONCE(reader->r_pos);
+	if (peek_entry(log, &r_pos))
 		ret |= POLLIN | POLLRDNORM;
-	mutex_unlock(&log->mutex);
 
 	return ret;
 }
@@ -474,10 +565,10 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	struct logger_log *log = file_get_log(file);
 	struct logger_reader *reader;
+	struct logger_frame *frame;
+	unsigned long r_pos;
 	long ret = -ENOTTY;
 
-	mutex_lock(&log->mutex);
-
 	switch (cmd) {
 	case LOGGER_GET_LOG_BUF_SIZE:
 		ret = log->size;
@@ -487,11 +578,14 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			ret = -EBADF;
 			break;
 		}
+		/* this includes the framing of the records */
 		reader = file->private_data;
-		if (log->w_off >= reader->r_off)
-			ret = log->w_off - reader->r_off;
-		else
-			ret = (log->size - reader->r_off) + log->w_off;
+		mutex_lock(&reader->mutex);
+		r_pos = reader->r_pos;
+		if (is_stale(log, r_pos, ACCESS_ONCE(log->head)))
+			r_pos = ACCESS_ONCE(log->head);
+		ret = ACCESS_ONCE(log->w_pos) - r_pos;
+		mutex_unlock(&reader->mutex);
 		break;
 	case LOGGER_GET_NEXT_ENTRY_LEN:
 		if (!(file->f_mode & FMODE_READ)) {
@@ -499,25 +593,24 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		reader = file->private_data;
-		if (log->w_off != reader->r_off)
-			ret = get_entry_len(log, reader->r_off);
-		else
-			ret = 0;
+		mutex_lock(&reader->mutex);
+		r_pos = reader->r_pos;
+		frame = peek_entry(log, &r_pos);
+		reader->r_pos = r_pos;
+		ret = frame ? get_entry_len(frame) : 0;
+		mutex_unlock(&reader->mutex);
 		break;
 	case LOGGER_FLUSH_LOG:
 		if (!(file->f_mode & FMODE_WRITE)) {
 			ret = -EBADF;
 			break;
 		}
-		list_for_each_entry(reader, &log->readers, list)
-			reader->r_off = log->w_off;
-		log->head = log->w_off;
+		/* readers catch up with the new head on their next read */
+		log->head = ACCESS_ONCE(log->w_pos);
 		ret = 0;
 		break;
 	}
 
-	mutex_unlock(&log->mutex);
-
 	return ret;
 }
 
@@ -538,7 +631,7 @@ static const struct file_operations logger_fops = {
  * LONG_MAX minus LOGGER_ENTRY_MAX_LEN.
  */
 #define DEFINE_LOGGER_DEVICE(VAR, NAME, SIZE) \
-static unsigned char _buf_ ## VAR[SIZE]; \
+static unsigned char _buf_ ## VAR[SIZE] __aligned(LOGGER_RECORD_ALIGN); \
 static struct logger_log VAR = { \
 	.buffer = _buf_ ## VAR, \
 	.misc = { \
@@ -548,9 +641,8 @@ static struct logger_log VAR = { \
 		.parent = NULL, \
 	}, \
 	.wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .wq), \
-	.readers = LIST_HEAD_INIT(VAR .readers), \
-	.mutex = __MUTEX_INITIALIZER(VAR .mutex), \
-	.w_off = 0, \
+	.w_pos = 0, \
+	.tail = 0, \
 	.head = 0, \
 	.size = SIZE, \
 };
@@ -573,6 +665,391 @@ static struct logger_log *get_log_from_minor(int minor)
 	return NULL;
 }
 
+#ifdef CONFIG_ANDROID_LOGGER_PERSIST
+/*
+ * Persistent logs: on panic and reboot the newest entries of every log are
+ * compressed into a memory region that ram_console keeps across the reboot,
+ * and on the next boot they are exposed as /proc/last_<log name>, in the
+ * format read() returns them. Each log gets a share of the region in
+ * proportion to its size.
+ *
+ * A log is saved in chunks of up to LOGGER_PERSIST_CHUNK bytes of entries,
+ * newest first, until its share is full, so that the oldest entries are the
+ * ones that get dropped.
+ */
+struct logger_persist_buffer {
+	uint32_t	sig;
+	uint32_t	size;	/* bytes of chunks in data */
+	uint8_t		data[0];
+};
+
+struct logger_persist_chunk {
+	uint16_t	log;	/* index into logger_persist_logs */
+	uint16_t	__pad;
+	uint32_t	ulen;	/* bytes of entries */
+	uint32_t	clen;	/* bytes of LZO compressed data */
+	uint8_t		data[0];
+};
+
+#define LOGGER_PERSIST_SIG	(0x474f4c50) /* PLOG */
+#define LOGGER_PERSIST_CHUNK	(16 * 1024)
+
+static struct logger_log *logger_persist_logs[] = {
+	&log_main, &log_events, &log_radio, &log_system,
+};
+
+#define LOGGER_PERSIST_LOGS	ARRAY_SIZE(logger_persist_logs)
+
+static struct logger_persist_buffer *logger_persist_buffer;
+static size_t logger_persist_size;
+static atomic_t logger_persist_busy = ATOMIC_INIT(0);
+
+/* preallocated, as the log is saved from panic context */
+static void *logger_persist_workmem;
+static unsigned char *logger_persist_stage;
+static unsigned char *logger_persist_out;
+static unsigned long *logger_persist_starts;
+static size_t logger_persist_max_chunks;
+
+/* the logs saved by the previous boot */
+static unsigned char *logger_last[LOGGER_PERSIST_LOGS];
+static size_t logger_last_size[LOGGER_PERSIST_LOGS];
+
+/*
+ * persist_next_entry - return the next complete entry at or after '*pos' and
+ * move '*pos' past it, or NULL at 'end'. Sets '*rec' to the position of its
+ * record and '*len' to its length, header included. Writers that were
+ * interrupted by the panic leave incomplete records, which are skipped; a
+ * record whose length never got published ends the log.
+ *
+ * On reboot, writers are still running and may rewrite a record at any
+ * time: every field is read once, and the caller must not rely on the
+ * entry still being there after this returns.
+ */
+static struct logger_entry *persist_next_entry(struct logger_log *log,
+					       unsigned long *pos,
+					       unsigned long end,
+					       unsigned long *rec, size_t *len)
+{
+	struct logger_frame *frame;
+	struct logger_entry *entry;
+	size_t room, frame_len;
+
+	while (*pos != end) {
+		room = get_room(log, *pos);
+		if (room < sizeof(struct logger_frame)) {
+			*pos += room;
+			continue;
+		}
+
+		frame = get_frame(log, *pos);
+		frame_len = ACCESS_ONCE(frame->len);
+		if (ACCESS_ONCE(frame->pos) != *pos || frame_len > room ||
+		    frame_len < sizeof(struct logger_frame))
+			return NULL;
+		*rec = *pos;
+		*pos += frame_len;
+
+		if (ACCESS_ONCE(frame->seq) != *rec ||
+		    (ACCESS_ONCE(frame->flags) & LOGGER_FRAME_PAD))
+			continue;
+
+		entry = (struct logger_entry *) (frame + 1);
+		*len = sizeof(struct logger_entry) + ACCESS_ONCE(entry->len);
+		if (*len > frame_len - sizeof(struct logger_frame))
+			continue;
+
+		return entry;
+	}
+
+	return NULL;
+}
+
+/*
+ * logger_persist_log - save the newest entries of 'log' that fit into 'size'
+ * bytes at 'dst' and return the number of bytes used.
+ */
+static size_t logger_persist_log(struct logger_log *log, int index,
+				 uint8_t *dst, size_t size)
+{
+	unsigned long *starts = logger_persist_starts;
+	unsigned long pos = log->tail;
+	unsigned long end = log->w_pos;
+	struct logger_entry *entry;
+	struct logger_frame *frame;
+	size_t fill = 0, used = 0, len;
+	unsigned long rec;
+	int n = 0, k;
+
+	/* first find where each chunk starts */
+	starts[0] = pos;
+	while ((entry = persist_next_entry(log, &pos, end, &rec, &len))) {
+		if (fill + len > LOGGER_PERSIST_CHUNK) {
+			if (n + 2 >= logger_persist_max_chunks) {
+				pos = rec;
+				break;
+			}
+			/* the record of this entry starts the next chunk */
+			starts[++n] = rec;
+			fill = 0;
+		}
+		fill += len;
+	}
+	starts[++n] = pos;
+
+	/* then save them newest first */
+	for (k = n - 1; k >= 0; k--) {
+		struct logger_persist_chunk *chunk;
+		size_t ulen = 0, clen;
+
+		/*
+		 * Records may have been rewritten since the first pass, so
+		 * its chunk boundaries are only a guide: never overrun the
+		 * stage, and drop entries overwritten while being copied.
+		 */
+		pos = starts[k];
+		while ((entry = persist_next_entry(log, &pos, starts[k + 1],
+						   &rec, &len))) {
+			if (ulen + len > LOGGER_PERSIST_CHUNK)
+				break;
+
+			memcpy(logger_persist_stage + ulen, entry, len);
+			smp_rmb();
+			frame = (struct logger_frame *) entry - 1;
+			if (ACCESS_ONCE(frame->seq) != rec ||
+			    is_stale(log, rec, ACCESS_ONCE(log->tail)))
+				continue;
+			ulen += len;
+		}
+		if (!ulen)
+			continue;
+
+		if (lzo1x_1_compress(logger_persist_stage, ulen,
+				     logger_persist_out, &clen,
+				     logger_persist_workmem) != LZO_E_OK)
+			break;
+		if (used + ALIGN(sizeof(*chunk) + clen, 4) > size)
+			break;
+
+		chunk = (struct logger_persist_chunk *) (dst + used);
+		chunk->log = index;
+		chunk->__pad = 0;
+		chunk->ulen = ulen;
+		chunk->clen = clen;
+		memcpy(chunk->data, logger_persist_out, clen);
+		used += ALIGN(sizeof(*chunk) + clen, 4);
+	}
+
+	return used;
+}
+
+static void logger_persist_save(void)
+{
+	struct logger_persist_buffer *buffer = logger_persist_buffer;
+	size_t size = logger_persist_size - sizeof(*buffer);
+	size_t total = 0, used = 0;
+	int i;
+
+	/* a CPU stopped by a panic may have been saving already */
+	if (atomic_xchg(&logger_persist_busy, 1))
+		return;
+
+	buffer->sig = 0;
+	mb();
+
+	for (i = 0; i < LOGGER_PERSIST_LOGS; i++)
+		total += logger_persist_logs[i]->size;
+	for (i = 0; i < LOGGER_PERSIST_LOGS; i++) {
+		struct logger_log *log = logger_persist_logs[i];
+		size_t share = div_u64((u64) size * log->size, total) & ~3;
+
+		used += logger_persist_log(log, i, buffer->data + used, share);
+	}
+
+	buffer->size = used;
+	mb();
+	buffer->sig = LOGGER_PERSIST_SIG;
+
+	atomic_set(&logger_persist_busy, 0);
+}
+
+static int logger_persist_notify(struct notifier_block *nb,
+				 unsigned long event, void *data)
+{
+	logger_persist_save();
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block logger_persist_panic_nb = {
+	.notifier_call = logger_persist_notify,
+};
+
+static struct notifier_block logger_persist_reboot_nb = {
+	.notifier_call = logger_persist_notify,
+};
+
+/*
+ * logger_persist_restore - decompress the logs saved by the previous boot.
+ * Chunks are stored newest first, so each is placed before the previous
+ * one of the same log.
+ */
+static void __init logger_persist_restore(void)
+{
+	struct logger_persist_buffer *buffer = logger_persist_buffer;
+	size_t size = logger_persist_size - sizeof(*buffer);
+	size_t fill[LOGGER_PERSIST_LOGS] = { 0 };
+	bool bad[LOGGER_PERSIST_LOGS] = { false };
+	struct logger_persist_chunk *chunk;
+	size_t off;
+	int i;
+
+	if (buffer->sig != LOGGER_PERSIST_SIG || buffer->size > size) {
+		printk(KERN_INFO "logger: no persistent logs found\n");
+		return;
+	}
+
+	/* first check the chunks and add up the size of each log */
+	for (off = 0; off + sizeof(*chunk) <= buffer->size;
+	     off += ALIGN(sizeof(*chunk) + chunk->clen, 4)) {
+		chunk = (struct logger_persist_chunk *) (buffer->data + off);
+		if (chunk->log >= LOGGER_PERSIST_LOGS ||
+		    chunk->ulen > LOGGER_PERSIST_CHUNK ||
+		    chunk->clen > buffer->size - off - sizeof(*chunk))
+			break;
+		logger_last_size[chunk->log] += chunk->ulen;
+	}
+	buffer->size = off;
+
+	for (i = 0; i < LOGGER_PERSIST_LOGS; i++) {
+		if (!logger_last_size[i])
+			continue;
+		logger_last[i] = vmalloc(logger_last_size[i]);
+		if (!logger_last[i])
+			logger_last_size[i] = 0;
+	}
+
+	for (off = 0; off < buffer->size;
+	     off += ALIGN(sizeof(*chunk) + chunk->clen, 4)) {
+		size_t ulen;
+		uint8_t *dst;
+
+		chunk = (struct logger_persist_chunk *) (buffer->data + off);
+		i = chunk->log;
+		if (!logger_last[i] || bad[i])
+			continue;
+
+		fill[i] += chunk->ulen;
+		dst = logger_last[i] + logger_last_size[i] - fill[i];
+		ulen = chunk->ulen;
+		if (lzo1x_decompress_safe(chunk->data, chunk->clen,
+					  dst, &ulen) != LZO_E_OK ||
+		    ulen != chunk->ulen) {
+			/* keep what is newer than the damaged chunk */
+			printk(KERN_ERR "logger: corrupt persistent chunk "
+			       "for log '%s'\n", logger_persist_logs[i]->misc.name);
+			memmove(logger_last[i], dst + chunk->ulen,
+				fill[i] - chunk->ulen);
+			logger_last_size[i] = fill[i] - chunk->ulen;
+			bad[i] = true;
+		}
+	}
+}
+
+static ssize_t logger_last_read(struct file *file, char __user *buf,
+				size_t len, loff_t *offset)
+{
+	int i = (long) PDE(file->f_path.dentry->d_inode)->data;
+	loff_t pos = *offset;
+	ssize_t count;
+
+	if (pos >= logger_last_size[i])
+		return 0;
+
+	count = min(len, (size_t)(logger_last_size[i] - pos));
+	if (copy_to_user(buf, logger_last[i] + pos, count))
+		return -EFAULT;
+
+	*offset += count;
+	return count;
+}
+
+static const struct file_operations logger_last_fops = {
+	.owner = THIS_MODULE,
+	.read = logger_last_read,
+};
+
+static int __init logger_persist_init(void)
+{
+	struct proc_dir_entry *entry;
+	char name[32];
+	size_t size;
+	int i;
+
+	logger_persist_buffer = ram_console_logger_area(&size);
+	if (!logger_persist_buffer ||
+	    size <= sizeof(struct logger_persist_buffer))
+		return 0;
+	logger_persist_size = size;
+
+	logger_persist_restore();
+
+	for (i = 0; i < LOGGER_PERSIST_LOGS; i++) {
+		if (!logger_last[i])
+			continue;
+		snprintf(name, sizeof(name), "last_%s",
+			 logger_persist_logs[i]->misc.name);
+		entry = create_proc_entry(name, S_IFREG | S_IRUSR, NULL);
+		if (!entry) {
+			printk(KERN_ERR "logger: failed to create proc entry "
+			       "%s\n", name);
+			continue;
+		}
+		entry->proc_fops = &logger_last_fops;
+		entry->data = (void *) (long) i;
+		entry->size = logger_last_size[i];
+	}
+
+	for (i = 0; i < LOGGER_PERSIST_LOGS; i++)
+		logger_persist_max_chunks = max(logger_persist_max_chunks,
+			DIV_ROUND_UP(logger_persist_logs[i]->size,
+				     LOGGER_PERSIST_CHUNK -
+				     LOGGER_ENTRY_MAX_LEN) + 2);
+
+	logger_persist_workmem = vmalloc(LZO1X_1_MEM_COMPRESS);
+	logger_persist_stage = kmalloc(LOGGER_PERSIST_CHUNK, GFP_KERNEL);
+	logger_persist_out = kmalloc(lzo1x_worst_compress(LOGGER_PERSIST_CHUNK),
+				     GFP_KERNEL);
+	logger_persist_starts = kmalloc(logger_persist_max_chunks *
+					sizeof(unsigned long), GFP_KERNEL);
+	if (!logger_persist_workmem || !logger_persist_stage ||
+	    !logger_persist_out || !logger_persist_starts) {
+		printk(KERN_ERR "logger: failed to allocate persistent log "
+		       "buffers\n");
+		vfree(logger_persist_workmem);
+		kfree(logger_persist_stage);
+		kfree(logger_persist_out);
+		kfree(logger_persist_starts);
+		return -ENOMEM;
+	}
+
+	/* nothing saved yet for this boot */
+	logger_persist_buffer->sig = 0;
+
+	atomic_notifier_chain_register(&panic_notifier_list,
+				       &logger_persist_panic_nb);
+	register_reboot_notifier(&logger_persist_reboot_nb);
+
+	printk(KERN_INFO "logger: %zuK for persistent logs\n", size >> 10);
+
+	return 0;
+}
+#else
+static inline int logger_persist_init(void)
+{
+	return 0;
+}
+#endif
+
 static int __init init_log(struct logger_log *log)
 {
 	int ret;
@@ -610,6 +1087,8 @@ static int __init logger_init(void)
 	if (unlikely(ret))
 		goto out;
 
+	ret = logger_persist_init();
+
 out:
 	return ret;
 }
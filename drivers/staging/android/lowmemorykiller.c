@@ -16,6 +16,16 @@
  * percentage of the cached memory is locked this can be very inaccurate
  * and processes may not get killed until the normal oom killer is triggered.
  *
+ * The thresholds are refined by how well reclaim is doing. Below a threshold
+ * nothing but the most important level is killed while reclaim frees most
+ * of the pages it scans (efficiency_high percent), as the cache is then
+ * merely cold. When reclaim frees less than efficiency_low percent and more
+ * than thrash_refaults major faults happen per window_ms, the working set
+ * is thrashing and the last level is killed even above all thresholds.
+ *
+ * Pressure changes and kills are reported as struct lmk_event records on
+ * /dev/lowmemorykiller, see lowmemorykiller.h.
+ *
  * Copyright (C) 2007-2008 Google, Inc.
  *
  * This software is licensed under the terms of the GNU General Public
@@ -38,6 +48,17 @@
 #include <linux/compaction.h>
 #include <linux/memory.h>
 #include <linux/memory_hotplug.h>
+#include <linux/ktime.h>
+#include <linux/swap.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/uaccess.h>
+#include <linux/wait.h>
+
+#include "lowmemorykiller.h"
 
 static uint32_t lowmem_debug_level = 1;
 static int lowmem_adj[6] = {
@@ -55,10 +76,45 @@ static size_t lowmem_minfree[6] = {
 };
 static int lowmem_minfree_size = 4;
 
+/* Victim selection statistics, exported read-only as module parameters */
+static unsigned long lowmem_scan_count;
+static unsigned long lowmem_scan_tasks;
+static unsigned long lowmem_scan_time_us;
+static unsigned long lowmem_scan_time_max_us;
+
+static unsigned int lowmem_deathpending_ms = 1000;
+static unsigned int lowmem_window_ms = 250;
+static unsigned int lowmem_efficiency_low = 25;
+static unsigned int lowmem_efficiency_high = 60;
+static unsigned int lowmem_thrash_refaults = 256;
+
 static unsigned int offlining;
 static struct task_struct *lowmem_deathpending;
 static unsigned long lowmem_deathpending_timeout;
 
+/* Reclaim efficiency and refault rate over the last complete window */
+static DEFINE_SPINLOCK(lowmem_pressure_lock);
+static unsigned long lowmem_window_start;
+static unsigned long lowmem_last_scanned;
+static unsigned long lowmem_last_reclaimed;
+static unsigned long lowmem_last_refaults;
+static unsigned int lowmem_efficiency = 100;
+static unsigned int lowmem_refaults;
+
+#define LMK_EVENT_RING	64
+
+static DEFINE_SPINLOCK(lowmem_event_lock);
+static DECLARE_WAIT_QUEUE_HEAD(lowmem_event_wait);
+static struct lmk_event lowmem_events[LMK_EVENT_RING];
+static unsigned int lowmem_event_head;	/* sequence of the next event */
+static unsigned int lowmem_last_level;
+static unsigned long lowmem_last_report;
+static atomic_t lowmem_takeover = ATOMIC_INIT(0);
+
+struct lowmem_reader {
+	unsigned int pos;	/* sequence of the next event to read */
+};
+
 extern int compact_nodes(bool sync);
 
 #define lowmem_print(level, x...)			\
@@ -109,7 +165,116 @@ static int lmk_hotplug_callback(struct notifier_block *self,
 }
 #endif
 
+static void lowmem_update_pressure(void)
+{
+	unsigned long scanned, reclaimed, refaults;
+	unsigned long window = msecs_to_jiffies(lowmem_window_ms);
+	unsigned long elapsed;
+
+	spin_lock(&lowmem_pressure_lock);
+	elapsed = jiffies - lowmem_window_start;
+	if (elapsed < window || !elapsed)
+		goto out;
+
+	global_reclaim_stat(&scanned, &reclaimed);
+	refaults = refault_count();
+
+	/* Too little reclaim to judge: assume it keeps up */
+	if (scanned - lowmem_last_scanned < SWAP_CLUSTER_MAX)
+		lowmem_efficiency = 100;
+	else
+		lowmem_efficiency = min(100UL,
+					(reclaimed - lowmem_last_reclaimed) *
+					100 / (scanned - lowmem_last_scanned));
+	/* The shrinker may not have run for a while: scale to one window */
+	lowmem_refaults = (refaults - lowmem_last_refaults) * window / elapsed;
+
+	lowmem_window_start = jiffies;
+	lowmem_last_scanned = scanned;
+	lowmem_last_reclaimed = reclaimed;
+	lowmem_last_refaults = refaults;
+out:
+	spin_unlock(&lowmem_pressure_lock);
+}
+
+/*
+ * Classify the pressure and adjust min_adj, which the minfree thresholds
+ * set from level i (array_size if none was crossed).
+ */
+static int lowmem_pressure_level(int *min_adj, int i, int array_size)
+{
+	lowmem_update_pressure();
+
+	if (lowmem_refaults >= lowmem_thrash_refaults &&
+	    lowmem_efficiency < lowmem_efficiency_low) {
+		/*
+		 * Reclaim evicts pages that are faulted straight back in,
+		 * kill before free memory gets low enough to notice.
+		 */
+		if (*min_adj == OOM_ADJUST_MAX + 1 && array_size > 0)
+			*min_adj = lowmem_adj[array_size - 1];
+		return LMK_LEVEL_CRITICAL;
+	}
+	if (*min_adj == OOM_ADJUST_MAX + 1)
+		return LMK_LEVEL_NONE;
+	if (lowmem_efficiency >= lowmem_efficiency_high) {
+		/* The cache is only cold, reclaim will free it */
+		if (i > 0)
+			*min_adj = OOM_ADJUST_MAX + 1;
+		return LMK_LEVEL_LOW;
+	}
+	return LMK_LEVEL_MEDIUM;
+}
+
+static void lowmem_post_event(struct lmk_event *ev)
+{
+	ev->efficiency = lowmem_efficiency;
+	ev->refaults = lowmem_refaults;
+	ev->time_ns = ktime_to_ns(ktime_get());
 
+	spin_lock(&lowmem_event_lock);
+	lowmem_events[lowmem_event_head % LMK_EVENT_RING] = *ev;
+	lowmem_event_head++;
+	spin_unlock(&lowmem_event_lock);
+
+	wake_up_interruptible(&lowmem_event_wait);
+}
+
+/* Report level changes, and pressure at most once per window */
+static void lowmem_report_pressure(int level, int min_adj,
+				   int other_free, int other_file)
+{
+	struct lmk_event ev = {
+		.type = LMK_EVENT_PRESSURE,
+		.level = level,
+		.min_adj = min_adj,
+		.free_pages = other_free,
+		.file_pages = other_file,
+	};
+
+	if (level == lowmem_last_level &&
+	    (level < LMK_LEVEL_MEDIUM ||
+	     time_before(jiffies, lowmem_last_report +
+			 msecs_to_jiffies(lowmem_window_ms))))
+		return;
+
+	lowmem_last_level = level;
+	lowmem_last_report = jiffies;
+	lowmem_post_event(&ev);
+}
+
+/*
+ * Pages of ion buffers the process holds handles to. Graphics buffers are
+ * not in the RSS, yet freed when the process dies, so count them too.
+ */
+static int lowmem_ion_pages(struct task_struct *p)
+{
+#if defined(CONFIG_ION) || defined(CONFIG_ION_MODULE)
+	return atomic_long_read(&p->signal->ion_bytes) >> PAGE_SHIFT;
+#else
+	return 0;
+#endif
+}
 
 static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 {
@@ -120,7 +285,12 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	int i;
 	int min_adj = OOM_ADJUST_MAX + 1;
 	int selected_tasksize = 0;
-	int selected_oom_adj;
+	int selected_oom_adj = 0;
+	int adj;
+	int scanned = 0;
+	unsigned long scan_us;
+	ktime_t start;
+	int level = LMK_LEVEL_NONE;
 	int array_size = ARRAY_SIZE(lowmem_adj);
 	int other_free = global_page_state(NR_FREE_PAGES);
 	int other_file = global_page_state(NR_FILE_PAGES) -
@@ -171,9 +341,15 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 		}
 #endif        
 	}
-	if (sc->nr_to_scan > 0)
-		lowmem_print(3, "lowmem_shrink %lu, %x, other_free %d other_file %d, min_adj %d\n",
-			     sc->nr_to_scan, sc->gfp_mask, other_free, other_file, min_adj);
+	if (sc->nr_to_scan > 0) {
+		level = lowmem_pressure_level(&min_adj, i, array_size);
+		lowmem_report_pressure(level, min_adj, other_free, other_file);
+		lowmem_print(3, "lowmem_shrink %lu, %x, other_free %d other_file %d, min_adj %d, level %d\n",
+			     sc->nr_to_scan, sc->gfp_mask, other_free, other_file, min_adj, level);
+		/* A userspace daemon owns the kill policy */
+		if (atomic_read(&lowmem_takeover))
+			min_adj = OOM_ADJUST_MAX + 1;
+	}
 	rem = global_page_state(NR_ACTIVE_ANON) +
 		global_page_state(NR_ACTIVE_FILE) +
 		global_page_state(NR_INACTIVE_ANON) +
@@ -183,66 +359,200 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 			     sc->nr_to_scan, sc->gfp_mask, rem);
 		return rem;
 	}
-	selected_oom_adj = min_adj;
-
-	read_lock(&tasklist_lock);
-	for_each_process(p) {
-		struct mm_struct *mm;
-		struct signal_struct *sig;
-		int oom_adj;
-
-		task_lock(p);
-		mm = p->mm;
-		sig = p->signal;
-		if (!mm || !sig) {
-			task_unlock(p);
-			continue;
-		}
-		oom_adj = sig->oom_adj;
+	start = ktime_get();
 
+	/*
+	 * Thread group leaders are indexed by oom_adj, so only the highest
+	 * non-empty bucket at or above min_adj has to be looked at: the
+	 * victim is the biggest task in it.
+	 */
+	spin_lock_irq(&oom_adj_index_lock);
+	min_adj = max(min_adj, OOM_DISABLE);
+	for (adj = OOM_ADJUST_MAX; adj >= min_adj && !selected; adj--) {
+		struct hlist_head *head = &oom_adj_index[adj - OOM_DISABLE];
+		struct hlist_node *node;
+
+		hlist_for_each_entry(p, node, head, oom_adj_node) {
+			struct mm_struct *mm;
+
+			scanned++;
+			task_lock(p);
+			mm = p->mm;
+			if (!mm || !p->signal) {
+				task_unlock(p);
+				continue;
+			}
 #ifdef CONFIG_LGE_DEBUG
-		lowmem_print(5, "PID %d (%s), adj %d\n",
-			     p->pid, p->comm, oom_adj);        
+			lowmem_print(5, "PID %d (%s), adj %d\n",
+				     p->pid, p->comm, adj);
 #endif
-
-		if (oom_adj < min_adj) {
+			tasksize = get_mm_rss(mm) + lowmem_ion_pages(p);
 			task_unlock(p);
-			continue;
-		}
-		tasksize = get_mm_rss(mm);
-		task_unlock(p);
-		if (tasksize <= 0)
-			continue;
-		if (selected) {
-			if (oom_adj < selected_oom_adj)
-				continue;
-			if (oom_adj == selected_oom_adj &&
-			    tasksize <= selected_tasksize)
+			if (tasksize <= selected_tasksize)
 				continue;
+			selected = p;
+			selected_tasksize = tasksize;
+			selected_oom_adj = adj;
+			lowmem_print(2, "select %d (%s), adj %d, size %d, "
+				     "to kill\n", p->pid, p->comm, adj, tasksize);
 		}
-		selected = p;
-		selected_tasksize = tasksize;
-		selected_oom_adj = oom_adj;
-		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
-			     p->pid, p->comm, oom_adj, tasksize);
 	}
+	if (selected)
+		get_task_struct(selected);
+	spin_unlock_irq(&oom_adj_index_lock);
+
+	scan_us = ktime_us_delta(ktime_get(), start);
+	lowmem_scan_count++;
+	lowmem_scan_tasks += scanned;
+	lowmem_scan_time_us += scan_us;
+	if (scan_us > lowmem_scan_time_max_us)
+		lowmem_scan_time_max_us = scan_us;
+	lowmem_print(3, "lowmem_shrink scanned %d tasks in %lu us\n",
+		     scanned, scan_us);
+
 	if (selected) {
+		struct lmk_event ev = {
+			.type = LMK_EVENT_KILL,
+			.level = level,
+			.min_adj = min_adj,
+			.free_pages = other_free,
+			.file_pages = other_file,
+			.pid = selected->pid,
+			.oom_adj = selected_oom_adj,
+			.rss_pages = selected_tasksize,
+		};
+
 		lowmem_print(1, "send sigkill to %d (%s), adj %d, size %d\n",
 			     selected->pid, selected->comm,
 			     selected_oom_adj, selected_tasksize);
 		lowmem_deathpending = selected;
-		lowmem_deathpending_timeout = jiffies + HZ;
-		force_sig(SIGKILL, selected);
+		lowmem_deathpending_timeout = jiffies +
+			msecs_to_jiffies(lowmem_deathpending_ms);
+		/*
+		 * Only the task is pinned here, not its sighand: send_sig()
+		 * copes with a victim that has been released meanwhile.
+		 */
+		send_sig(SIGKILL, selected, 0);
+		put_task_struct(selected);
+		lowmem_post_event(&ev);
 		rem -= selected_tasksize;
+		compact_nodes(false);
 	}
 	lowmem_print(4, "lowmem_shrink %lu, %x, return %d\n",
 		     sc->nr_to_scan, sc->gfp_mask, rem);
-	read_unlock(&tasklist_lock);
-    if (selected)
-        compact_nodes(false);
 	return rem;
 }
 
+static int lowmem_event_open(struct inode *inode, struct file *file)
+{
+	struct lowmem_reader *reader;
+
+	reader = kmalloc(sizeof(*reader), GFP_KERNEL);
+	if (!reader)
+		return -ENOMEM;
+
+	spin_lock(&lowmem_event_lock);
+	reader->pos = lowmem_event_head;
+	spin_unlock(&lowmem_event_lock);
+	file->private_data = reader;
+
+	if (file->f_mode & FMODE_WRITE)
+		atomic_inc(&lowmem_takeover);
+
+	return nonseekable_open(inode, file);
+}
+
+static int lowmem_event_release(struct inode *inode, struct file *file)
+{
+	if (file->f_mode & FMODE_WRITE)
+		atomic_dec(&lowmem_takeover);
+	kfree(file->private_data);
+	return 0;
+}
+
+/* Take the reader's next event, if any, under lowmem_event_lock */
+static bool lowmem_next_event(struct lowmem_reader *reader,
+			      struct lmk_event *ev)
+{
+	unsigned int lost = 0;
+
+	if (reader->pos == lowmem_event_head)
+		return false;
+
+	if (lowmem_event_head - reader->pos > LMK_EVENT_RING) {
+		lost = lowmem_event_head - LMK_EVENT_RING - reader->pos;
+		reader->pos = lowmem_event_head - LMK_EVENT_RING;
+	}
+	*ev = lowmem_events[reader->pos % LMK_EVENT_RING];
+	ev->lost = lost;
+	reader->pos++;
+	return true;
+}
+
+static ssize_t lowmem_event_read(struct file *file, char __user *buf,
+				 size_t count, loff_t *pos)
+{
+	struct lowmem_reader *reader = file->private_data;
+	struct lmk_event ev;
+	ssize_t ret = 0;
+	bool found;
+
+	if (count < sizeof(ev))
+		return -EINVAL;
+
+	while (count >= sizeof(ev)) {
+		spin_lock(&lowmem_event_lock);
+		found = lowmem_next_event(reader, &ev);
+		spin_unlock(&lowmem_event_lock);
+
+		if (!found) {
+			int err;
+
+			if (ret)
+				break;
+			if (file->f_flags & O_NONBLOCK)
+				return -EAGAIN;
+			err = wait_event_interruptible(lowmem_event_wait,
+				reader->pos != ACCESS_ONCE(lowmem_event_head));
+			if (err)
+				return err;
+			continue;
+		}
+
+		if (copy_to_user(buf + ret, &ev, sizeof(ev)))
+			return ret ? ret : -EFAULT;
+		ret += sizeof(ev);
+		count -= sizeof(ev);
+	}
+
+	return ret;
+}
+
+static unsigned int lowmem_event_poll(struct file *file, poll_table *wait)
+{
+	struct lowmem_reader *reader = file->private_data;
+
+	poll_wait(file, &lowmem_event_wait, wait);
+	if (reader->pos != ACCESS_ONCE(lowmem_event_head))
+		return POLLIN | POLLRDNORM;
+	return 0;
+}
+
+static const struct file_operations lowmem_event_fops = {
+	.owner = THIS_MODULE,
+	.open = lowmem_event_open,
+	.release = lowmem_event_release,
+	.read = lowmem_event_read,
+	.poll = lowmem_event_poll,
+	.llseek = no_llseek,
+};
+
+static struct miscdevice lowmem_event_misc = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "lowmemorykiller",
+	.fops = &lowmem_event_fops,
+};
+
 static struct shrinker lowmem_shrinker = {
 	.shrink = lowmem_shrink,
 	.seeks = DEFAULT_SEEKS * 16
@@ -250,6 +560,14 @@ static struct shrinker lowmem_shrinker = {
 
 static int __init lowmem_init(void)
 {
+	int ret;
+
+	ret = misc_register(&lowmem_event_misc);
+	if (ret) {
+		printk(KERN_ERR "lowmemorykiller: failed to register misc "
+		       "device, %d\n", ret);
+		return ret;
+	}
 	task_free_register(&task_nb);
 	register_shrinker(&lowmem_shrinker);
 #ifdef CONFIG_MEMORY_HOTPLUG
@@ -262,6 +580,7 @@ static void __exit lowmem_exit(void)
 {
 	unregister_shrinker(&lowmem_shrinker);
 	task_free_unregister(&task_nb);
+	misc_deregister(&lowmem_event_misc);
 }
 
 module_param_named(cost, lowmem_shrinker.seeks, int, S_IRUGO | S_IWUSR);
@@ -270,6 +589,19 @@ module_param_array_named(adj, lowmem_adj, int, &lowmem_adj_size,
 module_param_array_named(minfree, lowmem_minfree, uint, &lowmem_minfree_size,
 			 S_IRUGO | S_IWUSR);
 module_param_named(debug_level, lowmem_debug_level, uint, S_IRUGO | S_IWUSR);
+module_param_named(deathpending_ms, lowmem_deathpending_ms, uint,
+		   S_IRUGO | S_IWUSR);
+module_param_named(window_ms, lowmem_window_ms, uint, S_IRUGO | S_IWUSR);
+module_param_named(efficiency_low, lowmem_efficiency_low, uint,
+		   S_IRUGO | S_IWUSR);
+module_param_named(efficiency_high, lowmem_efficiency_high, uint,
+		   S_IRUGO | S_IWUSR);
+module_param_named(thrash_refaults, lowmem_thrash_refaults, uint,
+		   S_IRUGO | S_IWUSR);
+module_param_named(scan_count, lowmem_scan_count, ulong, S_IRUGO);
+module_param_named(scan_tasks, lowmem_scan_tasks, ulong, S_IRUGO);
+module_param_named(scan_time_us, lowmem_scan_time_us, ulong, S_IRUGO);
+module_param_named(scan_time_max_us, lowmem_scan_time_max_us, ulong, S_IRUGO);
 
 module_init(lowmem_init);
 module_exit(lowmem_exit);
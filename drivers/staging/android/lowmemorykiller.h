@@ -0,0 +1,54 @@
+/* drivers/staging/android/lowmemorykiller.h
+ *
+ * Copyright (C) 2012 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef _LINUX_LOWMEMORYKILLER_H
+#define _LINUX_LOWMEMORYKILLER_H
+
+#include <linux/types.h>
+
+/*
+ * Every read of /dev/lowmemorykiller returns one or more whole events and
+ * blocks (unless O_NONBLOCK) until there is one; poll() reports POLLIN.
+ * Each open file sees all events posted after it was opened.
+ *
+ * A process that opens the device for writing takes over the kill policy:
+ * while it holds the device open the kernel keeps reporting pressure but
+ * does not kill anything itself.
+ */
+#define LMK_EVENT_PRESSURE	1	/* pressure level changed or persists */
+#define LMK_EVENT_KILL		2	/* the kernel killed a task */
+
+#define LMK_LEVEL_NONE		0	/* above all minfree thresholds */
+#define LMK_LEVEL_LOW		1	/* below a threshold, reclaim keeps up */
+#define LMK_LEVEL_MEDIUM	2	/* below a threshold, reclaim struggles */
+#define LMK_LEVEL_CRITICAL	3	/* the working set is thrashing */
+
+struct lmk_event {
+	__u32		type;		/* LMK_EVENT_* */
+	__u32		level;		/* LMK_LEVEL_* */
+	__s32		min_adj;	/* lowest oom_adj the kernel would kill */
+	__u32		efficiency;	/* pages reclaimed per 100 scanned */
+	__u32		refaults;	/* major faults per window */
+	__u32		free_pages;
+	__u32		file_pages;
+	__s32		pid;		/* LMK_EVENT_KILL: the victim */
+	__s32		oom_adj;
+	__u32		rss_pages;	/* including ion buffers held */
+	__u32		lost;		/* events this reader missed before */
+	__u32		__pad;
+	__s64		time_ns;	/* CLOCK_MONOTONIC */
+};
+
+#endif /* _LINUX_LOWMEMORYKILLER_H */
@@ -45,6 +45,9 @@ static size_t ram_console_old_log_size;
 
 static struct ram_console_buffer *ram_console_buffer;
 static size_t ram_console_buffer_size;
+
+static void *ram_console_logger_buffer;
+static size_t ram_console_logger_buffer_size;
 #ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION
 static char *ram_console_par_buffer;
 static struct rs_control *ram_console_rs_decoder;
@@ -361,9 +364,20 @@ static int ram_console_driver_probe(struct platform_device *pdev)
 		return -ENOMEM;
 	}
 
-	if (pdata)
+	if (pdata) {
 		bootinfo = pdata->bootinfo;
 
+		if (pdata->logger_size &&
+		    pdata->logger_size < buffer_size / 2) {
+			buffer_size -= pdata->logger_size;
+			ram_console_logger_buffer = buffer + buffer_size;
+			ram_console_logger_buffer_size = pdata->logger_size;
+			printk(KERN_INFO "ram_console: %zx bytes at %zx for "
+			       "the logger\n", pdata->logger_size,
+			       start + buffer_size);
+		}
+	}
+
 	return ram_console_init(buffer, buffer_size, bootinfo, NULL/* allocate */);
 }
 
@@ -382,6 +396,17 @@ static int __init ram_console_module_init(void)
 }
 #endif
 
+/*
+ * ram_console_logger_area - the part of the persistent region set aside by
+ * the platform for the logger, or NULL.
+ */
+void *ram_console_logger_area(size_t *size)
+{
+	*size = ram_console_logger_buffer_size;
+	return ram_console_logger_buffer;
+}
+EXPORT_SYMBOL(ram_console_logger_area);
+
 static ssize_t ram_console_read_old(struct file *file, char __user *buf,
 				    size_t len, loff_t *offset)
 {
@@ -0,0 +1,289 @@
+/*
+ * Compression stream management for zram
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#define KMSG_COMPONENT "zram"
+#define pr_fmt(fmt) KMSG_COMPONENT ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/mm.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+
+#include "zcomp.h"
+#include "zcomp_lzo.h"
+#ifdef CONFIG_ZRAM_LZ4_COMPRESS
+#include "zcomp_lz4.h"
+#endif
+
+static struct zcomp_backend *backends[] = {
+	&zcomp_lzo,
+#ifdef CONFIG_ZRAM_LZ4_COMPRESS
+	&zcomp_lz4,
+#endif
+	NULL
+};
+
+static struct zcomp_backend *find_backend(const char *compress)
+{
+	int i;
+
+	for (i = 0; backends[i]; i++) {
+		if (sysfs_streq(compress, backends[i]->name))
+			return backends[i];
+	}
+	return NULL;
+}
+
+static void zcomp_strm_free(struct zcomp *comp, struct zcomp_strm *zstrm)
+{
+	if (zstrm->private)
+		comp->backend->destroy(zstrm->private);
+	free_pages((unsigned long)zstrm->buffer, 1);
+	kfree(zstrm);
+}
+
+/*
+ * Allocate a new compression stream. The output buffer is two pages
+ * since the compressor may expand incompressible input.
+ */
+static struct zcomp_strm *zcomp_strm_alloc(struct zcomp *comp, gfp_t flags)
+{
+	struct zcomp_strm *zstrm;
+
+	zstrm = kmalloc(sizeof(*zstrm), flags);
+	if (!zstrm)
+		return NULL;
+
+	zstrm->private = comp->backend->create(flags);
+	zstrm->buffer = (void *)__get_free_pages(flags | __GFP_ZERO, 1);
+	if (!zstrm->private || !zstrm->buffer) {
+		zcomp_strm_free(comp, zstrm);
+		return NULL;
+	}
+
+	return zstrm;
+}
+
+/*
+ * Get an idle stream or create a new one if we are still below
+ * max_strm. Otherwise, wait for some other writer to release one.
+ * The returned stream is exclusively owned by the caller until
+ * zcomp_strm_release().
+ */
+struct zcomp_strm *zcomp_strm_find(struct zcomp *comp)
+{
+	struct zcomp_strm *zstrm;
+
+	while (1) {
+		spin_lock(&comp->strm_lock);
+		if (!list_empty(&comp->idle_strm)) {
+			zstrm = list_entry(comp->idle_strm.next,
+					struct zcomp_strm, list);
+			list_del(&zstrm->list);
+			spin_unlock(&comp->strm_lock);
+			return zstrm;
+		}
+
+		if (comp->avail_strm >= comp->max_strm) {
+			spin_unlock(&comp->strm_lock);
+			wait_event(comp->strm_wait,
+				!list_empty(&comp->idle_strm));
+			continue;
+		}
+
+		comp->avail_strm++;
+		spin_unlock(&comp->strm_lock);
+
+		/* We are in the block I/O path, avoid recursing into it */
+		zstrm = zcomp_strm_alloc(comp, GFP_NOIO);
+		if (zstrm)
+			return zstrm;
+
+		spin_lock(&comp->strm_lock);
+		comp->avail_strm--;
+		spin_unlock(&comp->strm_lock);
+
+		/*
+		 * Could not allocate a new stream. There is always at
+		 * least one stream around (allocated at create time), so
+		 * just wait for it.
+		 */
+		wait_event(comp->strm_wait, !list_empty(&comp->idle_strm));
+	}
+}
+
+void zcomp_strm_release(struct zcomp *comp, struct zcomp_strm *zstrm)
+{
+	spin_lock(&comp->strm_lock);
+	list_add(&zstrm->list, &comp->idle_strm);
+	spin_unlock(&comp->strm_lock);
+
+	wake_up(&comp->strm_wait);
+}
+
+int zcomp_compress(struct zcomp *comp, struct zcomp_strm *zstrm,
+		const unsigned char *src, size_t *dst_len)
+{
+	return comp->backend->compress(src, zstrm->buffer, dst_len,
+			zstrm->private);
+}
+
+int zcomp_decompress(struct zcomp *comp, const unsigned char *src,
+		size_t src_len, unsigned char *dst)
+{
+	return comp->backend->decompress(src, src_len, dst);
+}
+
+/* show available compressors, the selected one in square brackets */
+ssize_t zcomp_available_show(const char *comp, char *buf)
+{
+	ssize_t sz = 0;
+	int i;
+
+	for (i = 0; backends[i]; i++) {
+		if (sysfs_streq(comp, backends[i]->name))
+			sz += sprintf(buf + sz, "[%s] ", backends[i]->name);
+		else
+			sz += sprintf(buf + sz, "%s ", backends[i]->name);
+	}
+	sz += sprintf(buf + sz, "\n");
+	return sz;
+}
+
+bool zcomp_available_algorithm(const char *comp)
+{
+	return find_backend(comp) != NULL;
+}
+
+/*
+ * Run every available backend over the given page sized buffers and
+ * report compression ratio, compression and decompression throughput.
+ * Each page is also verified to survive the round trip.
+ */
+ssize_t zcomp_bench(void **pages, int nr_pages, char *buf)
+{
+	ssize_t sz = 0;
+	int i, n;
+
+	for (i = 0; backends[i]; i++) {
+		struct zcomp_backend *backend = backends[i];
+		u64 comp_ns = 0, decomp_ns = 0, bytes, compr_bytes = 0;
+		unsigned char *dst, *out;
+		void *private;
+		int errors = 0;
+
+		private = backend->create(GFP_KERNEL);
+		dst = (void *)__get_free_pages(GFP_KERNEL, 1);
+		out = kmalloc(PAGE_SIZE, GFP_KERNEL);
+		if (!private || !dst || !out) {
+			if (private)
+				backend->destroy(private);
+			free_pages((unsigned long)dst, 1);
+			kfree(out);
+			return -ENOMEM;
+		}
+
+		for (n = 0; n < nr_pages; n++) {
+			size_t clen;
+			ktime_t start;
+
+			start = ktime_get();
+			if (backend->compress(pages[n], dst, &clen, private)) {
+				errors++;
+				continue;
+			}
+			comp_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+			compr_bytes += clen;
+
+			start = ktime_get();
+			if (backend->decompress(dst, clen, out))
+				errors++;
+			decomp_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+
+			if (memcmp(out, pages[n], PAGE_SIZE))
+				errors++;
+
+			cond_resched();
+		}
+
+		backend->destroy(private);
+		free_pages((unsigned long)dst, 1);
+		kfree(out);
+
+		/* bytes per ns * 1000 == MB/s */
+		bytes = (u64)nr_pages << PAGE_SHIFT;
+		sz += scnprintf(buf + sz, PAGE_SIZE - sz,
+			"%-4s pages: %d ratio: %llu%% comp: %llu MB/s "
+			"decomp: %llu MB/s errors: %d\n",
+			backend->name, nr_pages,
+			compr_bytes ? div64_u64(bytes * 100, compr_bytes) : 0,
+			comp_ns ? div64_u64(bytes * 1000, comp_ns) : 0,
+			decomp_ns ? div64_u64(bytes * 1000, decomp_ns) : 0,
+			errors);
+	}
+
+	return sz;
+}
+
+void zcomp_destroy(struct zcomp *comp)
+{
+	struct zcomp_strm *zstrm;
+
+	while (!list_empty(&comp->idle_strm)) {
+		zstrm = list_entry(comp->idle_strm.next,
+				struct zcomp_strm, list);
+		list_del(&zstrm->list);
+		zcomp_strm_free(comp, zstrm);
+	}
+	kfree(comp);
+}
+
+/*
+ * Create a stream pool for the 'compress' algorithm allowing up to
+ * max_strm concurrent compressions. One stream is allocated upfront so
+ * that writers can always make progress, even under memory pressure.
+ */
+struct zcomp *zcomp_create(const char *compress, int max_strm)
+{
+	struct zcomp *comp;
+	struct zcomp_backend *backend;
+	struct zcomp_strm *zstrm;
+
+	backend = find_backend(compress);
+	if (!backend)
+		return NULL;
+
+	comp = kzalloc(sizeof(*comp), GFP_KERNEL);
+	if (!comp)
+		return NULL;
+
+	comp->backend = backend;
+
+	spin_lock_init(&comp->strm_lock);
+	INIT_LIST_HEAD(&comp->idle_strm);
+	init_waitqueue_head(&comp->strm_wait);
+	comp->max_strm = max_strm;
+
+	zstrm = zcomp_strm_alloc(comp, GFP_KERNEL);
+	if (!zstrm) {
+		kfree(comp);
+		return NULL;
+	}
+
+	list_add(&zstrm->list, &comp->idle_strm);
+	comp->avail_strm = 1;
+
+	return comp;
+}
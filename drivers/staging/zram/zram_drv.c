@@ -28,28 +28,31 @@
 #include <linux/device.h>
 #include <linux/genhd.h>
 #include <linux/highmem.h>
+#include <linux/jiffies.h>
 #include <linux/slab.h>
-#include <linux/lzo.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 
 #include "zram_drv.h"
+#include "zram_dedup.h"
 
 /* Globals */
 static int zram_major;
+static struct kmem_cache *zram_entry_cache;
 struct zram *devices;
 
 /* Module params (documentation at end) */
 unsigned int num_devices;
 
-static void zram_stat_inc(u32 *v)
+static void zram_stat_inc(atomic_t *v)
 {
-	*v = *v + 1;
+	atomic_inc(v);
 }
 
-static void zram_stat_dec(u32 *v)
+static void zram_stat_dec(atomic_t *v)
 {
-	*v = *v - 1;
+	atomic_dec(v);
 }
 
 static void zram_stat64_add(struct zram *zram, u64 *v, u64 inc)
@@ -133,15 +136,178 @@ static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 	zram->disksize &= PAGE_MASK;
 }
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+static void zram_touch(struct zram *zram, u32 index)
+{
+	zram->table[index].ac_time = jiffies;
+}
+
+/*
+ * Grab a free block on the backing device. Block 0 is never handed out
+ * so that a written back slot can't be mistaken for an empty one.
+ */
+static unsigned long zram_alloc_bdev_block(struct zram *zram)
+{
+	unsigned long blk = 1;
+
+	do {
+		blk = find_next_zero_bit(zram->bitmap, zram->nr_pages, blk);
+		if (blk == zram->nr_pages)
+			return 0;
+	} while (test_and_set_bit(blk, zram->bitmap));
+
+	return blk;
+}
+
+static void zram_free_bdev_block(struct zram *zram, unsigned long blk)
+{
+	WARN_ON_ONCE(!test_and_clear_bit(blk, zram->bitmap));
+}
+
+static void zram_bdev_end_io(struct bio *bio, int err)
+{
+	complete(bio->bi_private);
+}
+
+/* Synchronously transfer one page to or from backing block 'blk' */
+static int zram_bdev_rw(struct zram *zram, struct page *page,
+			unsigned long blk, int rw)
+{
+	int ret;
+	struct bio *bio;
+	DECLARE_COMPLETION_ONSTACK(done);
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	if (!bio)
+		return -ENOMEM;
+
+	bio->bi_sector = blk << SECTORS_PER_PAGE_SHIFT;
+	bio->bi_bdev = zram->bdev;
+	if (!bio_add_page(bio, page, PAGE_SIZE, 0)) {
+		bio_put(bio);
+		return -EIO;
+	}
+	bio->bi_end_io = zram_bdev_end_io;
+	bio->bi_private = &done;
+
+	submit_bio(rw | REQ_SYNC, bio);
+	wait_for_completion(&done);
+
+	ret = test_bit(BIO_UPTODATE, &bio->bi_flags) ? 0 : -EIO;
+	bio_put(bio);
+
+	return ret;
+}
+
+struct zram_bdev_work {
+	struct work_struct work;
+	struct zram *zram;
+	struct page *page;
+	unsigned long blk;
+	int ret;
+};
+
+static void zram_bdev_read_work(struct work_struct *work)
+{
+	struct zram_bdev_work *zw = container_of(work,
+					struct zram_bdev_work, work);
+
+	zw->ret = zram_bdev_rw(zw->zram, zw->page, zw->blk, READ);
+}
+
+/*
+ * Bios submitted from within our own make_request function are only
+ * queued on current->bio_list and dispatched after we return, so
+ * waiting for one here would deadlock. Hand such reads to a worker.
+ */
+static int zram_read_from_bdev(struct zram *zram, struct page *page,
+				unsigned long blk)
+{
+	struct zram_bdev_work zw;
+
+	zram_stat64_inc(zram, &zram->stats.bd_reads);
+
+	if (!current->bio_list)
+		return zram_bdev_rw(zram, page, blk, READ);
+
+	zw.zram = zram;
+	zw.page = page;
+	zw.blk = blk;
+	INIT_WORK_ONSTACK(&zw.work, zram_bdev_read_work);
+	schedule_work(&zw.work);
+	flush_work(&zw.work);
+	destroy_work_on_stack(&zw.work);
+
+	return zw.ret;
+}
+#else
+static inline void zram_touch(struct zram *zram, u32 index) {}
+
+static inline void zram_free_bdev_block(struct zram *zram,
+					unsigned long blk) {}
+
+static inline int zram_read_from_bdev(struct zram *zram, struct page *page,
+				unsigned long blk)
+{
+	return -EIO;
+}
+#endif
+
+static struct zram_entry *zram_entry_alloc(struct zram *zram, size_t len)
+{
+	struct zram_entry *entry;
+
+	entry = kmem_cache_alloc(zram_entry_cache, GFP_NOIO);
+	if (!entry)
+		return NULL;
+
+	entry->handle = zs_malloc(zram->mem_pool, len);
+	if (!entry->handle) {
+		kmem_cache_free(zram_entry_cache, entry);
+		return NULL;
+	}
+
+	entry->len = len;
+	entry->refcount = 1;
+
+	return entry;
+}
+
+/*
+ * Drop a reference to entry, freeing its object once the last table
+ * entry sharing it is gone.
+ */
+static void zram_entry_put(struct zram *zram, struct zram_entry *entry)
+{
+	if (zram_dedup_put(zram, entry)) {
+		zram_stat64_sub(zram, &zram->stats.dup_size, entry->len);
+		return;
+	}
+
+	zram_stat64_sub(zram, &zram->stats.compr_size, entry->len);
+	zs_free(zram->mem_pool, entry->handle);
+	kmem_cache_free(zram_entry_cache, entry);
+}
+
+/*
+ * Release the memory backing table entry 'index'.
+ * Must be called with zram->tb_lock held for writing.
+ */
 static void zram_free_page(struct zram *zram, size_t index)
 {
-	u32 clen;
-	void *obj;
+	struct zram_entry *entry = zram->table[index].entry;
 
-	struct page *page = zram->table[index].page;
-	u32 offset = zram->table[index].offset;
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
 
-	if (unlikely(!page)) {
+	if (unlikely(zram_test_flag(zram, index, ZRAM_WB))) {
+		zram_free_bdev_block(zram, zram->table[index].element);
+		zram_clear_flag(zram, index, ZRAM_WB);
+		zram->table[index].element = 0;
+		zram_stat_dec(&zram->stats.pages_wb);
+		return;
+	}
+
+	if (unlikely(!entry)) {
 		/*
 		 * No memory is allocated for zero filled pages.
 		 * Simply clear zero page flag.
@@ -154,27 +320,16 @@ static void zram_free_page(struct zram *zram, size_t index)
 	}
 
 	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-		clen = PAGE_SIZE;
-		__free_page(page);
 		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
 		zram_stat_dec(&zram->stats.pages_expand);
-		goto out;
-	}
-
-	obj = kmap_atomic(page, KM_USER0) + offset;
-	clen = xv_get_object_size(obj) - sizeof(struct zobj_header);
-	kunmap_atomic(obj, KM_USER0);
-
-	xv_free(zram->mem_pool, page, offset);
-	if (clen <= PAGE_SIZE / 2)
+	} else if (entry->len <= PAGE_SIZE / 2) {
 		zram_stat_dec(&zram->stats.good_compress);
+	}
 
-out:
-	zram_stat64_sub(zram, &zram->stats.compr_size, clen);
+	zram_entry_put(zram, entry);
 	zram_stat_dec(&zram->stats.pages_stored);
 
-	zram->table[index].page = NULL;
-	zram->table[index].offset = 0;
+	zram->table[index].entry = NULL;
 }
 
 static void handle_zero_page(struct page *page)
@@ -193,81 +348,107 @@ static void handle_uncompressed_page(struct zram *zram,
 {
 	unsigned char *user_mem, *cmem;
 
+	struct zram_entry *entry = zram->table[index].entry;
+
 	user_mem = kmap_atomic(page, KM_USER0);
-	cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-			zram->table[index].offset;
+	cmem = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_RO);
 
 	memcpy(user_mem, cmem, PAGE_SIZE);
+	zs_unmap_object(zram->mem_pool, entry->handle);
 	kunmap_atomic(user_mem, KM_USER0);
-	kunmap_atomic(cmem, KM_USER1);
 
 	flush_dcache_page(page);
 }
 
-static void zram_read(struct zram *zram, struct bio *bio)
+static int zram_bvec_read(struct zram *zram, struct page *page, u32 index)
 {
+	int ret;
+	bool stale;
+	struct zram_entry *entry;
+	unsigned char *user_mem, *cmem;
 
-	int i;
-	u32 index;
-	struct bio_vec *bvec;
+again:
+	read_lock(&zram->tb_lock);
+	zram_touch(zram, index);
 
-	zram_stat64_inc(zram, &zram->stats.num_reads);
-	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
+	if (zram_test_flag(zram, index, ZRAM_ZERO)) {
+		read_unlock(&zram->tb_lock);
+		handle_zero_page(page);
+		return 0;
+	}
 
-	bio_for_each_segment(bvec, bio, i) {
-		int ret;
-		size_t clen;
-		struct page *page;
-		struct zobj_header *zheader;
-		unsigned char *user_mem, *cmem;
+	/* Page lives on the backing device */
+	if (unlikely(zram_test_flag(zram, index, ZRAM_WB))) {
+		unsigned long blk = zram->table[index].element;
 
-		page = bvec->bv_page;
+		read_unlock(&zram->tb_lock);
+		ret = zram_read_from_bdev(zram, page, blk);
 
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			handle_zero_page(page);
-			index++;
-			continue;
-		}
+		/*
+		 * The slot lock is not held across the I/O. If the slot was
+		 * rewritten or freed meanwhile, blk may have been handed out
+		 * again and overwritten by another writeback, so start over.
+		 */
+		read_lock(&zram->tb_lock);
+		stale = !zram_test_flag(zram, index, ZRAM_WB) ||
+			zram->table[index].element != blk;
+		read_unlock(&zram->tb_lock);
+		if (unlikely(stale))
+			goto again;
+
+		return ret;
+	}
 
-		/* Requested page is not present in compressed area */
-		if (unlikely(!zram->table[index].page)) {
-			pr_debug("Read before write: sector=%lu, size=%u",
-				(ulong)(bio->bi_sector), bio->bi_size);
-			handle_zero_page(page);
-			index++;
-			continue;
-		}
+	/* Requested page is not present in compressed area */
+	entry = zram->table[index].entry;
+	if (unlikely(!entry)) {
+		read_unlock(&zram->tb_lock);
+		pr_debug("Read before write: index=%u\n", index);
+		handle_zero_page(page);
+		return 0;
+	}
 
-		/* Page is stored uncompressed since it's incompressible */
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-			handle_uncompressed_page(zram, page, index);
-			index++;
-			continue;
-		}
+	/* Page is stored uncompressed since it's incompressible */
+	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
+		handle_uncompressed_page(zram, page, index);
+		read_unlock(&zram->tb_lock);
+		return 0;
+	}
 
-		user_mem = kmap_atomic(page, KM_USER0);
-		clen = PAGE_SIZE;
+	user_mem = kmap_atomic(page, KM_USER0);
+	cmem = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_RO);
 
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+	ret = zcomp_decompress(zram->comp, cmem, entry->len, user_mem);
 
-		ret = lzo1x_decompress_safe(
-			cmem + sizeof(*zheader),
-			xv_get_object_size(cmem) - sizeof(*zheader),
-			user_mem, &clen);
+	zs_unmap_object(zram->mem_pool, entry->handle);
+	kunmap_atomic(user_mem, KM_USER0);
+	read_unlock(&zram->tb_lock);
 
-		kunmap_atomic(user_mem, KM_USER0);
-		kunmap_atomic(cmem, KM_USER1);
+	/* Should NEVER happen. Return bio error if it does. */
+	if (unlikely(ret)) {
+		pr_err("Decompression failed! err=%d, page=%u\n",
+			ret, index);
+		return ret;
+	}
+
+	flush_dcache_page(page);
+	return 0;
+}
+
+static void zram_read(struct zram *zram, struct bio *bio)
+{
+	int i;
+	u32 index;
+	struct bio_vec *bvec;
 
-		/* Should NEVER happen. Return bio error if it does. */
-		if (unlikely(ret != LZO_E_OK)) {
-			pr_err("Decompression failed! err=%d, page=%u\n",
-				ret, index);
+	zram_stat64_inc(zram, &zram->stats.num_reads);
+	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
+
+	bio_for_each_segment(bvec, bio, i) {
+		if (zram_bvec_read(zram, bvec->bv_page, index)) {
 			zram_stat64_inc(zram, &zram->stats.failed_reads);
 			goto out;
 		}
-
-		flush_dcache_page(page);
 		index++;
 	}
 
@@ -279,121 +460,135 @@ out:
 	bio_io_error(bio);
 }
 
-static void zram_write(struct zram *zram, struct bio *bio)
+/*
+ * Publish entry as the content of page 'index', replacing whatever was
+ * stored there before.
+ */
+static void zram_set_entry(struct zram *zram, u32 index,
+			struct zram_entry *entry)
 {
-	int i;
-	u32 index;
-	struct bio_vec *bvec;
-
-	zram_stat64_inc(zram, &zram->stats.num_writes);
-	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
+	write_lock(&zram->tb_lock);
+	zram_free_page(zram, index);
+	zram->table[index].entry = entry;
+	zram_touch(zram, index);
+	if (unlikely(entry->len == PAGE_SIZE)) {
+		zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
+		zram_stat_inc(&zram->stats.pages_expand);
+	} else if (entry->len <= PAGE_SIZE / 2) {
+		zram_stat_inc(&zram->stats.good_compress);
+	}
+	write_unlock(&zram->tb_lock);
 
-	bio_for_each_segment(bvec, bio, i) {
-		int ret;
-		u32 offset;
-		size_t clen;
-		struct zobj_header *zheader;
-		struct page *page, *page_store;
-		unsigned char *user_mem, *cmem, *src;
+	zram_stat_inc(&zram->stats.pages_stored);
+}
 
-		page = bvec->bv_page;
-		src = zram->compress_buffer;
+/*
+ * Compress and store a single page. Compression runs on a private
+ * stream from the zcomp pool and the object is allocated and filled
+ * before the table lock is taken, so writers to different pages only
+ * serialize on the (short) table update.
+ */
+static int zram_bvec_write(struct zram *zram, struct page *page, u32 index)
+{
+	int ret;
+	u32 checksum = 0;
+	size_t clen;
+	struct zram_entry *entry = NULL;
+	struct zcomp_strm *zstrm;
+	unsigned char *user_mem, *cmem, *src;
 
-		/*
-		 * System overwrites unused sectors. Free memory associated
-		 * with this sector now.
-		 */
-		if (zram->table[index].page ||
-				zram_test_flag(zram, index, ZRAM_ZERO))
-			zram_free_page(zram, index);
-
-		mutex_lock(&zram->lock);
-
-		user_mem = kmap_atomic(page, KM_USER0);
-		if (page_zero_filled(user_mem)) {
-			kunmap_atomic(user_mem, KM_USER0);
-			mutex_unlock(&zram->lock);
-			zram_stat_inc(&zram->stats.pages_zero);
-			zram_set_flag(zram, index, ZRAM_ZERO);
-			index++;
-			continue;
-		}
+	user_mem = kmap_atomic(page, KM_USER0);
+	if (page_zero_filled(user_mem)) {
+		kunmap_atomic(user_mem, KM_USER0);
+		write_lock(&zram->tb_lock);
+		zram_free_page(zram, index);
+		zram_set_flag(zram, index, ZRAM_ZERO);
+		zram_touch(zram, index);
+		write_unlock(&zram->tb_lock);
+		zram_stat_inc(&zram->stats.pages_zero);
+		return 0;
+	}
+	kunmap_atomic(user_mem, KM_USER0);
 
-		ret = lzo1x_1_compress(user_mem, PAGE_SIZE, src, &clen,
-					zram->compress_workmem);
+	/* May sleep waiting for a stream to become available */
+	zstrm = zcomp_strm_find(zram->comp);
 
+	user_mem = kmap_atomic(page, KM_USER0);
+	if (zram->use_dedup)
+		entry = zram_dedup_find(zram, user_mem, zstrm->buffer,
+					&checksum);
+	if (entry) {
 		kunmap_atomic(user_mem, KM_USER0);
+		zcomp_strm_release(zram->comp, zstrm);
 
-		if (unlikely(ret != LZO_E_OK)) {
-			mutex_unlock(&zram->lock);
-			pr_err("Compression failed! err=%d\n", ret);
-			zram_stat64_inc(zram, &zram->stats.failed_writes);
-			goto out;
-		}
+		zram_stat64_add(zram, &zram->stats.dup_size, entry->len);
+		zram_stat64_inc(zram, &zram->stats.dedup_hits);
+		zram_set_entry(zram, index, entry);
+		return 0;
+	}
+	ret = zcomp_compress(zram->comp, zstrm, user_mem, &clen);
+	kunmap_atomic(user_mem, KM_USER0);
 
-		/*
-		 * Page is incompressible. Store it as-is (uncompressed)
-		 * since we do not want to return too many disk write
-		 * errors which has side effect of hanging the system.
-		 */
-		if (unlikely(clen > max_zpage_size)) {
-			clen = PAGE_SIZE;
-			page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
-			if (unlikely(!page_store)) {
-				mutex_unlock(&zram->lock);
-				pr_info("Error allocating memory for "
-					"incompressible page: %u\n", index);
-				zram_stat64_inc(zram,
-					&zram->stats.failed_writes);
-				goto out;
-			}
-
-			offset = 0;
-			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
-			zram_stat_inc(&zram->stats.pages_expand);
-			zram->table[index].page = page_store;
-			src = kmap_atomic(page, KM_USER0);
-			goto memstore;
-		}
+	if (unlikely(ret)) {
+		zcomp_strm_release(zram->comp, zstrm);
+		pr_err("Compression failed! err=%d\n", ret);
+		return ret;
+	}
 
-		if (xv_malloc(zram->mem_pool, clen + sizeof(*zheader),
-				&zram->table[index].page, &offset,
-				GFP_NOIO | __GFP_HIGHMEM)) {
-			mutex_unlock(&zram->lock);
-			pr_info("Error allocating memory for compressed "
-				"page: %u, size=%zu\n", index, clen);
-			zram_stat64_inc(zram, &zram->stats.failed_writes);
-			goto out;
-		}
+	/*
+	 * Page is incompressible. Store it as-is (uncompressed)
+	 * since we do not want to return too many disk write
+	 * errors which has side effect of hanging the system.
+	 */
+	if (unlikely(clen > max_zpage_size))
+		clen = PAGE_SIZE;
+
+	entry = zram_entry_alloc(zram, clen);
+	if (unlikely(!entry)) {
+		zcomp_strm_release(zram->comp, zstrm);
+		pr_info("Error allocating memory for compressed "
+			"page: %u, size=%zu\n", index, clen);
+		return -ENOMEM;
+	}
+
+	cmem = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_WO);
+	if (unlikely(clen == PAGE_SIZE)) {
+		src = kmap_atomic(page, KM_USER0);
+		memcpy(cmem, src, clen);
+		kunmap_atomic(src, KM_USER0);
+	} else {
+		memcpy(cmem, zstrm->buffer, clen);
+	}
+	zs_unmap_object(zram->mem_pool, entry->handle);
 
-memstore:
-		zram->table[index].offset = offset;
+	zcomp_strm_release(zram->comp, zstrm);
 
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+	zram_stat64_add(zram, &zram->stats.compr_size, clen);
+	zram_dedup_insert(zram, entry, checksum);
 
-#if 0
-		/* Back-reference needed for memory defragmentation */
-		if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
-			zheader = (struct zobj_header *)cmem;
-			zheader->table_idx = index;
-			cmem += sizeof(*zheader);
-		}
-#endif
+	/*
+	 * System overwrites unused sectors. Free memory associated
+	 * with this sector now and publish the new object.
+	 */
+	zram_set_entry(zram, index, entry);
 
-		memcpy(cmem, src, clen);
+	return 0;
+}
 
-		kunmap_atomic(cmem, KM_USER1);
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			kunmap_atomic(src, KM_USER0);
+static void zram_write(struct zram *zram, struct bio *bio)
+{
+	int i;
+	u32 index;
+	struct bio_vec *bvec;
 
-		/* Update stats */
-		zram_stat64_add(zram, &zram->stats.compr_size, clen);
-		zram_stat_inc(&zram->stats.pages_stored);
-		if (clen <= PAGE_SIZE / 2)
-			zram_stat_inc(&zram->stats.good_compress);
+	zram_stat64_inc(zram, &zram->stats.num_writes);
+	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
 
-		mutex_unlock(&zram->lock);
+	bio_for_each_segment(bvec, bio, i) {
+		if (zram_bvec_write(zram, bvec->bv_page, index)) {
+			zram_stat64_inc(zram, &zram->stats.failed_writes);
+			goto out;
+		}
 		index++;
 	}
 
@@ -453,6 +648,255 @@ static int zram_make_request(struct request_queue *queue, struct bio *bio)
 	return 0;
 }
 
+/*
+ * Benchmark all available compressors over a sample of the pages
+ * currently stored in the device, i.e. over real data (typically
+ * swapped out anonymous memory) rather than synthetic patterns.
+ */
+ssize_t zram_comp_bench(struct zram *zram, char *buf)
+{
+	ssize_t ret;
+	size_t index, num_pages;
+	unsigned int stride, seen = 0;
+	int i, nr_pages = 0;
+	struct page **pages;
+	void **bufs;
+
+	pages = kcalloc(max_bench_pages, sizeof(*pages), GFP_KERNEL);
+	bufs = kcalloc(max_bench_pages, sizeof(*bufs), GFP_KERNEL);
+	if (!pages || !bufs) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	mutex_lock(&zram->init_lock);
+	if (!zram->init_done) {
+		mutex_unlock(&zram->init_lock);
+		ret = -ENODEV;
+		goto out;
+	}
+
+	/* Spread the sample over the whole device */
+	stride = max(1U, (unsigned)atomic_read(&zram->stats.pages_stored) /
+			max_bench_pages);
+	num_pages = zram->disksize >> PAGE_SHIFT;
+
+	for (index = 0; index < num_pages && nr_pages < max_bench_pages;
+			index++) {
+		if (!zram->table[index].entry)
+			continue;
+		if (seen++ % stride)
+			continue;
+
+		pages[nr_pages] = alloc_page(GFP_KERNEL);
+		if (!pages[nr_pages])
+			break;
+		if (zram_bvec_read(zram, pages[nr_pages], index)) {
+			__free_page(pages[nr_pages]);
+			pages[nr_pages] = NULL;
+			continue;
+		}
+		bufs[nr_pages] = page_address(pages[nr_pages]);
+		nr_pages++;
+	}
+	mutex_unlock(&zram->init_lock);
+
+	if (!nr_pages) {
+		ret = sprintf(buf, "no pages stored\n");
+		goto out;
+	}
+
+	ret = zcomp_bench(bufs, nr_pages, buf);
+
+out:
+	if (pages) {
+		for (i = 0; i < nr_pages; i++)
+			__free_page(pages[i]);
+	}
+	kfree(bufs);
+	kfree(pages);
+	return ret;
+}
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+/*
+ * Attach the block device at 'path' as backing store. The device is
+ * claimed exclusively and carved into page sized blocks.
+ */
+int zram_set_backing_dev(struct zram *zram, const char *path)
+{
+	int ret;
+	char *name;
+	unsigned long nr_pages, *bitmap = NULL;
+	struct block_device *bdev;
+
+	name = kstrdup(path, GFP_KERNEL);
+	if (!name)
+		return -ENOMEM;
+	strim(name);
+
+	mutex_lock(&zram->init_lock);
+	if (zram->init_done || zram->bdev) {
+		pr_info("Cannot change backing device for initialized "
+			"device\n");
+		ret = -EBUSY;
+		goto out;
+	}
+
+	bdev = blkdev_get_by_path(name, FMODE_READ | FMODE_WRITE |
+				FMODE_EXCL, zram);
+	if (IS_ERR(bdev)) {
+		ret = PTR_ERR(bdev);
+		goto out;
+	}
+
+	nr_pages = i_size_read(bdev->bd_inode) >> PAGE_SHIFT;
+	if (nr_pages < 2) {
+		ret = -EINVAL;
+		goto put_bdev;
+	}
+
+	ret = set_blocksize(bdev, PAGE_SIZE);
+	if (ret)
+		goto put_bdev;
+
+	bitmap = vzalloc(BITS_TO_LONGS(nr_pages) * sizeof(long));
+	if (!bitmap) {
+		ret = -ENOMEM;
+		goto put_bdev;
+	}
+
+	zram->bdev = bdev;
+	zram->backing_dev = name;
+	zram->bitmap = bitmap;
+	zram->nr_pages = nr_pages;
+	mutex_unlock(&zram->init_lock);
+
+	pr_info("setup backing device %s\n", name);
+	return 0;
+
+put_bdev:
+	blkdev_put(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+out:
+	mutex_unlock(&zram->init_lock);
+	kfree(name);
+	return ret;
+}
+
+/* Release the backing device. Called with init_lock held or on exit. */
+void zram_reset_bdev(struct zram *zram)
+{
+	if (!zram->bdev)
+		return;
+
+	blkdev_put(zram->bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	zram->bdev = NULL;
+
+	vfree(zram->bitmap);
+	zram->bitmap = NULL;
+	zram->nr_pages = 0;
+
+	kfree(zram->backing_dev);
+	zram->backing_dev = NULL;
+}
+
+/*
+ * Check whether slot 'index' should be written back and if so, mark it
+ * ZRAM_UNDER_WB. Must be called with zram->tb_lock held for writing.
+ */
+static bool zram_wb_candidate(struct zram *zram, u32 index,
+			bool huge, bool idle)
+{
+	unsigned long age = zram->wb_idle_age * HZ;
+
+	if (!zram->table[index].entry ||
+	    zram_test_flag(zram, index, ZRAM_ZERO) ||
+	    zram_test_flag(zram, index, ZRAM_WB))
+		return false;
+
+	if ((huge && zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) ||
+	    (idle && time_after(jiffies, zram->table[index].ac_time + age))) {
+		zram_set_flag(zram, index, ZRAM_UNDER_WB);
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * Move incompressible ('huge') and/or not recently accessed ('idle')
+ * pages to the backing device, freeing their memory. The slot lock is
+ * not held across the I/O: a slot that gets rewritten or freed in the
+ * meantime loses its ZRAM_UNDER_WB flag and the copy is discarded.
+ */
+int zram_writeback(struct zram *zram, bool huge, bool idle)
+{
+	int ret = 0;
+	bool wb;
+	size_t index, num_pages;
+	unsigned long blk;
+	struct page *page;
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return -ENOMEM;
+
+	mutex_lock(&zram->init_lock);
+	if (!zram->init_done || !zram->bdev) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	num_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < num_pages; index++) {
+		write_lock(&zram->tb_lock);
+		wb = zram_wb_candidate(zram, index, huge, idle);
+		write_unlock(&zram->tb_lock);
+		if (!wb)
+			continue;
+
+		blk = zram_alloc_bdev_block(zram);
+		if (!blk) {
+			ret = -ENOSPC;
+			break;
+		}
+
+		ret = zram_bvec_read(zram, page, index);
+		if (!ret)
+			ret = zram_bdev_rw(zram, page, blk, WRITE);
+		if (ret) {
+			zram_free_bdev_block(zram, blk);
+			write_lock(&zram->tb_lock);
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+			write_unlock(&zram->tb_lock);
+			break;
+		}
+
+		write_lock(&zram->tb_lock);
+		if (!zram_test_flag(zram, index, ZRAM_UNDER_WB)) {
+			/* Slot changed under us, the copy is stale */
+			write_unlock(&zram->tb_lock);
+			zram_free_bdev_block(zram, blk);
+			continue;
+		}
+		zram_free_page(zram, index);
+		zram_set_flag(zram, index, ZRAM_WB);
+		zram->table[index].element = blk;
+		write_unlock(&zram->tb_lock);
+
+		zram_stat_inc(&zram->stats.pages_wb);
+		zram_stat64_inc(zram, &zram->stats.bd_writes);
+
+		cond_resched();
+	}
+
+out:
+	mutex_unlock(&zram->init_lock);
+	__free_page(page);
+	return ret;
+}
+#endif
+
 void zram_reset_device(struct zram *zram)
 {
 	size_t index;
@@ -461,35 +905,36 @@ void zram_reset_device(struct zram *zram)
 	zram->init_done = 0;
 
 	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
-
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	if (zram->comp)
+		zcomp_destroy(zram->comp);
+	zram->comp = NULL;
 
-	/* Free all pages that are still in this zram device */
+	/*
+	 * Free all pages that are still in this zram device. Blocks on the
+	 * backing device are released along with the device below.
+	 */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
-		struct page *page;
-		u16 offset;
+		struct zram_entry *entry = zram->table[index].entry;
 
-		page = zram->table[index].page;
-		offset = zram->table[index].offset;
-
-		if (!page)
+		if (!entry || zram_test_flag(zram, index, ZRAM_WB))
 			continue;
 
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			__free_page(page);
-		else
-			xv_free(zram->mem_pool, page, offset);
+		zram_entry_put(zram, entry);
 	}
 
 	vfree(zram->table);
 	zram->table = NULL;
 
-	xv_destroy_pool(zram->mem_pool);
+	zram_dedup_fini(zram);
+
+	if (zram->mem_pool)
+		zs_destroy_pool(zram->mem_pool);
 	zram->mem_pool = NULL;
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+	zram_reset_bdev(zram);
+#endif
+
 	/* Reset stats */
 	memset(&zram->stats, 0, sizeof(zram->stats));
 
@@ -511,16 +956,9 @@ int zram_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
-		goto fail;
-	}
-
-	zram->compress_buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
+	zram->comp = zcomp_create(zram->compressor, zram->max_comp_streams);
+	if (!zram->comp) {
+		pr_err("Error allocating compression streams\n");
 		ret = -ENOMEM;
 		goto fail;
 	}
@@ -535,12 +973,19 @@ int zram_init_device(struct zram *zram)
 		goto fail;
 	}
 
+	if (zram_dedup_init(zram, num_pages)) {
+		pr_err("Error allocating dedup index\n");
+		ret = -ENOMEM;
+		goto fail;
+	}
+
 	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
 
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
-	zram->mem_pool = xv_create_pool();
+	zram->mem_pool = zs_create_pool(zram->disk->disk_name,
+					GFP_NOIO | __GFP_HIGHMEM);
 	if (!zram->mem_pool) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
@@ -566,7 +1011,9 @@ void zram_slot_free_notify(struct block_device *bdev, unsigned long index)
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
+	write_lock(&zram->tb_lock);
 	zram_free_page(zram, index);
+	write_unlock(&zram->tb_lock);
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -579,9 +1026,17 @@ static int create_device(struct zram *zram, int device_id)
 {
 	int ret = 0;
 
-	mutex_init(&zram->lock);
 	mutex_init(&zram->init_lock);
 	spin_lock_init(&zram->stat64_lock);
+	rwlock_init(&zram->tb_lock);
+
+	/* Allow one compression in flight per CPU by default */
+	zram->max_comp_streams = num_online_cpus();
+	strlcpy(zram->compressor, default_compressor,
+		sizeof(zram->compressor));
+#ifdef CONFIG_ZRAM_WRITEBACK
+	zram->wb_idle_age = default_wb_idle_age;
+#endif
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
@@ -664,11 +1119,17 @@ static int __init zram_init(void)
 		goto out;
 	}
 
+	zram_entry_cache = KMEM_CACHE(zram_entry, 0);
+	if (!zram_entry_cache) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
 	zram_major = register_blkdev(0, "zram");
 	if (zram_major <= 0) {
 		pr_warning("Unable to get major number\n");
 		ret = -EBUSY;
-		goto out;
+		goto free_cache;
 	}
 
 	if (!num_devices) {
@@ -698,6 +1159,8 @@ free_devices:
 	kfree(devices);
 unregister:
 	unregister_blkdev(zram_major, "zram");
+free_cache:
+	kmem_cache_destroy(zram_entry_cache);
 out:
 	return ret;
 }
@@ -713,11 +1176,16 @@ static void __exit zram_exit(void)
 		destroy_device(zram);
 		if (zram->init_done)
 			zram_reset_device(zram);
+#ifdef CONFIG_ZRAM_WRITEBACK
+		/* Backing device may be set on a never initialized device */
+		zram_reset_bdev(zram);
+#endif
 	}
 
 	unregister_blkdev(zram_major, "zram");
 
 	kfree(devices);
+	kmem_cache_destroy(zram_entry_cache);
 	pr_debug("Cleanup done!\n");
 }
 
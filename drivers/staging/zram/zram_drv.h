@@ -15,10 +15,13 @@
 #ifndef _ZRAM_DRV_H_
 #define _ZRAM_DRV_H_
 
+#include <linux/atomic.h>
+#include <linux/rbtree.h>
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
 
-#include "xvmalloc.h"
+#include "zsmalloc.h"
+#include "zcomp.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -26,18 +29,6 @@
  */
 static const unsigned max_num_devices = 32;
 
-/*
- * Stored at beginning of each compressed object.
- *
- * It stores back-reference to table entry which points to this
- * object. This is required to support memory defragmentation.
- */
-struct zobj_header {
-#if 0
-	u32 table_idx;
-#endif
-};
-
 /*-- Configurable parameters */
 
 /* Default zram disk size: 25% of total RAM */
@@ -49,11 +40,14 @@ static const unsigned default_disksize_perc_ram = 25;
  */
 static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 
-/*
- * NOTE: max_zpage_size must be less than or equal to:
- *   XV_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
- * otherwise, xv_malloc() would always return failure.
- */
+/* Compression algorithm used by newly initialized devices */
+static const char default_compressor[] = "lzo";
+
+/* Max number of stored pages sampled by the compressor benchmark */
+static const unsigned max_bench_pages = 256;
+
+/* Pages not accessed for this many seconds are "idle" for writeback */
+static const unsigned default_wb_idle_age = 3600;
 
 /*-- End of configurable params */
 
@@ -71,15 +65,44 @@ enum zram_pageflags {
 	/* Page consists entirely of zeros */
 	ZRAM_ZERO,
 
+	/* Page was written back to the backing device */
+	ZRAM_WB,
+
+	/* Page is being written back; cleared if the slot changes */
+	ZRAM_UNDER_WB,
+
 	__NR_ZRAM_PAGEFLAGS,
 };
 
 /*-- Data structures */
 
+/*
+ * A stored object. With deduplication enabled, identical pages share
+ * one entry, found through the checksum of their uncompressed data.
+ */
+struct zram_entry {
+	struct rb_node rb_node;	/* link in zram->hash[].rb_root */
+	unsigned long handle;	/* zsmalloc handle */
+	unsigned long refcount;	/* no. of table entries using it */
+	u32 checksum;		/* of the uncompressed page */
+	u16 len;		/* object size, PAGE_SIZE if uncompressed */
+};
+
+/* Dedup index bucket: entries sorted by checksum */
+struct zram_hash {
+	spinlock_t lock;
+	struct rb_root rb_root;
+};
+
 /* Allocated for each disk page */
 struct table {
-	struct page *page;
-	u16 offset;
+	union {
+		struct zram_entry *entry;	/* NULL if nothing stored */
+		unsigned long element;		/* backing block if ZRAM_WB */
+	};
+#ifdef CONFIG_ZRAM_WRITEBACK
+	unsigned long ac_time;	/* jiffies of last access */
+#endif
 	u8 count;	/* object ref count (not yet used) */
 	u8 flags;
 } __attribute__((aligned(4)));
@@ -92,20 +115,36 @@ struct zram_stats {
 	u64 failed_writes;	/* can happen when memory is too low */
 	u64 invalid_io;		/* non-page-aligned I/O requests */
 	u64 notify_free;	/* no. of swap slot free notifications */
-	u32 pages_zero;		/* no. of zero filled pages */
-	u32 pages_stored;	/* no. of pages currently stored */
-	u32 good_compress;	/* % of pages with compression ratio<=50% */
-	u32 pages_expand;	/* % of incompressible pages */
+	u64 dup_size;		/* compressed bytes saved by dedup */
+	u64 dedup_hits;		/* no. of writes served by dedup */
+	u64 bd_reads;		/* no. of pages read from backing device */
+	u64 bd_writes;		/* no. of pages written back */
+	atomic_t pages_zero;	/* no. of zero filled pages */
+	atomic_t pages_stored;	/* no. of pages currently stored */
+	atomic_t good_compress;	/* % of pages with compression ratio<=50% */
+	atomic_t pages_expand;	/* % of incompressible pages */
+	atomic_t pages_wb;	/* no. of pages on backing device */
 };
 
 struct zram {
-	struct xv_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
+	struct zs_pool *mem_pool;
+	struct zcomp *comp;
 	struct table *table;
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct mutex lock;	/* protect compression buffers against
-				 * concurrent writes */
+	rwlock_t tb_lock;	/* protect table entries against
+				 * concurrent update and lookup */
+	int max_comp_streams;	/* no. of concurrent compressions */
+	char compressor[10];	/* compression algorithm name */
+	bool use_dedup;		/* share identical pages */
+	struct zram_hash *hash;	/* dedup index */
+	size_t hash_size;	/* no. of buckets, power of two */
+#ifdef CONFIG_ZRAM_WRITEBACK
+	struct block_device *bdev;	/* backing device, if any */
+	char *backing_dev;		/* path of the backing device */
+	unsigned long *bitmap;		/* allocated backing blocks */
+	unsigned long nr_pages;		/* size of backing device */
+	unsigned int wb_idle_age;	/* seconds until a page is idle */
+#endif
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
@@ -128,5 +167,11 @@ extern struct attribute_group zram_disk_attr_group;
 
 extern int zram_init_device(struct zram *zram);
 extern void zram_reset_device(struct zram *zram);
+extern ssize_t zram_comp_bench(struct zram *zram, char *buf);
+#ifdef CONFIG_ZRAM_WRITEBACK
+extern int zram_set_backing_dev(struct zram *zram, const char *path);
+extern void zram_reset_bdev(struct zram *zram);
+extern int zram_writeback(struct zram *zram, bool huge, bool idle);
+#endif
 
 #endif
@@ -0,0 +1,812 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+/*
+ * zsmalloc is a size-class allocator for compressed pages.
+ *
+ * Objects are grouped into size classes ZS_SIZE_CLASS_DELTA bytes
+ * apart. Each class carves its objects out of "zspages": groups of up
+ * to ZS_MAX_PAGES_PER_ZSPAGE 0-order pages treated as one contiguous
+ * span, with the number of pages chosen to minimize the tail waste
+ * for that class. Objects may straddle the boundary between two pages
+ * of a zspage; such objects are copied through a per-cpu buffer when
+ * mapped. Since the component pages need not be contiguous and may be
+ * highmem, zsmalloc never requires higher order allocations.
+ *
+ * Users get an opaque handle instead of a pointer. The handle points
+ * to a small descriptor holding the current location of the object,
+ * and every object starts with a back-reference to its handle. This
+ * allows zs_compact() to move objects out of sparsely used zspages
+ * into fuller ones and release the emptied pages. Objects too large
+ * for a back-reference to fit in a page with them go to the PAGE_SIZE
+ * class, which has one object per zspage and so is never compacted;
+ * they are stored without one.
+ *
+ * Locking: each size class is protected by its own spinlock. Object
+ * locations are stable while pool->migrate_lock is held for reading;
+ * zs_map_object() holds it until zs_unmap_object() and compaction
+ * takes it for writing.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/cpumask.h>
+#include <linux/highmem.h>
+#include <linux/init.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+
+#include "zsmalloc.h"
+
+/* User configurable params */
+
+/* Max number of 0-order pages combined into one zspage */
+#define ZS_MAX_PAGES_PER_ZSPAGE	4
+
+/* Objects are prefixed with a back-reference to their handle */
+#define ZS_HANDLE_SIZE		(sizeof(unsigned long))
+
+/* Must be a multiple of ZS_HANDLE_SIZE */
+#define ZS_MIN_ALLOC_SIZE	32
+#define ZS_MAX_ALLOC_SIZE	PAGE_SIZE
+
+/*
+ * Size classes are separated by this many bytes. For 4k pages this
+ * gives 256 classes, each wasting less than 16 bytes per object.
+ */
+#define ZS_SIZE_CLASS_DELTA	(PAGE_SIZE >> 8)
+#define ZS_SIZE_CLASSES	(DIV_ROUND_UP(ZS_MAX_ALLOC_SIZE - \
+				ZS_MIN_ALLOC_SIZE, ZS_SIZE_CLASS_DELTA) + 1)
+
+/* zspages at most this full (in quarters) are compaction sources */
+#define ZS_ALMOST_FULL_QUARTERS	3
+
+/* End of user params */
+
+/*
+ * Fullness groups of a zspage. Allocations are served from almost
+ * full zspages first, compaction empties almost empty ones.
+ */
+enum fullness_group {
+	ZS_ALMOST_FULL,
+	ZS_ALMOST_EMPTY,
+	_ZS_NR_FULLNESS_GROUPS,
+
+	ZS_EMPTY,
+	ZS_FULL
+};
+
+struct size_class {
+	spinlock_t lock;
+	struct list_head fullness_list[_ZS_NR_FULLNESS_GROUPS];
+	struct list_head full_list;
+
+	unsigned int size;		/* object size incl. header */
+	unsigned int hdr_size;		/* ZS_HANDLE_SIZE, 0 if never moved */
+	unsigned int pages_per_zspage;
+	unsigned int objs_per_zspage;
+
+	/* stats, protected by lock */
+	unsigned long zspages;
+	unsigned long objs_inuse;
+};
+
+struct zspage {
+	struct size_class *class;
+	struct list_head list;		/* link in class fullness list */
+	enum fullness_group fullness;
+	unsigned int inuse;		/* no. of allocated objects */
+	struct page *pages[ZS_MAX_PAGES_PER_ZSPAGE];
+	unsigned long used_map[0];	/* bitmap of allocated objects */
+};
+
+/* What a handle points to */
+struct zs_handle {
+	struct zspage *zspage;
+	unsigned int idx;
+};
+
+struct zs_pool {
+	struct size_class size_class[ZS_SIZE_CLASSES];
+
+	gfp_t flags;			/* allocation flags for zspages */
+	const char *name;
+	struct kmem_cache *handle_cachep;
+
+	rwlock_t migrate_lock;		/* see top of this file */
+	void *compact_buf;		/* protected by migrate_lock */
+	struct shrinker shrinker;
+
+	atomic_long_t pages_allocated;
+	atomic_long_t pages_compacted;
+};
+
+/* Per-cpu state of the object currently mapped on this cpu */
+struct mapping_area {
+	char *vm_buf;		/* copy of an object spanning pages */
+	char *vm_addr;		/* kmap'ed address of a single page object */
+	struct zspage *zspage;
+	unsigned int idx;
+	enum zs_mapmode mm;
+};
+
+static DEFINE_PER_CPU(struct mapping_area, zs_map_area);
+
+static int get_size_class_index(size_t size)
+{
+	int idx = 0;
+
+	if (likely(size > ZS_MIN_ALLOC_SIZE))
+		idx = DIV_ROUND_UP(size - ZS_MIN_ALLOC_SIZE,
+				ZS_SIZE_CLASS_DELTA);
+
+	return min_t(int, idx, ZS_SIZE_CLASSES - 1);
+}
+
+/*
+ * Find the number of pages (up to ZS_MAX_PAGES_PER_ZSPAGE) whose
+ * combined span wastes the smallest fraction on a partial object at
+ * the end.
+ */
+static unsigned int get_pages_per_zspage(unsigned int class_size)
+{
+	unsigned int i, best = 1, max_usedpc = 0;
+
+	for (i = 1; i <= ZS_MAX_PAGES_PER_ZSPAGE; i++) {
+		unsigned int zspage_size = i * PAGE_SIZE;
+		unsigned int waste = zspage_size % class_size;
+		unsigned int usedpc = (zspage_size - waste) * 100 / zspage_size;
+
+		if (usedpc > max_usedpc) {
+			max_usedpc = usedpc;
+			best = i;
+		}
+	}
+
+	return best;
+}
+
+static enum fullness_group get_fullness_group(struct zspage *zspage)
+{
+	unsigned int inuse = zspage->inuse;
+	unsigned int max = zspage->class->objs_per_zspage;
+
+	if (inuse == 0)
+		return ZS_EMPTY;
+	if (inuse == max)
+		return ZS_FULL;
+	if (inuse * 4 <= max * ZS_ALMOST_FULL_QUARTERS)
+		return ZS_ALMOST_EMPTY;
+	return ZS_ALMOST_FULL;
+}
+
+/*
+ * Move zspage to the list matching its current fullness. Empty
+ * zspages are taken off all lists; the caller must free them.
+ * Called with class->lock held.
+ */
+static enum fullness_group fix_fullness_group(struct size_class *class,
+				struct zspage *zspage)
+{
+	enum fullness_group newfg = get_fullness_group(zspage);
+
+	if (newfg == zspage->fullness)
+		return newfg;
+
+	switch (newfg) {
+	case ZS_EMPTY:
+		list_del_init(&zspage->list);
+		break;
+	case ZS_FULL:
+		list_move(&zspage->list, &class->full_list);
+		break;
+	default:
+		list_move(&zspage->list, &class->fullness_list[newfg]);
+		break;
+	}
+	zspage->fullness = newfg;
+
+	return newfg;
+}
+
+/*
+ * Copy 'len' bytes starting at byte 'off' of object 'idx' to or from
+ * 'buf', crossing page boundaries as needed.
+ */
+static void zs_copy_obj(struct zspage *zspage, unsigned int idx,
+		unsigned int off, char *buf, unsigned int len, bool to_obj)
+{
+	unsigned long pos;
+
+	pos = (unsigned long)idx * zspage->class->size + off;
+	while (len) {
+		unsigned int poff = pos & ~PAGE_MASK;
+		unsigned int n = min_t(unsigned int, len, PAGE_SIZE - poff);
+		char *addr;
+
+		addr = kmap_atomic(zspage->pages[pos >> PAGE_SHIFT], KM_USER1);
+		if (to_obj)
+			memcpy(addr + poff, buf, n);
+		else
+			memcpy(buf, addr + poff, n);
+		kunmap_atomic(addr, KM_USER1);
+
+		buf += n;
+		pos += n;
+		len -= n;
+	}
+}
+
+static void set_obj_handle(struct zspage *zspage, unsigned int idx,
+			struct zs_handle *handle)
+{
+	unsigned long val = (unsigned long)handle;
+
+	if (!zspage->class->hdr_size)
+		return;
+
+	/* Objects are aligned to ZS_HANDLE_SIZE so this never spans pages */
+	zs_copy_obj(zspage, idx, 0, (char *)&val, ZS_HANDLE_SIZE, true);
+}
+
+static struct zs_handle *get_obj_handle(struct zspage *zspage,
+			unsigned int idx)
+{
+	unsigned long val;
+
+	zs_copy_obj(zspage, idx, 0, (char *)&val, ZS_HANDLE_SIZE, false);
+	return (struct zs_handle *)val;
+}
+
+static void free_zspage(struct zspage *zspage)
+{
+	unsigned int i;
+
+	for (i = 0; i < zspage->class->pages_per_zspage; i++) {
+		if (zspage->pages[i])
+			__free_page(zspage->pages[i]);
+	}
+	kfree(zspage);
+}
+
+static struct zspage *alloc_zspage(struct size_class *class, gfp_t flags)
+{
+	unsigned int i;
+	struct zspage *zspage;
+
+	zspage = kzalloc(sizeof(*zspage) +
+			BITS_TO_LONGS(class->objs_per_zspage) * sizeof(long),
+			flags & ~__GFP_HIGHMEM);
+	if (!zspage)
+		return NULL;
+
+	zspage->class = class;
+	zspage->fullness = ZS_EMPTY;
+	INIT_LIST_HEAD(&zspage->list);
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		zspage->pages[i] = alloc_page(flags);
+		if (!zspage->pages[i]) {
+			free_zspage(zspage);
+			return NULL;
+		}
+	}
+
+	return zspage;
+}
+
+/* Get a zspage with at least one free object, fullest first */
+static struct zspage *find_get_zspage(struct size_class *class,
+				struct zspage *skip)
+{
+	int i;
+	struct zspage *zspage;
+
+	for (i = 0; i < _ZS_NR_FULLNESS_GROUPS; i++) {
+		list_for_each_entry(zspage, &class->fullness_list[i], list) {
+			if (zspage != skip)
+				return zspage;
+		}
+	}
+
+	return NULL;
+}
+
+/* Take a free object slot of zspage. Called with class->lock held. */
+static unsigned int obj_alloc(struct size_class *class,
+			struct zspage *zspage)
+{
+	unsigned int idx;
+
+	idx = find_first_zero_bit(zspage->used_map, class->objs_per_zspage);
+	BUG_ON(idx >= class->objs_per_zspage);
+
+	__set_bit(idx, zspage->used_map);
+	zspage->inuse++;
+	class->objs_inuse++;
+
+	return idx;
+}
+
+static void obj_free(struct size_class *class, struct zspage *zspage,
+			unsigned int idx)
+{
+	BUG_ON(!test_bit(idx, zspage->used_map));
+
+	__clear_bit(idx, zspage->used_map);
+	zspage->inuse--;
+	class->objs_inuse--;
+}
+
+/**
+ * zs_malloc - Allocate block of given size from pool.
+ * @pool: pool to allocate from
+ * @size: size of block to allocate
+ *
+ * Returns an opaque handle to the allocated object, or 0 on failure.
+ * The object is accessed through zs_map_object().
+ */
+unsigned long zs_malloc(struct zs_pool *pool, size_t size)
+{
+	unsigned int idx;
+	struct zs_handle *handle;
+	struct size_class *class;
+	struct zspage *zspage;
+
+	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE))
+		return 0;
+
+	handle = kmem_cache_alloc(pool->handle_cachep,
+				pool->flags & ~__GFP_HIGHMEM);
+	if (!handle)
+		return 0;
+
+	/* Objects that do not fit with a header end up in the last class */
+	class = &pool->size_class[get_size_class_index(size + ZS_HANDLE_SIZE)];
+
+	spin_lock(&class->lock);
+	zspage = find_get_zspage(class, NULL);
+	if (!zspage) {
+		spin_unlock(&class->lock);
+
+		zspage = alloc_zspage(class, pool->flags);
+		if (unlikely(!zspage)) {
+			kmem_cache_free(pool->handle_cachep, handle);
+			return 0;
+		}
+		atomic_long_add(class->pages_per_zspage,
+				&pool->pages_allocated);
+
+		spin_lock(&class->lock);
+		class->zspages++;
+	}
+
+	idx = obj_alloc(class, zspage);
+	handle->zspage = zspage;
+	handle->idx = idx;
+	set_obj_handle(zspage, idx, handle);
+	fix_fullness_group(class, zspage);
+	spin_unlock(&class->lock);
+
+	return (unsigned long)handle;
+}
+EXPORT_SYMBOL_GPL(zs_malloc);
+
+void zs_free(struct zs_pool *pool, unsigned long obj)
+{
+	struct zs_handle *handle = (struct zs_handle *)obj;
+	struct size_class *class;
+	struct zspage *zspage;
+	enum fullness_group fullness;
+
+	if (unlikely(!obj))
+		return;
+
+	read_lock(&pool->migrate_lock);
+	zspage = handle->zspage;
+	class = zspage->class;
+
+	spin_lock(&class->lock);
+	obj_free(class, zspage, handle->idx);
+	fullness = fix_fullness_group(class, zspage);
+	if (fullness == ZS_EMPTY)
+		class->zspages--;
+	spin_unlock(&class->lock);
+	read_unlock(&pool->migrate_lock);
+
+	if (fullness == ZS_EMPTY) {
+		atomic_long_sub(class->pages_per_zspage,
+				&pool->pages_allocated);
+		free_zspage(zspage);
+	}
+
+	kmem_cache_free(pool->handle_cachep, handle);
+}
+EXPORT_SYMBOL_GPL(zs_free);
+
+/**
+ * zs_map_object - get address of allocated object from handle.
+ * @pool: pool from which the object was allocated
+ * @handle: handle returned from zs_malloc
+ * @mm: mapping mode to use
+ *
+ * Before using an object allocated from zs_malloc, it must be mapped
+ * using this function. When done with the object, it must be unmapped
+ * using zs_unmap_object. Only one object can be mapped per cpu at a
+ * time and the caller must not sleep in between: this function
+ * disables preemption.
+ */
+void *zs_map_object(struct zs_pool *pool, unsigned long obj,
+			enum zs_mapmode mm)
+{
+	struct zs_handle *handle = (struct zs_handle *)obj;
+	struct mapping_area *area;
+	struct zspage *zspage;
+	unsigned long pos;
+	unsigned int off, size, hdr;
+
+	BUG_ON(!obj);
+
+	read_lock(&pool->migrate_lock);
+	zspage = handle->zspage;
+	size = zspage->class->size;
+	hdr = zspage->class->hdr_size;
+	pos = (unsigned long)handle->idx * size;
+	off = pos & ~PAGE_MASK;
+
+	area = &get_cpu_var(zs_map_area);
+	area->zspage = zspage;
+	area->idx = handle->idx;
+	area->mm = mm;
+
+	if (off + size <= PAGE_SIZE) {
+		/* this object is contained entirely within a page */
+		area->vm_addr = kmap_atomic(zspage->pages[pos >> PAGE_SHIFT],
+					KM_USER1);
+		return area->vm_addr + off + hdr;
+	}
+
+	/* this object spans two pages */
+	area->vm_addr = NULL;
+	if (mm != ZS_MM_WO)
+		zs_copy_obj(zspage, handle->idx, hdr, area->vm_buf,
+			size - hdr, false);
+
+	return area->vm_buf;
+}
+EXPORT_SYMBOL_GPL(zs_map_object);
+
+void zs_unmap_object(struct zs_pool *pool, unsigned long obj)
+{
+	struct mapping_area *area;
+
+	BUG_ON(!obj);
+
+	area = &__get_cpu_var(zs_map_area);
+	if (area->vm_addr) {
+		kunmap_atomic(area->vm_addr, KM_USER1);
+	} else if (area->mm != ZS_MM_RO) {
+		struct size_class *class = area->zspage->class;
+
+		zs_copy_obj(area->zspage, area->idx, class->hdr_size,
+			area->vm_buf, class->size - class->hdr_size, true);
+	}
+	put_cpu_var(zs_map_area);
+
+	read_unlock(&pool->migrate_lock);
+}
+EXPORT_SYMBOL_GPL(zs_unmap_object);
+
+/*
+ * Move objects out of the least used zspages of a class into other
+ * partially used zspages of the same class, freeing every source
+ * zspage that ends up empty, until 'budget' pages are freed. Returns
+ * the number of pages freed.
+ *
+ * A class of one object per zspage never has almost empty zspages,
+ * which is what lets the PAGE_SIZE class go without back-references.
+ */
+static unsigned long zs_compact_class(struct zs_pool *pool,
+				struct size_class *class, unsigned long budget)
+{
+	unsigned long freed = 0;
+	struct list_head *almost_empty;
+	struct zspage *src, *dst;
+	struct zs_handle *handle;
+	unsigned int sidx, didx;
+
+	almost_empty = &class->fullness_list[ZS_ALMOST_EMPTY];
+
+	while (freed < budget) {
+		write_lock(&pool->migrate_lock);
+		spin_lock(&class->lock);
+
+		if (list_empty(almost_empty)) {
+			spin_unlock(&class->lock);
+			write_unlock(&pool->migrate_lock);
+			break;
+		}
+		src = list_entry(almost_empty->prev, struct zspage, list);
+
+		/* Don't bother unless all of src fits elsewhere */
+		if (class->zspages * class->objs_per_zspage -
+				class->objs_inuse - (class->objs_per_zspage -
+				src->inuse) < src->inuse) {
+			spin_unlock(&class->lock);
+			write_unlock(&pool->migrate_lock);
+			break;
+		}
+
+		/* Keep src off the lists so it is never picked as dst */
+		list_del_init(&src->list);
+		src->fullness = ZS_EMPTY;
+
+		for_each_set_bit(sidx, src->used_map, class->objs_per_zspage) {
+			dst = find_get_zspage(class, src);
+			BUG_ON(!dst);
+
+			zs_copy_obj(src, sidx, 0, pool->compact_buf,
+					class->size, false);
+			didx = obj_alloc(class, dst);
+			zs_copy_obj(dst, didx, 0, pool->compact_buf,
+					class->size, true);
+			fix_fullness_group(class, dst);
+
+			handle = get_obj_handle(src, sidx);
+			handle->zspage = dst;
+			handle->idx = didx;
+
+			obj_free(class, src, sidx);
+		}
+
+		BUG_ON(src->inuse);
+		class->zspages--;
+
+		spin_unlock(&class->lock);
+		write_unlock(&pool->migrate_lock);
+
+		free_zspage(src);
+		freed += class->pages_per_zspage;
+		atomic_long_sub(class->pages_per_zspage,
+				&pool->pages_allocated);
+
+		cond_resched();
+	}
+
+	return freed;
+}
+
+/* Compact classes, largest first, until 'budget' pages are freed */
+static unsigned long __zs_compact(struct zs_pool *pool, unsigned long budget)
+{
+	int i;
+	unsigned long freed = 0;
+
+	for (i = ZS_SIZE_CLASSES - 1; i >= 0 && freed < budget; i--)
+		freed += zs_compact_class(pool, &pool->size_class[i],
+					budget - freed);
+
+	atomic_long_add(freed, &pool->pages_compacted);
+	pr_debug("%s: compaction freed %lu pages\n", pool->name, freed);
+
+	return freed;
+}
+
+/**
+ * zs_compact - defragment a pool
+ * @pool: pool to compact
+ *
+ * Returns the number of pages released to the system.
+ */
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	return __zs_compact(pool, ULONG_MAX);
+}
+EXPORT_SYMBOL_GPL(zs_compact);
+
+/* Estimate of the number of pages zs_compact() could free */
+static unsigned long zs_compactable_pages(struct zs_pool *pool)
+{
+	int i;
+	unsigned long pages = 0;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+		unsigned long free_objs;
+
+		free_objs = class->zspages * class->objs_per_zspage -
+				class->objs_inuse;
+		pages += free_objs / class->objs_per_zspage *
+				class->pages_per_zspage;
+	}
+
+	return pages;
+}
+
+static int zs_shrinker_shrink(struct shrinker *shrinker,
+				struct shrink_control *sc)
+{
+	struct zs_pool *pool = container_of(shrinker, struct zs_pool,
+					shrinker);
+
+	/* the objects the VM counts are the pages compaction could free */
+	if (sc->nr_to_scan)
+		__zs_compact(pool, sc->nr_to_scan);
+
+	return min_t(unsigned long, zs_compactable_pages(pool), INT_MAX);
+}
+
+u64 zs_get_total_size_bytes(struct zs_pool *pool)
+{
+	return (u64)atomic_long_read(&pool->pages_allocated) << PAGE_SHIFT;
+}
+EXPORT_SYMBOL_GPL(zs_get_total_size_bytes);
+
+unsigned long zs_get_pages_compacted(struct zs_pool *pool)
+{
+	return atomic_long_read(&pool->pages_compacted);
+}
+EXPORT_SYMBOL_GPL(zs_get_pages_compacted);
+
+/*
+ * Fill in statistics for size class 'index'. Returns -ENOENT once
+ * 'index' is past the last class.
+ */
+int zs_get_class_stats(struct zs_pool *pool, int index,
+			struct zs_class_stats *stats)
+{
+	struct size_class *class;
+
+	if (index < 0 || index >= ZS_SIZE_CLASSES)
+		return -ENOENT;
+
+	class = &pool->size_class[index];
+
+	spin_lock(&class->lock);
+	stats->size = class->size;
+	stats->pages_per_zspage = class->pages_per_zspage;
+	stats->zspages = class->zspages;
+	stats->objs_allocated = class->zspages * class->objs_per_zspage;
+	stats->objs_inuse = class->objs_inuse;
+	spin_unlock(&class->lock);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(zs_get_class_stats);
+
+/**
+ * zs_create_pool - Creates an allocation pool to work from.
+ * @name: name of the pool to be created
+ * @flags: allocation flags used when growing pool
+ *
+ * This function must be called before anything when using
+ * the zsmalloc allocator.
+ *
+ * On success, a pointer to the newly created pool is returned,
+ * otherwise NULL.
+ */
+struct zs_pool *zs_create_pool(const char *name, gfp_t flags)
+{
+	int i;
+	struct zs_pool *pool;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		int fg;
+		struct size_class *class = &pool->size_class[i];
+
+		class->size = min_t(unsigned int, ZS_MAX_ALLOC_SIZE,
+				ZS_MIN_ALLOC_SIZE + i * ZS_SIZE_CLASS_DELTA);
+		class->hdr_size = class->size == ZS_MAX_ALLOC_SIZE ? 0 :
+				ZS_HANDLE_SIZE;
+		class->pages_per_zspage = get_pages_per_zspage(class->size);
+		class->objs_per_zspage = class->pages_per_zspage *
+					PAGE_SIZE / class->size;
+
+		spin_lock_init(&class->lock);
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++)
+			INIT_LIST_HEAD(&class->fullness_list[fg]);
+		INIT_LIST_HEAD(&class->full_list);
+	}
+
+	pool->handle_cachep = kmem_cache_create(name,
+				sizeof(struct zs_handle), 0, 0, NULL);
+	pool->compact_buf = kmalloc(ZS_MAX_ALLOC_SIZE, GFP_KERNEL);
+	if (!pool->handle_cachep || !pool->compact_buf) {
+		if (pool->handle_cachep)
+			kmem_cache_destroy(pool->handle_cachep);
+		kfree(pool->compact_buf);
+		kfree(pool);
+		return NULL;
+	}
+
+	rwlock_init(&pool->migrate_lock);
+	pool->flags = flags;
+	pool->name = name;
+
+	pool->shrinker.shrink = zs_shrinker_shrink;
+	pool->shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&pool->shrinker);
+
+	return pool;
+}
+EXPORT_SYMBOL_GPL(zs_create_pool);
+
+static void zs_free_class(struct list_head *head)
+{
+	struct zspage *zspage, *tmp;
+
+	list_for_each_entry_safe(zspage, tmp, head, list) {
+		list_del(&zspage->list);
+		free_zspage(zspage);
+	}
+}
+
+/*
+ * Destroy the pool. Objects still allocated are released along with
+ * it; their handles become invalid.
+ */
+void zs_destroy_pool(struct zs_pool *pool)
+{
+	int i, fg;
+
+	unregister_shrinker(&pool->shrinker);
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+
+		if (class->objs_inuse)
+			pr_info("Freeing non-empty class with size %u\n",
+				class->size);
+
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++)
+			zs_free_class(&class->fullness_list[fg]);
+		zs_free_class(&class->full_list);
+	}
+
+	kmem_cache_destroy(pool->handle_cachep);
+	kfree(pool->compact_buf);
+	kfree(pool);
+}
+EXPORT_SYMBOL_GPL(zs_destroy_pool);
+
+static int __init zs_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct mapping_area *area = &per_cpu(zs_map_area, cpu);
+
+		area->vm_buf = kmalloc(ZS_MAX_ALLOC_SIZE, GFP_KERNEL);
+		if (!area->vm_buf)
+			goto fail;
+	}
+
+	return 0;
+
+fail:
+	for_each_possible_cpu(cpu) {
+		kfree(per_cpu(zs_map_area, cpu).vm_buf);
+		per_cpu(zs_map_area, cpu).vm_buf = NULL;
+	}
+	return -ENOMEM;
+}
+module_init(zs_init);
@@ -1574,6 +1574,155 @@ static inline u8 _usb_addr(struct ci13xxx_ep *ep)
 	return ((ep->dir == TX) ? USB_ENDPOINT_DIR_MASK : 0) | ep->num;
 }
 
+/**
+ * _hardware_map_sg: maps the scatterlist of a request for DMA
+ * @mEp:  endpoint
+ * @mReq: request
+ *
+ * A TD only moves from one segment to the next at a page boundary, so every
+ * segment but the first has to start on one, and every one but the last has
+ * to end on one.
+ *
+ * This function returns an error code
+ */
+static int _hardware_map_sg(struct ci13xxx_ep *mEp, struct ci13xxx_req *mReq)
+{
+	struct scatterlist *sg;
+	int i, n;
+
+	n = dma_map_sg(mEp->device, mReq->req.sg, mReq->req.num_sgs,
+		       mEp->dir ? DMA_TO_DEVICE : DMA_FROM_DEVICE);
+	if (n == 0)
+		return -ENOMEM;
+
+	for_each_sg(mReq->req.sg, sg, n, i) {
+		if ((i > 0 &&
+		     (sg_dma_address(sg) & (CI13XXX_PAGE_SIZE - 1))) ||
+		    (i < n - 1 &&
+		     ((sg_dma_address(sg) + sg_dma_len(sg)) &
+		      (CI13XXX_PAGE_SIZE - 1)))) {
+			dma_unmap_sg(mEp->device, mReq->req.sg,
+				     mReq->req.num_sgs,
+				     mEp->dir ? DMA_TO_DEVICE : DMA_FROM_DEVICE);
+			return -EINVAL;
+		}
+	}
+
+	mReq->req.num_mapped_sgs = n;
+	mReq->map = 1;
+	return 0;
+}
+
+/**
+ * _hardware_unmap: undoes the DMA mapping of a request, if it was mapped
+ *                  by _hardware_enqueue
+ * @mEp:  endpoint
+ * @mReq: request
+ */
+static void _hardware_unmap(struct ci13xxx_ep *mEp, struct ci13xxx_req *mReq)
+{
+	if (!mReq->map)
+		return;
+
+	if (mReq->req.num_mapped_sgs) {
+		dma_unmap_sg(mEp->device, mReq->req.sg, mReq->req.num_sgs,
+			     mEp->dir ? DMA_TO_DEVICE : DMA_FROM_DEVICE);
+		mReq->req.num_mapped_sgs = 0;
+	} else {
+		dma_unmap_single(mEp->device, mReq->req.dma, mReq->req.length,
+				 mEp->dir ? DMA_TO_DEVICE : DMA_FROM_DEVICE);
+		mReq->req.dma = 0;
+	}
+	mReq->map = 0;
+}
+
+/**
+ * _hardware_sg_pages: points a TD at the next bytes of a mapped scatterlist
+ * @td:     TD
+ * @sg:     segment the TD starts in, moved on past the TD
+ * @offset: offset of the TD in *sg, moved on past the TD
+ * @length: number of bytes the TD moves
+ */
+static void _hardware_sg_pages(struct ci13xxx_td *td, struct scatterlist **sg,
+			       unsigned *offset, unsigned length)
+{
+	unsigned i = 0, chunk;
+	dma_addr_t dma;
+
+	/* one page pointer for each page, or part of one, the TD touches */
+	while (length) {
+		dma = sg_dma_address(*sg) + *offset;
+		td->page[i++] = dma;
+
+		chunk = CI13XXX_PAGE_SIZE - (dma & (CI13XXX_PAGE_SIZE - 1));
+		chunk = min3(chunk, length, sg_dma_len(*sg) - *offset);
+		length  -= chunk;
+		*offset += chunk;
+		if (*offset == sg_dma_len(*sg)) {
+			*sg = sg_next(*sg);
+			*offset = 0;
+		}
+	}
+}
+
+/**
+ * _hardware_free_xtds: frees the TDs chained after the first of a request
+ * @mEp:  endpoint
+ * @mReq: request
+ */
+static void _hardware_free_xtds(struct ci13xxx_ep *mEp,
+				struct ci13xxx_req *mReq)
+{
+	while (mReq->xtds--)
+		dma_pool_free(mEp->td_pool, mReq->xtd[mReq->xtds].ptr,
+			      mReq->xtd[mReq->xtds].dma);
+	kfree(mReq->xtd);
+	mReq->xtd  = NULL;
+	mReq->xtds = 0;
+}
+
+/**
+ * _hardware_alloc_xtds: allocates the TDs a request larger than
+ *                       CI13XXX_TD_MAX_LEN needs after its first one
+ * @mEp:  endpoint
+ * @mReq: request
+ *
+ * This function returns an error code
+ */
+static int _hardware_alloc_xtds(struct ci13xxx_ep *mEp,
+				struct ci13xxx_req *mReq)
+{
+	unsigned n = DIV_ROUND_UP(mReq->req.length, CI13XXX_TD_MAX_LEN) - 1;
+
+	mReq->xtd = kcalloc(n, sizeof(*mReq->xtd), GFP_ATOMIC);
+	if (mReq->xtd == NULL)
+		return -ENOMEM;
+
+	for (mReq->xtds = 0; mReq->xtds < n; mReq->xtds++) {
+		struct ci13xxx_xtd *xtd = &mReq->xtd[mReq->xtds];
+
+		xtd->ptr = dma_pool_alloc(mEp->td_pool, GFP_ATOMIC, &xtd->dma);
+		if (xtd->ptr == NULL) {
+			_hardware_free_xtds(mEp, mReq);
+			return -ENOMEM;
+		}
+	}
+	return 0;
+}
+
+/**
+ * _hardware_last_td: returns the TD the next request gets chained after
+ * @mReq: request
+ */
+static struct ci13xxx_td *_hardware_last_td(struct ci13xxx_req *mReq)
+{
+	if (mReq->zptr)
+		return mReq->zptr;
+	if (mReq->xtds)
+		return mReq->xtd[mReq->xtds - 1].ptr;
+	return mReq->ptr;
+}
+
 /**
  * _hardware_queue: configures a request at hardware level
  * @gadget: gadget
@@ -1583,7 +1732,9 @@ static inline u8 _usb_addr(struct ci13xxx_ep *ep)
  */
 static int _hardware_enqueue(struct ci13xxx_ep *mEp, struct ci13xxx_req *mReq)
 {
-	unsigned i;
+	struct scatterlist *sg = NULL;
+	unsigned sg_offset = 0;
+	unsigned i, j;
 	int ret = 0;
 	unsigned length = mReq->req.length;
 
@@ -1594,7 +1745,11 @@ static int _hardware_enqueue(struct ci13xxx_ep *mEp, struct ci13xxx_req *mReq)
 		return -EALREADY;
 
 	mReq->req.status = -EALREADY;
-	if (length && !mReq->req.dma) {
+	if (mReq->req.num_sgs) {
+		ret = _hardware_map_sg(mEp, mReq);
+		if (ret)
+			return ret;
+	} else if (length && !mReq->req.dma) {
 		mReq->req.dma = \
 			dma_map_single(mEp->device, mReq->req.buf,
 				       length, mEp->dir ? DMA_TO_DEVICE :
@@ -1605,17 +1760,23 @@ static int _hardware_enqueue(struct ci13xxx_ep *mEp, struct ci13xxx_req *mReq)
 		mReq->map = 1;
 	}
 
+	/* requests larger than one TD can take are split over a TD chain */
+	if (length > CI13XXX_TD_MAX_LEN &&
+	    !(CI13XX_REQ_VENDOR_ID(mReq->req.udc_priv) == MSM_VENDOR_ID &&
+	      (mReq->req.udc_priv & MSM_SPS_MODE))) {
+		ret = _hardware_alloc_xtds(mEp, mReq);
+		if (ret) {
+			_hardware_unmap(mEp, mReq);
+			return ret;
+		}
+	}
+
 	if (mReq->req.zero && length && (length % mEp->ep.maxpacket == 0)) {
 		mReq->zptr = dma_pool_alloc(mEp->td_pool, GFP_ATOMIC,
 					   &mReq->zdma);
 		if (mReq->zptr == NULL) {
-			if (mReq->map) {
-				dma_unmap_single(mEp->device, mReq->req.dma,
-					length, mEp->dir ? DMA_TO_DEVICE :
-					DMA_FROM_DEVICE);
-				mReq->req.dma = 0;
-				mReq->map     = 0;
-			}
+			_hardware_free_xtds(mEp, mReq);
+			_hardware_unmap(mEp, mReq);
 			return -ENOMEM;
 		}
 		memset(mReq->zptr, 0, sizeof(*mReq->zptr));
@@ -1626,13 +1787,15 @@ static int _hardware_enqueue(struct ci13xxx_ep *mEp, struct ci13xxx_req *mReq)
 	}
 	/*
 	 * TD configuration
-	 * TODO - handle requests which spawns into several TDs
 	 */
 	memset(mReq->ptr, 0, sizeof(*mReq->ptr));
-	mReq->ptr->token    = length << ffs_nr(TD_TOTAL_BYTES);
+	mReq->ptr->token    = min_t(unsigned, length, CI13XXX_TD_MAX_LEN)
+				<< ffs_nr(TD_TOTAL_BYTES);
 	mReq->ptr->token   &= TD_TOTAL_BYTES;
 	mReq->ptr->token   |= TD_STATUS_ACTIVE;
-	if (mReq->zptr) {
+	if (mReq->xtds) {
+		mReq->ptr->next    = mReq->xtd[0].dma;
+	} else if (mReq->zptr) {
 		mReq->ptr->next    = mReq->zdma;
 	} else {
 		mReq->ptr->next    = TD_TERMINATE;
@@ -1656,10 +1819,48 @@ static int _hardware_enqueue(struct ci13xxx_ep *mEp, struct ci13xxx_req *mReq)
 		}
 	}
 
-	mReq->ptr->page[0]  = mReq->req.dma;
-	for (i = 1; i < 5; i++)
-		mReq->ptr->page[i] =
-			(mReq->req.dma + i * CI13XXX_PAGE_SIZE) & ~TD_RESERVED_MASK;
+	if (mReq->req.num_mapped_sgs) {
+		sg = mReq->req.sg;
+		_hardware_sg_pages(mReq->ptr, &sg, &sg_offset,
+				   min_t(unsigned, length, CI13XXX_TD_MAX_LEN));
+	} else {
+		mReq->ptr->page[0]  = mReq->req.dma;
+		for (i = 1; i < 5; i++)
+			mReq->ptr->page[i] = (mReq->req.dma +
+				i * CI13XXX_PAGE_SIZE) & ~TD_RESERVED_MASK;
+	}
+
+	for (j = 0; j < mReq->xtds; j++) {
+		struct ci13xxx_td *td = mReq->xtd[j].ptr;
+		dma_addr_t dma = mReq->req.dma + (j + 1) * CI13XXX_TD_MAX_LEN;
+
+		memset(td, 0, sizeof(*td));
+		td->token  = min_t(unsigned, length - (j + 1) *
+				   CI13XXX_TD_MAX_LEN, CI13XXX_TD_MAX_LEN)
+				<< ffs_nr(TD_TOTAL_BYTES);
+		td->token &= TD_TOTAL_BYTES;
+		td->token |= TD_STATUS_ACTIVE;
+		if (j + 1 < mReq->xtds) {
+			td->next = mReq->xtd[j + 1].dma;
+		} else if (mReq->zptr) {
+			td->next = mReq->zdma;
+		} else {
+			td->next = TD_TERMINATE;
+			if (!mReq->req.no_interrupt)
+				td->token |= TD_IOC;
+		}
+		if (mReq->req.num_mapped_sgs) {
+			_hardware_sg_pages(td, &sg, &sg_offset,
+					   min_t(unsigned, length - (j + 1) *
+						 CI13XXX_TD_MAX_LEN,
+						 CI13XXX_TD_MAX_LEN));
+			continue;
+		}
+		td->page[0] = dma;
+		for (i = 1; i < 5; i++)
+			td->page[i] =
+				(dma + i * CI13XXX_PAGE_SIZE) & ~TD_RESERVED_MASK;
+	}
 
 	if (!list_empty(&mEp->qh.queue)) {
 		struct ci13xxx_req *mReqPrev;
@@ -1668,10 +1869,7 @@ static int _hardware_enqueue(struct ci13xxx_ep *mEp, struct ci13xxx_req *mReq)
 
 		mReqPrev = list_entry(mEp->qh.queue.prev,
 				struct ci13xxx_req, queue);
-		if (mReqPrev->zptr)
-			mReqPrev->zptr->next = mReq->dma & TD_ADDR_MASK;
-		else
-			mReqPrev->ptr->next = mReq->dma & TD_ADDR_MASK;
+		_hardware_last_td(mReqPrev)->next = mReq->dma & TD_ADDR_MASK;
 		wmb();
 		if (hw_cread(CAP_ENDPTPRIME, BIT(n)))
 			goto done;
@@ -1752,6 +1950,10 @@ done:
  */
 static int _hardware_dequeue(struct ci13xxx_ep *mEp, struct ci13xxx_req *mReq)
 {
+	struct ci13xxx_td *td = mReq->ptr;
+	unsigned remaining, actual = 0;
+	unsigned j;
+
 	trace("%p, %p", mEp, mReq);
 
 	if (mReq->req.status != -EALREADY)
@@ -1767,23 +1969,56 @@ static int _hardware_dequeue(struct ci13xxx_ep *mEp, struct ci13xxx_req *mReq)
 		if ((mReq->req.udc_priv & MSM_SPS_MODE) &&
 			(mReq->req.udc_priv & MSM_TBE))
 			return -EBUSY;
-	if (mReq->zptr) {
+
+	/*
+	 * Walk the TD chain up to the TD the transfer ended in: the last one,
+	 * or the one that got an error or a short packet.
+	 */
+	for (j = 0; ; j++) {
+		remaining   = td->token & TD_TOTAL_BYTES;
+		remaining >>= ffs_nr(TD_TOTAL_BYTES);
+		actual     += min_t(unsigned, mReq->req.length -
+				    j * CI13XXX_TD_MAX_LEN,
+				    CI13XXX_TD_MAX_LEN) - remaining;
+		if (j == mReq->xtds || remaining || (td->token & TD_STATUS))
+			break;
+		td = mReq->xtd[j].ptr;
+		if ((TD_STATUS_ACTIVE & td->token) != 0)
+			return -EBUSY;
+	}
+
+	if (j < mReq->xtds) {
+		/*
+		 * The rest of the chain was never used. Take it back from the
+		 * controller, and restart it at the next request if any.
+		 */
+		hw_ep_flush(mEp->num, mEp->dir);
+		if (!list_is_last(&mReq->queue, &mEp->qh.queue)) {
+			struct ci13xxx_req *mReqNext =
+				list_entry(mReq->queue.next,
+					   struct ci13xxx_req, queue);
+
+			mEp->qh.ptr->td.next   = mReqNext->dma;
+			mEp->qh.ptr->td.token &= ~TD_STATUS;
+			wmb();
+			hw_ep_prime(mEp->num, mEp->dir,
+				    mEp->type == USB_ENDPOINT_XFER_CONTROL);
+		}
+	} else if (mReq->zptr) {
 		if ((TD_STATUS_ACTIVE & mReq->zptr->token) != 0)
 			return -EBUSY;
+	}
+	if (mReq->zptr) {
 		dma_pool_free(mEp->td_pool, mReq->zptr, mReq->zdma);
 		mReq->zptr = NULL;
 	}
+	_hardware_free_xtds(mEp, mReq);
 
 	mReq->req.status = 0;
 
-	if (mReq->map) {
-		dma_unmap_single(mEp->device, mReq->req.dma, mReq->req.length,
-				 mEp->dir ? DMA_TO_DEVICE : DMA_FROM_DEVICE);
-		mReq->req.dma = 0;
-		mReq->map     = 0;
-	}
+	_hardware_unmap(mEp, mReq);
 
-	mReq->req.status = mReq->ptr->token & TD_STATUS;
+	mReq->req.status = td->token & TD_STATUS;
 	if ((TD_STATUS_HALTED & mReq->req.status) != 0)
 		mReq->req.status = -1;
 	else if ((TD_STATUS_DT_ERR & mReq->req.status) != 0)
@@ -1791,10 +2026,7 @@ static int _hardware_dequeue(struct ci13xxx_ep *mEp, struct ci13xxx_req *mReq)
 	else if ((TD_STATUS_TR_ERR & mReq->req.status) != 0)
 		mReq->req.status = -1;
 
-	mReq->req.actual   = mReq->ptr->token & TD_TOTAL_BYTES;
-	mReq->req.actual >>= ffs_nr(TD_TOTAL_BYTES);
-	mReq->req.actual   = mReq->req.length - mReq->req.actual;
-	mReq->req.actual   = mReq->req.status ? 0 : mReq->req.actual;
+	mReq->req.actual   = mReq->req.status ? 0 : actual;
 
 	return mReq->req.actual;
 }
@@ -1843,14 +2075,9 @@ __acquires(mEp->lock)
 			}
 		}
 		mReq->req.status = -ESHUTDOWN;
+		_hardware_free_xtds(mEp, mReq);
 
-		if (mReq->map) {
-			dma_unmap_single(mEp->device, mReq->req.dma,
-				mReq->req.length,
-				mEp->dir ? DMA_TO_DEVICE : DMA_FROM_DEVICE);
-			mReq->req.dma = 0;
-			mReq->map     = 0;
-		}
+		_hardware_unmap(mEp, mReq);
 
 		if (mReq->req.complete != NULL) {
 			spin_unlock(mEp->lock);
@@ -2575,8 +2802,11 @@ static int ep_queue(struct usb_ep *ep, struct usb_request *req,
 		goto done;
 	}
 
-	if (req->length > (4 * CI13XXX_PAGE_SIZE)) {
-		req->length = (4 * CI13XXX_PAGE_SIZE);
+	/* only a single TD can describe an SPS transfer */
+	if (req->length > CI13XXX_TD_MAX_LEN &&
+	    CI13XX_REQ_VENDOR_ID(req->udc_priv) == MSM_VENDOR_ID &&
+	    (req->udc_priv & MSM_SPS_MODE)) {
+		req->length = CI13XXX_TD_MAX_LEN;
 		retval = -EMSGSIZE;
 		warn("request length truncated");
 	}
@@ -2628,12 +2858,8 @@ static int ep_dequeue(struct usb_ep *ep, struct usb_request *req)
 
 	/* pop request */
 	list_del_init(&mReq->queue);
-	if (mReq->map) {
-		dma_unmap_single(mEp->device, mReq->req.dma, mReq->req.length,
-				 mEp->dir ? DMA_TO_DEVICE : DMA_FROM_DEVICE);
-		mReq->req.dma = 0;
-		mReq->map     = 0;
-	}
+	_hardware_free_xtds(mEp, mReq);
+	_hardware_unmap(mEp, mReq);
 	req->status = -ECONNRESET;
 
 	if (mReq->req.complete != NULL) {
@@ -3168,6 +3394,7 @@ static int udc_probe(struct ci13xxx_udc_driver *driver, struct device *dev,
 	udc->gadget.ops          = &usb_gadget_ops;
 	udc->gadget.speed        = USB_SPEED_UNKNOWN;
 	udc->gadget.is_dualspeed = 1;
+	udc->gadget.sg_supported = 1;
 	udc->gadget.is_otg       = 0;
 	udc->gadget.name         = driver->name;
 
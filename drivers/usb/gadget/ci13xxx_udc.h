@@ -20,6 +20,8 @@
  * DEFINE
  *****************************************************************************/
 #define CI13XXX_PAGE_SIZE  4096ul /* page size for TD's */
+/* data per TD, which can start anywhere in its first page */
+#define CI13XXX_TD_MAX_LEN (4 * CI13XXX_PAGE_SIZE)
 #define ENDPT_MAX          (32)
 #define CTRL_PAYLOAD_MAX   (64)
 #define RX        (0)  /* similar to USB_DIR_OUT but can be used as an index */
@@ -83,6 +85,12 @@ struct ci13xxx_qh {
 	struct usb_ctrlrequest   setup;
 } __attribute__ ((packed));
 
+/* TD chained after the first one of a request */
+struct ci13xxx_xtd {
+	struct ci13xxx_td   *ptr;
+	dma_addr_t           dma;
+};
+
 /* Extension of usb_request */
 struct ci13xxx_req {
 	struct usb_request   req;
@@ -92,6 +100,9 @@ struct ci13xxx_req {
 	dma_addr_t           dma;
 	struct ci13xxx_td   *zptr;
 	dma_addr_t           zdma;
+	/* rest of a request larger than CI13XXX_TD_MAX_LEN */
+	struct ci13xxx_xtd  *xtd;
+	unsigned             xtds;
 };
 
 /* Extension of usb_ep */
@@ -45,6 +45,7 @@
 #include <linux/list.h>
 #include <linux/interrupt.h>
 #include <linux/platform_device.h>
+#include <linux/scatterlist.h>
 #include <linux/usb.h>
 #include <linux/usb/gadget.h>
 #include <linux/usb/hcd.h>
@@ -534,6 +535,7 @@ dummy_queue (struct usb_ep *_ep, struct usb_request *_req,
 	if (ep->desc && (ep->desc->bEndpointAddress & USB_DIR_IN) &&
 			list_empty (&dum->fifo_req.queue) &&
 			list_empty (&ep->queue) &&
+			!_req->num_sgs &&
 			_req->length <= FIFO_SIZE) {
 		req = &dum->fifo_req;
 		req->req = *_req;
@@ -879,6 +881,7 @@ static int dummy_udc_probe (struct platform_device *pdev)
 	dum->gadget.name = gadget_name;
 	dum->gadget.ops = &dummy_ops;
 	dum->gadget.is_dualspeed = 1;
+	dum->gadget.sg_supported = 1;
 
 	/* maybe claim OTG support, though we won't complete HNP */
 	dum->gadget.is_otg = (dummy_to_hcd(dum)->self.otg_port != 0);
@@ -1029,6 +1032,35 @@ static int dummy_urb_dequeue(struct usb_hcd *hcd, struct urb *urb, int status)
 	return rc;
 }
 
+/* copy len bytes between ubuf and the request's scatterlist, at its actual */
+static void
+dummy_copy_sg (struct dummy_request *req, char *ubuf, unsigned len,
+		int to_host)
+{
+	struct sg_mapping_iter	miter;
+	unsigned		skip = req->req.actual;
+	unsigned		this_len;
+
+	sg_miter_start (&miter, req->req.sg, req->req.num_sgs,
+			SG_MITER_ATOMIC | (to_host
+				? SG_MITER_FROM_SG : SG_MITER_TO_SG));
+	while (len && sg_miter_next (&miter)) {
+		if (skip >= miter.length) {
+			skip -= miter.length;
+			continue;
+		}
+		this_len = min (len, (unsigned) miter.length - skip);
+		if (to_host)
+			memcpy (ubuf, miter.addr + skip, this_len);
+		else
+			memcpy (miter.addr + skip, ubuf, this_len);
+		ubuf += this_len;
+		len -= this_len;
+		skip = 0;
+	}
+	sg_miter_stop (&miter);
+}
+
 /* transfer up to a frame's worth; caller must own lock */
 static int
 transfer(struct dummy *dum, struct urb *urb, struct dummy_ep *ep, int limit,
@@ -1079,7 +1111,9 @@ top:
 			/* else transfer packet(s) */
 			ubuf = urb->transfer_buffer + urb->actual_length;
 			rbuf = req->req.buf + req->req.actual;
-			if (to_host)
+			if (req->req.num_sgs)
+				dummy_copy_sg (req, ubuf, len, to_host);
+			else if (to_host)
 				memcpy (ubuf, rbuf, len);
 			else
 				memcpy (rbuf, ubuf, len);
@@ -29,8 +29,24 @@
 
 #define ADB_BULK_BUFFER_SIZE           4096
 
-/* number of tx requests to allocate */
-#define TX_REQ_MAX 4
+/*
+ * Bulk request sizes and number of tx requests, applied when the function
+ * is bound. adb_read() and adb_write() move up to one request's worth of
+ * data per call. Sizes are rounded down to a multiple of
+ * ADB_BULK_BUFFER_SIZE, limited to the controller's max_req_len, and
+ * halved down to ADB_BULK_BUFFER_SIZE if the buffers cannot be allocated.
+ */
+static unsigned int adb_tx_req_len = 16384;
+module_param(adb_tx_req_len, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(adb_tx_req_len, "ADB bulk IN request size in bytes");
+
+static unsigned int adb_rx_req_len = 16384;
+module_param(adb_rx_req_len, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(adb_rx_req_len, "ADB bulk OUT request size in bytes");
+
+static unsigned int adb_tx_reqs = 8;
+module_param(adb_tx_reqs, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(adb_tx_reqs, "number of ADB bulk IN requests");
 
 static const char adb_shortname[] = "android_adb";
 
@@ -55,6 +71,9 @@ struct adb_dev {
 	wait_queue_head_t write_wq;
 	struct usb_request *rx_req;
 	int rx_done;
+	/* bulk request sizes in use since the function was bound */
+	unsigned tx_req_len;
+	unsigned rx_req_len;
 };
 
 static struct usb_interface_descriptor adb_interface_desc = {
@@ -139,6 +158,23 @@ static struct usb_request *adb_request_new(struct usb_ep *ep, int buffer_size)
 	return req;
 }
 
+/*
+ * Allocates a bulk request of *len bytes, halving *len down to
+ * ADB_BULK_BUFFER_SIZE until the buffer can be allocated.
+ */
+static struct usb_request *adb_request_new_bulk(struct usb_ep *ep,
+						unsigned *len)
+{
+	struct usb_request *req;
+
+	for (;;) {
+		req = adb_request_new(ep, *len);
+		if (req || *len <= ADB_BULK_BUFFER_SIZE)
+			return req;
+		*len = max_t(unsigned, *len / 2, ADB_BULK_BUFFER_SIZE);
+	}
+}
+
 static void adb_request_free(struct usb_request *req, struct usb_ep *ep)
 {
 	if (req) {
@@ -243,14 +279,26 @@ static int adb_create_bulk_endpoints(struct adb_dev *dev,
 	dev->ep_out = ep;
 
 	/* now allocate requests for our endpoints */
-	req = adb_request_new(dev->ep_out, ADB_BULK_BUFFER_SIZE);
+	dev->tx_req_len = max_t(unsigned,
+			adb_tx_req_len & ~(ADB_BULK_BUFFER_SIZE - 1),
+			ADB_BULK_BUFFER_SIZE);
+	dev->rx_req_len = max_t(unsigned,
+			adb_rx_req_len & ~(ADB_BULK_BUFFER_SIZE - 1),
+			ADB_BULK_BUFFER_SIZE);
+	if (cdev->gadget->max_req_len) {
+		dev->tx_req_len = min(dev->tx_req_len,
+				      cdev->gadget->max_req_len);
+		dev->rx_req_len = min(dev->rx_req_len,
+				      cdev->gadget->max_req_len);
+	}
+	req = adb_request_new_bulk(dev->ep_out, &dev->rx_req_len);
 	if (!req)
 		goto fail;
 	req->complete = adb_complete_out;
 	dev->rx_req = req;
 
-	for (i = 0; i < TX_REQ_MAX; i++) {
-		req = adb_request_new(dev->ep_in, ADB_BULK_BUFFER_SIZE);
+	for (i = 0; i < max_t(unsigned, adb_tx_reqs, 1); i++) {
+		req = adb_request_new_bulk(dev->ep_in, &dev->tx_req_len);
 		if (!req)
 			goto fail;
 		req->complete = adb_complete_in;
@@ -276,7 +324,7 @@ static ssize_t adb_read(struct file *fp, char __user *buf,
 	if (!_adb_dev)
 		return -ENODEV;
 
-	if (count > ADB_BULK_BUFFER_SIZE)
+	if (count > dev->rx_req_len)
 		return -EINVAL;
 
 	if (adb_lock(&dev->read_excl))
@@ -374,8 +422,8 @@ static ssize_t adb_write(struct file *fp, const char __user *buf,
 		}
 
 		if (req != 0) {
-			if (count > ADB_BULK_BUFFER_SIZE)
-				xfer = ADB_BULK_BUFFER_SIZE;
+			if (count > dev->tx_req_len)
+				xfer = dev->tx_req_len;
 			else
 				xfer = count;
 			if (copy_from_user(req->buf, buf, xfer)) {
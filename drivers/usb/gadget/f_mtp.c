@@ -28,6 +28,8 @@
 
 #include <linux/types.h>
 #include <linux/file.h>
+#include <linux/backing-dev.h>
+#include <linux/pagemap.h>
 #include <linux/device.h>
 #include <linux/miscdevice.h>
 
@@ -49,8 +51,7 @@
 #define STATE_CANCELED              3   /* transaction canceled by host */
 #define STATE_ERROR                 4   /* error from completion routine */
 
-/* number of tx and rx requests to allocate */
-#define TX_REQ_MAX 4
+/* number of rx and interrupt requests to allocate */
 #define RX_REQ_MAX 2
 #define INTR_REQ_MAX 5
 
@@ -67,6 +68,35 @@
 #define MTP_RESPONSE_OK             0x2001
 #define MTP_RESPONSE_DEVICE_BUSY    0x2019
 
+/*
+ * Bulk request sizes and number of tx requests, applied when the function
+ * is bound. A send or receive moves up to one request's worth of a file per
+ * vfs_read() or vfs_write(), so larger requests mean fewer calls and fewer
+ * completions per file. Sizes are rounded down to a multiple of
+ * MTP_BULK_BUFFER_SIZE, limited to the controller's max_req_len, and
+ * halved down to MTP_BULK_BUFFER_SIZE if the buffers cannot be allocated.
+ */
+static unsigned int mtp_tx_req_len = 128 * 1024;
+module_param(mtp_tx_req_len, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mtp_tx_req_len, "MTP bulk IN request size in bytes");
+
+static unsigned int mtp_rx_req_len = 128 * 1024;
+module_param(mtp_rx_req_len, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mtp_rx_req_len, "MTP bulk OUT request size in bytes");
+
+static unsigned int mtp_tx_reqs = 8;
+module_param(mtp_tx_reqs, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mtp_tx_reqs, "number of MTP bulk IN requests");
+
+/*
+ * Send files straight from their page cache pages, with scatter-gather
+ * requests, rather than copying them into the request buffers. Only used
+ * when the controller takes scatterlists.
+ */
+static bool mtp_zero_copy = 1;
+module_param(mtp_zero_copy, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mtp_zero_copy, "send files without copying them");
+
 static const char mtp_shortname[] = "mtp_usb";
 
 struct mtp_dev {
@@ -93,6 +123,9 @@ struct mtp_dev {
 	wait_queue_head_t intr_wq;
 	struct usb_request *rx_req[RX_REQ_MAX];
 	int rx_done;
+	/* bulk request sizes in use since the function was bound */
+	unsigned tx_req_len;
+	unsigned rx_req_len;
 
 	/* for processing MTP_SEND_FILE, MTP_RECEIVE_FILE and
 	 * MTP_SEND_FILE_WITH_HEADER ioctls on a work queue
@@ -293,9 +326,27 @@ static struct usb_request *mtp_request_new(struct usb_ep *ep, int buffer_size)
 	return req;
 }
 
+/*
+ * Allocates a bulk request of *len bytes, halving *len down to
+ * MTP_BULK_BUFFER_SIZE until the buffer can be allocated.
+ */
+static struct usb_request *mtp_request_new_bulk(struct usb_ep *ep,
+						unsigned *len)
+{
+	struct usb_request *req;
+
+	for (;;) {
+		req = mtp_request_new(ep, *len);
+		if (req || *len <= MTP_BULK_BUFFER_SIZE)
+			return req;
+		*len = max_t(unsigned, *len / 2, MTP_BULK_BUFFER_SIZE);
+	}
+}
+
 static void mtp_request_free(struct usb_request *req, struct usb_ep *ep)
 {
 	if (req) {
+		kfree(req->sg);
 		kfree(req->buf);
 		usb_ep_free_request(ep, req);
 	}
@@ -345,6 +396,17 @@ static struct usb_request
 	return req;
 }
 
+/* Drops the page cache pages a tx request was sent from, if any */
+static void mtp_req_put_pages(struct usb_request *req)
+{
+	struct scatterlist *sg;
+	int i;
+
+	for_each_sg(req->sg, sg, req->num_sgs, i)
+		page_cache_release(sg_page(sg));
+	req->num_sgs = 0;
+}
+
 static void mtp_complete_in(struct usb_ep *ep, struct usb_request *req)
 {
 	struct mtp_dev *dev = _mtp_dev;
@@ -352,6 +414,7 @@ static void mtp_complete_in(struct usb_ep *ep, struct usb_request *req)
 	if (req->status != 0)
 		dev->state = STATE_ERROR;
 
+	mtp_req_put_pages(req);
 	mtp_req_put(dev, &dev->tx_idle, req);
 
 	wake_up(&dev->write_wq);
@@ -420,15 +483,32 @@ static int mtp_create_bulk_endpoints(struct mtp_dev *dev,
 	dev->ep_intr = ep;
 
 	/* now allocate requests for our endpoints */
-	for (i = 0; i < TX_REQ_MAX; i++) {
-		req = mtp_request_new(dev->ep_in, MTP_BULK_BUFFER_SIZE);
+	dev->tx_req_len = max_t(unsigned,
+			mtp_tx_req_len & ~(MTP_BULK_BUFFER_SIZE - 1),
+			MTP_BULK_BUFFER_SIZE);
+	dev->rx_req_len = max_t(unsigned,
+			mtp_rx_req_len & ~(MTP_BULK_BUFFER_SIZE - 1),
+			MTP_BULK_BUFFER_SIZE);
+	if (cdev->gadget->max_req_len) {
+		dev->tx_req_len = min(dev->tx_req_len,
+				      cdev->gadget->max_req_len);
+		dev->rx_req_len = min(dev->rx_req_len,
+				      cdev->gadget->max_req_len);
+	}
+	for (i = 0; i < max_t(unsigned, mtp_tx_reqs, 1); i++) {
+		req = mtp_request_new_bulk(dev->ep_in, &dev->tx_req_len);
 		if (!req)
 			goto fail;
+		/* without one, the request just always copies */
+		if (cdev->gadget->sg_supported)
+			req->sg = kmalloc(sizeof(struct scatterlist) *
+					  (dev->tx_req_len / PAGE_SIZE + 1),
+					  GFP_KERNEL);
 		req->complete = mtp_complete_in;
 		mtp_req_put(dev, &dev->tx_idle, req);
 	}
 	for (i = 0; i < RX_REQ_MAX; i++) {
-		req = mtp_request_new(dev->ep_out, MTP_BULK_BUFFER_SIZE);
+		req = mtp_request_new_bulk(dev->ep_out, &dev->rx_req_len);
 		if (!req)
 			goto fail;
 		req->complete = mtp_complete_out;
@@ -460,7 +540,7 @@ static ssize_t mtp_read(struct file *fp, char __user *buf,
 
 	DBG(cdev, "mtp_read(%d)\n", count);
 
-	if (count > MTP_BULK_BUFFER_SIZE)
+	if (count > dev->rx_req_len)
 		return -EINVAL;
 
 	/* we will block until we're online */
@@ -590,8 +670,8 @@ static ssize_t mtp_write(struct file *fp, const char __user *buf,
 			break;
 		}
 
-		if (count > MTP_BULK_BUFFER_SIZE)
-			xfer = MTP_BULK_BUFFER_SIZE;
+		if (count > dev->tx_req_len)
+			xfer = dev->tx_req_len;
 		else
 			xfer = count;
 		if (xfer && copy_from_user(req->buf, buf, xfer)) {
@@ -628,6 +708,52 @@ static ssize_t mtp_write(struct file *fp, const char __user *buf,
 	return r;
 }
 
+/*
+ * Points a tx request at the page cache pages holding 'len' bytes of 'filp'
+ * from 'offset' on, reading them in with readahead as vfs_read() would, and
+ * holds a reference to each until the request completes.
+ */
+static int mtp_send_file_pages(struct usb_request *req, struct file *filp,
+			       loff_t offset, unsigned len)
+{
+	struct address_space *mapping = filp->f_mapping;
+	pgoff_t index = offset >> PAGE_CACHE_SHIFT;
+	pgoff_t last = (offset + len - 1) >> PAGE_CACHE_SHIFT;
+	unsigned off = offset & ~PAGE_CACHE_MASK;
+	unsigned chunk;
+	struct page *page;
+
+	sg_init_table(req->sg, last - index + 1);
+	req->num_sgs = 0;
+	req->length = len;
+	for (; index <= last; index++) {
+		page = find_get_page(mapping, index);
+		if (!page)
+			page_cache_sync_readahead(mapping, &filp->f_ra, filp,
+						  index, last + 1 - index);
+		else if (PageReadahead(page))
+			page_cache_async_readahead(mapping, &filp->f_ra, filp,
+						   page, index,
+						   last + 1 - index);
+		if (!page || !PageUptodate(page)) {
+			if (page)
+				page_cache_release(page);
+			page = read_mapping_page(mapping, index, filp);
+			if (IS_ERR(page)) {
+				mtp_req_put_pages(req);
+				return PTR_ERR(page);
+			}
+		}
+
+		chunk = min_t(unsigned, PAGE_CACHE_SIZE - off, len);
+		sg_set_page(&req->sg[req->num_sgs++], page, chunk, off);
+		len -= chunk;
+		off = 0;
+	}
+	filp->f_ra.prev_pos = (loff_t)last << PAGE_CACHE_SHIFT;
+	return 0;
+}
+
 /* read from a local file and write to USB */
 static void send_file_work(struct work_struct *data) {
 	struct mtp_dev	*dev = container_of(data, struct mtp_dev, send_file_work);
@@ -640,6 +766,7 @@ static void send_file_work(struct work_struct *data) {
 	int xfer, ret, hdr_size;
 	int r = 0;
 	int sendZLP = 0;
+	bool zero_copy;
 
 	/* read our parameters */
 	smp_rmb();
@@ -649,6 +776,18 @@ static void send_file_work(struct work_struct *data) {
 
 	DBG(cdev, "send_file_work(%lld %lld)\n", offset, count);
 
+	zero_copy = mtp_zero_copy && filp->f_mapping->a_ops->readpage &&
+		!(filp->f_flags & O_DIRECT);
+
+	/*
+	 * Read ahead as for POSIX_FADV_SEQUENTIAL, so the file is read from
+	 * storage while the requests already queued go out.
+	 */
+	spin_lock(&filp->f_lock);
+	filp->f_ra.ra_pages = filp->f_mapping->backing_dev_info->ra_pages * 2;
+	filp->f_mode &= ~FMODE_RANDOM;
+	spin_unlock(&filp->f_lock);
+
 	if (dev->xfer_send_header) {
 		hdr_size = sizeof(struct mtp_data_header);
 		count += hdr_size;
@@ -682,8 +821,8 @@ static void send_file_work(struct work_struct *data) {
 			break;
 		}
 
-		if (count > MTP_BULK_BUFFER_SIZE)
-			xfer = MTP_BULK_BUFFER_SIZE;
+		if (count > dev->tx_req_len)
+			xfer = dev->tx_req_len;
 		else
 			xfer = count;
 
@@ -696,18 +835,34 @@ static void send_file_work(struct work_struct *data) {
 			header->transaction_id = __cpu_to_le32(dev->xfer_transaction_id);
 		}
 
-		ret = vfs_read(filp, req->buf + hdr_size, xfer - hdr_size, &offset);
-		if (ret < 0) {
-			r = ret;
-			break;
+		/*
+		 * The header, the ZLP and any part of the file past its
+		 * current end go through the request buffer.
+		 */
+		if (zero_copy && req->sg && !hdr_size && xfer &&
+		    offset + xfer <= i_size_read(filp->f_mapping->host)) {
+			ret = mtp_send_file_pages(req, filp, offset, xfer);
+			if (ret < 0) {
+				r = ret;
+				break;
+			}
+			offset += xfer;
+		} else {
+			ret = vfs_read(filp, req->buf + hdr_size,
+				       xfer - hdr_size, &offset);
+			if (ret < 0) {
+				r = ret;
+				break;
+			}
+			xfer = ret + hdr_size;
+			hdr_size = 0;
+			req->length = xfer;
 		}
-		xfer = ret + hdr_size;
-		hdr_size = 0;
 
-		req->length = xfer;
 		ret = usb_ep_queue(dev->ep_in, req, GFP_KERNEL);
 		if (ret < 0) {
 			DBG(cdev, "send_file_work: xfer error %d\n", ret);
+			mtp_req_put_pages(req);
 			dev->state = STATE_ERROR;
 			r = -EIO;
 			break;
@@ -754,8 +909,8 @@ static void receive_file_work(struct work_struct *data)
 			read_req = dev->rx_req[cur_buf];
 			cur_buf = (cur_buf + 1) % RX_REQ_MAX;
 
-			read_req->length = (count > MTP_BULK_BUFFER_SIZE
-					? MTP_BULK_BUFFER_SIZE : count);
+			read_req->length = (count > dev->rx_req_len
+					? dev->rx_req_len : count);
 			dev->rx_done = 0;
 			ret = usb_ep_queue(dev->ep_out, read_req, GFP_KERNEL);
 			if (ret < 0) {
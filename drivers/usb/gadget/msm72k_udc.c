@@ -65,6 +65,8 @@ static const char driver_name[] = "msm72k_udc";
 
 #define SETUP_BUF_SIZE     8
 
+#define MAX_REQ_LEN        0x4000
+
 
 static const char *const ep_name[] = {
 	"ep0out", "ep1out", "ep2out", "ep3out",
@@ -1271,7 +1273,7 @@ int usb_ept_queue_xfer(struct msm_endpoint *ept, struct usb_request *_req)
 	struct usb_info *ui = ept->ui;
 	unsigned length = req->req.length;
 
-	if (length > 0x4000)
+	if (length > MAX_REQ_LEN)
 		return -EMSGSIZE;
 
 	spin_lock_irqsave(&ui->lock, flags);
@@ -3284,6 +3286,7 @@ static int msm72k_probe(struct platform_device *pdev)
 
 	ui->gadget.ops = &msm72k_ops;
 	ui->gadget.is_dualspeed = 1;
+	ui->gadget.max_req_len = MAX_REQ_LEN;
 	device_initialize(&ui->gadget.dev);
 	dev_set_name(&ui->gadget.dev, "gadget");
 	ui->gadget.dev.parent = &pdev->dev;
@@ -23,8 +23,11 @@
 #include <linux/poll.h>
 #include <linux/workqueue.h>
 
-/** Max number of pages that can be used in a single read request */
-#define FUSE_MAX_PAGES_PER_REQ 32
+/** Default max number of pages that can be used in a single read request */
+#define FUSE_DEFAULT_MAX_PAGES_PER_REQ 32
+
+/** Most pages a filesystem can ask for with FUSE_MAX_PAGES, 1MB of 4k pages */
+#define FUSE_MAX_MAX_PAGES 256
 
 /** Bias for fi->writectr, meaning new writepages must not be sent */
 #define FUSE_NOWRITE INT_MIN
@@ -284,12 +287,18 @@ struct fuse_req {
 		struct fuse_lk_in lk_in;
 	} misc;
 
-	/** page vector */
-	struct page *pages[FUSE_MAX_PAGES_PER_REQ];
+	/** page vector, either inline_pages or allocated with the request */
+	struct page **pages;
+
+	/** size of the page vector */
+	unsigned max_pages;
 
 	/** number of pages in vector */
 	unsigned num_pages;
 
+	/** page vector of requests that need no more than the default */
+	struct page *inline_pages[FUSE_DEFAULT_MAX_PAGES_PER_REQ];
+
 	/** offset of data on first page */
 	unsigned page_offset;
 
@@ -341,6 +350,9 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
+	/** Maximum number of pages in a read or write request */
+	unsigned max_pages;
+
 	/** Readers of the connection are waiting on this */
 	wait_queue_head_t waitq;
 
@@ -472,6 +484,9 @@ struct fuse_conn {
 	/** Don't apply umask to creation modes */
 	unsigned dont_mask:1;
 
+	/** Cache buffered writes, the kernel owns size and mtime of files */
+	unsigned writeback_cache:1;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -644,7 +659,7 @@ void fuse_ctl_cleanup(void);
  */
 struct fuse_req *fuse_request_alloc(void);
 
-struct fuse_req *fuse_request_alloc_nofs(void);
+struct fuse_req *fuse_request_alloc_nofs(unsigned npages);
 
 /**
  * Free a request
@@ -656,6 +671,11 @@ void fuse_request_free(struct fuse_req *req);
  */
 struct fuse_req *fuse_get_req(struct fuse_conn *fc);
 
+/**
+ * Get a request with room for 'npages' pages, may fail with -ENOMEM
+ */
+struct fuse_req *fuse_get_req_pages(struct fuse_conn *fc, unsigned npages);
+
 /**
  * Gets a requests for a file operation, always succeeds
  */
@@ -737,6 +757,11 @@ void fuse_flush_writepages(struct inode *inode);
 void fuse_set_nowrite(struct inode *inode);
 void fuse_release_nowrite(struct inode *inode);
 
+/**
+ * Send the kernel's mtime of a file to the filesystem
+ */
+int fuse_flush_mtime(struct inode *inode);
+
 u64 fuse_get_attr_version(struct fuse_conn *fc);
 
 /**
@@ -763,4 +788,16 @@ int fuse_dev_release(struct inode *inode, struct file *file);
 
 void fuse_write_update_size(struct inode *inode, loff_t pos);
 
+/**
+ * Adjust open flags for a filesystem with the writeback cache: the
+ * kernel appends at its own i_size, and reads pages in before writing
+ * parts of them.
+ */
+static inline void fuse_writeback_open_flags(u32 *flags)
+{
+	*flags &= ~O_APPEND;
+	if ((*flags & O_ACCMODE) == O_WRONLY)
+		*flags = (*flags & ~O_ACCMODE) | O_RDWR;
+}
+
 #endif /* _FS_FUSE_I_H */
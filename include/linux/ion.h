@@ -25,7 +25,7 @@
 struct ion_handle;
 /**
  * enum ion_heap_types - list of all possible types of heaps
- * @ION_HEAP_TYPE_SYSTEM:	 memory allocated via vmalloc
+ * @ION_HEAP_TYPE_SYSTEM:	 memory allocated from pools of pages
  * @ION_HEAP_TYPE_SYSTEM_CONTIG: memory allocated via kmalloc
  * @ION_HEAP_TYPE_CARVEOUT:	 memory allocated from a prereserved
  * 				 carveout heap, allocations are physically
@@ -754,6 +754,67 @@ struct ion_flag_data {
 	unsigned long flags;
 };
 
+/**
+ * DOC: /proc/ion_stats - ion memory usage in a fixed binary format
+ *
+ * Reading /proc/ion_stats returns a snapshot made of a struct
+ * ion_stats_header, followed by nr_heaps struct ion_heap_stats and then
+ * nr_clients struct ion_client_stats. All sizes are in bytes. A buffer is
+ * charged in full to every client holding a handle to it, much like a
+ * shared page counts towards the RSS of every process mapping it. There is
+ * one client per userspace process.
+ */
+#define ION_STATS_VERSION	1
+#define ION_NUM_HEAP_IDS	32
+#define ION_STATS_NAME_LEN	32
+
+struct ion_stats_header {
+	__u32 version;
+	__u32 nr_heaps;
+	__u32 nr_clients;
+	__u32 reserved;
+};
+
+/**
+ * struct ion_heap_stats - usage of one heap
+ * @id:		heap id, the index into ion_client_stats.heap_bytes
+ * @type:	enum ion_heap_type of the heap
+ * @total_bytes:	bytes currently allocated from the heap
+ * @peak_bytes:	high watermark of total_bytes
+ * @nr_buffers:	number of buffers currently allocated from the heap
+ * @name:	name of the heap
+ */
+struct ion_heap_stats {
+	__u32 id;
+	__u32 type;
+	__u64 total_bytes;
+	__u64 peak_bytes;
+	__u32 nr_buffers;
+	__u32 reserved;
+	char name[ION_STATS_NAME_LEN];
+};
+
+#define ION_CLIENT_STATS_KERNEL	1	/* client created by a driver */
+
+/**
+ * struct ion_client_stats - usage of one client
+ * @pid:	process the client belongs to (the creator, for kernel clients)
+ * @flags:	ION_CLIENT_STATS_* flags
+ * @nr_handles:	number of buffers the client holds handles to
+ * @total_bytes:	size of those buffers
+ * @heap_bytes:	size of those buffers, by heap id
+ * @name:	name of the client
+ */
+struct ion_client_stats {
+	__s32 pid;
+	__u32 flags;
+	__u32 nr_handles;
+	__u32 reserved;
+	__u64 total_bytes;
+	__u64 heap_bytes[ION_NUM_HEAP_IDS];
+	char name[ION_STATS_NAME_LEN];
+};
+
 #define ION_IOC_MAGIC		'I'
 
 /**
@@ -70,6 +70,43 @@ extern unsigned long badness(struct task_struct *p, struct mem_cgroup *mem,
 
 extern struct task_struct *find_lock_task_mm(struct task_struct *p);
 
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+/*
+ * Thread group leaders bucketed by signal->oom_adj, so that the Android
+ * low memory killer can find its candidates without walking all tasks.
+ * Buckets are indexed by oom_adj - OOM_DISABLE and protected by
+ * oom_adj_index_lock, which nests inside tasklist_lock and outside
+ * task_lock(); take it with interrupts disabled.
+ */
+#define OOM_ADJ_BUCKETS		(OOM_ADJUST_MAX - OOM_DISABLE + 1)
+
+extern spinlock_t oom_adj_index_lock;
+extern struct hlist_head oom_adj_index[OOM_ADJ_BUCKETS];
+
+extern void oom_adj_index_add(struct task_struct *p);
+extern void oom_adj_index_del(struct task_struct *p);
+extern void oom_adj_index_replace(struct task_struct *old,
+				  struct task_struct *new);
+extern void oom_adj_index_update(struct task_struct *p);
+#else
+static inline void oom_adj_index_add(struct task_struct *p)
+{
+}
+
+static inline void oom_adj_index_del(struct task_struct *p)
+{
+}
+
+static inline void oom_adj_index_replace(struct task_struct *old,
+					 struct task_struct *new)
+{
+}
+
+static inline void oom_adj_index_update(struct task_struct *p)
+{
+}
+#endif
+
 /* sysctls */
 extern int sysctl_oom_dump_tasks;
 extern int sysctl_oom_kill_allocating_task;
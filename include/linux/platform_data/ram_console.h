@@ -15,8 +15,17 @@
 #ifndef _INCLUDE_LINUX_PLATFORM_DATA_RAM_CONSOLE_H_
 #define _INCLUDE_LINUX_PLATFORM_DATA_RAM_CONSOLE_H_
 
+#include <linux/types.h>
+
 struct ram_console_platform_data {
 	const char *bootinfo;
+	/*
+	 * Bytes at the end of the region set aside for the Android logger
+	 * to save its logs in, compressed, across a reboot.
+	 */
+	size_t logger_size;
 };
 
+extern void *ram_console_logger_area(size_t *size);
+
 #endif /* _INCLUDE_LINUX_PLATFORM_DATA_RAM_CONSOLE_H_ */
@@ -11,8 +11,13 @@
  *
  */
 
+#include <linux/math64.h>
+
 struct rq_data {
 	unsigned int rq_avg;
+	/* tenths of runnable tasks times jiffies, summed since boot */
+	u64 rq_sum;
+	unsigned long rq_sum_jiffies;
 	unsigned long rq_poll_jiffies;
 	unsigned long def_timer_jiffies;
 	unsigned long rq_poll_last_jiffy;
@@ -29,3 +34,29 @@ struct rq_data {
 extern spinlock_t rq_lock;
 extern struct rq_data rq_info;
 extern struct workqueue_struct *rq_wq;
+
+/*
+ * A private view of the run queue average, for in-kernel users that must
+ * not share (and reset) the one reported to userspace.
+ */
+struct rq_window {
+	u64 sum;
+	unsigned long jiffies;
+};
+
+/*
+ * Tenths of runnable tasks, averaged since the previous call for the same
+ * window, or -1 if the run queue has not been sampled since then. Caller
+ * must hold rq_lock.
+ */
+static inline int rq_window_avg(struct rq_window *w)
+{
+	unsigned long n = rq_info.rq_sum_jiffies - w->jiffies;
+	u64 sum = rq_info.rq_sum - w->sum;
+
+	if (!n)
+		return -1;
+	w->sum = rq_info.rq_sum;
+	w->jiffies = rq_info.rq_sum_jiffies;
+	return div_u64(sum, n);
+}
@@ -6,6 +6,7 @@
 #include <linux/init.h>
 #include <linux/pm.h>
 #include <linux/mm.h>
+#include <linux/ktime.h>
 #include <asm/errno.h>
 
 #if defined(CONFIG_PM_SLEEP) && defined(CONFIG_VT) && defined(CONFIG_VT_CONSOLE)
@@ -318,4 +319,28 @@ static inline void unlock_system_sleep(void)
 }
 #endif
 
+/* Points of a suspend cycle that suspend_time_mark() is called at */
+enum {
+	SUSPEND_TIME_BEGIN,	/* enter_state() starts */
+	SUSPEND_TIME_ENTERED,	/* everything but syscore is suspended */
+	SUSPEND_TIME_RESUMING,	/* back from the platform's enter() */
+	SUSPEND_TIME_END,	/* devices are resumed and tasks thawed */
+};
+
+#ifdef CONFIG_SUSPEND_TIME
+/*
+ * suspend_time_record - log how long a suspend or resume callback took
+ * since @calltime, under @phase and the name built from @fmt.
+ */
+extern __printf(3, 4) void suspend_time_record(const char *phase,
+					       ktime_t calltime,
+					       const char *fmt, ...);
+extern void suspend_time_mark(int mark);
+#else
+static inline __printf(3, 4) void suspend_time_record(const char *phase,
+						      ktime_t calltime,
+						      const char *fmt, ...) {}
+static inline void suspend_time_mark(int mark) {}
+#endif
+
 #endif /* _LINUX_SUSPEND_H */
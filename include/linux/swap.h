@@ -264,6 +264,12 @@ extern unsigned long shrink_all_memory(unsigned long nr_pages);
 extern int vm_swappiness;
 extern int remove_mapping(struct address_space *mapping, struct page *page);
 extern long vm_total_pages;
+extern void global_reclaim_stat(unsigned long *scanned,
+				unsigned long *reclaimed);
+
+/* linux/mm/thrash.c */
+extern void count_refault(void);
+extern unsigned long refault_count(void);
 
 #ifdef CONFIG_NUMA
 extern int zone_reclaim_mode;
@@ -177,6 +177,7 @@ repeat:
 	rcu_read_unlock();
 
 	proc_flush_task(p);
+	oom_adj_index_del(p);
 
 	write_lock_irq(&tasklist_lock);
 	tracehook_finish_release_task(p);
@@ -17,6 +17,7 @@
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/rtc.h>
+#include <linux/suspend.h>
 #include <linux/wakelock.h>
 #include <linux/workqueue.h>
 
@@ -74,6 +75,7 @@ static void early_suspend(struct work_struct *work)
 {
 	struct early_suspend *pos;
 	unsigned long irqflags;
+	ktime_t calltime;
 	int abort = 0;
 
 	mutex_lock(&early_suspend_lock);
@@ -97,7 +99,10 @@ static void early_suspend(struct work_struct *work)
 		if (pos->suspend != NULL) {
 			if (debug_mask & DEBUG_VERBOSE)
 				pr_info("early_suspend: calling %pf\n", pos->suspend);
+			calltime = ktime_get();
 			pos->suspend(pos);
+			suspend_time_record("early_suspend", calltime, "%pf",
+					    pos->suspend);
 		}
 	}
 	mutex_unlock(&early_suspend_lock);
@@ -114,6 +119,7 @@ static void late_resume(struct work_struct *work)
 {
 	struct early_suspend *pos;
 	unsigned long irqflags;
+	ktime_t calltime;
 	int abort = 0;
 
 	mutex_lock(&early_suspend_lock);
@@ -136,7 +142,10 @@ static void late_resume(struct work_struct *work)
 			if (debug_mask & DEBUG_VERBOSE)
 				pr_info("late_resume: calling %pf\n", pos->resume);
 
+			calltime = ktime_get();
 			pos->resume(pos);
+			suspend_time_record("late_resume", calltime, "%pf",
+					    pos->resume);
 		}
 	}
 	if (debug_mask & DEBUG_SUSPEND)
@@ -166,6 +166,7 @@ static int suspend_enter(suspend_state_t state)
 	arch_suspend_disable_irqs();
 	BUG_ON(!irqs_disabled());
 
+	suspend_time_mark(SUSPEND_TIME_ENTERED);
 	error = syscore_suspend();
 	if (!error) {
 		if (!(suspend_test(TEST_CORE) || pm_wakeup_pending())) {
@@ -174,6 +175,7 @@ static int suspend_enter(suspend_state_t state)
 		}
 		syscore_resume();
 	}
+	suspend_time_mark(SUSPEND_TIME_RESUMING);
 
 	arch_suspend_enable_irqs();
 	BUG_ON(irqs_disabled());
@@ -276,6 +278,7 @@ int enter_state(suspend_state_t state)
 	if (!mutex_trylock(&pm_mutex))
 		return -EBUSY;
 
+	suspend_time_mark(SUSPEND_TIME_BEGIN);
 	suspend_sys_sync_queue();
 
 	pr_debug("PM: Preparing system for %s sleep\n", pm_states[state]);
@@ -295,6 +298,7 @@ int enter_state(suspend_state_t state)
 	pr_debug("PM: Finishing wakeup.\n");
 	suspend_finish();
  Unlock:
+	suspend_time_mark(SUSPEND_TIME_END);
 	mutex_unlock(&pm_mutex);
 	return error;
 }
@@ -1,5 +1,6 @@
 /*
- * debugfs file to track time spent in suspend
+ * debugfs files to track time spent in suspend, and how long entering and
+ * leaving it takes
  *
  * Copyright (c) 2011, Google, Inc.
  *
@@ -19,13 +20,181 @@
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/seq_file.h>
+#include <linux/sort.h>
+#include <linux/spinlock.h>
+#include <linux/suspend.h>
 #include <linux/syscore_ops.h>
 #include <linux/time.h>
+#include <linux/vmalloc.h>
 
 static struct timespec suspend_time_before;
 static unsigned int time_in_suspend_bins[32];
 
+/*
+ * Every device, early suspend and sys_sync callback timed in the last few
+ * suspend cycles, oldest overwritten first.
+ */
+#define SUSPEND_LATENCY_ENTRIES		1024
+#define SUSPEND_LATENCY_NAME_LEN	32
+
+struct suspend_latency_entry {
+	unsigned int cycle;
+	unsigned int usecs;
+	const char *phase;
+	char name[SUSPEND_LATENCY_NAME_LEN];
+};
+
+static DEFINE_SPINLOCK(suspend_latency_lock);
+static struct suspend_latency_entry suspend_latency_ring[
+	SUSPEND_LATENCY_ENTRIES];
+static unsigned int suspend_latency_next;
+static unsigned int suspend_cycle;
+
+static ktime_t suspend_begin_time;
+static ktime_t suspend_resume_time;
+static bool suspend_entered;
+static unsigned int suspend_entry_us;
+static unsigned int suspend_exit_us;
+static unsigned int suspend_aborted;
+static unsigned int suspend_entry_bins[32];
+static unsigned int suspend_exit_bins[32];
+
+void suspend_time_record(const char *phase, ktime_t calltime,
+			 const char *fmt, ...)
+{
+	s64 usecs = ktime_us_delta(ktime_get(), calltime);
+	struct suspend_latency_entry *entry;
+	unsigned long flags;
+	va_list args;
+
+	spin_lock_irqsave(&suspend_latency_lock, flags);
+	entry = &suspend_latency_ring[suspend_latency_next++ %
+				      SUSPEND_LATENCY_ENTRIES];
+	entry->cycle = suspend_cycle;
+	entry->usecs = usecs;
+	entry->phase = phase;
+	va_start(args, fmt);
+	vsnprintf(entry->name, sizeof(entry->name), fmt, args);
+	va_end(args);
+	spin_unlock_irqrestore(&suspend_latency_lock, flags);
+}
+
+/*
+ * The marks are only set from the task doing the suspend, the latencies
+ * they produce are only statistics, so they are not locked.
+ */
+void suspend_time_mark(int mark)
+{
+	ktime_t now = ktime_get();
+
+	switch (mark) {
+	case SUSPEND_TIME_BEGIN:
+		suspend_cycle++;
+		suspend_begin_time = now;
+		suspend_entered = false;
+		break;
+	case SUSPEND_TIME_ENTERED:
+		suspend_entry_us = ktime_us_delta(now, suspend_begin_time);
+		suspend_entry_bins[fls(suspend_entry_us / USEC_PER_MSEC)]++;
+		suspend_entered = true;
+		break;
+	case SUSPEND_TIME_RESUMING:
+		suspend_resume_time = now;
+		break;
+	case SUSPEND_TIME_END:
+		if (!suspend_entered) {
+			suspend_aborted++;
+			break;
+		}
+		suspend_exit_us = ktime_us_delta(now, suspend_resume_time);
+		suspend_exit_bins[fls(suspend_exit_us / USEC_PER_MSEC)]++;
+		break;
+	}
+}
+
 #ifdef CONFIG_DEBUG_FS
+static u32 suspend_latency_top_n = 20;
+
+static int suspend_latency_cmp(const void *a, const void *b)
+{
+	const struct suspend_latency_entry *x = a, *y = b;
+
+	return x->usecs < y->usecs ? 1 : x->usecs > y->usecs ? -1 : 0;
+}
+
+static int suspend_latency_top_show(struct seq_file *s, void *data)
+{
+	struct suspend_latency_entry *entries;
+	unsigned long flags;
+	unsigned int i, n;
+
+	entries = vmalloc(sizeof(suspend_latency_ring));
+	if (!entries)
+		return -ENOMEM;
+
+	spin_lock_irqsave(&suspend_latency_lock, flags);
+	n = min_t(unsigned int, suspend_latency_next, SUSPEND_LATENCY_ENTRIES);
+	memcpy(entries, suspend_latency_ring, n * sizeof(*entries));
+	spin_unlock_irqrestore(&suspend_latency_lock, flags);
+
+	sort(entries, n, sizeof(*entries), suspend_latency_cmp, NULL);
+	seq_printf(s, "cycle      usecs  phase          callback\n");
+	for (i = 0; i < n && i < suspend_latency_top_n; i++)
+		seq_printf(s, "%5u %10u  %-14s %s\n", entries[i].cycle,
+			   entries[i].usecs, entries[i].phase, entries[i].name);
+
+	vfree(entries);
+	return 0;
+}
+
+static int suspend_latency_top_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, suspend_latency_top_show, NULL);
+}
+
+static const struct file_operations suspend_latency_top_fops = {
+	.open		= suspend_latency_top_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int suspend_latency_histogram_show(struct seq_file *s, void *data)
+{
+	int bin;
+
+	seq_printf(s, "latency (msecs)  entry   exit\n");
+	seq_printf(s, "-----------------------------\n");
+	for (bin = 0; bin < 32; bin++) {
+		if (!suspend_entry_bins[bin] && !suspend_exit_bins[bin])
+			continue;
+		seq_printf(s, "%6d - %6d %6u %6u\n",
+			bin ? 1 << (bin - 1) : 0, 1 << bin,
+			suspend_entry_bins[bin], suspend_exit_bins[bin]);
+	}
+	seq_printf(s, "last: entry %u.%03u msecs, exit %u.%03u msecs\n",
+		   suspend_entry_us / USEC_PER_MSEC,
+		   suspend_entry_us % USEC_PER_MSEC,
+		   suspend_exit_us / USEC_PER_MSEC,
+		   suspend_exit_us % USEC_PER_MSEC);
+	seq_printf(s, "cycles %u, aborted %u\n", suspend_cycle,
+		   suspend_aborted);
+	return 0;
+}
+
+static int suspend_latency_histogram_open(struct inode *inode,
+					  struct file *file)
+{
+	return single_open(file, suspend_latency_histogram_show, NULL);
+}
+
+static const struct file_operations suspend_latency_histogram_fops = {
+	.open		= suspend_latency_histogram_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static int suspend_time_debug_show(struct seq_file *s, void *data)
 {
 	int bin;
@@ -64,6 +233,16 @@ static int __init suspend_time_debug_init(void)
 		return -ENOMEM;
 	}
 
+	d = debugfs_create_dir("suspend_latency", NULL);
+	if (!d) {
+		pr_err("Failed to create suspend_latency debug dir\n");
+		return -ENOMEM;
+	}
+	debugfs_create_u32("top_n", 0644, d, &suspend_latency_top_n);
+	debugfs_create_file("top", 0444, d, NULL, &suspend_latency_top_fops);
+	debugfs_create_file("histogram", 0444, d, NULL,
+			    &suspend_latency_histogram_fops);
+
 	return 0;
 }
 
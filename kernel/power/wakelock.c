@@ -21,6 +21,7 @@
 #include <linux/wakelock.h>
 #ifdef CONFIG_WAKELOCK_STAT
 #include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 #endif
 #include "power.h"
 
@@ -43,6 +44,13 @@ module_param_named(debug_mask, debug_mask, int, S_IRUGO | S_IWUSR | S_IWGRP);
 static DEFINE_SPINLOCK(list_lock);
 static LIST_HEAD(inactive_locks);
 static struct list_head active_wake_locks[WAKE_LOCK_TYPE_COUNT];
+/*
+ * Active locks without a timeout are only counted, the ones with a timeout
+ * are also kept sorted by expiry, so has_wake_lock() need not walk the
+ * active list.
+ */
+static int active_untimed_count[WAKE_LOCK_TYPE_COUNT];
+static struct rb_root active_timed_locks[WAKE_LOCK_TYPE_COUNT];
 static int current_event_num;
 static int suspend_sys_sync_count;
 static DEFINE_SPINLOCK(suspend_sys_sync_lock);
@@ -63,6 +71,14 @@ static unsigned suspend_short_count;
 static struct wake_lock deleted_wake_locks;
 static ktime_t last_sleep_time_update;
 static int wait_for_wakeup;
+/*
+ * The time spent waiting for sleep, i.e. with main_wake_lock released, only
+ * advances while sleep_wait_done is clear. A lock preventing suspend
+ * remembers this clock when it is taken and is charged the difference when
+ * it is released, so no lock list is walked on the transitions.
+ */
+static ktime_t sleep_wait_time;
+static int sleep_wait_done;
 
 int get_expired_time(struct wake_lock *lock, ktime_t *expire_time)
 {
@@ -86,6 +102,15 @@ int get_expired_time(struct wake_lock *lock, ktime_t *expire_time)
 	return 1;
 }
 
+/* Caller must acquire the list_lock spinlock */
+static ktime_t sleep_wait_clock(ktime_t now)
+{
+	if (sleep_wait_done ||
+	    ktime_to_ns(now) < ktime_to_ns(last_sleep_time_update))
+		return sleep_wait_time;
+	return ktime_add(sleep_wait_time,
+			 ktime_sub(now, last_sleep_time_update));
+}
 
 static int print_lock_stat(struct seq_file *m, struct wake_lock *lock)
 {
@@ -110,7 +135,8 @@ static int print_lock_stat(struct seq_file *m, struct wake_lock *lock)
 		total_time = ktime_add(total_time, add_time);
 		if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND)
 			prevent_suspend_time = ktime_add(prevent_suspend_time,
-					ktime_sub(now, last_sleep_time_update));
+					ktime_sub(sleep_wait_clock(now),
+					lock->stat.prevent_suspend_start));
 		if (add_time.tv64 > max_time.tv64)
 			max_time = add_time;
 	}
@@ -124,27 +150,78 @@ static int print_lock_stat(struct seq_file *m, struct wake_lock *lock)
 		     ktime_to_ns(lock->stat.last_time));
 }
 
-static int wakelock_stats_show(struct seq_file *m, void *unused)
+/* The inactive locks are listed first, then the active ones of each type */
+static struct list_head *wakelock_stats_list(int i)
 {
-	unsigned long irqflags;
-	struct wake_lock *lock;
-	int ret;
-	int type;
+	return i ? &active_wake_locks[i - 1] : &inactive_locks;
+}
 
-	spin_lock_irqsave(&list_lock, irqflags);
+/* Caller must acquire the list_lock spinlock */
+static struct wake_lock *wakelock_stats_next_lock(struct wake_lock *lock)
+{
+	struct list_head *link = &inactive_locks;
+	int i = 0;
 
-	ret = seq_puts(m, "name\tcount\texpire_count\twake_count\tactive_since"
-			"\ttotal_time\tsleep_time\tmax_time\tlast_change\n");
-	list_for_each_entry(lock, &inactive_locks, link)
-		ret = print_lock_stat(m, lock);
-	for (type = 0; type < WAKE_LOCK_TYPE_COUNT; type++) {
-		list_for_each_entry(lock, &active_wake_locks[type], link)
-			ret = print_lock_stat(m, lock);
+	if (lock) {
+		if (lock->flags & WAKE_LOCK_ACTIVE)
+			i = (lock->flags & WAKE_LOCK_TYPE_MASK) + 1;
+		link = &lock->link;
 	}
-	spin_unlock_irqrestore(&list_lock, irqflags);
+	while (link->next == wakelock_stats_list(i)) {
+		if (++i > WAKE_LOCK_TYPE_COUNT)
+			return NULL;
+		link = wakelock_stats_list(i);
+	}
+	return list_entry(link->next, struct wake_lock, link);
+}
+
+/*
+ * The list_lock is only held while one buffer of output is formatted,
+ * rather than for the whole file and again each time the buffer had to
+ * grow, so reading the stats does not hold off wake_lock() for long.
+ */
+static void *wakelock_stats_start(struct seq_file *m, loff_t *pos)
+{
+	struct wake_lock *lock = NULL;
+	loff_t n = *pos;
+
+	spin_lock_irq(&list_lock);
+	if (!n)
+		return SEQ_START_TOKEN;
+	while (n-- && (lock = wakelock_stats_next_lock(lock)))
+		;
+	return lock;
+}
+
+static void *wakelock_stats_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	++*pos;
+	return wakelock_stats_next_lock(v == SEQ_START_TOKEN ? NULL : v);
+}
+
+static void wakelock_stats_stop(struct seq_file *m, void *v)
+{
+	spin_unlock_irq(&list_lock);
+}
+
+static int wakelock_stats_show(struct seq_file *m, void *v)
+{
+	if (v == SEQ_START_TOKEN)
+		seq_puts(m, "name\tcount\texpire_count\twake_count\t"
+			 "active_since\ttotal_time\tsleep_time\tmax_time\t"
+			 "last_change\n");
+	else
+		print_lock_stat(m, v);
 	return 0;
 }
 
+static const struct seq_operations wakelock_stats_ops = {
+	.start = wakelock_stats_start,
+	.next = wakelock_stats_next,
+	.stop = wakelock_stats_stop,
+	.show = wakelock_stats_show,
+};
+
 static void wake_unlock_stat_locked(struct wake_lock *lock, int expired)
 {
 	ktime_t duration;
@@ -164,46 +241,83 @@ static void wake_unlock_stat_locked(struct wake_lock *lock, int expired)
 		lock->stat.max_time = duration;
 	lock->stat.last_time = ktime_get();
 	if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND) {
-		duration = ktime_sub(now, last_sleep_time_update);
+		duration = ktime_sub(sleep_wait_clock(now),
+				     lock->stat.prevent_suspend_start);
 		lock->stat.prevent_suspend_time = ktime_add(
 			lock->stat.prevent_suspend_time, duration);
 		lock->flags &= ~WAKE_LOCK_PREVENTING_SUSPEND;
 	}
 }
 
+static void prevent_suspend_stat_locked(struct wake_lock *lock)
+{
+	if (lock == &main_wake_lock ||
+	    (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND))
+		return;
+	lock->stat.prevent_suspend_start = sleep_wait_clock(ktime_get());
+	lock->flags |= WAKE_LOCK_PREVENTING_SUSPEND;
+}
+
 static void update_sleep_wait_stats_locked(int done)
 {
-	struct wake_lock *lock;
-	ktime_t now, etime, elapsed, add;
-	int expired;
-
-	now = ktime_get();
-	elapsed = ktime_sub(now, last_sleep_time_update);
-	list_for_each_entry(lock, &active_wake_locks[WAKE_LOCK_SUSPEND], link) {
-		expired = get_expired_time(lock, &etime);
-		if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND) {
-			if (expired)
-				add = ktime_sub(etime, last_sleep_time_update);
-			else
-				add = elapsed;
-			lock->stat.prevent_suspend_time = ktime_add(
-				lock->stat.prevent_suspend_time, add);
-		}
-		if (done || expired)
-			lock->flags &= ~WAKE_LOCK_PREVENTING_SUSPEND;
-		else
-			lock->flags |= WAKE_LOCK_PREVENTING_SUSPEND;
-	}
+	ktime_t now = ktime_get();
+
+	if (!sleep_wait_done)
+		sleep_wait_time = ktime_add(sleep_wait_time,
+				ktime_sub(now, last_sleep_time_update));
 	last_sleep_time_update = now;
+	sleep_wait_done = done;
 }
 #endif
 
+/* Caller must acquire the list_lock spinlock */
+static void add_active_wake_lock(struct wake_lock *lock, int type)
+{
+	struct rb_node **p = &active_timed_locks[type].rb_node;
+	struct rb_node *parent = NULL;
+	struct wake_lock *entry;
+
+	if (!(lock->flags & WAKE_LOCK_AUTO_EXPIRE)) {
+		active_untimed_count[type]++;
+		list_add(&lock->link, &active_wake_locks[type]);
+		return;
+	}
+
+	while (*p) {
+		parent = *p;
+		entry = rb_entry(parent, struct wake_lock, expire_node);
+		if (time_before(lock->expires, entry->expires))
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&lock->expire_node, parent, p);
+	rb_insert_color(&lock->expire_node, &active_timed_locks[type]);
+	list_add_tail(&lock->link, &active_wake_locks[type]);
+}
+
+/*
+ * Caller must acquire the list_lock spinlock, and move lock->link off the
+ * active list itself.
+ */
+static void del_active_wake_lock(struct wake_lock *lock)
+{
+	int type = lock->flags & WAKE_LOCK_TYPE_MASK;
+
+	if (!(lock->flags & WAKE_LOCK_ACTIVE))
+		return;
+	if (lock->flags & WAKE_LOCK_AUTO_EXPIRE)
+		rb_erase(&lock->expire_node, &active_timed_locks[type]);
+	else
+		active_untimed_count[type]--;
+}
 
 static void expire_wake_lock(struct wake_lock *lock)
 {
 #ifdef CONFIG_WAKELOCK_STAT
 	wake_unlock_stat_locked(lock, 1);
 #endif
+	del_active_wake_lock(lock);
 	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
 	list_del(&lock->link);
 	list_add(&lock->link, &inactive_locks);
@@ -234,23 +348,31 @@ static void print_active_locks(int type)
 	}
 }
 
+/*
+ * Only the locks that have timed out since the last call are looked at,
+ * the latest expiry is the last node of the tree.
+ */
 static long has_wake_lock_locked(int type)
 {
-	struct wake_lock *lock, *n;
-	long max_timeout = 0;
+	struct rb_root *root = &active_timed_locks[type];
+	struct rb_node *node;
+	struct wake_lock *lock;
+	unsigned long now = jiffies;
 
 	BUG_ON(type >= WAKE_LOCK_TYPE_COUNT);
-	list_for_each_entry_safe(lock, n, &active_wake_locks[type], link) {
-		if (lock->flags & WAKE_LOCK_AUTO_EXPIRE) {
-			long timeout = lock->expires - jiffies;
-			if (timeout <= 0)
-				expire_wake_lock(lock);
-			else if (timeout > max_timeout)
-				max_timeout = timeout;
-		} else
-			return -1;
+	if (active_untimed_count[type])
+		return -1;
+	while ((node = rb_first(root))) {
+		lock = rb_entry(node, struct wake_lock, expire_node);
+		if (time_after(lock->expires, now))
+			break;
+		expire_wake_lock(lock);
 	}
-	return max_timeout;
+	node = rb_last(root);
+	if (!node)
+		return 0;
+	lock = rb_entry(node, struct wake_lock, expire_node);
+	return lock->expires - now;
 }
 
 long has_wake_lock(int type)
@@ -267,10 +389,14 @@ long has_wake_lock(int type)
 
 static void suspend_sys_sync(struct work_struct *work)
 {
+	ktime_t calltime;
+
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("PM: Syncing filesystems...\n");
 
+	calltime = ktime_get();
 	sys_sync();
+	suspend_time_record("sys_sync", calltime, "sys_sync");
 
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("sync done.\n");
@@ -441,6 +567,7 @@ void wake_lock_init(struct wake_lock *lock, int type, const char *name)
 	lock->stat.wakeup_count = 0;
 	lock->stat.total_time = ktime_set(0, 0);
 	lock->stat.prevent_suspend_time = ktime_set(0, 0);
+	lock->stat.prevent_suspend_start = ktime_set(0, 0);
 	lock->stat.max_time = ktime_set(0, 0);
 	lock->stat.last_time = ktime_set(0, 0);
 #endif
@@ -475,6 +602,8 @@ void wake_lock_destroy(struct wake_lock *lock)
 				  lock->stat.max_time);
 	}
 #endif
+	del_active_wake_lock(lock);
+	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
 	list_del(&lock->link);
 	spin_unlock_irqrestore(&list_lock, irqflags);
 }
@@ -504,6 +633,7 @@ static void wake_lock_internal(
 		lock->stat.last_time = ktime_get();
 	}
 #endif
+	del_active_wake_lock(lock);
 	if (!(lock->flags & WAKE_LOCK_ACTIVE)) {
 		lock->flags |= WAKE_LOCK_ACTIVE;
 #ifdef CONFIG_WAKELOCK_STAT
@@ -518,21 +648,20 @@ static void wake_lock_internal(
 				(timeout % HZ) * MSEC_PER_SEC / HZ);
 		lock->expires = jiffies + timeout;
 		lock->flags |= WAKE_LOCK_AUTO_EXPIRE;
-		list_add_tail(&lock->link, &active_wake_locks[type]);
 	} else {
 		if (debug_mask & DEBUG_WAKE_LOCK)
 			pr_info("wake_lock: %s, type %d\n", lock->name, type);
 		lock->expires = LONG_MAX;
 		lock->flags &= ~WAKE_LOCK_AUTO_EXPIRE;
-		list_add(&lock->link, &active_wake_locks[type]);
 	}
+	add_active_wake_lock(lock, type);
 	if (type == WAKE_LOCK_SUSPEND) {
 		current_event_num++;
 #ifdef CONFIG_WAKELOCK_STAT
 		if (lock == &main_wake_lock)
 			update_sleep_wait_stats_locked(1);
-		else if (!wake_lock_active(&main_wake_lock))
-			update_sleep_wait_stats_locked(0);
+		else
+			prevent_suspend_stat_locked(lock);
 #endif
 		if (has_timeout)
 			expire_in = has_wake_lock_locked(type);
@@ -578,6 +707,7 @@ void wake_unlock(struct wake_lock *lock)
 #endif
 	if (debug_mask & DEBUG_WAKE_LOCK)
 		pr_info("wake_unlock: %s\n", lock->name);
+	del_active_wake_lock(lock);
 	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
 	list_del(&lock->link);
 	list_add(&lock->link, &inactive_locks);
@@ -616,7 +746,7 @@ EXPORT_SYMBOL(wake_lock_active);
 
 static int wakelock_stats_open(struct inode *inode, struct file *file)
 {
-	return single_open(file, wakelock_stats_show, NULL);
+	return seq_open(file, &wakelock_stats_ops);
 }
 
 static const struct file_operations wakelock_stats_fops = {
@@ -624,7 +754,7 @@ static const struct file_operations wakelock_stats_fops = {
 	.open = wakelock_stats_open,
 	.read = seq_read,
 	.llseek = seq_lseek,
-	.release = single_release,
+	.release = seq_release,
 };
 
 static int __init wakelocks_init(void)
@@ -632,8 +762,10 @@ static int __init wakelocks_init(void)
 	int ret;
 	int i;
 
-	for (i = 0; i < ARRAY_SIZE(active_wake_locks); i++)
+	for (i = 0; i < ARRAY_SIZE(active_wake_locks); i++) {
 		INIT_LIST_HEAD(&active_wake_locks[i]);
+		active_timed_locks[i] = RB_ROOT;
+	}
 
 #ifdef CONFIG_WAKELOCK_STAT
 	wake_lock_init(&deleted_wake_locks, WAKE_LOCK_SUSPEND,
@@ -28,8 +28,10 @@
 
 
 struct rq_data rq_info;
+EXPORT_SYMBOL(rq_info);
 struct workqueue_struct *rq_wq;
 spinlock_t rq_lock;
+EXPORT_SYMBOL(rq_lock);
 
 /*
  * Per cpu nohz control structure
@@ -718,7 +720,8 @@ void tick_check_idle(int cpu)
 static void update_rq_stats(void)
 {
 	unsigned long jiffy_gap = 0;
-	unsigned int rq_avg = 0;
+	unsigned int nr = 0;
+	u64 rq_avg = 0;
 	unsigned long flags = 0;
 
 	jiffy_gap = jiffies - rq_info.rq_poll_last_jiffy;
@@ -730,11 +733,12 @@ static void update_rq_stats(void)
 		if (!rq_info.rq_avg)
 			rq_info.rq_poll_total_jiffies = 0;
 
-		rq_avg = nr_running() * 10;
+		nr = nr_running() * 10;
+		rq_avg = nr;
 
 		if (rq_info.rq_poll_total_jiffies) {
 			rq_avg = (rq_avg * jiffy_gap) +
-				(rq_info.rq_avg *
+				((u64)rq_info.rq_avg *
 				 rq_info.rq_poll_total_jiffies);
 			do_div(rq_avg,
 			       rq_info.rq_poll_total_jiffies + jiffy_gap);
@@ -742,6 +746,8 @@ static void update_rq_stats(void)
 
 		rq_info.rq_avg =  rq_avg;
 		rq_info.rq_poll_total_jiffies += jiffy_gap;
+		rq_info.rq_sum += (u64)nr * jiffy_gap;
+		rq_info.rq_sum_jiffies += jiffy_gap;
 		rq_info.rq_poll_last_jiffy = jiffies;
 
 		spin_unlock_irqrestore(&rq_lock, flags);
@@ -0,0 +1,121 @@
+/*
+ *  LZ4 Compressor
+ *
+ *  Single pass compressor for the LZ4 block format. A hash table of
+ *  LZ4_HASH_SIZE entries maps the hash of every 4-byte sequence seen so
+ *  far to its offset in the input; a hit is verified and then extended
+ *  in both directions. Inputs without matches are skipped over with an
+ *  increasing stride so that incompressible data is handled quickly.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+static inline u32 lz4_hash(u32 sequence)
+{
+	return (sequence * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+static inline unsigned char *lz4_put_length(unsigned char *op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+
+	return op;
+}
+
+static inline unsigned char *lz4_put_literals(unsigned char *op,
+		unsigned char *token, const unsigned char *anchor, size_t len)
+{
+	if (len >= RUN_MASK) {
+		*token = RUN_MASK << ML_BITS;
+		op = lz4_put_length(op, len - RUN_MASK);
+	} else {
+		*token = len << ML_BITS;
+	}
+
+	memcpy(op, anchor, len);
+
+	return op + len;
+}
+
+int lz4_compress(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	u32 *hash_table = wrkmem;
+	const unsigned char *ip = src, *anchor = src, *ref;
+	const unsigned char * const iend = src + src_len;
+	const unsigned char * const mflimit = iend - MFLIMIT;
+	const unsigned char * const matchlimit = iend - LASTLITERALS;
+	unsigned char *op = dst, *token;
+	size_t len;
+	u32 seq, h;
+
+	if (src_len < MINLENGTH)
+		goto last_literals;
+
+	memset(hash_table, 0, LZ4_MEM_COMPRESS);
+	hash_table[lz4_hash(get_unaligned_le32(ip))] = 0;
+	ip++;
+
+	while (ip < mflimit) {
+		seq = get_unaligned_le32(ip);
+		h = lz4_hash(seq);
+		ref = src + hash_table[h];
+		hash_table[h] = ip - src;
+
+		if (ip - ref > MAX_DISTANCE ||
+				get_unaligned_le32(ref) != seq) {
+			ip += 1 + ((ip - anchor) >> LZ4_SKIP_TRIGGER);
+			continue;
+		}
+
+		/* Catch up with bytes that also match before ip */
+		while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+
+		/* Extend the match, leaving room for the last literals */
+		len = MINMATCH;
+		while (ip + len < matchlimit && ip[len] == ref[len])
+			len++;
+
+		token = op++;
+		op = lz4_put_literals(op, token, anchor, ip - anchor);
+
+		put_unaligned_le16(ip - ref, op);
+		op += 2;
+
+		if (len - MINMATCH >= ML_MASK) {
+			*token |= ML_MASK;
+			op = lz4_put_length(op, len - MINMATCH - ML_MASK);
+		} else {
+			*token |= len - MINMATCH;
+		}
+
+		ip += len;
+		anchor = ip;
+
+		/* Index the tail of the match to help the next sequence */
+		if (ip < mflimit)
+			hash_table[lz4_hash(get_unaligned_le32(ip - 2))] =
+				ip - 2 - src;
+	}
+
+last_literals:
+	token = op++;
+	op = lz4_put_literals(op, token, anchor, iend - anchor);
+
+	*dst_len = op - dst;
+	return LZ4_E_OK;
+}
+EXPORT_SYMBOL_GPL(lz4_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Compressor");
@@ -0,0 +1,34 @@
+/*
+ *  lz4defs.h -- LZ4 block format constants
+ *
+ *  LZ4 is a byte oriented LZ77 format: every sequence starts with a
+ *  token byte whose high nibble is the literal run length and whose
+ *  low nibble is the match length minus MINMATCH. A nibble value of 15
+ *  is extended by extra bytes, each adding up to 255. Literals follow
+ *  the token, then a 16-bit little endian match offset.
+ *
+ *  The last sequence of a block carries literals only, and the last
+ *  LASTLITERALS bytes of the input are always emitted as literals.
+ */
+
+#define MINMATCH	4
+#define LASTLITERALS	5
+#define MFLIMIT		(8 + LASTLITERALS)
+#define MINLENGTH	(MFLIMIT + 1)
+
+#define ML_BITS		4
+#define ML_MASK		((1U << ML_BITS) - 1)
+#define RUN_BITS	(8 - ML_BITS)
+#define RUN_MASK	((1U << RUN_BITS) - 1)
+
+#define MAX_DISTANCE	((1 << 16) - 1)
+
+#define LZ4_HASH_LOG	12
+#define LZ4_HASH_SIZE	(1 << LZ4_HASH_LOG)
+
+/*
+ * Number of consecutive misses after which the compressor starts
+ * skipping input faster. Bigger values compress better but slower on
+ * incompressible data.
+ */
+#define LZ4_SKIP_TRIGGER	6
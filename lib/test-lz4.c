@@ -0,0 +1,150 @@
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+
+#define TEST_BUF_SIZE	(64 * 1024)
+
+enum test_pattern {
+	PATTERN_ZERO,
+	PATTERN_RANDOM,
+	PATTERN_SHORT_PERIOD,
+	PATTERN_TEXT,
+	PATTERN_SPARSE,
+	__NR_PATTERNS,
+};
+
+static const char * const pattern_names[] __initconst = {
+	"zero", "random", "short-period", "text", "sparse",
+};
+
+static const size_t test_sizes[] __initconst = {
+	0, 1, 4, 12, 13, 14, 31, 255, 256, 4095, 4096, 4097, 65535, 65536,
+};
+
+static void __init fill_pattern(unsigned char *buf, size_t len,
+		enum test_pattern pattern)
+{
+	static const char text[] = "The quick brown fox jumps over the dog ";
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		switch (pattern) {
+		case PATTERN_ZERO:
+			buf[i] = 0;
+			break;
+		case PATTERN_RANDOM:
+			buf[i] = random32();
+			break;
+		case PATTERN_SHORT_PERIOD:
+			buf[i] = i % 3;
+			break;
+		case PATTERN_TEXT:
+			buf[i] = text[(i * 7 + (i >> 5)) % (sizeof(text) - 1)];
+			break;
+		case PATTERN_SPARSE:
+			buf[i] = (random32() & 63) ? 0 : random32();
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+static int __init test_lz4_one(unsigned char *in, unsigned char *comp,
+		unsigned char *out, void *wrkmem, size_t len,
+		enum test_pattern pattern)
+{
+	size_t clen, dlen;
+	int ret;
+
+	fill_pattern(in, len, pattern);
+
+	ret = lz4_compress(in, len, comp, &clen, wrkmem);
+	if (ret != LZ4_E_OK || clen > lz4_compressbound(len)) {
+		WARN(1, "%s/%zu: compress failed: ret=%d clen=%zu\n",
+			pattern_names[pattern], len, ret, clen);
+		return -EINVAL;
+	}
+
+	dlen = len;
+	ret = lz4_decompress_safe(comp, clen, out, &dlen);
+	if (ret != LZ4_E_OK || dlen != len || memcmp(in, out, len)) {
+		WARN(1, "%s/%zu: round trip failed: ret=%d dlen=%zu\n",
+			pattern_names[pattern], len, ret, dlen);
+		return -EINVAL;
+	}
+
+	/* Truncated input must be detected, never overrun */
+	if (clen > 1) {
+		dlen = len;
+		ret = lz4_decompress_safe(comp, clen - 1, out, &dlen);
+		if (ret == LZ4_E_OK && dlen == len) {
+			WARN(1, "%s/%zu: truncated input accepted\n",
+				pattern_names[pattern], len);
+			return -EINVAL;
+		}
+	}
+
+	/* So must a too small output buffer */
+	if (len > 0) {
+		dlen = len - 1;
+		ret = lz4_decompress_safe(comp, clen, out, &dlen);
+		if (ret != LZ4_E_OUTPUT_OVERRUN) {
+			WARN(1, "%s/%zu: output overrun not detected: %d\n",
+				pattern_names[pattern], len, ret);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+static int __init test_lz4_init(void)
+{
+	unsigned char *in, *comp, *out;
+	void *wrkmem;
+	unsigned int i, p, failed = 0;
+	int ret = -ENOMEM;
+
+	in = kmalloc(TEST_BUF_SIZE, GFP_KERNEL);
+	comp = kmalloc(lz4_compressbound(TEST_BUF_SIZE), GFP_KERNEL);
+	out = kmalloc(TEST_BUF_SIZE, GFP_KERNEL);
+	wrkmem = kmalloc(LZ4_MEM_COMPRESS, GFP_KERNEL);
+	if (!in || !comp || !out || !wrkmem)
+		goto out;
+
+	for (p = 0; p < __NR_PATTERNS; p++) {
+		for (i = 0; i < ARRAY_SIZE(test_sizes); i++) {
+			if (test_lz4_one(in, comp, out, wrkmem,
+					test_sizes[i], p))
+				failed++;
+		}
+	}
+
+	if (failed) {
+		pr_err("lz4: %u tests failed\n", failed);
+		ret = -EINVAL;
+	} else {
+		pr_info("lz4: all tests passed\n");
+		ret = 0;
+	}
+
+out:
+	kfree(wrkmem);
+	kfree(out);
+	kfree(comp);
+	kfree(in);
+	return ret;
+}
+module_init(test_lz4_init);
+
+static void __exit test_lz4_exit(void)
+{
+}
+module_exit(test_lz4_exit);
+
+MODULE_LICENSE("GPL");
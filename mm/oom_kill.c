@@ -130,6 +130,73 @@ struct task_struct *find_lock_task_mm(struct task_struct *p)
 	return NULL;
 }
 
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+DEFINE_SPINLOCK(oom_adj_index_lock);
+struct hlist_head oom_adj_index[OOM_ADJ_BUCKETS];
+
+static struct hlist_head *oom_adj_bucket(struct task_struct *p)
+{
+	int oom_adj = clamp(p->signal->oom_adj, OOM_DISABLE, OOM_ADJUST_MAX);
+
+	return &oom_adj_index[oom_adj - OOM_DISABLE];
+}
+
+/* A new thread group leader, called from fork with tasklist_lock held */
+void oom_adj_index_add(struct task_struct *p)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&oom_adj_index_lock, flags);
+	hlist_add_head(&p->oom_adj_node, oom_adj_bucket(p));
+	spin_unlock_irqrestore(&oom_adj_index_lock, flags);
+}
+
+/* Called when p is released */
+void oom_adj_index_del(struct task_struct *p)
+{
+	unsigned long flags;
+
+	/* Only thread group leaders are indexed; skip the lock for others */
+	if (hlist_unhashed(&p->oom_adj_node))
+		return;
+
+	spin_lock_irqsave(&oom_adj_index_lock, flags);
+	hlist_del_init(&p->oom_adj_node);
+	spin_unlock_irqrestore(&oom_adj_index_lock, flags);
+}
+
+/* A non-leader thread execs and takes over as thread group leader */
+void oom_adj_index_replace(struct task_struct *old, struct task_struct *new)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&oom_adj_index_lock, flags);
+	if (!hlist_unhashed(&old->oom_adj_node)) {
+		hlist_del_init(&old->oom_adj_node);
+		hlist_add_head(&new->oom_adj_node, oom_adj_bucket(new));
+	}
+	spin_unlock_irqrestore(&oom_adj_index_lock, flags);
+}
+
+/*
+ * Move p's thread group to the bucket of its current oom_adj. Must be
+ * called after every change of signal->oom_adj, without task_lock() or
+ * the siglock held.
+ */
+void oom_adj_index_update(struct task_struct *p)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&oom_adj_index_lock, flags);
+	p = p->group_leader;
+	if (!hlist_unhashed(&p->oom_adj_node)) {
+		hlist_del(&p->oom_adj_node);
+		hlist_add_head(&p->oom_adj_node, oom_adj_bucket(p));
+	}
+	spin_unlock_irqrestore(&oom_adj_index_lock, flags);
+}
+#endif
+
 /* return true if the task is not adequate as candidate victim task. */
 static bool oom_unkillable_task(struct task_struct *p,
 		const struct mem_cgroup *mem, const nodemask_t *nodemask)
@@ -15,6 +15,11 @@
  * If the token is acquired, that task's priority is boosted to prevent
  * the token from bouncing around too often and to let the task make
  * some progress in its execution.
+ *
+ * Refault counting for the low memory killer:
+ * Under memory pressure most major faults are for pages that reclaim has
+ * just thrown out, so their rate tells whether the working set still
+ * fits in memory.  This part does not depend on CONFIG_SWAP.
  */
 
 #include <linux/jiffies.h>
@@ -25,6 +30,20 @@
 
 #include <trace/events/vmscan.h>
 
+static atomic_long_t refaults = ATOMIC_LONG_INIT(0);
+
+/* Called for every major fault on a file page or swap-in */
+void count_refault(void)
+{
+	atomic_long_inc(&refaults);
+}
+
+unsigned long refault_count(void)
+{
+	return atomic_long_read(&refaults);
+}
+
+#ifdef CONFIG_SWAP
 #define TOKEN_AGING_INTERVAL	(0xFF)
 
 static DEFINE_SPINLOCK(swap_token_lock);
@@ -142,3 +161,4 @@ void disable_swap_token(struct mem_cgroup *memcg)
 		spin_unlock(&swap_token_lock);
 	}
 }
+#endif /* CONFIG_SWAP */
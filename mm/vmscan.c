@@ -154,6 +154,19 @@ long vm_total_pages;	/* The total number of pages which the VM controls */
 static LIST_HEAD(shrinker_list);
 static DECLARE_RWSEM(shrinker_rwsem);
 
+/*
+ * Pages scanned and reclaimed from the inactive lists by global reclaim.
+ * Their ratio tells how hard reclaim has to work for each freed page.
+ */
+static atomic_long_t global_reclaim_scanned = ATOMIC_LONG_INIT(0);
+static atomic_long_t global_reclaim_reclaimed = ATOMIC_LONG_INIT(0);
+
+void global_reclaim_stat(unsigned long *scanned, unsigned long *reclaimed)
+{
+	*scanned = atomic_long_read(&global_reclaim_scanned);
+	*reclaimed = atomic_long_read(&global_reclaim_reclaimed);
+}
+
 #ifdef CONFIG_CGROUP_MEM_RES_CTLR
 #define scanning_global_lru(sc)	(!(sc)->mem_cgroup)
 #else
@@ -1468,6 +1481,10 @@ shrink_inactive_list(unsigned long nr_to_scan, struct zone *zone,
 	if (current_is_kswapd())
 		__count_vm_events(KSWAPD_STEAL, nr_reclaimed);
 	__count_zone_vm_events(PGSTEAL, zone, nr_reclaimed);
+	if (scanning_global_lru(sc)) {
+		atomic_long_add(nr_scanned, &global_reclaim_scanned);
+		atomic_long_add(nr_reclaimed, &global_reclaim_reclaimed);
+	}
 
 	putback_lru_pages(zone, sc, nr_anon, nr_file, &page_list);
 
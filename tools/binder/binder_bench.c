@@ -0,0 +1,510 @@
+/*
+ * binder_bench.c -- binder transaction throughput benchmark
+ *
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Forks N server and N client processes. Server n registers itself with
+ * the service manager as "binder_bench.<n>", client n looks it up and
+ * sends it synchronous transactions of every payload size in turn, which
+ * the server answers with a reply of the same size. All clients run each
+ * payload size at the same time; the aggregate number of round trips per
+ * second is reported per size.
+ *
+ * Needs a running service manager and must run as a user allowed to
+ * register services with it (e.g. root).
+ *
+ * $(CROSS_COMPILE)cc -Wall -Wextra -g -o binder_bench binder_bench.c
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../../drivers/staging/android/binder.h"
+
+#define MAP_SIZE		(1024 * 1024)
+#define MAX_PAYLOAD		(128 * 1024)
+
+#define SVC_MGR_GET_SERVICE	1
+#define SVC_MGR_ADD_SERVICE	3
+
+static const char svcmgr_id[] = "android.os.IServiceManager";
+
+static const size_t default_sizes[] = {
+	0, 16, 64, 256, 1024, 4096, 16384, 65536
+};
+
+static void die(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	fprintf(stderr, "binder_bench[%d]: ", getpid());
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	exit(1);
+}
+
+/******************** Parcels ***********************************************/
+
+struct parcel {
+	uint8_t data[256];
+	size_t size;
+	size_t offsets[1];
+	size_t nr_offsets;
+};
+
+static void *parcel_alloc(struct parcel *p, size_t len)
+{
+	void *ptr;
+
+	len = (len + 3) & ~3;
+	if (p->size + len > sizeof(p->data))
+		die("parcel overflow\n");
+	ptr = p->data + p->size;
+	memset(ptr, 0, len);
+	p->size += len;
+	return ptr;
+}
+
+static void parcel_put_u32(struct parcel *p, uint32_t val)
+{
+	*(uint32_t *)parcel_alloc(p, sizeof(val)) = val;
+}
+
+static void parcel_put_str16(struct parcel *p, const char *str)
+{
+	size_t i, len = strlen(str);
+	uint16_t *s16;
+
+	parcel_put_u32(p, len);
+	s16 = parcel_alloc(p, (len + 1) * sizeof(uint16_t));
+	for (i = 0; i < len; i++)
+		s16[i] = str[i];
+}
+
+static void parcel_put_binder(struct parcel *p, void *ptr)
+{
+	struct flat_binder_object *obj;
+
+	p->offsets[p->nr_offsets++] = p->size;
+	obj = parcel_alloc(p, sizeof(*obj));
+	obj->type = BINDER_TYPE_BINDER;
+	obj->flags = 0x7f | FLAT_BINDER_FLAG_ACCEPTS_FDS;
+	obj->binder = ptr;
+	obj->cookie = ptr;
+}
+
+/******************** Driver interface **************************************/
+
+static int bench_open(void)
+{
+	struct binder_version version;
+	int fd;
+
+	fd = open("/dev/binder", O_RDWR);
+	if (fd < 0)
+		die("/dev/binder: %s\n", strerror(errno));
+	if (ioctl(fd, BINDER_VERSION, &version) < 0 ||
+	    version.protocol_version != BINDER_CURRENT_PROTOCOL_VERSION)
+		die("binder protocol version mismatch\n");
+	if (mmap(NULL, MAP_SIZE, PROT_READ, MAP_PRIVATE, fd, 0) == MAP_FAILED)
+		die("mmap: %s\n", strerror(errno));
+	return fd;
+}
+
+static void bench_write(int fd, void *wbuf, size_t wsize)
+{
+	struct binder_write_read bwr;
+
+	memset(&bwr, 0, sizeof(bwr));
+	bwr.write_size = wsize;
+	bwr.write_buffer = (unsigned long)wbuf;
+	if (ioctl(fd, BINDER_WRITE_READ, &bwr) < 0)
+		die("BINDER_WRITE_READ: %s\n", strerror(errno));
+}
+
+/*
+ * Write wbuf (if any), then read until a transaction or reply arrives.
+ * Reference count requests on our own node are acknowledged on the way.
+ * Returns the BR_ code that ended the read.
+ */
+static uint32_t bench_txn(int fd, void *wbuf, size_t wsize,
+			  struct binder_transaction_data *txn)
+{
+	struct binder_write_read bwr;
+	uint32_t rbuf[128];
+	uint8_t ack[sizeof(uint32_t) + 2 * sizeof(void *)];
+	uint32_t cmd = BR_NOOP;
+	uint8_t *ptr, *end;
+
+	bwr.write_size = wsize;
+	bwr.write_consumed = 0;
+	bwr.write_buffer = (unsigned long)wbuf;
+
+	while (cmd != BR_TRANSACTION && cmd != BR_REPLY) {
+		bwr.read_size = sizeof(rbuf);
+		bwr.read_consumed = 0;
+		bwr.read_buffer = (unsigned long)rbuf;
+		if (ioctl(fd, BINDER_WRITE_READ, &bwr) < 0) {
+			if (errno == EINTR)
+				continue;
+			die("BINDER_WRITE_READ: %s\n", strerror(errno));
+		}
+
+		ptr = (uint8_t *)rbuf;
+		end = ptr + bwr.read_consumed;
+		while (ptr < end) {
+			memcpy(&cmd, ptr, sizeof(cmd));
+			ptr += sizeof(cmd);
+			switch (cmd) {
+			case BR_NOOP:
+			case BR_TRANSACTION_COMPLETE:
+			case BR_SPAWN_LOOPER:
+				break;
+			case BR_INCREFS:
+			case BR_ACQUIRE:
+				*(uint32_t *)ack = cmd == BR_INCREFS ?
+					BC_INCREFS_DONE : BC_ACQUIRE_DONE;
+				memcpy(ack + sizeof(uint32_t), ptr,
+				       2 * sizeof(void *));
+				ptr += 2 * sizeof(void *);
+				bench_write(fd, ack, sizeof(ack));
+				break;
+			case BR_RELEASE:
+			case BR_DECREFS:
+				ptr += 2 * sizeof(void *);
+				break;
+			case BR_TRANSACTION:
+			case BR_REPLY:
+				memcpy(txn, ptr, sizeof(*txn));
+				ptr += sizeof(*txn);
+				break;
+			case BR_DEAD_REPLY:
+			case BR_FAILED_REPLY:
+				return cmd;
+			default:
+				die("unexpected return 0x%x\n", cmd);
+			}
+		}
+	}
+	return cmd;
+}
+
+/* Command buffer for one write: up to BC_FREE_BUFFER + BC_TRANSACTION */
+struct bench_cmds {
+	uint8_t data[2 * sizeof(uint32_t) + sizeof(void *) +
+		     sizeof(struct binder_transaction_data)];
+	size_t size;
+};
+
+static void cmds_put(struct bench_cmds *c, const void *data, size_t len)
+{
+	memcpy(c->data + c->size, data, len);
+	c->size += len;
+}
+
+static void cmds_free_buffer(struct bench_cmds *c, const void *buffer)
+{
+	uint32_t cmd = BC_FREE_BUFFER;
+
+	cmds_put(c, &cmd, sizeof(cmd));
+	cmds_put(c, &buffer, sizeof(buffer));
+}
+
+static void cmds_transaction(struct bench_cmds *c, uint32_t cmd,
+			     uint32_t handle, uint32_t code,
+			     const void *data, size_t size,
+			     const size_t *offsets, size_t nr_offsets)
+{
+	struct binder_transaction_data tr;
+
+	memset(&tr, 0, sizeof(tr));
+	tr.target.handle = handle;
+	tr.code = code;
+	tr.data_size = size;
+	tr.data.ptr.buffer = data;
+	tr.offsets_size = nr_offsets * sizeof(size_t);
+	tr.data.ptr.offsets = offsets;
+	cmds_put(c, &cmd, sizeof(cmd));
+	cmds_put(c, &tr, sizeof(tr));
+}
+
+/* Synchronous call to the service manager, returns the reply */
+static uint32_t svcmgr_call(int fd, uint32_t code, struct parcel *p,
+			    struct binder_transaction_data *reply)
+{
+	struct bench_cmds c = { .size = 0 };
+
+	cmds_transaction(&c, BC_TRANSACTION, 0, code, p->data, p->size,
+			 p->offsets, p->nr_offsets);
+	return bench_txn(fd, c.data, c.size, reply);
+}
+
+/******************** Server ************************************************/
+
+static void run_server(int id)
+{
+	static uint8_t payload[MAX_PAYLOAD];
+	struct binder_transaction_data txn;
+	struct bench_cmds c;
+	struct parcel p;
+	char name[32];
+	uint32_t cmd;
+	int fd;
+
+	fd = bench_open();
+
+	memset(&p, 0, sizeof(p));
+	snprintf(name, sizeof(name), "binder_bench.%d", id);
+	parcel_put_u32(&p, 0);		/* strict mode policy */
+	parcel_put_str16(&p, svcmgr_id);
+	parcel_put_str16(&p, name);
+	parcel_put_binder(&p, payload);
+	if (svcmgr_call(fd, SVC_MGR_ADD_SERVICE, &p, &txn) != BR_REPLY)
+		die("cannot register %s\n", name);
+
+	c.size = 0;
+	cmds_free_buffer(&c, txn.data.ptr.buffer);
+	cmd = BC_ENTER_LOOPER;
+	cmds_put(&c, &cmd, sizeof(cmd));
+	bench_write(fd, c.data, c.size);
+
+	/* Echo every request with a reply of the same size */
+	c.size = 0;
+	for (;;) {
+		if (bench_txn(fd, c.data, c.size, &txn) != BR_TRANSACTION)
+			die("server %d: no transaction\n", id);
+		if (txn.data_size > sizeof(payload))
+			die("server %d: payload too big\n", id);
+		c.size = 0;
+		cmds_free_buffer(&c, txn.data.ptr.buffer);
+		cmds_transaction(&c, BC_REPLY, 0, 0, payload, txn.data_size,
+				 NULL, 0);
+	}
+}
+
+/******************** Client ************************************************/
+
+struct client_result {
+	int id;
+	size_t size;
+	double usecs;
+};
+
+static uint32_t lookup_server(int fd, int id)
+{
+	struct binder_transaction_data txn;
+	struct flat_binder_object obj;
+	struct bench_cmds c;
+	struct parcel p;
+	char name[32];
+	uint32_t handle, cmd;
+	int tries;
+
+	snprintf(name, sizeof(name), "binder_bench.%d", id);
+	for (tries = 0; tries < 100; tries++) {
+		memset(&p, 0, sizeof(p));
+		parcel_put_u32(&p, 0);
+		parcel_put_str16(&p, svcmgr_id);
+		parcel_put_str16(&p, name);
+		if (svcmgr_call(fd, SVC_MGR_GET_SERVICE, &p, &txn) != BR_REPLY)
+			die("service manager lookup failed\n");
+
+		if (txn.offsets_size == 0) {
+			/* Not registered yet */
+			c.size = 0;
+			cmds_free_buffer(&c, txn.data.ptr.buffer);
+			bench_write(fd, c.data, c.size);
+			usleep(50000);
+			continue;
+		}
+
+		memcpy(&obj, txn.data.ptr.buffer, sizeof(obj));
+		if (obj.type != BINDER_TYPE_HANDLE)
+			die("%s: unexpected object type\n", name);
+		handle = obj.handle;
+
+		/* Keep the reference beyond the reply buffer */
+		c.size = 0;
+		cmd = BC_ACQUIRE;
+		cmds_put(&c, &cmd, sizeof(cmd));
+		cmds_put(&c, &handle, sizeof(handle));
+		cmds_free_buffer(&c, txn.data.ptr.buffer);
+		bench_write(fd, c.data, c.size);
+		return handle;
+	}
+	die("%s not found\n", name);
+	return 0;
+}
+
+static void run_client(int id, const size_t *sizes, int nr_sizes,
+		       int iterations, int go_fd, int result_fd)
+{
+	static uint8_t payload[MAX_PAYLOAD];
+	struct binder_transaction_data txn;
+	struct client_result res;
+	struct timeval start, end;
+	struct bench_cmds c;
+	uint32_t handle;
+	int fd, i, n;
+	char go;
+
+	fd = bench_open();
+	handle = lookup_server(fd, id);
+
+	for (i = 0; i < nr_sizes; i++) {
+		if (read(go_fd, &go, 1) != 1)
+			die("lost the parent\n");
+
+		c.size = 0;
+		gettimeofday(&start, NULL);
+		for (n = 0; n < iterations; n++) {
+			cmds_transaction(&c, BC_TRANSACTION, handle, 1,
+					 payload, sizes[i], NULL, 0);
+			if (bench_txn(fd, c.data, c.size, &txn) != BR_REPLY)
+				die("client %d: transaction failed\n", id);
+			c.size = 0;
+			cmds_free_buffer(&c, txn.data.ptr.buffer);
+		}
+		gettimeofday(&end, NULL);
+		bench_write(fd, c.data, c.size);
+
+		res.id = id;
+		res.size = sizes[i];
+		res.usecs = (end.tv_sec - start.tv_sec) * 1e6 +
+			(end.tv_usec - start.tv_usec);
+		if (write(result_fd, &res, sizeof(res)) != sizeof(res))
+			die("lost the parent\n");
+	}
+	exit(0);
+}
+
+/******************** Main **************************************************/
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-p pairs] [-i iterations] [-s size[,size...]]\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	size_t sizes[32];
+	int nr_sizes = 0, pairs = 1, iterations = 10000;
+	int go_pipe[2], result_pipe[2];
+	pid_t *servers;
+	int i, n, opt;
+	char *tok;
+
+	while ((opt = getopt(argc, argv, "p:i:s:")) != -1) {
+		switch (opt) {
+		case 'p':
+			pairs = atoi(optarg);
+			break;
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		case 's':
+			for (tok = strtok(optarg, ","); tok && nr_sizes < 32;
+			     tok = strtok(NULL, ","))
+				sizes[nr_sizes++] = strtoul(tok, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (pairs < 1 || iterations < 1)
+		usage(argv[0]);
+	if (!nr_sizes) {
+		nr_sizes = sizeof(default_sizes) / sizeof(default_sizes[0]);
+		memcpy(sizes, default_sizes, sizeof(default_sizes));
+	}
+	for (i = 0; i < nr_sizes; i++)
+		if (sizes[i] > MAX_PAYLOAD)
+			die("payload size %zu exceeds %d\n", sizes[i],
+			    MAX_PAYLOAD);
+
+	if (pipe(go_pipe) || pipe(result_pipe))
+		die("pipe: %s\n", strerror(errno));
+
+	servers = calloc(pairs, sizeof(*servers));
+	if (!servers)
+		die("out of memory\n");
+	for (i = 0; i < pairs; i++) {
+		servers[i] = fork();
+		if (servers[i] < 0)
+			die("fork: %s\n", strerror(errno));
+		if (servers[i] == 0)
+			run_server(i);
+	}
+	for (i = 0; i < pairs; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0)
+			die("fork: %s\n", strerror(errno));
+		if (pid == 0) {
+			close(go_pipe[1]);
+			close(result_pipe[0]);
+			run_client(i, sizes, nr_sizes, iterations,
+				   go_pipe[0], result_pipe[1]);
+		}
+	}
+	close(go_pipe[0]);
+	close(result_pipe[1]);
+
+	printf("%d client/server pairs, %d transactions per client\n",
+	       pairs, iterations);
+	printf("%8s %12s %12s %12s\n", "size", "trans/s", "avg us", "max us");
+	for (i = 0; i < nr_sizes; i++) {
+		struct client_result res;
+		double sum = 0, max = 0;
+
+		for (n = 0; n < pairs; n++)
+			if (write(go_pipe[1], "g", 1) != 1)
+				die("lost a client\n");
+		for (n = 0; n < pairs; n++) {
+			if (read(result_pipe[0], &res, sizeof(res)) !=
+			    sizeof(res))
+				die("lost a client\n");
+			sum += res.usecs;
+			if (res.usecs > max)
+				max = res.usecs;
+		}
+		/* Clients run concurrently, the slowest one bounds the rate */
+		printf("%8zu %12.0f %12.2f %12.2f\n", sizes[i],
+		       max ? (double)pairs * iterations * 1e6 / max : 0,
+		       sum / pairs / iterations, max / iterations);
+	}
+
+	for (i = 0; i < pairs; i++)
+		kill(servers[i], SIGTERM);
+	while (wait(NULL) > 0)
+		;
+	return 0;
+}
@@ -0,0 +1,346 @@
+/*
+ * interactive_replay.c -- replay load traces through the interactive
+ * cpufreq governor's speed selection
+ *
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Reads a load trace, one line per timer_rate window recorded on a device:
+ *
+ *	load freq [rq_depth [input]]
+ *
+ * load is the percentage of the window the CPU was busy, at freq kHz.
+ * rq_depth is in tenths of runnable tasks per CPU, as
+ * /sys/devices/system/cpu/cpu0/rq-stats/run_queue_avg reports them, and a
+ * non-zero input marks a touch event in the window. Lines starting with #
+ * are skipped.
+ *
+ * The work in each window is replayed at the speed the governor picks, with
+ * the same target load, prediction and hispeed logic as
+ * drivers/cpufreq/cpufreq_interactive.c, and the options named after its
+ * tunables. Reports the time spent at each speed, the average speed, and
+ * the windows in which the work did not fit at the chosen speed, so
+ * tunables can be compared on the same trace. -v prints every window.
+ *
+ * $(CROSS_COMPILE)cc -Wall -Wextra -g -o interactive_replay interactive_replay.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CPUFREQ_RELATION_L 0
+#define CPUFREQ_RELATION_H 1
+
+#include "../../drivers/cpufreq/cpufreq_interactive_load.h"
+
+#define MAX_FREQS	32
+
+static const unsigned int default_freqs[] = {
+	384000, 486000, 594000, 702000, 810000, 918000, 1026000, 1134000,
+	1242000, 1350000, 1458000, 1512000
+};
+
+static unsigned int freqs[MAX_FREQS];
+static int nfreqs;
+
+static unsigned int target_loads[INTERACTIVE_MAX_TARGET_LOADS] = { 90 };
+static int ntarget_loads = 1;
+static unsigned int go_hispeed_load = 85;
+static unsigned int hispeed_freq;
+static unsigned long min_sample_time = 80000;
+static unsigned long above_hispeed_delay = 20000;
+static unsigned long timer_rate = 20000;
+static unsigned int load_ewma_weight;
+static unsigned int rq_depth_boost;
+static unsigned int input_boost_freq;
+static int verbose;
+
+/* Same rounding as cpufreq_frequency_table_target() over a sorted table */
+static unsigned int freq_lookup(void *data, unsigned int target_freq,
+				unsigned int relation)
+{
+	int i;
+
+	(void)data;
+	if (relation == CPUFREQ_RELATION_L) {
+		for (i = 0; i < nfreqs; i++)
+			if (freqs[i] >= target_freq)
+				return freqs[i];
+		return freqs[nfreqs - 1];
+	}
+	for (i = nfreqs - 1; i >= 0; i--)
+		if (freqs[i] <= target_freq)
+			return freqs[i];
+	return freqs[0];
+}
+
+static int parse_list(const char *s, unsigned int *out, int max,
+		      const char *seps)
+{
+	int n = 0;
+
+	while (n < max) {
+		char *end;
+
+		out[n++] = strtoul(s, &end, 0);
+		if (end == s)
+			return -1;
+		if (!*end || *end == '\n')
+			return n;
+		if (!strchr(seps, *end))
+			return -1;
+		s = end + 1;
+	}
+	return -1;
+}
+
+struct sim {
+	unsigned long now;
+	unsigned int cur;
+	unsigned int floor_freq;
+	unsigned long floor_validate_time;
+	unsigned long hispeed_validate_time;
+	/* load since the last speed change */
+	unsigned long load_sum;
+	unsigned long load_windows;
+	struct interactive_predictor pred;
+};
+
+static void sim_set(struct sim *sim, unsigned int freq)
+{
+	if (freq != sim->cur) {
+		sim->load_sum = 0;
+		sim->load_windows = 0;
+	}
+	sim->cur = freq;
+}
+
+/* cpufreq_interactive_boost() for one CPU */
+static void sim_boost(struct sim *sim, unsigned int freq)
+{
+	if (sim->cur < freq) {
+		sim_set(sim, freq);
+		sim->hispeed_validate_time = sim->now;
+	}
+	sim->floor_freq = freq;
+	sim->floor_validate_time = sim->now;
+}
+
+/* cpufreq_interactive_timer(), returns the load it went by */
+static unsigned int sim_timer(struct sim *sim, unsigned int cpu_load,
+			      unsigned int rq_depth)
+{
+	unsigned int load_since_change, new_freq;
+
+	sim->load_sum += cpu_load;
+	sim->load_windows++;
+	load_since_change = sim->load_sum / sim->load_windows;
+
+	if (load_ewma_weight)
+		cpu_load = interactive_predict_load(&sim->pred, cpu_load,
+						    load_ewma_weight, rq_depth,
+						    rq_depth_boost,
+						    go_hispeed_load);
+	else if (load_since_change > cpu_load)
+		cpu_load = load_since_change;
+
+	if (cpu_load >= go_hispeed_load) {
+		if (sim->cur <= freqs[0]) {
+			new_freq = hispeed_freq;
+		} else {
+			new_freq = interactive_choose_freq(sim->cur,
+					cpu_load * sim->cur, target_loads,
+					ntarget_loads, freq_lookup, NULL);
+			if (new_freq < hispeed_freq)
+				new_freq = hispeed_freq;
+			if (sim->cur == hispeed_freq &&
+			    new_freq > hispeed_freq &&
+			    sim->now - sim->hispeed_validate_time <
+			    above_hispeed_delay)
+				return cpu_load;
+		}
+	} else {
+		new_freq = interactive_choose_freq(sim->cur,
+				cpu_load * sim->cur, target_loads,
+				ntarget_loads, freq_lookup, NULL);
+	}
+
+	if (new_freq <= hispeed_freq)
+		sim->hispeed_validate_time = sim->now;
+
+	new_freq = freq_lookup(NULL, new_freq, CPUFREQ_RELATION_H);
+
+	if (new_freq < sim->floor_freq &&
+	    sim->now - sim->floor_validate_time < min_sample_time)
+		return cpu_load;
+
+	sim->floor_freq = new_freq;
+	sim->floor_validate_time = sim->now;
+	sim_set(sim, new_freq);
+	return cpu_load;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-f freq,freq...] [-t target_loads] "
+		"[-g go_hispeed_load]\n"
+		"\t[-H hispeed_freq] [-m min_sample_time_us] "
+		"[-a above_hispeed_delay_us]\n"
+		"\t[-r timer_rate_us] [-w load_ewma_weight] "
+		"[-q rq_depth_boost]\n"
+		"\t[-i input_boost_freq] [-v] [trace]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long time_at[MAX_FREQS] = { 0 };
+	unsigned long windows = 0, short_windows = 0;
+	unsigned long long khz_sum = 0, deficit = 0;
+	struct sim sim;
+	char line[256];
+	FILE *trace = stdin;
+	int i, opt;
+
+	while ((opt = getopt(argc, argv, "f:t:g:H:m:a:r:w:q:i:v")) != -1) {
+		switch (opt) {
+		case 'f':
+			nfreqs = parse_list(optarg, freqs, MAX_FREQS, ",");
+			if (nfreqs < 1)
+				usage(argv[0]);
+			break;
+		case 't':
+			ntarget_loads = parse_list(optarg, target_loads,
+						   INTERACTIVE_MAX_TARGET_LOADS,
+						   " :");
+			if (ntarget_loads < 1 || !(ntarget_loads & 1))
+				usage(argv[0]);
+			break;
+		case 'g':
+			go_hispeed_load = atoi(optarg);
+			break;
+		case 'H':
+			hispeed_freq = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			min_sample_time = strtoul(optarg, NULL, 0);
+			break;
+		case 'a':
+			above_hispeed_delay = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			timer_rate = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			load_ewma_weight = atoi(optarg);
+			break;
+		case 'q':
+			rq_depth_boost = atoi(optarg);
+			break;
+		case 'i':
+			input_boost_freq = strtoul(optarg, NULL, 0);
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (load_ewma_weight > 100 || !timer_rate)
+		usage(argv[0]);
+	for (i = 0; i < ntarget_loads; i += 2)
+		if (!target_loads[i])
+			usage(argv[0]);
+	if (!nfreqs) {
+		nfreqs = sizeof(default_freqs) / sizeof(default_freqs[0]);
+		memcpy(freqs, default_freqs, sizeof(default_freqs));
+	}
+	if (!hispeed_freq)
+		hispeed_freq = freqs[nfreqs - 1];
+	if (optind < argc) {
+		trace = fopen(argv[optind], "r");
+		if (!trace) {
+			perror(argv[optind]);
+			return 1;
+		}
+	}
+
+	memset(&sim, 0, sizeof(sim));
+	sim.cur = freqs[0];
+	sim.floor_freq = freqs[0];
+
+	if (verbose)
+		printf("%10s %5s %5s %5s %8s\n", "time_us", "load", "used",
+		       "rq", "freq");
+
+	while (fgets(line, sizeof(line), trace)) {
+		unsigned int load, freq, rq_depth = 0, input = 0;
+		unsigned long long demand;
+		unsigned int cpu_load, used;
+
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "%u %u %u %u", &load, &freq, &rq_depth,
+			   &input) < 2)
+			continue;
+
+		/* the work of the window, replayed at the current speed */
+		demand = (unsigned long long)load * freq;
+		if (demand > 100ULL * sim.cur) {
+			short_windows++;
+			deficit += demand - 100ULL * sim.cur;
+			cpu_load = 100;
+		} else {
+			cpu_load = demand / sim.cur;
+		}
+
+		for (i = 0; i < nfreqs; i++)
+			if (freqs[i] == sim.cur)
+				time_at[i] += timer_rate;
+		khz_sum += sim.cur;
+		windows++;
+		sim.now += timer_rate;
+
+		if (input && input_boost_freq)
+			sim_boost(&sim, input_boost_freq);
+		used = sim_timer(&sim, cpu_load, rq_depth);
+
+		if (verbose)
+			printf("%10lu %5u %5u %5u %8u\n", sim.now, cpu_load,
+			       used, rq_depth, sim.cur);
+	}
+
+	if (!windows) {
+		fprintf(stderr, "no windows in trace\n");
+		return 1;
+	}
+
+	printf("%lu windows of %lu us\n", windows, timer_rate);
+	printf("%10s %8s %6s\n", "freq", "time_ms", "share");
+	for (i = 0; i < nfreqs; i++)
+		if (time_at[i])
+			printf("%10u %8lu %5.1f%%\n", freqs[i],
+			       time_at[i] / 1000,
+			       100.0 * time_at[i] / (windows * timer_rate));
+	printf("average freq %llu kHz\n", khz_sum / windows);
+	printf("windows short of speed %lu (%.1f%%), unfinished work %.1f "
+	       "ms at %u kHz\n", short_windows, 100.0 * short_windows / windows,
+	       deficit / 100.0 * timer_rate / freqs[nfreqs - 1] / 1000,
+	       freqs[nfreqs - 1]);
+	return 0;
+}
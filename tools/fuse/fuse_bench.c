@@ -0,0 +1,872 @@
+/*
+ * fuse_bench.c -- sequential throughput benchmark through a passthrough
+ * FUSE filesystem
+ *
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Mounts a FUSE filesystem on the -m directory that passes files in the -d
+ * directory through, the way the sdcard daemon passes /data/media through
+ * to /sdcard, and serves it from a thread speaking the protocol on
+ * /dev/fuse directly. Only the files at the top of -d are visible, which
+ * is all the benchmark needs.
+ *
+ * A file of -s MB is then written through the mount with write() calls of
+ * -l bytes each, dropped from the page cache, and read back the same way.
+ * For both, the throughput and the number and average size of the WRITE
+ * and READ requests the daemon saw are reported.
+ *
+ * -p asks for requests of up to that many pages with FUSE_MAX_PAGES, and
+ * -w sets the max_write the daemon negotiates, which also caps the size
+ * of WRITE requests. Running with and without -p shows what the larger
+ * requests save:
+ *
+ *	fuse_bench -d /data/media -m /mnt/bench
+ *	fuse_bench -d /data/media -m /mnt/bench -p 256 -w 1048576
+ *
+ * -W asks for FUSE_WRITEBACK_CACHE, so that writes land in the page cache
+ * and reach the daemon in batches from writepages; -l 4096 shows what that
+ * does for small writes.
+ *
+ * -S runs a stress test for that many seconds instead. -j writer threads
+ * each write and read back random spans of their own 1 MB region of one
+ * file, while another thread writes its region through a shared mapping
+ * and one more truncates and extends the end of the file and writes to
+ * it. Each thread keeps a copy of what its region should hold, and when
+ * time is up the whole file is checked against those, both through the
+ * mount and in the -d directory, along with its size. With -W, the mtime
+ * the mount reports must also survive the attributes being refreshed from
+ * the daemon. While the others keep going, the writers now and then
+ * fsync() and the mmap thread msync()s, and their region in the -d
+ * directory must then match right away. -F makes the daemon answer
+ * FSYNC with ENOSYS, which must not change that. Exits with 1 if
+ * anything differs:
+ *
+ *	fuse_bench -d /data/media -m /mnt/bench -W -S 60 -j 4
+ *	fuse_bench -d /data/media -m /mnt/bench -W -S 60 -j 4 -F
+ *
+ * Needs permission to mount (e.g. root).
+ *
+ * $(CROSS_COMPILE)cc -Wall -Wextra -g -o fuse_bench fuse_bench.c -lpthread
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "../../include/linux/fuse.h"
+
+#define MAX_FILES	64
+#define BENCH_FILE	"fuse_bench.dat"
+#define STRESS_FILE	"fuse_stress.dat"
+
+/* Stress test regions, and the longest write or read of one */
+#define REGION		(1024 * 1024)
+#define MAX_WRITERS	16
+#define MAX_XFER	(64 * 1024)
+
+static const char *srcdir;
+static unsigned int max_pages;
+static unsigned int max_write = 128 * 1024;
+static int writeback_cache;
+static int no_fsync;
+static int fuse_fd;
+
+/* Nodes other than the root, nodeid is the index plus 2 */
+static char *names[MAX_FILES];
+static int nr_names;
+
+/* What the daemon saw, per opcode of interest */
+static unsigned long nr_reads, nr_writes;
+static unsigned long long read_bytes, write_bytes;
+
+static long now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000L + tv.tv_usec;
+}
+
+static int node_path(__u64 nodeid, char *path)
+{
+	if (nodeid == FUSE_ROOT_ID) {
+		snprintf(path, PATH_MAX, "%s", srcdir);
+		return 0;
+	}
+	if (nodeid - 2 >= (__u64)nr_names)
+		return -ESTALE;
+	snprintf(path, PATH_MAX, "%s/%s", srcdir, names[nodeid - 2]);
+	return 0;
+}
+
+static __u64 node_get(const char *name)
+{
+	int i;
+
+	for (i = 0; i < nr_names; i++)
+		if (!strcmp(names[i], name))
+			return i + 2;
+	if (nr_names == MAX_FILES)
+		return 0;
+	names[nr_names] = strdup(name);
+	if (!names[nr_names])
+		return 0;
+	return ++nr_names + 1;
+}
+
+static void fill_attr(struct fuse_attr *attr, const struct stat *st,
+		      __u64 nodeid)
+{
+	memset(attr, 0, sizeof(*attr));
+	attr->ino = nodeid;
+	attr->size = st->st_size;
+	attr->blocks = st->st_blocks;
+	attr->atime = st->st_atime;
+	attr->mtime = st->st_mtime;
+	attr->ctime = st->st_ctime;
+	attr->mode = st->st_mode;
+	attr->nlink = st->st_nlink;
+	attr->uid = st->st_uid;
+	attr->gid = st->st_gid;
+	attr->blksize = st->st_blksize;
+}
+
+static int fill_entry(struct fuse_entry_out *entry, const char *name)
+{
+	char path[PATH_MAX];
+	struct stat st;
+
+	memset(entry, 0, sizeof(*entry));
+	entry->nodeid = node_get(name);
+	if (!entry->nodeid)
+		return -ENFILE;
+	node_path(entry->nodeid, path);
+	if (lstat(path, &st) < 0)
+		return -errno;
+	entry->entry_valid = 1;
+	entry->attr_valid = 1;
+	fill_attr(&entry->attr, &st, entry->nodeid);
+	return 0;
+}
+
+static void reply(__u64 unique, int error, const void *arg1, size_t size1,
+		  const void *arg2, size_t size2)
+{
+	struct fuse_out_header out;
+	struct iovec iov[3];
+
+	out.len = sizeof(out);
+	out.error = error;
+	out.unique = unique;
+	iov[0].iov_base = &out;
+	iov[0].iov_len = sizeof(out);
+	iov[1].iov_base = (void *)arg1;
+	iov[1].iov_len = error ? 0 : size1;
+	iov[2].iov_base = (void *)arg2;
+	iov[2].iov_len = error ? 0 : size2;
+	out.len += iov[1].iov_len + iov[2].iov_len;
+	if (writev(fuse_fd, iov, 3) < 0 && errno != ENOENT)
+		perror("fuse reply");
+}
+
+static void do_init(struct fuse_in_header *in, struct fuse_init_in *arg)
+{
+	struct fuse_init_out out;
+
+	memset(&out, 0, sizeof(out));
+	out.major = FUSE_KERNEL_VERSION;
+	out.minor = FUSE_KERNEL_MINOR_VERSION;
+	out.max_readahead = arg->max_readahead;
+	out.flags = arg->flags & (FUSE_ASYNC_READ | FUSE_BIG_WRITES);
+	if (max_pages && (arg->flags & FUSE_MAX_PAGES)) {
+		out.flags |= FUSE_MAX_PAGES;
+		out.max_pages = max_pages;
+	} else if (max_pages) {
+		fprintf(stderr, "kernel does not support FUSE_MAX_PAGES\n");
+	}
+	if (writeback_cache && (arg->flags & FUSE_WRITEBACK_CACHE))
+		out.flags |= FUSE_WRITEBACK_CACHE;
+	else if (writeback_cache)
+		fprintf(stderr, "kernel does not support FUSE_WRITEBACK_CACHE\n");
+	out.max_background = 12;
+	out.congestion_threshold = 9;
+	out.max_write = max_write;
+	reply(in->unique, 0, &out, sizeof(out), NULL, 0);
+}
+
+/* Handles one request, 'buf' holds the header and its arguments */
+static void handle(char *buf, char *data)
+{
+	struct fuse_in_header *in = (struct fuse_in_header *)buf;
+	void *arg = buf + sizeof(*in);
+	struct fuse_entry_out entry;
+	struct fuse_attr_out attr;
+	struct fuse_open_out open_out;
+	char path[PATH_MAX];
+	struct stat st;
+	ssize_t n;
+	int fd, err;
+
+	memset(&attr, 0, sizeof(attr));
+	memset(&open_out, 0, sizeof(open_out));
+	err = node_path(in->nodeid, path);
+
+	switch (in->opcode) {
+	case FUSE_INIT:
+		do_init(in, arg);
+		return;
+	case FUSE_FORGET:
+	case FUSE_BATCH_FORGET:
+		return;
+	case FUSE_LOOKUP:
+		if (in->nodeid != FUSE_ROOT_ID)
+			err = -ENOENT;
+		else
+			err = fill_entry(&entry, arg);
+		reply(in->unique, err, &entry, sizeof(entry), NULL, 0);
+		return;
+	case FUSE_SETATTR: {
+		struct fuse_setattr_in *setattr = arg;
+
+		struct timespec ts[2];
+
+		if (!err && (setattr->valid & FATTR_SIZE) &&
+		    truncate(path, setattr->size) < 0)
+			err = -errno;
+		/* the mtime from the writeback cache comes this way */
+		ts[0].tv_sec = setattr->atime;
+		ts[0].tv_nsec = setattr->atimensec;
+		if (!(setattr->valid & FATTR_ATIME))
+			ts[0].tv_nsec = UTIME_OMIT;
+		else if (setattr->valid & FATTR_ATIME_NOW)
+			ts[0].tv_nsec = UTIME_NOW;
+		ts[1].tv_sec = setattr->mtime;
+		ts[1].tv_nsec = setattr->mtimensec;
+		if (!(setattr->valid & FATTR_MTIME))
+			ts[1].tv_nsec = UTIME_OMIT;
+		else if (setattr->valid & FATTR_MTIME_NOW)
+			ts[1].tv_nsec = UTIME_NOW;
+		if (!err && (setattr->valid & (FATTR_ATIME | FATTR_MTIME)) &&
+		    utimensat(AT_FDCWD, path, ts, 0) < 0)
+			err = -errno;
+	}
+		/* fall through */
+	case FUSE_GETATTR:
+		if (!err && lstat(path, &st) < 0)
+			err = -errno;
+		if (!err) {
+			attr.attr_valid = 1;
+			fill_attr(&attr.attr, &st, in->nodeid);
+		}
+		reply(in->unique, err, &attr, sizeof(attr), NULL, 0);
+		return;
+	case FUSE_CREATE: {
+		struct fuse_create_in *create = arg;
+		char *name = (char *)(create + 1);
+
+		if (in->nodeid != FUSE_ROOT_ID)
+			err = -EPERM;
+		else
+			snprintf(path, PATH_MAX, "%s/%s", srcdir, name);
+		fd = err ? -1 : open(path, create->flags, create->mode);
+		if (!err && fd < 0)
+			err = -errno;
+		if (!err)
+			err = fill_entry(&entry, name);
+		open_out.fh = fd;
+		reply(in->unique, err, &entry, sizeof(entry), &open_out,
+		      sizeof(open_out));
+		return;
+	}
+	case FUSE_OPEN: {
+		struct fuse_open_in *open_in = arg;
+
+		fd = err ? -1 : open(path, open_in->flags);
+		if (!err && fd < 0)
+			err = -errno;
+		open_out.fh = fd;
+		reply(in->unique, err, &open_out, sizeof(open_out), NULL, 0);
+		return;
+	}
+	case FUSE_READ: {
+		struct fuse_read_in *read_in = arg;
+
+		n = pread(read_in->fh, data, read_in->size, read_in->offset);
+		nr_reads++;
+		if (n > 0)
+			read_bytes += n;
+		reply(in->unique, n < 0 ? -errno : 0, data, n, NULL, 0);
+		return;
+	}
+	case FUSE_WRITE: {
+		struct fuse_write_in *write_in = arg;
+		struct fuse_write_out write_out;
+
+		n = pwrite(write_in->fh, write_in + 1, write_in->size,
+			   write_in->offset);
+		nr_writes++;
+		if (n > 0)
+			write_bytes += n;
+		memset(&write_out, 0, sizeof(write_out));
+		write_out.size = n;
+		reply(in->unique, n < 0 ? -errno : 0, &write_out,
+		      sizeof(write_out), NULL, 0);
+		return;
+	}
+	case FUSE_FSYNC: {
+		struct fuse_fsync_in *fsync_in = arg;
+
+		if (no_fsync)
+			err = -ENOSYS;
+		else
+			err = fsync(fsync_in->fh) < 0 ? -errno : 0;
+		reply(in->unique, err, NULL, 0, NULL, 0);
+		return;
+	}
+	case FUSE_FLUSH:
+		reply(in->unique, 0, NULL, 0, NULL, 0);
+		return;
+	case FUSE_RELEASE: {
+		struct fuse_release_in *release = arg;
+
+		close(release->fh);
+		reply(in->unique, 0, NULL, 0, NULL, 0);
+		return;
+	}
+	default:
+		reply(in->unique, -ENOSYS, NULL, 0, NULL, 0);
+	}
+}
+
+static void *daemon_thread(void *unused)
+{
+	/* big enough for the largest WRITE the kernel may send */
+	size_t len = max_write + 8192;
+	char *buf = malloc(len), *data = malloc(len);
+	ssize_t n;
+
+	(void)unused;
+	if (!buf || !data) {
+		perror("malloc");
+		exit(1);
+	}
+	for (;;) {
+		n = read(fuse_fd, buf, len);
+		if (n < 0 && (errno == EINTR || errno == ENOENT))
+			continue;
+		if (n < 0) {
+			/* ENODEV once unmounted */
+			if (errno != ENODEV)
+				perror("fuse read");
+			break;
+		}
+		if ((size_t)n < sizeof(struct fuse_in_header))
+			continue;
+		handle(buf, data);
+	}
+	free(data);
+	free(buf);
+	return NULL;
+}
+
+/* write() or read() 'size' bytes in 'len' byte chunks */
+static int rw_file(int fd, int write_it, unsigned long long size, size_t len)
+{
+	char *buf = malloc(len);
+	unsigned long long done = 0;
+	ssize_t n;
+
+	if (!buf) {
+		perror("malloc");
+		return -1;
+	}
+	memset(buf, 0x5a, len);
+	while (done < size) {
+		size_t xfer = size - done < len ? size - done : len;
+
+		n = write_it ? write(fd, buf, xfer) : read(fd, buf, xfer);
+		if (n <= 0) {
+			perror(write_it ? "write" : "read");
+			break;
+		}
+		done += n;
+	}
+	free(buf);
+	return done == size ? 0 : -1;
+}
+
+static void report(const char *what, unsigned long long size, long us,
+		   unsigned long nr, unsigned long long bytes)
+{
+	printf("%s %llu MB in %.3f s: %.2f MB/s, %lu requests of %.1f kB "
+	       "on average\n", what, size >> 20, us / 1e6,
+	       us ? (double)size / us : 0.0, nr,
+	       nr ? bytes / 1024.0 / nr : 0.0);
+}
+
+enum { STRESS_WRITE, STRESS_MMAP, STRESS_TRUNCATE };
+
+struct stress {
+	pthread_t thread;
+	int kind;
+	int fd;
+	int src_fd;		/* the same file in the -d directory */
+	off_t start;		/* of the region the thread owns */
+	size_t size;		/* of the region, less for STRESS_TRUNCATE */
+	unsigned char *shadow;	/* what the region should hold */
+	unsigned int seed;
+	unsigned long ops;
+	unsigned long syncs;
+	int failed;
+};
+
+static volatile int stress_stop;
+
+/* Compare 'len' bytes of 'fd' at 'off' with 'want' */
+static int check(const char *what, int fd, off_t off,
+		 const unsigned char *want, size_t len)
+{
+	unsigned char buf[MAX_XFER];
+	size_t done = 0, i;
+	ssize_t n;
+
+	while (done < len) {
+		size_t xfer = len - done < MAX_XFER ? len - done : MAX_XFER;
+
+		n = pread(fd, buf, xfer, off + done);
+		if (n <= 0) {
+			fprintf(stderr, "%s: read at %lld: %s\n", what,
+				(long long)(off + done),
+				n ? strerror(errno) : "end of file");
+			return -1;
+		}
+		for (i = 0; i < (size_t)n; i++) {
+			if (buf[i] != want[done + i]) {
+				fprintf(stderr, "%s: byte %lld is 0x%02x, not "
+					"0x%02x\n", what,
+					(long long)(off + done + i), buf[i],
+					want[done + i]);
+				return -1;
+			}
+		}
+		done += n;
+	}
+	return 0;
+}
+
+/* A random span of 1 to MAX_XFER bytes within 'size' */
+static void random_span(unsigned int *seed, size_t size, size_t *off,
+			size_t *len)
+{
+	*len = rand_r(seed) % MAX_XFER + 1;
+	if (*len > size)
+		*len = size;
+	*off = rand_r(seed) % (size - *len + 1);
+}
+
+/* A pattern that tells a shifted or misplaced span from the right one */
+static void fill(unsigned int *seed, unsigned char *buf, size_t len)
+{
+	unsigned char c = rand_r(seed);
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = c + i;
+}
+
+/* pwrite() a random span of the region and note it in the shadow */
+static void stress_write(struct stress *s, size_t size)
+{
+	unsigned char buf[MAX_XFER];
+	size_t off, len;
+
+	random_span(&s->seed, size, &off, &len);
+	fill(&s->seed, buf, len);
+	if (pwrite(s->fd, buf, len, s->start + off) != (ssize_t)len) {
+		perror("stress write");
+		s->failed = 1;
+		return;
+	}
+	memcpy(s->shadow + off, buf, len);
+}
+
+/* Shrink or extend the region, or write to it, and check its size */
+static void stress_truncate(struct stress *s)
+{
+	size_t size = rand_r(&s->seed) % (REGION + 1);
+	struct stat st;
+
+	if (rand_r(&s->seed) % 2) {
+		if (ftruncate(s->fd, s->start + size) < 0) {
+			perror("stress truncate");
+			s->failed = 1;
+			return;
+		}
+		/* what was cut off reads back as zeroes when extended */
+		if (size < s->size)
+			memset(s->shadow + size, 0, s->size - size);
+		s->size = size;
+	} else {
+		size_t off, len;
+
+		random_span(&s->seed, REGION, &off, &len);
+		fill(&s->seed, s->shadow + off, len);
+		if (pwrite(s->fd, s->shadow + off, len, s->start + off) !=
+		    (ssize_t)len) {
+			perror("stress write");
+			s->failed = 1;
+			return;
+		}
+		if (off + len > s->size)
+			s->size = off + len;
+	}
+
+	if (fstat(s->fd, &st) < 0) {
+		perror("stress fstat");
+		s->failed = 1;
+	} else if (st.st_size != s->start + (off_t)s->size) {
+		fprintf(stderr, "truncate: size %lld, not %lld\n",
+			(long long)st.st_size,
+			(long long)(s->start + s->size));
+		s->failed = 1;
+	}
+}
+
+/*
+ * After an fsync() or msync() of the region, it must be in the -d
+ * directory already, whatever the other threads are doing
+ */
+static void stress_check_synced(struct stress *s)
+{
+	if (check("stress fsync", s->src_fd, s->start, s->shadow, s->size))
+		s->failed = 1;
+	s->syncs++;
+}
+
+static void *stress_thread(void *arg)
+{
+	struct stress *s = arg;
+	unsigned char *map = NULL;
+	size_t off, len;
+
+	if (s->kind == STRESS_MMAP) {
+		map = mmap(NULL, REGION, PROT_READ | PROT_WRITE, MAP_SHARED,
+			   s->fd, s->start);
+		if (map == MAP_FAILED) {
+			perror("stress mmap");
+			s->failed = 1;
+			return NULL;
+		}
+	}
+
+	while (!stress_stop && !s->failed) {
+		switch (s->kind) {
+		case STRESS_WRITE:
+			stress_write(s, REGION);
+			if (rand_r(&s->seed) % 32 == 0) {
+				if (fsync(s->fd) < 0) {
+					perror("stress fsync");
+					s->failed = 1;
+				} else {
+					stress_check_synced(s);
+				}
+			}
+			break;
+		case STRESS_MMAP:
+			random_span(&s->seed, REGION, &off, &len);
+			fill(&s->seed, map + off, len);
+			memcpy(s->shadow + off, map + off, len);
+			if (rand_r(&s->seed) % 8 != 0)
+				break;
+			if (msync(map, REGION, MS_SYNC) < 0) {
+				perror("stress msync");
+				s->failed = 1;
+			} else {
+				stress_check_synced(s);
+			}
+			break;
+		case STRESS_TRUNCATE:
+			stress_truncate(s);
+			break;
+		}
+		s->ops++;
+
+		/* every so often, read back some of what was written */
+		if (rand_r(&s->seed) % 8 == 0 && s->size) {
+			random_span(&s->seed, s->size, &off, &len);
+			if (check("stress read", s->fd, s->start + off,
+				  s->shadow + off, len))
+				s->failed = 1;
+		}
+	}
+
+	if (map)
+		munmap(map, REGION);
+	return NULL;
+}
+
+/*
+ * Runs the writers, the mmap and the truncate threads on one file for
+ * 'seconds', then checks what ended up in it
+ */
+static int stress(const char *mnt, int nr_writers, int seconds)
+{
+	struct stress threads[MAX_WRITERS + 2], *s;
+	struct stat st, src_st;
+	char path[PATH_MAX], src[PATH_MAX];
+	int nr = nr_writers + 2;
+	unsigned long ops = 0, syncs = 0;
+	time_t mtime = 0;
+	off_t size;
+	int fd, src_fd, i, ret = 0;
+
+	snprintf(path, sizeof(path), "%s/%s", mnt, STRESS_FILE);
+	snprintf(src, sizeof(src), "%s/%s", srcdir, STRESS_FILE);
+	memset(threads, 0, sizeof(threads));
+	for (i = 0; i < nr; i++) {
+		s = &threads[i];
+		s->kind = i < nr_writers ? STRESS_WRITE :
+			i == nr_writers ? STRESS_MMAP : STRESS_TRUNCATE;
+		s->start = (off_t)i * REGION;
+		s->size = s->kind == STRESS_TRUNCATE ? REGION / 2 : REGION;
+		s->shadow = calloc(1, REGION);
+		s->seed = i + 1;
+		s->fd = open(path, O_RDWR | O_CREAT | (i ? 0 : O_TRUNC),
+			     0644);
+		s->src_fd = open(src, O_RDONLY);
+		if (!s->shadow || s->fd < 0 || s->src_fd < 0) {
+			perror(s->fd < 0 ? path : src);
+			return -1;
+		}
+	}
+	s = &threads[nr - 1];
+	if (ftruncate(s->fd, s->start + s->size) < 0) {
+		perror(path);
+		return -1;
+	}
+
+	for (i = 0; i < nr; i++) {
+		if (pthread_create(&threads[i].thread, NULL, stress_thread,
+				   &threads[i])) {
+			fprintf(stderr, "pthread_create failed\n");
+			stress_stop = 1;
+			nr = i;
+			ret = -1;
+		}
+	}
+	sleep(seconds);
+	stress_stop = 1;
+	for (i = 0; i < nr; i++)
+		pthread_join(threads[i].thread, NULL);
+
+	if (!fstat(threads[0].fd, &st))
+		mtime = st.st_mtime;
+	for (i = 0; i < nr; i++) {
+		s = &threads[i];
+		if (s->failed)
+			ret = -1;
+		ops += s->ops;
+		syncs += s->syncs;
+		close(s->src_fd);
+		/* writes that did not make it show up here at the latest */
+		if (close(s->fd) < 0) {
+			perror("stress close");
+			ret = -1;
+		}
+	}
+	if (ret)
+		goto out;
+
+	/* let the attributes the mount has cached time out */
+	sleep(2);
+	fd = open(path, O_RDONLY);
+	src_fd = open(src, O_RDONLY);
+	if (fd < 0 || src_fd < 0) {
+		perror(fd < 0 ? path : src);
+		return -1;
+	}
+	/* read it back through FUSE, not from the page cache */
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	for (i = 0; i < nr; i++) {
+		s = &threads[i];
+		if (check(path, fd, s->start, s->shadow, s->size) ||
+		    check(src, src_fd, s->start, s->shadow, s->size))
+			ret = -1;
+	}
+
+	size = threads[nr - 1].start + threads[nr - 1].size;
+	if (fstat(fd, &st) < 0 || fstat(src_fd, &src_st) < 0) {
+		perror("fstat");
+		ret = -1;
+	} else if (st.st_size != size || src_st.st_size != size) {
+		fprintf(stderr, "size %lld through the mount and %lld in %s, "
+			"not %lld\n", (long long)st.st_size,
+			(long long)src_st.st_size, srcdir, (long long)size);
+		ret = -1;
+	} else if (writeback_cache && st.st_mtime != mtime) {
+		fprintf(stderr, "mtime went from %ld to %ld\n", (long)mtime,
+			(long)st.st_mtime);
+		ret = -1;
+	}
+	close(src_fd);
+	close(fd);
+
+out:
+	printf("stress: %d writers, mmap and truncate for %d s, %lu "
+	       "operations, %lu syncs checked, %lu WRITE requests of %.1f kB "
+	       "on average: %s\n",
+	       nr_writers, seconds, ops, syncs, nr_writes,
+	       nr_writes ? write_bytes / 1024.0 / nr_writes : 0.0,
+	       ret ? "FAILED" : "ok");
+	/* the daemon does not do UNLINK */
+	if (!ret)
+		unlink(src);
+	for (i = 0; i < nr_writers + 2; i++)
+		free(threads[i].shadow);
+	return ret;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s -d dir -m mountpoint [-s MB] [-l len] "
+		"[-p max_pages] [-w max_write] [-W]\n"
+		"\t[-S seconds [-j writers] [-F]]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *mnt = NULL;
+	unsigned long long size = 256ULL << 20;
+	size_t len = 1024 * 1024;
+	char opts[128], path[PATH_MAX];
+	pthread_t thread;
+	long start;
+	int seconds = 0, nr_writers = 4;
+	int fd, opt, ret = 1;
+
+	while ((opt = getopt(argc, argv, "d:m:s:l:p:w:WS:j:F")) != -1) {
+		switch (opt) {
+		case 'd':
+			srcdir = optarg;
+			break;
+		case 'm':
+			mnt = optarg;
+			break;
+		case 's':
+			size = strtoull(optarg, NULL, 0) << 20;
+			break;
+		case 'l':
+			len = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			max_pages = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			max_write = strtoul(optarg, NULL, 0);
+			break;
+		case 'W':
+			writeback_cache = 1;
+			break;
+		case 'S':
+			seconds = atoi(optarg);
+			break;
+		case 'j':
+			nr_writers = atoi(optarg);
+			break;
+		case 'F':
+			no_fsync = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!srcdir || !mnt || !size || !len || max_pages > 0xffff ||
+	    max_write < 4096 || seconds < 0 || nr_writers < 0 ||
+	    nr_writers > MAX_WRITERS)
+		usage(argv[0]);
+
+	fuse_fd = open("/dev/fuse", O_RDWR);
+	if (fuse_fd < 0) {
+		perror("/dev/fuse");
+		return 1;
+	}
+	snprintf(opts, sizeof(opts),
+		 "fd=%d,rootmode=40000,user_id=%d,group_id=%d,allow_other",
+		 fuse_fd, getuid(), getgid());
+	if (mount("fuse_bench", mnt, "fuse", MS_NOSUID | MS_NODEV, opts) < 0) {
+		perror("mount");
+		return 1;
+	}
+	if (pthread_create(&thread, NULL, daemon_thread, NULL)) {
+		fprintf(stderr, "pthread_create failed\n");
+		umount2(mnt, MNT_DETACH);
+		return 1;
+	}
+
+	if (seconds) {
+		ret = stress(mnt, nr_writers, seconds) ? 1 : 0;
+		goto out;
+	}
+
+	snprintf(path, sizeof(path), "%s/%s", mnt, BENCH_FILE);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(path);
+		goto out;
+	}
+	start = now_us();
+	if (rw_file(fd, 1, size, len) || fsync(fd) < 0) {
+		close(fd);
+		goto out;
+	}
+	report("wrote", size, now_us() - start, nr_writes, write_bytes);
+	close(fd);
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		goto out;
+	}
+	/* read it back through FUSE, not from the page cache */
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	start = now_us();
+	if (rw_file(fd, 0, size, len)) {
+		close(fd);
+		goto out;
+	}
+	report("read", size, now_us() - start, nr_reads, read_bytes);
+	close(fd);
+	unlink(path);
+	ret = 0;
+
+out:
+	umount2(mnt, MNT_DETACH);
+	pthread_join(thread, NULL);
+	close(fuse_fd);
+	return ret;
+}
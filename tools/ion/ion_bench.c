@@ -0,0 +1,219 @@
+/*
+ * ion_bench.c -- ion allocation and free latency benchmark
+ *
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Allocates and frees buffers of each size in turn from an ion heap, the
+ * system heap by default, and reports the minimum, median, 99th percentile
+ * and maximum latency of ION_IOC_ALLOC and ION_IOC_FREE. With -m, every
+ * buffer is also mapped and written to, the way gralloc clients use it,
+ * and the time to do so is reported too. With -d, the benchmark sleeps
+ * between iterations, giving the heap time to zero freed pages in the
+ * background.
+ *
+ * Needs /dev/ion and permission to open it (e.g. root).
+ *
+ * $(CROSS_COMPILE)cc -Wall -Wextra -g -o ion_bench ion_bench.c
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "../../include/linux/ion.h"
+
+static const size_t default_sizes[] = {
+	4096, 64 * 1024, 1024 * 1024, 8 * 1024 * 1024
+};
+
+static long now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000L + tv.tv_usec;
+}
+
+static int cmp_long(const void *a, const void *b)
+{
+	long x = *(const long *)a, y = *(const long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void report(const char *what, long *us, int n)
+{
+	long sum = 0;
+	int i;
+
+	qsort(us, n, sizeof(*us), cmp_long);
+	for (i = 0; i < n; i++)
+		sum += us[i];
+	printf("  %-6s min %6ld  p50 %6ld  p99 %6ld  max %6ld  avg %8.1f us\n",
+	       what, us[0], us[n / 2], us[n * 99 / 100], us[n - 1],
+	       (double)sum / n);
+}
+
+/* Map the buffer and write to every page of it, then unmap it again */
+static int touch(int fd, struct ion_handle *handle, size_t size)
+{
+	struct ion_fd_data data;
+	char *ptr;
+	size_t off;
+
+	data.handle = handle;
+	if (ioctl(fd, ION_IOC_MAP, &data) < 0) {
+		perror("ION_IOC_MAP");
+		return -1;
+	}
+	ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, data.fd, 0);
+	if (ptr == MAP_FAILED) {
+		perror("mmap");
+		close(data.fd);
+		return -1;
+	}
+	for (off = 0; off < size; off += 4096)
+		ptr[off] = 1;
+	munmap(ptr, size);
+	close(data.fd);
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-i iterations] [-s size[,size...]] [-H heap_mask] "
+		"[-c] [-m] [-d delay_us]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	size_t sizes[32];
+	int nr_sizes = 0, iterations = 1000, cached = 0, map = 0;
+	unsigned int heap_mask = ION_HEAP(ION_SYSTEM_HEAP_ID);
+	long delay_us = 0;
+	long *alloc_us, *free_us, *map_us;
+	int fd, i, n, opt;
+	char *tok;
+
+	while ((opt = getopt(argc, argv, "i:s:H:cmd:")) != -1) {
+		switch (opt) {
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		case 's':
+			for (tok = strtok(optarg, ","); tok && nr_sizes < 32;
+			     tok = strtok(NULL, ","))
+				sizes[nr_sizes++] = strtoul(tok, NULL, 0);
+			break;
+		case 'H':
+			heap_mask = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			cached = 1;
+			break;
+		case 'm':
+			map = 1;
+			break;
+		case 'd':
+			delay_us = atol(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (iterations < 1 || delay_us < 0)
+		usage(argv[0]);
+	if (!nr_sizes) {
+		nr_sizes = sizeof(default_sizes) / sizeof(default_sizes[0]);
+		memcpy(sizes, default_sizes, sizeof(default_sizes));
+	}
+
+	fd = open("/dev/ion", O_RDONLY);
+	if (fd < 0) {
+		perror("/dev/ion");
+		return 1;
+	}
+
+	alloc_us = calloc(iterations, sizeof(long));
+	free_us = calloc(iterations, sizeof(long));
+	map_us = calloc(iterations, sizeof(long));
+	if (!alloc_us || !free_us || !map_us) {
+		perror("calloc");
+		return 1;
+	}
+
+	printf("heap mask 0x%x, %s, %d iterations%s\n", heap_mask,
+	       cached ? "cached" : "uncached", iterations,
+	       map ? ", mapped and written" : "");
+
+	for (n = 0; n < nr_sizes; n++) {
+		struct ion_allocation_data alloc;
+		struct ion_handle_data free_data;
+		long start;
+
+		for (i = 0; i < iterations; i++) {
+			memset(&alloc, 0, sizeof(alloc));
+			alloc.len = sizes[n];
+			alloc.align = 4096;
+			alloc.flags = heap_mask | ION_SET_CACHE(cached);
+
+			start = now_us();
+			if (ioctl(fd, ION_IOC_ALLOC, &alloc) < 0) {
+				fprintf(stderr, "ION_IOC_ALLOC of %zu bytes: "
+					"%s\n", sizes[n], strerror(errno));
+				return 1;
+			}
+			alloc_us[i] = now_us() - start;
+
+			if (map) {
+				start = now_us();
+				if (touch(fd, alloc.handle, sizes[n]) < 0)
+					return 1;
+				map_us[i] = now_us() - start;
+			}
+
+			free_data.handle = alloc.handle;
+			start = now_us();
+			if (ioctl(fd, ION_IOC_FREE, &free_data) < 0) {
+				perror("ION_IOC_FREE");
+				return 1;
+			}
+			free_us[i] = now_us() - start;
+
+			if (delay_us)
+				usleep(delay_us);
+		}
+
+		printf("%zu bytes:\n", sizes[n]);
+		report("alloc", alloc_us, iterations);
+		if (map)
+			report("map", map_us, iterations);
+		report("free", free_us, iterations);
+	}
+
+	free(map_us);
+	free(free_us);
+	free(alloc_us);
+	close(fd);
+	return 0;
+}
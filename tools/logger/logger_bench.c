@@ -0,0 +1,218 @@
+/*
+ * logger_bench.c -- Android logger write throughput benchmark
+ *
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Starts N threads that each write log entries to a log device as fast as
+ * they can for a number of seconds, the way liblog does (priority, tag and
+ * message in three iovecs), optionally while a reader drains the log like
+ * logcat. Reports the aggregate number of writes per second and the
+ * worst latency of a single write. Run it against kernels with and without
+ * the lockless logger to compare.
+ *
+ * $(CROSS_COMPILE)cc -Wall -Wextra -g -o logger_bench logger_bench.c -lpthread
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define ENTRY_MAX_LEN	(4 * 1024)
+
+static const char *device = "/dev/log/main";
+static int nr_threads = 4;
+static int seconds = 5;
+static int msg_len = 64;
+static int with_reader;
+
+static volatile int stop;
+
+struct writer {
+	pthread_t thread;
+	unsigned long writes;
+	unsigned long errors;
+	long max_us;
+};
+
+static long now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000L + tv.tv_usec;
+}
+
+static void *writer_thread(void *arg)
+{
+	struct writer *w = arg;
+	unsigned char prio = 4;		/* ANDROID_LOG_INFO */
+	char tag[] = "logger_bench";
+	char *msg;
+	struct iovec vec[3];
+	int fd;
+
+	fd = open(device, O_WRONLY);
+	if (fd < 0) {
+		perror(device);
+		exit(1);
+	}
+
+	msg = malloc(msg_len + 1);
+	if (!msg) {
+		perror("malloc");
+		exit(1);
+	}
+	memset(msg, 'x', msg_len);
+	msg[msg_len] = '\0';
+
+	vec[0].iov_base = &prio;
+	vec[0].iov_len = 1;
+	vec[1].iov_base = tag;
+	vec[1].iov_len = sizeof(tag);
+	vec[2].iov_base = msg;
+	vec[2].iov_len = msg_len + 1;
+
+	while (!stop) {
+		long start = now_us(), us;
+
+		if (writev(fd, vec, 3) < 0)
+			w->errors++;
+		else
+			w->writes++;
+
+		us = now_us() - start;
+		if (us > w->max_us)
+			w->max_us = us;
+	}
+
+	free(msg);
+	close(fd);
+	return NULL;
+}
+
+static void *reader_thread(void *arg)
+{
+	char buf[ENTRY_MAX_LEN + 1];
+	int fd;
+
+	(void)arg;
+	fd = open(device, O_RDONLY);
+	if (fd < 0) {
+		perror(device);
+		exit(1);
+	}
+
+	while (!stop)
+		if (read(fd, buf, sizeof(buf)) < 0 && errno != EINTR)
+			break;
+
+	close(fd);
+	return NULL;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-d device] [-t threads] [-s seconds] "
+		"[-l message length] [-r]\n"
+		"  -r  read the log concurrently, like logcat\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct writer *writers;
+	pthread_t reader;
+	unsigned long writes = 0, errors = 0;
+	long max_us = 0, elapsed;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "d:t:s:l:r")) != -1) {
+		switch (opt) {
+		case 'd':
+			device = optarg;
+			break;
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'l':
+			msg_len = atoi(optarg);
+			break;
+		case 'r':
+			with_reader = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (nr_threads < 1 || seconds < 1 || msg_len < 0 ||
+	    msg_len > ENTRY_MAX_LEN - 64)
+		usage(argv[0]);
+
+	writers = calloc(nr_threads, sizeof(*writers));
+	if (!writers) {
+		perror("calloc");
+		return 1;
+	}
+
+	if (with_reader)
+		pthread_create(&reader, NULL, reader_thread, NULL);
+
+	elapsed = now_us();
+	for (i = 0; i < nr_threads; i++)
+		pthread_create(&writers[i].thread, NULL, writer_thread,
+			       &writers[i]);
+
+	sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(writers[i].thread, NULL);
+		writes += writers[i].writes;
+		errors += writers[i].errors;
+		if (writers[i].max_us > max_us)
+			max_us = writers[i].max_us;
+	}
+	elapsed = now_us() - elapsed;
+
+	/* a last entry wakes the reader up if it is blocked */
+	if (with_reader) {
+		int fd = open(device, O_WRONLY);
+
+		if (fd >= 0) {
+			if (write(fd, "\4logger_bench\0done", 19) < 0)
+				perror("write");
+			close(fd);
+		}
+		pthread_join(reader, NULL);
+	}
+
+	printf("%s: %d threads, %d byte messages%s\n", device, nr_threads,
+	       msg_len, with_reader ? ", with reader" : "");
+	printf("%lu writes, %.0f writes/s, max latency %ld us, %lu errors\n",
+	       writes, writes * 1000000.0 / elapsed, max_us, errors);
+
+	free(writers);
+	return 0;
+}
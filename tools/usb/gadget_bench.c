@@ -0,0 +1,330 @@
+/*
+ * gadget_bench.c -- bulk throughput benchmark for the MTP and ADB gadget
+ * functions
+ *
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Runs one end of a bulk transfer and reports its throughput, and how busy
+ * the CPUs were meanwhile according to /proc/stat.
+ *
+ * The device end (-d) runs on the gadget, on /dev/mtp_usb or
+ * /dev/android_adb. For MTP, the data goes to or from the file given with
+ * -f through MTP_SEND_FILE and MTP_RECEIVE_FILE, the same path as a file
+ * copy from or to a PC; otherwise it is read or written with read() and
+ * write() of -l bytes each, as adbd does.
+ *
+ * The host end (-D) runs on the USB host, on the usbfs node of the gadget,
+ * and keeps -q URBs of -l bytes in flight on the bulk endpoint given with
+ * -e, whose direction bit says which way the data goes. Start the device
+ * end first.
+ *
+ * Both ends can run on one machine with dummy_hcd, e.g. to send 256 MB
+ * from the gadget:
+ *
+ *	modprobe dummy_hcd
+ *	echo mtp > /sys/class/android_usb/android0/functions
+ *	echo 1 > /sys/class/android_usb/android0/enable
+ *	gadget_bench -d /dev/mtp_usb -w -f /data/256M.bin &
+ *	gadget_bench -D /dev/bus/usb/001/002 -e 0x81 -s 256
+ *
+ * $(CROSS_COMPILE)cc -Wall -Wextra -g -o gadget_bench gadget_bench.c
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <linux/usbdevice_fs.h>
+
+#include "../../include/linux/usb/f_mtp.h"
+
+/* usbfs limit on one bulk URB */
+#define MAX_URB_LEN	16384
+#define MAX_URBS	64
+
+static long now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000L + tv.tv_usec;
+}
+
+/* Reads the busy and total jiffies of all CPUs from /proc/stat */
+static int cpu_jiffies(unsigned long long *busy, unsigned long long *total)
+{
+	unsigned long long v[8] = { 0 };
+	FILE *f = fopen("/proc/stat", "r");
+	int i, n;
+
+	if (!f)
+		return -1;
+	n = fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu %llu", &v[0],
+		   &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]);
+	fclose(f);
+	if (n < 4)
+		return -1;
+	*total = 0;
+	for (i = 0; i < 8; i++)
+		*total += v[i];
+	/* everything but idle and iowait */
+	*busy = *total - v[3] - v[4];
+	return 0;
+}
+
+static void report(const char *what, unsigned long long bytes, long us,
+		   unsigned long long busy, unsigned long long total)
+{
+	printf("%s %llu bytes in %.3f s: %.2f MB/s", what, bytes, us / 1e6,
+	       us ? (double)bytes / us : 0.0);
+	if (total)
+		printf(", cpu %.1f%%", 100.0 * busy / total);
+	printf("\n");
+}
+
+/* MTP_SEND_FILE or MTP_RECEIVE_FILE of 'size' bytes of 'file' */
+static int mtp_file(int fd, const char *file, int send,
+		    unsigned long long *size)
+{
+	struct mtp_file_range range;
+	struct stat st;
+	int ret;
+
+	memset(&range, 0, sizeof(range));
+	range.fd = open(file, send ? O_RDONLY : O_WRONLY | O_CREAT | O_TRUNC,
+			0644);
+	if (range.fd < 0) {
+		perror(file);
+		return -1;
+	}
+	if (send && !*size) {
+		if (fstat(range.fd, &st) < 0) {
+			perror(file);
+			close(range.fd);
+			return -1;
+		}
+		*size = st.st_size;
+	}
+	range.length = *size;
+
+	ret = ioctl(fd, send ? MTP_SEND_FILE : MTP_RECEIVE_FILE, &range);
+	if (ret < 0)
+		perror(send ? "MTP_SEND_FILE" : "MTP_RECEIVE_FILE");
+	close(range.fd);
+	return ret;
+}
+
+/* read() or write() 'size' bytes in 'len' byte chunks */
+static int rw_loop(int fd, int send, unsigned long long *size, size_t len)
+{
+	unsigned long long done = 0;
+	char *buf = malloc(len);
+	ssize_t n;
+	int ret = 0;
+
+	if (!buf) {
+		perror("malloc");
+		return -1;
+	}
+	memset(buf, 0x5a, len);
+	while (done < *size) {
+		size_t xfer = *size - done < len ? *size - done : len;
+
+		n = send ? write(fd, buf, xfer) : read(fd, buf, xfer);
+		if (n <= 0) {
+			perror(send ? "write" : "read");
+			ret = -1;
+			break;
+		}
+		done += n;
+	}
+	free(buf);
+	*size = done;
+	return ret;
+}
+
+/* Bulk transfer of 'size' bytes with up to 'depth' URBs in flight */
+static int host_loop(int fd, unsigned char ep, unsigned long long *size,
+		     size_t len, int depth)
+{
+	struct usbdevfs_urb urbs[MAX_URBS], *urb;
+	unsigned long long queued = 0, done = 0;
+	int i, inflight = 0, ret = 0;
+	char *bufs;
+
+	bufs = malloc(len * depth);
+	if (!bufs) {
+		perror("malloc");
+		return -1;
+	}
+	memset(bufs, 0x5a, len * depth);
+	memset(urbs, 0, sizeof(urbs));
+
+	for (i = 0; i < depth && queued < *size; i++) {
+		urb = &urbs[i];
+		urb->type = USBDEVFS_URB_TYPE_BULK;
+		urb->endpoint = ep;
+		urb->buffer = bufs + i * len;
+		urb->buffer_length = *size - queued < len ? *size - queued : len;
+		if (ioctl(fd, USBDEVFS_SUBMITURB, urb) < 0) {
+			perror("USBDEVFS_SUBMITURB");
+			ret = -1;
+			break;
+		}
+		queued += urb->buffer_length;
+		inflight++;
+	}
+
+	while (inflight) {
+		if (ioctl(fd, USBDEVFS_REAPURB, &urb) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("USBDEVFS_REAPURB");
+			ret = -1;
+			break;
+		}
+		inflight--;
+		if (urb->status) {
+			fprintf(stderr, "urb status %d\n", urb->status);
+			ret = -1;
+		}
+		done += urb->actual_length;
+		/* a short packet ends an IN transfer */
+		if ((ep & 0x80) && urb->actual_length < urb->buffer_length)
+			*size = queued;
+		if (ret || queued >= *size)
+			continue;
+
+		urb->buffer_length = *size - queued < len ? *size - queued : len;
+		if (ioctl(fd, USBDEVFS_SUBMITURB, urb) < 0) {
+			perror("USBDEVFS_SUBMITURB");
+			ret = -1;
+			continue;
+		}
+		queued += urb->buffer_length;
+		inflight++;
+	}
+
+	free(bufs);
+	*size = done;
+	return ret;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s -d /dev/mtp_usb|/dev/android_adb [-w] [-f file] "
+		"[-s MB] [-l len]\n"
+		"       %s -D /dev/bus/usb/BBB/DDD -e ep [-I interface] "
+		"[-s MB] [-l len] [-q urbs]\n", prog, prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *dev = NULL, *usbfs = NULL, *file = NULL;
+	unsigned long long size = 0, busy0, total0, busy1, total1;
+	unsigned int intf = 0;
+	unsigned char ep = 0;
+	size_t len = 0;
+	int send = 0, depth = 16, have_cpu;
+	int fd, opt, ret;
+	long start, us;
+
+	while ((opt = getopt(argc, argv, "d:D:wf:s:l:e:I:q:")) != -1) {
+		switch (opt) {
+		case 'd':
+			dev = optarg;
+			break;
+		case 'D':
+			usbfs = optarg;
+			break;
+		case 'w':
+			send = 1;
+			break;
+		case 'f':
+			file = optarg;
+			break;
+		case 's':
+			size = strtoull(optarg, NULL, 0) << 20;
+			break;
+		case 'l':
+			len = strtoul(optarg, NULL, 0);
+			break;
+		case 'e':
+			ep = strtoul(optarg, NULL, 0);
+			break;
+		case 'I':
+			intf = strtoul(optarg, NULL, 0);
+			break;
+		case 'q':
+			depth = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!dev == !usbfs || (usbfs && !ep) || depth < 1 ||
+	    depth > MAX_URBS)
+		usage(argv[0]);
+	if (!size && !(dev && file && send))
+		size = 256ULL << 20;
+
+	fd = open(dev ? dev : usbfs, O_RDWR);
+	if (fd < 0) {
+		perror(dev ? dev : usbfs);
+		return 1;
+	}
+	if (usbfs) {
+		if (!len || len > MAX_URB_LEN)
+			len = MAX_URB_LEN;
+		if (ioctl(fd, USBDEVFS_CLAIMINTERFACE, &intf) < 0) {
+			perror("USBDEVFS_CLAIMINTERFACE");
+			return 1;
+		}
+	} else if (!len) {
+		len = 16384;
+	}
+
+	have_cpu = !cpu_jiffies(&busy0, &total0);
+	start = now_us();
+	if (usbfs)
+		ret = host_loop(fd, ep, &size, len, depth);
+	else if (file)
+		ret = mtp_file(fd, file, send, &size);
+	else
+		ret = rw_loop(fd, send, &size, len);
+	us = now_us() - start;
+	if (have_cpu && !cpu_jiffies(&busy1, &total1)) {
+		busy1 -= busy0;
+		total1 -= total0;
+	} else {
+		busy1 = total1 = 0;
+	}
+
+	report(usbfs ? (ep & 0x80 ? "host read" : "host wrote") :
+	       (send ? "device sent" : "device received"),
+	       size, us, busy1, total1);
+	close(fd);
+	return ret ? 1 : 0;
+}
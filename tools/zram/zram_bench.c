@@ -0,0 +1,236 @@
+/*
+ * zram_bench.c -- zram parallel write throughput benchmark
+ *
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Starts N threads that each write pages with O_DIRECT to their own part
+ * of a zram device, as fast as they can for a number of seconds, and
+ * reports the aggregate write throughput. Pages are made of a chosen
+ * share of random bytes, the rest repeated, so the compression ratio can
+ * be set. With -S the run is repeated for 1, 2, ... N threads, which
+ * shows how writes scale with max_comp_streams.
+ *
+ * $(CROSS_COMPILE)cc -Wall -Wextra -g -o zram_bench zram_bench.c -lpthread
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <linux/fs.h>
+
+/* distinct pages each thread cycles through */
+#define NR_PATTERNS	64
+
+static const char *device = "/dev/zram0";
+static int nr_threads = 4;
+static int seconds = 5;
+static int random_pct = 50;
+static int sweep;
+
+static long page_size;
+static unsigned long dev_pages;
+static volatile int stop;
+
+struct writer {
+	pthread_t thread;
+	int id;
+	int nr;
+	unsigned long writes;
+	unsigned long errors;
+};
+
+static long now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000L + tv.tv_usec;
+}
+
+static void *writer_thread(void *arg)
+{
+	struct writer *w = arg;
+	unsigned long first = dev_pages / w->nr * w->id;
+	unsigned long count = dev_pages / w->nr;
+	long rnd_len = random_pct * page_size / 100;
+	uint64_t x = (uint64_t)(w->id + 1) * 0x9e3779b97f4a7c15ULL;
+	unsigned char *buf;
+	unsigned long i;
+	long j;
+	int fd;
+
+	fd = open(device, O_WRONLY | O_DIRECT);
+	if (fd < 0) {
+		perror(device);
+		exit(1);
+	}
+	if (posix_memalign((void **)&buf, page_size, NR_PATTERNS * page_size)) {
+		fprintf(stderr, "posix_memalign failed\n");
+		exit(1);
+	}
+	for (i = 0; i < NR_PATTERNS; i++) {
+		unsigned char *p = buf + i * page_size;
+
+		for (j = 0; j < rnd_len; j++) {
+			x ^= x << 13;
+			x ^= x >> 7;
+			x ^= x << 17;
+			p[j] = x;
+		}
+		memset(p + rnd_len, i + 1, page_size - rnd_len);
+	}
+
+	for (i = 0; !stop; i++) {
+		if (pwrite(fd, buf + i % NR_PATTERNS * page_size, page_size,
+			   (first + i % count) * page_size) != page_size)
+			w->errors++;
+		else
+			w->writes++;
+	}
+
+	free(buf);
+	close(fd);
+	return NULL;
+}
+
+static int run(int nr)
+{
+	struct writer *writers;
+	unsigned long writes = 0, errors = 0;
+	long elapsed;
+	int i;
+
+	writers = calloc(nr, sizeof(*writers));
+	if (!writers) {
+		perror("calloc");
+		exit(1);
+	}
+
+	stop = 0;
+	elapsed = now_us();
+	for (i = 0; i < nr; i++) {
+		writers[i].id = i;
+		writers[i].nr = nr;
+		pthread_create(&writers[i].thread, NULL, writer_thread,
+			       &writers[i]);
+	}
+
+	sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < nr; i++) {
+		pthread_join(writers[i].thread, NULL);
+		writes += writers[i].writes;
+		errors += writers[i].errors;
+	}
+	elapsed = now_us() - elapsed;
+
+	printf("%2d threads: %8.1f MB/s, %9.0f writes/s, %lu errors\n", nr,
+	       (double)writes * page_size / elapsed,
+	       writes * 1000000.0 / elapsed, errors);
+
+	free(writers);
+	return errors != 0;
+}
+
+static void print_stat(const char *name)
+{
+	const char *dev = strrchr(device, '/');
+	char path[256], val[64];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/sys/block/%s/%s",
+		 dev ? dev + 1 : device, name);
+	f = fopen(path, "r");
+	if (!f)
+		return;
+	if (fgets(val, sizeof(val), f))
+		printf("%s: %s", name, val);
+	fclose(f);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-d device] [-t threads] [-s seconds] "
+		"[-r random%%] [-S]\n"
+		"  -r  share of each page that is random, 100 is "
+		"incompressible\n"
+		"  -S  run with 1 to threads writers in turn\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long size;
+	int opt, fd, i, ret = 0;
+
+	while ((opt = getopt(argc, argv, "d:t:s:r:S")) != -1) {
+		switch (opt) {
+		case 'd':
+			device = optarg;
+			break;
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'r':
+			random_pct = atoi(optarg);
+			break;
+		case 'S':
+			sweep = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (nr_threads < 1 || seconds < 1 || random_pct < 0 ||
+	    random_pct > 100)
+		usage(argv[0]);
+
+	page_size = sysconf(_SC_PAGESIZE);
+	fd = open(device, O_RDONLY);
+	if (fd < 0) {
+		perror(device);
+		return 1;
+	}
+	if (ioctl(fd, BLKGETSIZE64, &size) < 0) {
+		perror("BLKGETSIZE64");
+		return 1;
+	}
+	close(fd);
+	dev_pages = size / page_size;
+	if (dev_pages < (unsigned long)nr_threads) {
+		fprintf(stderr, "%s: too small\n", device);
+		return 1;
+	}
+
+	printf("%s: %d%% random pages\n", device, random_pct);
+	print_stat("max_comp_streams");
+	print_stat("comp_algorithm");
+	for (i = sweep ? 1 : nr_threads; i <= nr_threads; i++)
+		ret |= run(i);
+
+	return ret;
+}
@@ -0,0 +1,356 @@
+/*
+ * zram_stress.c -- concurrent write/discard/verify stress test for zram
+ *
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Starts N threads that each own every Nth page of the first pages of a
+ * zram device and, for a number of seconds, randomly write, discard or
+ * read back and check one of their pages with O_DIRECT. A share of the
+ * writes take their content from a small pool common to all threads, so
+ * with dedup enabled many slots share one object while other threads
+ * overwrite and free their copies. Page contents range from highly
+ * compressible to incompressible. Each thread checks all of its pages
+ * once more at the end, and any mismatch is reported and makes the test
+ * fail.
+ *
+ * Slots are freed with BLKDISCARD. If the device does not take discards,
+ * they are freed by writing a page of zeroes instead, which releases the
+ * stored object the same way.
+ *
+ * $(CROSS_COMPILE)cc -Wall -Wextra -g -o zram_stress zram_stress.c -lpthread
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <linux/fs.h>
+
+#define POOL_SIZE	16
+
+static const char *device = "/dev/zram0";
+static int nr_threads = 4;
+static int seconds = 10;
+static unsigned long nr_pages = 4096;
+static int dup_pct = 50;
+static int discard_pct = 20;
+static int verify_pct = 20;
+
+static long page_size;
+static volatile int stop;
+static int no_discard;
+
+struct worker {
+	pthread_t thread;
+	int id;
+	uint64_t rnd;
+	/* content of each owned page, 0 if it must read back as zeroes */
+	uint64_t *seeds;
+	unsigned long writes;
+	unsigned long discards;
+	unsigned long verifies;
+	unsigned long mismatches;
+	unsigned long errors;
+};
+
+static long now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000L + tv.tv_usec;
+}
+
+static uint64_t next_rnd(uint64_t *x)
+{
+	*x ^= *x << 13;
+	*x ^= *x >> 7;
+	*x ^= *x << 17;
+	return *x;
+}
+
+/*
+ * The same seed always gives the same page. seed % 5 quarters of it are
+ * random, the rest is one non-zero byte repeated.
+ */
+static void fill_page(unsigned char *buf, uint64_t seed)
+{
+	uint64_t x = seed * 0x9e3779b97f4a7c15ULL | 1;
+	long rnd_len = (seed % 5) * page_size / 4;
+	long i;
+
+	for (i = 0; i < rnd_len; i += sizeof(x)) {
+		next_rnd(&x);
+		memcpy(buf + i, &x, sizeof(x));
+	}
+	memset(buf + rnd_len, (seed & 0xff) | 1, page_size - rnd_len);
+}
+
+static void expect_page(unsigned char *buf, uint64_t seed)
+{
+	if (seed)
+		fill_page(buf, seed);
+	else
+		memset(buf, 0, page_size);
+}
+
+static void free_page(struct worker *w, int fd, unsigned long page,
+		      unsigned char *zero)
+{
+	uint64_t range[2] = { page * page_size, page_size };
+
+	if (!no_discard) {
+		if (!ioctl(fd, BLKDISCARD, range))
+			return;
+		if (errno != EOPNOTSUPP) {
+			perror("BLKDISCARD");
+			w->errors++;
+			return;
+		}
+		if (!__sync_lock_test_and_set(&no_discard, 1))
+			fprintf(stderr, "%s: no discard support, freeing "
+				"pages by writing zeroes\n", device);
+	}
+	if (pwrite(fd, zero, page_size, page * page_size) != page_size) {
+		perror("pwrite");
+		w->errors++;
+	}
+}
+
+static void verify_page(struct worker *w, int fd, unsigned long page,
+			unsigned char *buf, unsigned char *expect)
+{
+	uint64_t seed = w->seeds[page / nr_threads];
+
+	w->verifies++;
+	if (pread(fd, buf, page_size, page * page_size) != page_size) {
+		perror("pread");
+		w->errors++;
+		return;
+	}
+	expect_page(expect, seed);
+	if (memcmp(buf, expect, page_size)) {
+		fprintf(stderr, "page %lu: mismatch, expected seed %llx\n",
+			page, (unsigned long long)seed);
+		w->mismatches++;
+	}
+}
+
+static void *worker_thread(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long owned = (nr_pages - w->id + nr_threads - 1) / nr_threads;
+	unsigned char *buf, *expect, *zero;
+	unsigned long i, page, unique = 0;
+	uint64_t seed;
+	int fd, op;
+
+	fd = open(device, O_RDWR | O_DIRECT);
+	if (fd < 0) {
+		perror(device);
+		exit(1);
+	}
+	if (posix_memalign((void **)&buf, page_size, page_size) ||
+	    posix_memalign((void **)&expect, page_size, page_size) ||
+	    posix_memalign((void **)&zero, page_size, page_size)) {
+		fprintf(stderr, "posix_memalign failed\n");
+		exit(1);
+	}
+	memset(zero, 0, page_size);
+
+	/* start from a known state */
+	for (i = 0; i < owned; i++)
+		free_page(w, fd, w->id + i * nr_threads, zero);
+
+	while (!stop) {
+		i = next_rnd(&w->rnd) % owned;
+		page = w->id + i * nr_threads;
+		op = next_rnd(&w->rnd) % 100;
+
+		if (op < discard_pct) {
+			free_page(w, fd, page, zero);
+			w->seeds[i] = 0;
+			w->discards++;
+		} else if (op < discard_pct + verify_pct) {
+			verify_page(w, fd, page, buf, expect);
+		} else {
+			if ((int)(next_rnd(&w->rnd) % 100) < dup_pct)
+				seed = 1 + next_rnd(&w->rnd) % POOL_SIZE;
+			else
+				seed = (uint64_t)(w->id + 1) << 32 | ++unique;
+			fill_page(buf, seed);
+			if (pwrite(fd, buf, page_size, page * page_size) !=
+			    page_size) {
+				perror("pwrite");
+				w->errors++;
+				continue;
+			}
+			w->seeds[i] = seed;
+			w->writes++;
+		}
+	}
+
+	for (i = 0; i < owned; i++)
+		verify_page(w, fd, w->id + i * nr_threads, buf, expect);
+
+	free(buf);
+	free(expect);
+	free(zero);
+	close(fd);
+	return NULL;
+}
+
+static void print_stat(const char *name)
+{
+	const char *dev = strrchr(device, '/');
+	char path[256], val[64];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/sys/block/%s/%s",
+		 dev ? dev + 1 : device, name);
+	f = fopen(path, "r");
+	if (!f)
+		return;
+	if (fgets(val, sizeof(val), f))
+		printf("%s: %s", name, val);
+	fclose(f);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-d device] [-t threads] [-s seconds] [-n pages] "
+		"[-u dup%%] [-x discard%%] [-v verify%%]\n"
+		"  -n  number of pages at the start of the device to use\n"
+		"  -u  share of writes taken from the common content pool\n"
+		"  -x  share of operations that discard a page\n"
+		"  -v  share of operations that read a page back\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct worker *workers;
+	unsigned long writes = 0, discards = 0, verifies = 0;
+	unsigned long mismatches = 0, errors = 0;
+	unsigned long long size;
+	long elapsed;
+	int opt, fd, i;
+
+	while ((opt = getopt(argc, argv, "d:t:s:n:u:x:v:")) != -1) {
+		switch (opt) {
+		case 'd':
+			device = optarg;
+			break;
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'n':
+			nr_pages = strtoul(optarg, NULL, 0);
+			break;
+		case 'u':
+			dup_pct = atoi(optarg);
+			break;
+		case 'x':
+			discard_pct = atoi(optarg);
+			break;
+		case 'v':
+			verify_pct = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (nr_threads < 1 || seconds < 1 || nr_pages < (unsigned)nr_threads ||
+	    dup_pct < 0 || dup_pct > 100 || discard_pct < 0 ||
+	    verify_pct < 0 || discard_pct + verify_pct > 100)
+		usage(argv[0]);
+
+	page_size = sysconf(_SC_PAGESIZE);
+	fd = open(device, O_RDONLY);
+	if (fd < 0) {
+		perror(device);
+		return 1;
+	}
+	if (ioctl(fd, BLKGETSIZE64, &size) < 0) {
+		perror("BLKGETSIZE64");
+		return 1;
+	}
+	close(fd);
+	if (nr_pages > size / page_size) {
+		fprintf(stderr, "%s: only %llu pages\n", device,
+			size / page_size);
+		return 1;
+	}
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!workers) {
+		perror("calloc");
+		return 1;
+	}
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].id = i;
+		workers[i].rnd = (now_us() << 8 | i) | 1;
+		workers[i].seeds = calloc(nr_pages / nr_threads + 1,
+					  sizeof(uint64_t));
+		if (!workers[i].seeds) {
+			perror("calloc");
+			return 1;
+		}
+	}
+
+	elapsed = now_us();
+	for (i = 0; i < nr_threads; i++)
+		pthread_create(&workers[i].thread, NULL, worker_thread,
+			       &workers[i]);
+
+	sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		writes += workers[i].writes;
+		discards += workers[i].discards;
+		verifies += workers[i].verifies;
+		mismatches += workers[i].mismatches;
+		errors += workers[i].errors;
+		free(workers[i].seeds);
+	}
+	elapsed = now_us() - elapsed;
+
+	printf("%s: %d threads, %lu pages, %d%% duplicate writes, %s\n",
+	       device, nr_threads, nr_pages, dup_pct,
+	       no_discard ? "zero-page frees" : "BLKDISCARD frees");
+	printf("%lu writes, %lu discards, %lu verifies in %.1f s\n",
+	       writes, discards, verifies, elapsed / 1000000.0);
+	print_stat("dedup_hits");
+	print_stat("dup_data_size");
+	print_stat("zero_pages");
+	print_stat("compr_data_size");
+	printf("%lu mismatches, %lu errors\n", mismatches, errors);
+
+	free(workers);
+	return mismatches || errors;
+}